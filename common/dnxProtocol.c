@@ -187,6 +187,16 @@ int dnxWaitForMgmtReply(DnxChannel * channel, DnxMgmtReply * pReply, char * addr
    return dnxXmlGet(&xbuf, "Result", DNX_XML_STR, &pReply->reply);
 }
 
+//------------------------------------------------------------------------------
+//Encode a job acknowledgement for sending, singly or in a batch
+int dnxEncodeJobAck(DnxXmlBuf * xbuf, DnxJob * pAck)
+{
+    dnxXmlOpen (xbuf, "JobAck");
+    dnxXmlAdd  (xbuf, "XID", DNX_XML_XID, &pAck->xid);
+    dnxXmlAdd  (xbuf, "Timestamp", DNX_XML_UINT, &pAck->timestamp);
+    return dnxXmlClose(xbuf);
+}
+
 //------------------------------------------------------------------------------
 //This function handles acknowledgement of a job recieved from the server to the client,
 // or a responce from the client to the server
@@ -194,10 +204,7 @@ int dnxSendJobAck(DnxChannel* channel, DnxJob *pAck, char * address)
 {
     DnxXmlBuf xbuf;
 
-    dnxXmlOpen (&xbuf, "JobAck");
-    dnxXmlAdd  (&xbuf, "XID", DNX_XML_XID, &pAck->xid);
-    dnxXmlAdd  (&xbuf, "Timestamp", DNX_XML_UINT, &pAck->timestamp);
-    dnxXmlClose(&xbuf);
+    dnxEncodeJobAck(&xbuf, pAck);
 
     dnxDebug(3, "dnxSendJobAck: Channel(%lx) XML msg(%d bytes)=%s.", channel, xbuf.size, xbuf.buf);
        // send it on the specified channel
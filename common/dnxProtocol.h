@@ -144,6 +144,7 @@
 #include <time.h>
 
 #include "dnxTransport.h"
+#include "dnxXml.h"
 
 /** Defines the type of a DNX object in a network message. */
 typedef enum DnxObjType
@@ -193,6 +194,8 @@ typedef struct DnxXID
    unsigned long objSlot;           //!< Request queue slot number.
 } DnxXID;
 
+struct DnxAffinitySet;
+
 /** Request job wire structure. */
 typedef struct DnxNodeRequest
 {
@@ -201,7 +204,7 @@ typedef struct DnxNodeRequest
    unsigned int jobCap;             //!< Job capacity.
    unsigned int ttl;                //!< Request Time-To-Live (in seconds).
    char address[DNX_MAX_ADDRESS];   //!< Source address. (should be initialized as at least the same size as  a struct sockaddr_storage)
-   unsigned long long flags;        //!< Affinity groups bitmask (not transmitted).
+   const struct DnxAffinitySet * flags; //!< Affinity groups set; a server DnxAffinity (not transmitted).
    time_t expires;                  //!< Job expiration time (not transmitted).
    time_t retry;                    //!< Time to attempt to resubmit if no Ack recieved
    char * addr;                     //!< Source address as char * for easier logging later (not transmitted)
@@ -255,6 +258,7 @@ int dnxSendMgmtRequest(DnxChannel * channel, DnxMgmtRequest * pRequest, char * a
 int dnxSendMgmtReply(DnxChannel * channel, DnxMgmtReply * pReply, char * address);
 int dnxWaitForMgmtReply(DnxChannel * channel, DnxMgmtReply * pReply, char * address, int timeout);
 int dnxSendJobAck(DnxChannel* channel, DnxJob *pAck, char * address);
+int dnxEncodeJobAck(DnxXmlBuf * xbuf, DnxJob * pAck);
 
 int dnxMakeXID(DnxXID * pxid, DnxObjType xType, unsigned long xSerial, unsigned long xSlot);
 int dnxEqualXIDs(DnxXID * pxa, DnxXID * pxb);
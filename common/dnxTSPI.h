@@ -32,6 +32,8 @@
 #ifndef _DNXTSPI_H_
 #define _DNXTSPI_H_
 
+#include "dnxTransport.h"
+
 /** The generic Transport Service Provider Interface (TSPI) structure. */
 typedef struct iDnxChannel_
 {
@@ -50,6 +52,13 @@ typedef struct iDnxChannel_
    /** Transport destructor. */
    void (*txDelete)(struct iDnxChannel_ * icp);
 
+   /** Transport batch read method; optional, may be NULL. Its timeout is
+    * in milliseconds, as is that of the batch write method. */
+   int (*txReadBatch)(struct iDnxChannel_ * icp, DnxMsgBuf * msgs, int * count, int timeout);
+
+   /** Transport batch write method; optional, may be NULL. */
+   int (*txWriteBatch)(struct iDnxChannel_ * icp, DnxMsgBuf * msgs, int * count, int timeout);
+
 } iDnxChannel;
 
 /** Transport Service Provider initialization function.
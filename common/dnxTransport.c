@@ -464,6 +464,82 @@ int dnxPut(DnxChannel * channel, char * buf, int size, int timeout, char * dst)
 
 //----------------------------------------------------------------------------
 
+/** Read a batch of messages from an open channel.
+ * 
+ * Waits as dnxGet does for the first message, then takes any others 
+ * already waiting, up to @p count, without waiting for more. Transports 
+ * with no batch read method return one message.
+ * 
+ * @param[in] channel - the channel from which to read.
+ * @param[in,out] msgs - the messages to be read. On entry, each message's 
+ *    buf and size give the storage for its data, and its addr, if not NULL,
+ *    storage for its sender's address, as for dnxGet's @p src; on exit, the
+ *    size of each message read, which is 0 if the message was discarded 
+ *    as being of an invalid size.
+ * @param[in,out] count - on entry, the number of messages in @p msgs, from
+ *    1 to DNX_MAX_BATCH; on exit, the number read.
+ * @param[in] timeout - the maximum number of milliseconds the caller is 
+ *    willing to wait for data on @p channel before returning a timeout 
+ *    error. Transports with no batch read method wait in whole seconds, so
+ *    the timeout is rounded up to one.
+ * 
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxGetBatch(DnxChannel * channel, DnxMsgBuf * msgs, int * count, int timeout)
+{
+   iDnxChannel * icp = (iDnxChannel *)channel;
+   int ret;
+
+   assert(channel && msgs && count && *count > 0 && *count <= DNX_MAX_BATCH);
+
+   if (icp->txReadBatch)
+      return icp->txReadBatch(icp, msgs, count, timeout);
+
+   if ((ret = icp->txRead(icp, msgs[0].buf, &msgs[0].size, 
+         (timeout + 999) / 1000, msgs[0].addr)) == DNX_OK)
+      *count = 1;
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Write a batch of messages to an open channel.
+ * 
+ * The messages are written in order, stopping at the first that fails.
+ * Transports with no batch write method write them one at a time.
+ * 
+ * @param[in] channel - the channel to which data should be written.
+ * @param[in] msgs - the messages to be written; the addr of each, if not 
+ *    NULL, is the address to which it is sent, as for dnxPut's @p dst.
+ * @param[in,out] count - on entry, the number of messages in @p msgs, from
+ *    1 to DNX_MAX_BATCH; on exit, the number written.
+ * @param[in] timeout - the maximum number of milliseconds the caller is 
+ *    willing to wait for each write operation to complete, rounded up to
+ *    whole seconds as for dnxGetBatch.
+ * 
+ * @return Zero if every message was written, or the non-zero error value 
+ *    of the message at @p count.
+ */
+int dnxPutBatch(DnxChannel * channel, DnxMsgBuf * msgs, int * count, int timeout)
+{
+   iDnxChannel * icp = (iDnxChannel *)channel;
+   int i, ret = DNX_OK;
+
+   assert(channel && msgs && count && *count > 0 && *count <= DNX_MAX_BATCH);
+
+   if (icp->txWriteBatch)
+      return icp->txWriteBatch(icp, msgs, count, timeout);
+
+   for (i = 0; i < *count; i++)
+      if ((ret = icp->txWrite(icp, msgs[i].buf, msgs[i].size, 
+            (timeout + 999) / 1000, msgs[i].addr)) != DNX_OK)
+         break;
+   *count = i;
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
 /** Initialize the channel map sub-system.
  * 
  * @param[in] fileName - a persistent storage file for the channel map. 
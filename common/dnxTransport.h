@@ -59,9 +59,20 @@
 /** The maximum length of a DNX message. */
 #define DNX_MAX_MSG  4096
 
+/** The most messages read or written by one batch call. */
+#define DNX_MAX_BATCH 16
+
 /** An abstraction for DnxChannel. */
 typedef struct { int unused; } DnxChannel;
 
+/** A message read or written by dnxGetBatch or dnxPutBatch. */
+typedef struct DnxMsgBuf
+{
+   char * buf;    //!< The message data.
+   int size;      //!< The size of buf when reading, or of the message.
+   char * addr;   //!< The sender or destination sockaddr_in; optional.
+} DnxMsgBuf;
+
 int dnxChanMapAdd(char * name, char * url);
 void dnxChanMapDelete(char * name);
 
@@ -71,6 +82,9 @@ void dnxDisconnect(DnxChannel * channel);
 int dnxGet(DnxChannel * channel, char * buf, int * size, int timeout, char * src);
 int dnxPut(DnxChannel * channel, char * buf, int size, int timeout, char * dst);
 
+int dnxGetBatch(DnxChannel * channel, DnxMsgBuf * msgs, int * count, int timeout);
+int dnxPutBatch(DnxChannel * channel, DnxMsgBuf * msgs, int * count, int timeout);
+
 int dnxChanMapInit(char * fileName);
 void dnxChanMapRelease(void);
 
@@ -24,6 +24,17 @@
  * @attention Please submit patches to http://dnx.sourceforge.net
  * @ingroup DNX_COMMON_IMPL
  */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+// recvmmsg and sendmmsg are GNU extensions
+#if HAVE_RECVMMSG && HAVE_SENDMMSG
+# define _GNU_SOURCE
+# define DNX_UDP_MMSG 1
+#endif
+
 #include "dnxTypes.h"
 #include "dnxUdp.h"     // temporary
 #include "dnxTSPI.h"
@@ -397,6 +408,218 @@ static int dnxUdpWrite(iDnxChannel * icp, char * buf, int size, int timeout, cha
 
 //----------------------------------------------------------------------------
 
+#if DNX_UDP_MMSG
+
+/** Read a batch of messages from a UDP channel object.
+ * 
+ * Whatever messages are already waiting are taken with a single recvmmsg 
+ * call, so a busy socket is drained with one system call per batch rather 
+ * than a select and a recvfrom per message. The socket is only waited on 
+ * when nothing is waiting.
+ * 
+ * @param[in] icp - the UDP channel object from which to read data.
+ * @param[in,out] msgs - the messages to be read; see dnxGetBatch.
+ * @param[in,out] count - on entry, the number of messages in @p msgs; on
+ *    exit, the number read.
+ * @param[in] timeout - the maximum number of milliseconds we're willing to
+ *    wait for data to become available on @p icp without returning a 
+ *    timeout error.
+ * 
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxUdpReadBatch(iDnxChannel * icp, DnxMsgBuf * msgs, int * count, int timeout)
+{
+   iDnxUdpChannel * iucp = (iDnxUdpChannel *) ((char *)icp - offsetof(iDnxUdpChannel, ichan));
+
+   struct mmsghdr hdrs[DNX_MAX_BATCH];
+   struct iovec iovs[DNX_MAX_BATCH];
+   struct sockaddr_in bit_bucket;
+   int i, n, got;
+
+   assert(icp && iucp->socket && msgs && count && *count > 0);
+
+   n = *count < DNX_MAX_BATCH? *count: DNX_MAX_BATCH;
+
+   memset(hdrs, 0, n * sizeof *hdrs);
+   for (i = 0; i < n; i++)
+   {
+      iovs[i].iov_base = msgs[i].buf;
+      iovs[i].iov_len = msgs[i].size;
+      hdrs[i].msg_hdr.msg_iov = &iovs[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+      hdrs[i].msg_hdr.msg_name = msgs[i].addr? msgs[i].addr: (char *)&bit_bucket;
+      hdrs[i].msg_hdr.msg_namelen = sizeof bit_bucket;
+   }
+
+   // take what's waiting; wait only if there's nothing
+   if ((got = recvmmsg(iucp->socket, hdrs, n, MSG_DONTWAIT, 0)) < 0 
+         && (errno == EAGAIN || errno == EWOULDBLOCK))
+   {
+      if (timeout > 0)
+      {
+         struct timeval tv;
+         fd_set fd_rds;
+         int nsd;
+
+         FD_ZERO(&fd_rds);
+         FD_SET(iucp->socket, &fd_rds);
+
+         tv.tv_usec = (timeout % 1000) * 1000L;
+         tv.tv_sec = timeout / 1000;
+
+         if ((nsd = select(iucp->socket + 1, &fd_rds, 0, 0, &tv)) == 0)
+            return DNX_ERR_TIMEOUT;
+
+         if (nsd < 0)
+         {
+            if (errno != EINTR) 
+            {
+               dnxLog("dnxUdpReadBatch: select failed: %s.", strerror(errno));
+               return DNX_ERR_RECEIVE;
+            }
+            return DNX_ERR_TIMEOUT;
+         }
+      }
+
+      // another thread reading the socket may have taken the messages
+      got = recvmmsg(iucp->socket, hdrs, n, 
+            timeout > 0? MSG_DONTWAIT: MSG_WAITFORONE, 0);
+      if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         return DNX_ERR_TIMEOUT;
+   }
+
+   if (got < 0)
+   {
+      // see dnxUdpRead
+      if (errno == ECONNREFUSED || errno == EINTR)
+         return DNX_ERR_TIMEOUT;
+      dnxDebug(4, "recvmmsg failed: %s.", strerror(errno));
+      return DNX_ERR_RECEIVE;
+   }
+
+   // messages of an invalid size are passed back empty
+   for (i = 0; i < got; i++)
+      msgs[i].size = hdrs[i].msg_len >= 1 && hdrs[i].msg_len <= DNX_MAX_MSG?
+            (int)hdrs[i].msg_len: 0;
+
+   *count = got;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Write a batch of messages to a UDP channel object.
+ * 
+ * The messages are sent with as few sendmmsg calls as the socket allows;
+ * usually one.
+ * 
+ * @param[in] icp - the UDP channel object on which to write data.
+ * @param[in] msgs - the messages to be written; see dnxPutBatch.
+ * @param[in,out] count - on entry, the number of messages in @p msgs; on 
+ *    exit, the number written.
+ * @param[in] timeout - the maximum number of milliseconds to wait for the
+ *    write operation to complete without returning a timeout error.
+ * 
+ * @return Zero if every message was written, or the non-zero error value
+ *    of the message at @p count.
+ */
+static int dnxUdpWriteBatch(iDnxChannel * icp, DnxMsgBuf * msgs, int * count, int timeout)
+{
+   iDnxUdpChannel * iucp = (iDnxUdpChannel *) ((char *)icp - offsetof(iDnxUdpChannel, ichan));
+
+   struct mmsghdr hdrs[DNX_MAX_BATCH];
+   struct iovec iovs[DNX_MAX_BATCH];
+   int i, n, sent, ret = DNX_OK;
+
+   assert(icp && iucp->socket && msgs && count && *count > 0);
+
+   n = *count < DNX_MAX_BATCH? *count: DNX_MAX_BATCH;
+
+   // implement timeout logic, if timeout value is greater than zero
+   if (timeout > 0)
+   {
+      struct timeval tv;
+      fd_set fd_wrs;
+      int nsd;
+
+      FD_ZERO(&fd_wrs);
+      FD_SET(iucp->socket, &fd_wrs);
+
+      tv.tv_usec = (timeout % 1000) * 1000L;
+      tv.tv_sec = timeout / 1000;
+
+      if ((nsd = select(iucp->socket + 1, 0, &fd_wrs, 0, &tv)) == 0)
+      {
+         *count = 0;
+         return DNX_ERR_TIMEOUT;
+      }
+      if (nsd < 0)
+      {
+         *count = 0;
+         if (errno != EINTR) 
+         {
+            dnxLog("dnxUdpWriteBatch: select failed: %s.", strerror(errno));
+            return DNX_ERR_SEND;
+         }
+         return DNX_ERR_TIMEOUT;
+      }
+   }
+
+   memset(hdrs, 0, n * sizeof *hdrs);
+   for (i = 0; i < n; i++)
+   {
+      iovs[i].iov_base = msgs[i].buf;
+      iovs[i].iov_len = msgs[i].size;
+      hdrs[i].msg_hdr.msg_iov = &iovs[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+      if (msgs[i].addr)
+      {
+         hdrs[i].msg_hdr.msg_name = msgs[i].addr;
+         hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      }
+   }
+
+   // a call may send fewer than asked; carry on from there
+   for (sent = 0; sent < n; sent += i)
+      if ((i = sendmmsg(iucp->socket, hdrs + sent, n - sent, 0)) < 0)
+      {
+         if (errno == EINTR)
+         {
+            i = 0;
+            continue;
+         }
+         dnxDebug(2, "sendmmsg failed: %s.", strerror(errno));
+         ret = DNX_ERR_SEND;
+         break;
+      }
+
+   // count each message to its destination, as dnxUdpWrite does
+   for (i = 0; i < sent + (ret != DNX_OK); i++)
+   {
+      char * addrStr;
+      if (msgs[i].addr)
+      {
+         struct sockaddr_in tmp;
+         memcpy(&tmp, msgs[i].addr, sizeof tmp);
+         addrStr = ntop((char *)&tmp);
+      }
+      else
+         addrStr = xstrdup(iucp->host);
+      if (i < sent)
+         dnxDebug(3,"DnxUdpWriteBatch: Sent %i bytes to %s", msgs[i].size, addrStr);
+      dnxComStatIncrement(addrStr, i < sent? PACKETS_OUT: PACKETS_FAILED);
+      xfree(addrStr);
+   }
+
+   *count = sent;
+   return ret;
+}
+
+#endif   /* DNX_UDP_MMSG */
+
+//----------------------------------------------------------------------------
+
 /** Delete a UDP channel object.
  * 
  * @param[in] icp - the UDP channel object to be deleted.
@@ -476,6 +699,10 @@ static int dnxUdpNew(char * url, iDnxChannel ** icpp)
    iucp->ichan.txRead   = dnxUdpRead;
    iucp->ichan.txWrite  = dnxUdpWrite;
    iucp->ichan.txDelete = dnxUdpDelete;
+#if DNX_UDP_MMSG
+   iucp->ichan.txReadBatch  = dnxUdpReadBatch;
+   iucp->ichan.txWriteBatch = dnxUdpWriteBatch;
+#endif
 
    *icpp = &iucp->ichan;
 
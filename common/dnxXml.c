@@ -585,6 +585,34 @@ int dnxXmlGet(DnxXmlBuf * xbuf, char * xTag, DnxXmlType xType, void * xData)
 
 //----------------------------------------------------------------------------
 
+/** Unescape the string value of a specified tag into a caller's buffer.
+ * 
+ * Unlike dnxXmlGet with DNX_XML_STR, no memory is allocated.
+ * 
+ * @param[in] xbuf - the dnx xml buffer from which to extract a value.
+ * @param[in] xTag - the tag for which to search in @p xbuf.
+ * @param[out] buf - the address of storage for the returned string.
+ * @param[in] size - the size of @p buf in bytes.
+ * 
+ * @return Zero on success, DNX_ERR_CAPACITY if the value doesn't fit in 
+ *    @p buf, or another non-zero error value.
+ */
+int dnxXmlGetStr(DnxXmlBuf * xbuf, char * xTag, char * buf, int size)
+{
+   char tmp[DNX_MAX_MSG];
+   int ret;
+
+   assert(buf && size > 0);
+
+   if ((ret = dnxXmlGetTagValue(xbuf, 
+         xTag, DNX_XML_STR, tmp, sizeof tmp)) != DNX_OK)
+      return ret;
+
+   return dnxXmlUnescapeStr(buf, tmp, size);
+}
+
+//----------------------------------------------------------------------------
+
 /** Compare a string with an XML node text value.
  * 
  * @param[in,out] xbuf - the buffer to be validated and closed.
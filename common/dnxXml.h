@@ -53,6 +53,7 @@ typedef struct DnxXmlBuf
 int dnxXmlOpen(DnxXmlBuf * xbuf, char * tag);
 int dnxXmlAdd(DnxXmlBuf * xbuf, char * xTag, DnxXmlType xType, void * xData);
 int dnxXmlGet(DnxXmlBuf * xbuf, char * xTag, DnxXmlType xType, void * xData);
+int dnxXmlGetStr(DnxXmlBuf * xbuf, char * xTag, char * buf, int size);
 int dnxXmlCmpStr(DnxXmlBuf * xbuf, char * xTag, char * cmpstr);
 int dnxXmlClose(DnxXmlBuf * xbuf);
 
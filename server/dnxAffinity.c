@@ -0,0 +1,445 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Implements interned affinity sets for DNX.
+ *
+ * Sets are kept in a hash table keyed on their bits, under a mutex that is
+ * only taken to make a set. Each set is allocated in one block, along with
+ * its bits and its text, and never changes or moves until the table is 
+ * released.
+ *
+ * @file dnxAffinity.c
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IMPL
+ */
+
+#include "dnxAffinity.h"
+
+#include "dnxError.h"
+#include "dnxDebug.h"
+#include "dnxLogging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/** The initial number of intern hash buckets; a power of two. */
+#define DNX_AFFINITY_HASH_MIN    64
+
+static DnxAffinitySet ** affBuckets;   //!< The intern hash table.
+static unsigned affBucketCount;        //!< The number of hash buckets.
+static unsigned affSetCount;           //!< The number of sets made.
+static pthread_mutex_t affMutex = PTHREAD_MUTEX_INITIALIZER; //!< Guards the table.
+
+/*--------------------------------------------------------------------------
+                              IMPLEMENTATION
+  --------------------------------------------------------------------------*/
+
+/** Return the hash of an array of affinity bits.
+ * 
+ * @param[in] bits - the bits to be hashed.
+ * @param[in] words - the number of words in @p bits.
+ *
+ * @return The hash value.
+ */
+static unsigned long dnxAffinityHash(const DnxAffinityWord * bits, 
+      unsigned words)
+{
+   unsigned long long hash = words;
+   unsigned i;
+
+   for (i = 0; i < words; i++) {
+      hash = (hash ^ bits[i]) * 0x9E3779B97F4A7C15ULL;
+      hash ^= hash >> 29;
+   }
+   return (unsigned long)hash;
+}
+
+//----------------------------------------------------------------------------
+
+/** Double the number of intern hash buckets.
+ * 
+ * The table is left as it is if memory is short; chains just get longer. 
+ * The caller must hold the table mutex.
+ */
+static void dnxAffinityHashGrow(void)
+{
+   unsigned size = affBucketCount? affBucketCount * 2: DNX_AFFINITY_HASH_MIN;
+   DnxAffinitySet ** buckets, * pSet, * pNext;
+   unsigned i;
+
+   if ((buckets = (DnxAffinitySet **)xcalloc(size, sizeof *buckets)) == 0)
+      return;
+
+   for (i = 0; i < affBucketCount; i++)
+      for (pSet = affBuckets[i]; pSet; pSet = pNext) {
+         pNext = pSet->next;
+         pSet->next = buckets[pSet->hash & (size - 1)];
+         buckets[pSet->hash & (size - 1)] = pSet;
+      }
+
+   xfree(affBuckets);
+   affBuckets = buckets;
+   affBucketCount = size;
+}
+
+//----------------------------------------------------------------------------
+
+/** Format a set's bits in hexadecimal, most significant word first.
+ * 
+ * @param[in] pSet - the set whose bits are to be formatted.
+ * @param[out] text - storage for at least 3 + 16 * words characters.
+ */
+static void dnxAffinityFormat(DnxAffinitySet * pSet, char * text)
+{
+   unsigned i = pSet->words;
+
+   text += sprintf(text, "0x%llx", pSet->bits[--i]);
+   while (i--)
+      text += sprintf(text, "%016llx", pSet->bits[i]);
+}
+
+/*--------------------------------------------------------------------------
+                                 INTERFACE
+  --------------------------------------------------------------------------*/
+
+int dnxAffinityMake(const DnxAffinityWord * bits, unsigned words, 
+      DnxAffinity * pSet)
+{
+   DnxAffinitySet * pNew;
+   unsigned long hash;
+   size_t size;
+
+   assert(pSet && (bits || !words));
+
+   while (words && !bits[words - 1])
+      words--;
+
+   if (!words) {
+      *pSet = 0;
+      return DNX_OK;
+   }
+
+   hash = dnxAffinityHash(bits, words);
+
+   DNX_PT_MUTEX_LOCK(&affMutex);
+
+   if (affBucketCount)
+      for (pNew = affBuckets[hash & (affBucketCount - 1)]; pNew; pNew = pNew->next)
+         if (pNew->hash == hash && pNew->words == words 
+               && memcmp(pNew->bits, bits, words * sizeof *bits) == 0) {
+            DNX_PT_MUTEX_UNLOCK(&affMutex);
+            *pSet = pNew;
+            return DNX_OK;
+         }
+
+   if (affSetCount >= affBucketCount)
+      dnxAffinityHashGrow();
+
+   // the set, its bits and its text are allocated together
+   size = sizeof *pNew + words * sizeof *bits + 3 + 16 * words;
+   if (!affBucketCount || (pNew = (DnxAffinitySet *)xmalloc(size)) == 0) {
+      DNX_PT_MUTEX_UNLOCK(&affMutex);
+      return DNX_ERR_MEMORY;
+   }
+   pNew->hash = hash;
+   pNew->words = words;
+   memcpy(pNew->bits, bits, words * sizeof *bits);
+   pNew->text = (char *)&pNew->bits[words];
+   dnxAffinityFormat(pNew, pNew->text);
+
+   pNew->next = affBuckets[hash & (affBucketCount - 1)];
+   affBuckets[hash & (affBucketCount - 1)] = pNew;
+   affSetCount++;
+
+   DNX_PT_MUTEX_UNLOCK(&affMutex);
+
+   dnxDebug(3, "dnxAffinityMake: Made set %s; %u sets in all.", 
+         pNew->text, affSetCount);
+
+   *pSet = pNew;
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityBit(unsigned bit, DnxAffinity * pSet)
+{
+   return dnxAffinityRange(bit, 1, pSet);
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityRange(unsigned first, unsigned count, DnxAffinity * pSet)
+{
+   unsigned words = (first + count + DNX_AFFINITY_WORD_BITS - 1) 
+         / DNX_AFFINITY_WORD_BITS;
+   DnxAffinityWord * bits;
+   unsigned bit;
+   int ret;
+
+   assert(pSet);
+
+   if (!count) {
+      *pSet = 0;
+      return DNX_OK;
+   }
+
+   if ((bits = (DnxAffinityWord *)xcalloc(words, sizeof *bits)) == 0)
+      return DNX_ERR_MEMORY;
+
+   for (bit = first; bit < first + count; bit++)
+      bits[bit / DNX_AFFINITY_WORD_BITS] |= 
+            (DnxAffinityWord)1 << (bit % DNX_AFFINITY_WORD_BITS);
+
+   ret = dnxAffinityMake(bits, words, pSet);
+   xfree(bits);
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityUnion(DnxAffinity a, DnxAffinity b, DnxAffinity * pSet)
+{
+   DnxAffinityWord * bits;
+   DnxAffinity t;
+   unsigned i;
+   int ret;
+
+   assert(pSet);
+
+   // the wider set is copied and the narrower one merged into it
+   if (!a || (b && b->words > a->words)) {
+      t = a;
+      a = b;
+      b = t;
+   }
+   if (!b || a == b || dnxAffinityIsSubset(b, a)) {
+      *pSet = a;
+      return DNX_OK;
+   }
+
+   if ((bits = (DnxAffinityWord *)xmalloc(a->words * sizeof *bits)) == 0)
+      return DNX_ERR_MEMORY;
+
+   memcpy(bits, a->bits, a->words * sizeof *bits);
+   for (i = 0; i < b->words; i++)
+      bits[i] |= b->bits[i];
+
+   ret = dnxAffinityMake(bits, a->words, pSet);
+   xfree(bits);
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityIntersects(DnxAffinity a, DnxAffinity b)
+{
+   unsigned i = 0, words;
+
+   if (!a || !b)
+      return 0;
+
+   words = a->words < b->words? a->words: b->words;
+
+#ifdef __SSE2__
+   // two words at a time; a byte compare against zero finds any set bit
+   for (; i + 2 <= words; i += 2) {
+      __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)&a->bits[i]),
+            _mm_loadu_si128((const __m128i *)&b->bits[i]));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF)
+         return 1;
+   }
+#endif
+
+   for (; i < words; i++)
+      if (a->bits[i] & b->bits[i])
+         return 1;
+
+   return 0;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityIsSubset(DnxAffinity a, DnxAffinity b)
+{
+   unsigned i;
+
+   if (!a || a == b)
+      return 1;
+   if (!b || a->words > b->words)
+      return 0;
+
+   for (i = 0; i < a->words; i++)
+      if (a->bits[i] & ~b->bits[i])
+         return 0;
+
+   return 1;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityFirstCommon(DnxAffinity a, DnxAffinity b)
+{
+   unsigned i, words;
+   DnxAffinityWord common;
+
+   if (!a || !b)
+      return -1;
+
+   words = a->words < b->words? a->words: b->words;
+   for (i = 0; i < words; i++)
+      if ((common = a->bits[i] & b->bits[i]) != 0)
+         return i * DNX_AFFINITY_WORD_BITS + __builtin_ctzll(common);
+
+   return -1;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxAffinityHas(DnxAffinity a, unsigned bit)
+{
+   return a && bit / DNX_AFFINITY_WORD_BITS < a->words 
+         && (a->bits[bit / DNX_AFFINITY_WORD_BITS] 
+               >> (bit % DNX_AFFINITY_WORD_BITS) & 1);
+}
+
+//----------------------------------------------------------------------------
+
+unsigned dnxAffinityCount(DnxAffinity a)
+{
+   unsigned i, count = 0;
+
+   if (a)
+      for (i = 0; i < a->words; i++)
+         count += __builtin_popcountll(a->bits[i]);
+
+   return count;
+}
+
+//----------------------------------------------------------------------------
+
+const char * dnxAffinityText(DnxAffinity a)
+{
+   return a? a->text: "0x0";
+}
+
+//----------------------------------------------------------------------------
+
+void dnxAffinityRelease(void)
+{
+   DnxAffinitySet * pSet;
+   unsigned i;
+
+   DNX_PT_MUTEX_LOCK(&affMutex);
+
+   for (i = 0; i < affBucketCount; i++)
+      while ((pSet = affBuckets[i]) != 0) {
+         affBuckets[i] = pSet->next;
+         xfree(pSet);
+      }
+
+   xfree(affBuckets);
+   affBuckets = 0;
+   affBucketCount = affSetCount = 0;
+
+   DNX_PT_MUTEX_UNLOCK(&affMutex);
+}
+
+/*--------------------------------------------------------------------------
+                                 UNIT TEST
+
+   From within dnx/server, compile with GNU tools using this command line:
+
+      gcc -DDEBUG -DDNX_AFFINITY_TEST -g -O0 -I../common dnxAffinity.c \
+         ../common/dnxError.c -lpthread -lgcc_s -lrt -o dnxAffinityTest
+
+  --------------------------------------------------------------------------*/
+
+#ifdef DNX_AFFINITY_TEST
+
+#include "utesthelp.h"
+
+static int verbose;
+
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+int main(int argc, char ** argv)
+{
+   DnxAffinityWord bits[8] = { 0 };
+   DnxAffinity a, b, c, all, none = 0;
+   unsigned i;
+
+   verbose = argc > 1? 1: 0;
+
+   // sets are interned, whatever their trailing zeros
+   CHECK_ZERO(dnxAffinityBit(3, &a));
+   bits[0] = 8;
+   CHECK_ZERO(dnxAffinityMake(bits, 8, &b));
+   CHECK_TRUE(a == b && a->words == 1);
+   CHECK_TRUE(strcmp(dnxAffinityText(a), "0x8") == 0);
+   CHECK_ZERO(dnxAffinityMake(bits, 0, &b));
+   CHECK_TRUE(b == 0 && strcmp(dnxAffinityText(b), "0x0") == 0);
+
+   // sets may be wider than a word
+   CHECK_ZERO(dnxAffinityBit(400, &b));
+   CHECK_TRUE(b->words == 7 && dnxAffinityHas(b, 400) && !dnxAffinityHas(b, 3));
+   CHECK_TRUE(!dnxAffinityIntersects(a, b) && !dnxAffinityIntersects(b, none));
+   CHECK_ZERO(dnxAffinityUnion(a, b, &c));
+   CHECK_TRUE(dnxAffinityCount(c) == 2 && dnxAffinityIntersects(c, a));
+   CHECK_TRUE(dnxAffinityFirstCommon(c, b) == 400 && dnxAffinityFirstCommon(c, c) == 3);
+   CHECK_TRUE(dnxAffinityFirstCommon(a, b) == -1 && dnxAffinityFirstCommon(none, c) == -1);
+   CHECK_TRUE(dnxAffinityIntersects(b, c) && dnxAffinityIntersects(c, b));
+   CHECK_TRUE(dnxAffinityIsSubset(a, c) && dnxAffinityIsSubset(b, c));
+   CHECK_TRUE(!dnxAffinityIsSubset(c, a) && dnxAffinityIsSubset(none, a));
+   CHECK_TRUE(strncmp(dnxAffinityText(c), "0x10000", 7) == 0
+         && strlen(dnxAffinityText(c)) == 2 + 5 + 6 * 16);
+
+   // every set made from the same bits is the same set
+   CHECK_ZERO(dnxAffinityUnion(b, a, &b));
+   CHECK_TRUE(b == c);
+   CHECK_ZERO(dnxAffinityRange(1, 499, &all));
+   CHECK_TRUE(dnxAffinityCount(all) == 499 && !dnxAffinityHas(all, 0));
+   CHECK_TRUE(dnxAffinityIsSubset(c, all) && dnxAffinityHas(all, 499));
+   for (i = 1; i < 500; i++) {
+      CHECK_ZERO(dnxAffinityBit(i, &b));
+      CHECK_TRUE(dnxAffinityIntersects(b, all) && dnxAffinityIntersects(all, b));
+      CHECK_ZERO(dnxAffinityUnion(b, none, &a));
+      CHECK_TRUE(a == b);
+   }
+   CHECK_ZERO(dnxAffinityBit(0, &a));
+   CHECK_TRUE(!dnxAffinityIntersects(a, all));
+
+   dnxAffinityRelease();
+
+   return 0;
+}
+
+#endif   /* DNX_AFFINITY_TEST */
+
+/*--------------------------------------------------------------------------*/
+
@@ -0,0 +1,165 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Definitions and prototypes for DNX affinity sets.
+ *
+ * A job may only be sent to a worker node whose affinity shares a bit with 
+ * the job's. Each bit stands for a Nagios hostgroup; bit 0 is the local
+ * (bypass) group. A set is only as wide as its highest bit, so any number
+ * of hostgroups may be used.
+ *
+ * Sets are immutable and interned: every distinct set is stored once, and 
+ * kept until dnxAffinityRelease is called. A DnxAffinity is therefore a 
+ * pointer that may be copied, stored and compared for equality like an 
+ * integer, without allocation or locking; only making a new set takes a
+ * lock. The null pointer is the empty set.
+ *
+ * @file dnxAffinity.h
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IFC
+ */
+
+#ifndef _DNXAFFINITY_H_
+#define _DNXAFFINITY_H_
+
+/** The unit in which affinity bits are stored. */
+typedef unsigned long long DnxAffinityWord;
+
+/** The number of bits in a DnxAffinityWord. */
+#define DNX_AFFINITY_WORD_BITS   (8 * (unsigned)sizeof(DnxAffinityWord))
+
+/** An interned affinity set; read-only once made. */
+typedef struct DnxAffinitySet
+{
+   struct DnxAffinitySet * next;    /*!< The next set in the same intern bucket. */
+   unsigned long hash;              /*!< The hash of the set's bits. */
+   char * text;                     /*!< The set in hexadecimal, for logging. */
+   unsigned words;                  /*!< The number of words; the last is non-zero. */
+   DnxAffinityWord bits[];          /*!< The set's bits, lowest word first. */
+} DnxAffinitySet;
+
+/** An affinity set handle; 0 is the empty set. */
+typedef const DnxAffinitySet * DnxAffinity;
+
+/** Return the interned set holding a given array of bits.
+ * 
+ * @param[in] bits - the bits of the set, lowest word first; trailing zero
+ *    words are ignored.
+ * @param[in] words - the number of words in @p bits.
+ * @param[out] pSet - the address of storage for returning the set.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxAffinityMake(const DnxAffinityWord * bits, unsigned words, 
+      DnxAffinity * pSet);
+
+/** Return the set holding a single bit.
+ * 
+ * @param[in] bit - the bit to be set.
+ * @param[out] pSet - the address of storage for returning the set.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxAffinityBit(unsigned bit, DnxAffinity * pSet);
+
+/** Return the set holding a range of bits.
+ * 
+ * @param[in] first - the lowest bit to be set.
+ * @param[in] count - the number of bits to be set.
+ * @param[out] pSet - the address of storage for returning the set.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxAffinityRange(unsigned first, unsigned count, DnxAffinity * pSet);
+
+/** Return the union of two sets.
+ * 
+ * @param[in] a - the first set.
+ * @param[in] b - the second set.
+ * @param[out] pSet - the address of storage for returning the union; may 
+ *    be the address of @p a or @p b.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxAffinityUnion(DnxAffinity a, DnxAffinity b, DnxAffinity * pSet);
+
+/** Determine whether two sets share a bit.
+ * 
+ * This is the affinity match test, so it is vectorized where the target
+ * supports it.
+ * 
+ * @param[in] a - the first set.
+ * @param[in] b - the second set.
+ *
+ * @return Non-zero if @p a and @p b have a bit in common, otherwise zero.
+ */
+int dnxAffinityIntersects(DnxAffinity a, DnxAffinity b);
+
+/** Determine whether every bit of one set is in another.
+ * 
+ * @param[in] a - the set that may be a subset.
+ * @param[in] b - the set that may contain it.
+ *
+ * @return Non-zero if @p a is a subset of @p b, otherwise zero.
+ */
+int dnxAffinityIsSubset(DnxAffinity a, DnxAffinity b);
+
+/** Return the lowest bit two sets have in common.
+ * 
+ * @param[in] a - the first set.
+ * @param[in] b - the second set.
+ *
+ * @return The lowest bit set in both @p a and @p b, or -1 if there is none.
+ */
+int dnxAffinityFirstCommon(DnxAffinity a, DnxAffinity b);
+
+/** Determine whether a set holds a given bit.
+ * 
+ * @param[in] a - the set to be examined.
+ * @param[in] bit - the bit to be tested.
+ *
+ * @return Non-zero if @p bit is set in @p a, otherwise zero.
+ */
+int dnxAffinityHas(DnxAffinity a, unsigned bit);
+
+/** Return the number of bits in a set.
+ * 
+ * @param[in] a - the set to be examined.
+ *
+ * @return The number of bits set in @p a.
+ */
+unsigned dnxAffinityCount(DnxAffinity a);
+
+/** Return a set in hexadecimal, for logging.
+ * 
+ * @param[in] a - the set to be formatted.
+ *
+ * @return The text of @p a; owned by the set.
+ */
+const char * dnxAffinityText(DnxAffinity a);
+
+/** Free every set made so far.
+ * 
+ * Must only be called once no set is in use.
+ */
+void dnxAffinityRelease(void);
+
+#endif   /* _DNXAFFINITY_H_ */
+
@@ -17,13 +17,13 @@
  
   --------------------------------------------------------------------------*/
 
-/** Implements the DNX Collector thread.
+/** Implements the DNX Collector threads.
  *
- * The purpose of this thread is to collect service check
+ * The purpose of these threads is to collect service check
  * completion results from the worker nodes.  When a service
- * check result is collected, this thread dequeues the service
- * check from the Jobs queue and posts the result to the existing
- * Nagios service_result_buffer.
+ * check result is collected, the thread that received it dequeues 
+ * the service check from the Jobs queue and posts the result to the 
+ * existing Nagios service_result_buffer.
  * 
  * @file dnxCollector.c
  * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
@@ -42,7 +42,10 @@
 #include "dnxLogging.h"
 #include "dnxNode.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #include "nagios.h"
@@ -62,14 +65,185 @@ typedef struct iDnxCollector_
    char * url;             /*!< The collector channel URL. */
    DnxJobList * joblist;   /*!< The job list we're collecting for. */
    DnxChannel * channel;   /*!< Collector communications channel. */
-   pthread_t tid;          /*!< The collector thread id. */
+   unsigned port;          /*!< The UDP port of channel; 0 if not UDP. */
+   unsigned long received; /*!< Results and acks received. */
+   unsigned long drops;    /*!< Socket drops when last checked. */
+   time_t dropCheck;       /*!< The time of the next drop check. */
+   unsigned threads;       /*!< The number of collector threads running. */
+   pthread_t tids[DNX_COLLECTOR_MAX_THREADS]; /*!< The collector thread ids. */
 } iDnxCollector;
 
 /*--------------------------------------------------------------------------
                               IMPLEMENTATION
   --------------------------------------------------------------------------*/
 
+/** Read the kernel's counters for a bound UDP port from /proc/net/udp.
+ * 
+ * Only sockets bound to @p port and not connected are counted, so that
+ * worker sockets on this host sending to the port are ignored.
+ * 
+ * @param[in] port - the local UDP port whose sockets should be counted.
+ * @param[out] pDrops - the address of storage for the number of datagrams
+ *    dropped because the sockets' receive buffers were full.
+ * @param[out] pQueued - the address of storage for the number of bytes
+ *    waiting in the sockets' receive buffers.
+ * 
+ * @return Zero on success, or DNX_ERR_NOTFOUND if no such socket was found.
+ */
+static int dnxUdpPortCounters(unsigned port, unsigned long * pDrops, 
+      unsigned long * pQueued)
+{
+   char line[256];
+   unsigned lport, rport;
+   unsigned long rxq, drops;
+   int found = 0, state;
+   FILE * fp;
+
+   *pDrops = *pQueued = 0;
+
+   // stdio calls may be cancellation points; don't leave the file open
+   pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+   if ((fp = fopen("/proc/net/udp", "r")) == 0)
+   {
+      pthread_setcancelstate(state, 0);
+      return DNX_ERR_NOTFOUND;
+   }
+
+   while (fgets(line, sizeof line, fp))
+      if (sscanf(line, " %*u: %*x:%x %*x:%x %*x %*x:%lx %*x:%*x %*x %*u %*u "
+            "%*u %*u %*s %lu", &lport, &rport, &rxq, &drops) == 4 
+            && lport == port && rport == 0)
+      {
+         *pDrops += drops;
+         *pQueued += rxq;
+         found = 1;
+      }
+
+   fclose(fp);
+   pthread_setcancelstate(state, 0);
+
+   return found? DNX_OK: DNX_ERR_NOTFOUND;
+}
+
+//----------------------------------------------------------------------------
+
+/** Log the results dropped by the collector socket since the last check.
+ * 
+ * Called by every collector thread as it goes around its loop; the check
+ * is made by one of them at most once every DNX_COLLECTOR_TIMEOUT seconds.
+ * 
+ * @param[in] icoll - the collector whose socket should be checked.
+ */
+static void dnxCollectorCheckDrops(iDnxCollector * icoll)
+{
+   time_t now = time(0), next = icoll->dropCheck;
+   unsigned long drops, queued, last;
+
+   if (!icoll->port || now < next || !__sync_bool_compare_and_swap(
+         &icoll->dropCheck, next, now + DNX_COLLECTOR_TIMEOUT))
+      return;
+
+   if (dnxUdpPortCounters(icoll->port, &drops, &queued) != DNX_OK)
+      return;
+
+   last = __sync_lock_test_and_set(&icoll->drops, drops);
+   if (drops > last)
+   {
+      dnxDebug(1, "dnxCollector: %lu results lost to a full receive buffer "
+            "on port %u; %lu bytes queued.", drops - last, icoll->port, queued);
+      dnxLog("dnxCollector: %lu results lost to a full receive buffer "
+            "on port %u; %lu bytes queued.", drops - last, icoll->port, queued);
+   }
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the time a node took to return a job's result.
+ * 
+ * The time is measured from the job's dispatch, as the runtime the client 
+ * reports is in whole seconds, which can't tell most checks apart.
+ * 
+ * @param[in] pJob - the job whose result has been collected.
+ * @param[in] pResult - the job's result.
+ * 
+ * @return The time taken in milliseconds.
+ */
+static unsigned dnxResultLatency(DnxNewJob * pJob, DnxResult * pResult)
+{
+   struct timeval now, taken;
+
+   gettimeofday(&now, 0);
+   if (!timerisset(&pJob->sent) || timercmp(&now, &pJob->sent, <))
+      return pResult->delta * 1000;    // not dispatched, or the clock went back
+
+   timersub(&now, &pJob->sent, &taken);
+   return taken.tv_sec * 1000 + taken.tv_usec / 1000;
+}
+
+//----------------------------------------------------------------------------
+
+/** Post a job result, or an Ack for a job sent, to the job list.
+ * 
+ * @param[in] icoll - the collector object.
+ * @param[in] pResult - the result received; its result data is released
+ *    or handed on to Nagios.
+ */
+static void dnxCollectResult(iDnxCollector * icoll, DnxResult * pResult)
+{
+   pthread_t tid = pthread_self();
+   DnxNewJob Job;
+   int ret;
+
+   if(pResult->resCode == -1) {
+      if((ret = dnxJobListMarkAck(icoll->joblist, pResult)) == DNX_OK) {
+         dnxDebug(2, "dnxCollector[%lx]: Received ack for job [%lu:%lu]", 
+            tid, pResult->xid.objSerial, pResult->xid.objSlot);
+      } else {
+         dnxDebug(2, "dnxCollector[%lx]: Had error (%s) with ack for job [%lu:%lu]", 
+            tid, dnxErrorString(ret), pResult->xid.objSerial, pResult->xid.objSlot);
+      }
+   } else {
+      dnxDebug(2, "dnxCollector[%lx]: Received result for job [%lu:%lu]: %s.", 
+            tid, pResult->xid.objSerial, pResult->xid.objSlot, pResult->resData);
+
+      // dequeue the matching service request from the in progress job queue
+      // as a side effect an Ack is dispatched
+      if ((ret = dnxJobListCollect(icoll->joblist, pResult, &Job)) == DNX_OK) {
+
+         time_t check_time = Job.start_time + pResult->delta;
+         dnxDebug(2, "dnxCollector[%lx]: Collecting Job [%lu:%lu] Hostname(%s) Time[%lu] Delta[%lu]",
+            tid, pResult->xid.objSerial, pResult->xid.objSlot, Job.host_name, check_time, pResult->delta);
+
+         dnxNodeListRecordResult(Job.pNode->addr, dnxResultLatency(&Job, pResult));
+
+         /** @todo Wrapper release DnxResult structure. */
+         dnxAuditJob(&Job, "COLLECT");
+         dnxLog("RESPONSE: Job %lu: %s", pResult->xid.objSerial, pResult->resData);
+         ret = dnxSubmitCheck(&Job, pResult, check_time);
+
+         dnxDebug(2, "dnxCollector[%lx]: Post result for job [%lu:%lu]: %s.", 
+               tid, pResult->xid.objSerial, pResult->xid.objSlot, 
+               dnxErrorString(ret));
+         
+         // We should finally be done with the job
+         dnxDebug(2, "dnxCollector[%lx]: Job [%lu:%lu]: type(%i).", 
+               tid, Job.xid.objSerial, Job.xid.objSlot, Job.state);
+         dnxJobListMarkComplete(icoll->joblist, &Job.xid);
+      } else {
+         dnxDebug(3, "dnxCollector[%lx]: Dequeue job failed: %s.",
+               tid, dnxErrorString(ret));
+         xfree(pResult->resData);
+      }
+   }
+}
+
+//----------------------------------------------------------------------------
+
 /** The collector thread main entry point procedure.
+ * 
+ * Results waiting on the collector socket are received together, in as few
+ * system calls as the transport allows, and then posted one by one.
  * 
  * @param[in] data - an opaque pointer to the collector thread data structure,
  *    which is actually a DnxGlobalData object (the dnxServer global data 
@@ -81,9 +255,9 @@ static void * dnxCollector(void * data)
 {
    iDnxCollector * icoll = (iDnxCollector *)data;
    pthread_t tid = pthread_self();
-   DnxResult sResult;
-   DnxNewJob Job;
-   int ret;
+   DnxResult sResults[DNX_MAX_BATCH];
+   unsigned due;
+   int i, count, ret;
 
    assert(data);
 
@@ -96,49 +270,18 @@ static void * dnxCollector(void * data)
    {
       pthread_testcancel();
 
-      if ((ret = dnxWaitForResult(icoll->channel, 
-            &sResult, sResult.address, DNX_COLLECTOR_TIMEOUT)) == DNX_OK) {
-         if(sResult.resCode == -1) {
-            if((ret = dnxJobListMarkAck(icoll->joblist, &sResult)) == DNX_OK) {
-               dnxDebug(2, "dnxCollector[%lx]: Received ack for job [%lu:%lu]", 
-                  tid, sResult.xid.objSerial, sResult.xid.objSlot);
-            } else {
-               dnxDebug(2, "dnxCollector[%lx]: Had error (%s) with ack for job [%lu:%lu]", 
-                  tid, dnxErrorString(ret), sResult.xid.objSerial, sResult.xid.objSlot);
-            }
-         } else {
-            dnxDebug(2, "dnxCollector[%lx]: Received result for job [%lu:%lu]: %s.", 
-                  tid, sResult.xid.objSerial, sResult.xid.objSlot, sResult.resData);
-   
-            // dequeue the matching service request from the in progress job queue
-            // as a side effect an Ack is dispatched
-            if ((ret = dnxJobListCollect(icoll->joblist, &sResult.xid, &Job)) == DNX_OK) {
-   
-               time_t check_time = Job.start_time + sResult.delta;
-               dnxDebug(2, "dnxCollector[%lx]: Collecting Job [%lu:%lu] Hostname(%s) Time[%lu] Delta[%lu]",
-                  tid, sResult.xid.objSerial, sResult.xid.objSlot, Job.host_name, check_time, sResult.delta);
-   
-               dnxNodeListIncrementNodeMember(Job.pNode->addr,JOBS_HANDLED);
-   
-               /** @todo Wrapper release DnxResult structure. */
-               dnxAuditJob(&Job, "COLLECT");
-               dnxLog("RESPONSE: Job %lu: %s", sResult.xid.objSerial, sResult.resData);
-               ret = dnxSubmitCheck(&Job, &sResult, check_time);
-   
-               dnxDebug(2, "dnxCollector[%lx]: Post result for job [%lu:%lu]: %s.", 
-                     tid, sResult.xid.objSerial, sResult.xid.objSlot, 
-                     dnxErrorString(ret));
-               
-               // We should finally be done with the job
-               dnxDebug(2, "dnxCollector[%lx]: Job [%lu:%lu]: type(%i).", 
-                     tid, Job.xid.objSerial, Job.xid.objSlot, Job.state);
-               dnxJobListMarkComplete(icoll->joblist, &Job.xid);
-            } else {
-               dnxDebug(3, "dnxCollector[%lx]: Dequeue job failed: %s.",
-                     tid, dnxErrorString(ret));
-               xfree(sResult.resData);
-            }
-         }
+      dnxCollectorCheckDrops(icoll);
+
+      // while results wait for a batch, wake up in time to submit them
+      if ((due = dnxSubmitFlush(0)) == 0 || due > DNX_COLLECTOR_TIMEOUT * 1000)
+         due = DNX_COLLECTOR_TIMEOUT * 1000;
+
+      count = DNX_MAX_BATCH;
+      if ((ret = dnxWaitForResults(icoll->channel, 
+            sResults, &count, (int)due)) == DNX_OK) {
+         __sync_fetch_and_add(&icoll->received, count);
+         for (i = 0; i < count; i++)
+            dnxCollectResult(icoll, &sResults[i]);
       } else if (ret != DNX_ERR_TIMEOUT) {
          dnxDebug(1, "dnxCollector[%lx]: Receive failed: %s.", 
                tid, dnxErrorString(ret));
@@ -158,11 +301,35 @@ DnxChannel * dnxCollectorGetChannel(DnxCollector * coll)
 
 //----------------------------------------------------------------------------
 
-int dnxCollectorCreate(char * chname, char * collurl, DnxJobList * joblist, DnxCollector ** pcoll)
+int dnxCollectorGetStats(DnxCollector * coll, DnxCollectorStats * pStats)
+{
+   iDnxCollector * icoll = (iDnxCollector *)coll;
+
+   assert(coll && pStats);
+
+   pStats->threads = icoll->threads;
+   pStats->received = icoll->received;
+
+   if (!icoll->port)
+   {
+      pStats->drops = pStats->queued = 0;
+      return DNX_ERR_UNSUPPORTED;
+   }
+   return dnxUdpPortCounters(icoll->port, &pStats->drops, &pStats->queued);
+}
+
+//----------------------------------------------------------------------------
+
+int dnxCollectorCreate(char * chname, char * collurl, DnxJobList * joblist, 
+      unsigned threads, DnxCollector ** pcoll)
 {
    iDnxCollector * icoll;
+   unsigned long queued;
+   char * cp;
    int ret;
 
+   assert(threads > 0 && threads <= DNX_COLLECTOR_MAX_THREADS);
+
    if ((icoll = (iDnxCollector *)xmalloc(sizeof *icoll)) == 0)
       return DNX_ERR_MEMORY;
 
@@ -193,16 +360,24 @@ int dnxCollectorCreate(char * chname, char * collurl, DnxJobList * joblist, DnxC
       goto e2;
    }
 
-   // create the collector thread
-   if ((ret = pthread_create(&icoll->tid, 0, dnxCollector, icoll)) != 0)
-   {
-      dnxDebug(1, "dnxCollectorCreate: thread creation failed: %s.", 
-            dnxErrorString(ret));
-      dnxLog("dnxCollectorCreate: thread creation failed: %s.", 
-            dnxErrorString(ret));
-      ret = DNX_ERR_THREAD;
-      goto e3;
-   }
+   // note the port of a UDP channel, and the drops it starts with
+   if (!strncmp(collurl, "udp://", 6) && (cp = strrchr(collurl, ':')) != 0)
+      icoll->port = (unsigned)strtoul(cp + 1, 0, 0);
+   if (icoll->port)
+      dnxUdpPortCounters(icoll->port, &icoll->drops, &queued);
+
+   // create the collector threads
+   for (; icoll->threads < threads; icoll->threads++)
+      if ((ret = pthread_create(&icoll->tids[icoll->threads], 0, 
+            dnxCollector, icoll)) != 0)
+      {
+         dnxDebug(1, "dnxCollectorCreate: thread creation failed: %s.", 
+               dnxErrorString(ret));
+         dnxLog("dnxCollectorCreate: thread creation failed: %s.", 
+               dnxErrorString(ret));
+         ret = DNX_ERR_THREAD;
+         goto e3;
+      }
 
    *pcoll = (DnxCollector *)icoll;
 
@@ -210,7 +385,12 @@ int dnxCollectorCreate(char * chname, char * collurl, DnxJobList * joblist, DnxC
 
 // error paths
 
-e3:dnxDisconnect(icoll->channel);
+e3:while (icoll->threads--)
+   {
+      pthread_cancel(icoll->tids[icoll->threads]);
+      pthread_join(icoll->tids[icoll->threads], 0);
+   }
+   dnxDisconnect(icoll->channel);
 e2:dnxChanMapDelete(icoll->chname);
 e1:xfree(icoll->url);
    xfree(icoll->chname);
@@ -224,9 +404,12 @@ e1:xfree(icoll->url);
 void dnxCollectorDestroy(DnxCollector  * coll)
 {
    iDnxCollector * icoll = (iDnxCollector *)coll;
+   unsigned i;
 
-   pthread_cancel(icoll->tid);
-   pthread_join(icoll->tid, 0);
+   for (i = 0; i < icoll->threads; i++)
+      pthread_cancel(icoll->tids[i]);
+   for (i = 0; i < icoll->threads; i++)
+      pthread_join(icoll->tids[i], 0);
 
    dnxDisconnect(icoll->channel);
    dnxChanMapDelete(icoll->chname);
@@ -373,13 +556,13 @@ void dnxCollectorDestroy(DnxCollector  * coll)
 //    test_result.delta = 1;
 //    test_result.resCode = 1;
 // 
-//    CHECK_ZERO(dnxCollectorCreate(test_chname, test_url, test_joblist, &cp));
+//    CHECK_ZERO(dnxCollectorCreate(test_chname, test_url, test_joblist, 1, &cp));
 // 
 //    icp = (iDnxCollector *)cp;
 // 
 //    CHECK_TRUE(strcmp(icp->chname, test_chname) == 0);
 //    CHECK_TRUE(icp->joblist == test_joblist);
-//    CHECK_TRUE(icp->tid != 0);
+//    CHECK_TRUE(icp->threads == 1 && icp->tids[0] != 0);
 //    CHECK_TRUE(strcmp(icp->url, test_url) == 0);
 // 
 //    CHECK_TRUE(dnxCollectorGetChannel(cp) == icp->channel);
@@ -17,13 +17,13 @@
  
   --------------------------------------------------------------------------*/
 
-/** Definitions and prototypes for the DNX Collector thread.
+/** Definitions and prototypes for the DNX Collector threads.
  *
- * The purpose of this thread is to collect service check
+ * The purpose of these threads is to collect service check
  * completion results from the worker nodes.  When a service
- * check result is collected, this thread dequeues the service
- * check from the Jobs queue and posts the result to the existing
- * Nagios service_result_buffer.
+ * check result is collected, the thread that received it dequeues 
+ * the service check from the Jobs queue and posts the result to the 
+ * existing Nagios service_result_buffer.
  * 
  * @file dnxCollector.h
  * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
@@ -37,9 +37,21 @@
 #include "dnxJobList.h"
 #include "dnxTransport.h"
 
+/** The most collector threads a collector may run. */
+#define DNX_COLLECTOR_MAX_THREADS   64
+
 /** Abstract data type for the DNX job results collector. */
 typedef struct { int unused; } DnxCollector;
 
+/** Collector statistics, as returned by dnxCollectorGetStats. */
+typedef struct DnxCollectorStats
+{
+   unsigned threads;       /*!< The number of collector threads. */
+   unsigned long received; /*!< Results and acks received since creation. */
+   unsigned long drops;    /*!< Datagrams dropped by the collector socket. */
+   unsigned long queued;   /*!< Bytes waiting in the socket receive buffer. */
+} DnxCollectorStats;
+
 /** Return a reference to the collector channel object.
  * 
  * @param[in] coll - the collector whose dispatch channel should be returned.
@@ -48,18 +60,42 @@ typedef struct { int unused; } DnxCollector;
  */
 DnxChannel * dnxCollectorGetChannel(DnxCollector * coll);
 
+/** Return a collector's statistics.
+ * 
+ * The drop and queue counts are the kernel's, read from /proc/net/udp for
+ * the collector's port, so they include datagrams lost before the 
+ * collector was created. The drop count only grows while the collector
+ * threads fall behind the results arriving; the collector also logs any
+ * increase it sees, at most once every 30 seconds.
+ * 
+ * @param[in] coll - the collector whose statistics should be returned.
+ * @param[out] pStats - the address of storage for the statistics.
+ * 
+ * @return Zero on success; DNX_ERR_UNSUPPORTED if the collector channel is
+ *    not UDP, or DNX_ERR_NOTFOUND if the socket counters could not be read.
+ *    The thread and received counts are returned in either case.
+ */
+int dnxCollectorGetStats(DnxCollector * coll, DnxCollectorStats * pStats);
+
 /** Create a new collector object.
+ * 
+ * The collector runs @p threads threads, each waiting for the next result
+ * on the collector channel's socket, then decoding it, looking up its job
+ * and posting it to Nagios, so that a burst of results is drained from the
+ * socket receive buffer by all of them at once.
  * 
  * @param[in] chname - the name of the collect channel.
  * @param[in] collurl - the collect channel URL.
  * @param[in] joblist - a pointer to the global job list object.
+ * @param[in] threads - the number of collector threads to run; from 1 to
+ *    DNX_COLLECTOR_MAX_THREADS.
  * @param[out] pcoll - the address of storage for the return of the new
  *    collector object.
  * 
  * @return Zero on success, or a non-zero error value.
  */
 int dnxCollectorCreate(char * chname, char * collurl, DnxJobList * joblist, 
-      DnxCollector ** pcoll);
+      unsigned threads, DnxCollector ** pcoll);
 
 /** Destroy an existing collector object.
  * 
@@ -19,7 +19,7 @@
 
 /** Implements the DNX Dispatcher thread.
  *
- * The purpose of this thread is to dispatch service check jobs to the
+ * The purpose of these threads is to dispatch service check jobs to the
  * registered worker nodes for execution.  It accomplishes this by
  * accepting work node registrations and then dispatching service check
  * jobs to registered worker nodes using a weighted-round-robin algorithm.
@@ -46,6 +46,7 @@
 
 #include <netinet/in.h>
 #include <assert.h>
+#include <stdio.h>
 
 /** The implementation data structure for a dispatcher object. */
 typedef struct iDnxDispatcher_
@@ -54,104 +55,163 @@ typedef struct iDnxDispatcher_
    char * url;             /*!< The dispatcher channel URL. */
    DnxJobList * joblist;   /*!< The job list we're dispatching from. */
    DnxChannel * channel;   /*!< Dispatcher communications channel. */
-   pthread_t tid;          /*!< The dispatcher thread id. */
+   unsigned threads;       /*!< The number of dispatcher threads running. */
+   pthread_t tids[DNX_DISPATCHER_MAX_THREADS]; /*!< The dispatcher thread ids. */
 } iDnxDispatcher;
 
+/** A job or Ack being sent in a batch by a dispatcher thread. */
+typedef struct DnxDispatchMsg
+{
+   DnxXmlBuf xbuf;                  /*!< The encoded message. */
+   int ack;                         /*!< Non-zero if the message is an Ack. */
+   char address[DNX_MAX_ADDRESS];   /*!< The worker node's socket address. */
+   char addr[DNX_MAX_ADDRESS];      /*!< The worker node's address, for logging. */
+} DnxDispatchMsg;
+
 /*--------------------------------------------------------------------------
                               IMPLEMENTATION
   --------------------------------------------------------------------------*/
 
-/** Send a job to a designated client node.
+/** Encode a job, or an Ack for its results, for its client node.
  * 
- * @param[in] idisp - the dispatcher object.
- * @param[in] pSvcReq - the service request block belonging to the client 
- *    node we're targeting.
- * @param[in] pNode - the dnx request node to be sent.
+ * The node's addresses are copied into @p pMsg, as the node request 
+ * sometimes gets released before the message is sent.
  * 
- * @return Zero on success, or a non-zero error value.
+ * @param[in] pSvcReq - the service request to be encoded.
+ * @param[out] pMsg - the message in which to encode @p pSvcReq.
  */
-static int dnxSendJobMsg(iDnxDispatcher * idisp, DnxNewJob * pSvcReq, DnxNodeRequest * pNode)
+static void dnxEncodeJobMsg(DnxNewJob * pSvcReq, DnxDispatchMsg * pMsg)
 {
-   struct sockaddr * sin; 
+   DnxNodeRequest * pNode = pSvcReq->pNode;
    pthread_t tid = pthread_self();
    DnxJob job;
-   int ret;
-   time_t now = time(0);
+   time_t now;
+
+   memcpy(pMsg->address, pNode->address, sizeof pMsg->address);
+   snprintf(pMsg->addr, sizeof pMsg->addr, "%s", pNode->addr);
+
+   // look at job type. If it's a job still in progress, send ack
+   if ((pMsg->ack = pSvcReq->state == DNX_JOB_RECEIVED 
+         || pSvcReq->state == DNX_JOB_COMPLETE) != 0)
+   {
+      job.xid = pSvcReq->xid;
+      job.timestamp = 0;
+      dnxEncodeJobAck(&pMsg->xbuf, &job);
+      dnxDebug(3, "dnxSendJobAck: XML msg(%d bytes)=%s.", 
+            pMsg->xbuf.size, pMsg->xbuf.buf);
+      return;
+   }
+
+   now = time(0);
 
    dnxDebug(2, 
          "dnxSendJobMsg[%lx]: Dispatching job [%lu:%lu] (%s) to dnxClient [%s]"
-         " at node %s host flags = (%llu)",
+         " at node %s host flags = (%s)",
          tid, pSvcReq->xid.objSerial, pSvcReq->xid.objSlot, pSvcReq->cmd, 
-         pNode->hn, pNode->addr, pNode->flags);
-
-   // We may need to correctly change the flag of the slot in the queue here to 
-   // indicate it's been dispatched and we are waiting for it...
-   
+         pNode->hn, pNode->addr, dnxAffinityText(pNode->flags));
 
    memset(&job, 0, sizeof job);
    job.xid        = pSvcReq->xid;
    job.state      = DNX_JOB_PENDING;
-   job.priority   = 1;
+   job.priority   = pSvcReq->priority;
    job.timeout    = pSvcReq->timeout;
    job.cmd        = pSvcReq->cmd;
    job.timestamp  = now;
       
    dnxDebug(1,"dnxSendJobMsg[%lx]: Job [%lu:%lu] is in state(%i) and expires in (%i) seconds.",
             tid, pSvcReq->xid.objSerial, pSvcReq->xid.objSlot, pSvcReq->state, pSvcReq->expires - now);
-   
-   // Make a copy because it sometimes gets released before we even get to
-   // increment it's stats
-   char *address = xstrdup(pNode->addr);
 
-   if ((ret = dnxSendJob(idisp->channel, &job, pNode->address)) != DNX_OK)
+   dnxEncodeJob(&pMsg->xbuf, &job);
+
+   dnxDebug(3, "dnxSendJob: XML msg(%d bytes)=%s.", pMsg->xbuf.size, pMsg->xbuf.buf);
+}
+
+//----------------------------------------------------------------------------
+
+/** Record the outcome of sending a job or Ack to its client node.
+ * 
+ * @param[in] idisp - the dispatcher object.
+ * @param[in] pSvcReq - the service request that was sent.
+ * @param[in] pMsg - the message sent for @p pSvcReq.
+ * @param[in] ret - the result of sending @p pMsg.
+ */
+static void dnxJobMsgSent(iDnxDispatcher * idisp, DnxNewJob * pSvcReq, 
+      DnxDispatchMsg * pMsg, int ret)
+{
+   pthread_t tid = pthread_self();
+
+   if (pMsg->ack)
+   {
+      if (ret == DNX_OK)
+         dnxJobListMarkAckSent(idisp->joblist, &pSvcReq->xid);
+   }
+   else
    {
+      if (ret != DNX_OK)
+      {
             dnxDebug(1, "dnxSendJobMsg[%lx]: Unable to send job [%lu:%lu] (%s) to worker node %s: %s.",
             tid, pSvcReq->xid.objSerial, pSvcReq->xid.objSlot, pSvcReq->cmd, 
-            address, dnxErrorString(ret));
+            pMsg->addr, dnxErrorString(ret));
 
             dnxLog("dnxSendJobMsg[%lx]: Unable to send job [%lu:%lu] (%s) to worker node %s: %s.",
             tid, pSvcReq->xid.objSerial, pSvcReq->xid.objSlot, pSvcReq->cmd, 
-            address, dnxErrorString(ret));
-   } else {
-        dnxNodeListIncrementNodeMember(address,JOBS_DISPATCHED);        
+            pMsg->addr, dnxErrorString(ret));
+      } else {
+           dnxNodeListIncrementNodeMember(pMsg->addr,JOBS_DISPATCHED);        
+      }
+      dnxAuditJob(pSvcReq, "DISPATCH");
    }
-   
-   xfree(address); // Now we can deallocate it
-   return ret;
+   /** @todo Implement the fork-error re-scheduling logic as 
+    * found in run_service_check() in checks.c. 
+    */
+
+   if (ret != DNX_OK)
+      dnxAuditJob(pSvcReq, "DISPATCH-FAIL");
 }
 
 //----------------------------------------------------------------------------
 
-/** Send a service request to the appropriate worker node.
+/** Send a batch of service requests to the appropriate worker nodes.
  * 
- * @param[in] idisp - the dispatcher object.
- * @param[in] pSvcReq - the service request to be dispatched.
+ * The requests are sent together, in as few system calls as the transport
+ * allows. A request that can't be sent is logged, and the rest are still
+ * sent.
  * 
- * @return Zero on success, or a non-zero error value.
+ * @param[in] idisp - the dispatcher object.
+ * @param[in] pSvcReqs - the service requests to be dispatched.
+ * @param[in] count - the number of requests in @p pSvcReqs, from 1 to 
+ *    DNX_MAX_BATCH.
  */
-static int dnxDispatchJob(iDnxDispatcher * idisp, DnxNewJob * pSvcReq)
+static void dnxDispatchJobs(iDnxDispatcher * idisp, DnxNewJob * pSvcReqs, 
+      int count)
 {
-   DnxNodeRequest * pNode = pSvcReq->pNode;
-   int ret;
-   DnxJob ack;
-   
-   ack.xid = pSvcReq->xid;
-   ack.timestamp = 0;
-   
-   // look at job type. If it's a job still in progress, send ack
-   if (pSvcReq->state == DNX_JOB_RECEIVED || pSvcReq->state == DNX_JOB_COMPLETE) {
-      if((ret = dnxSendJobAck(idisp->channel, &ack, pNode->address)) == DNX_OK) {
-         dnxJobListMarkAckSent(idisp->joblist, &(ack.xid));
+   DnxDispatchMsg dmsgs[DNX_MAX_BATCH];
+   DnxMsgBuf msgs[DNX_MAX_BATCH];
+   int i, n, sent, ret;
+
+   assert(count > 0 && count <= DNX_MAX_BATCH);
+
+   for (i = 0; i < count; i++)
+   {
+      dnxEncodeJobMsg(&pSvcReqs[i], &dmsgs[i]);
+      msgs[i].buf = dmsgs[i].xbuf.buf;
+      msgs[i].size = dmsgs[i].xbuf.size;
+      msgs[i].addr = dmsgs[i].address;
+   }
+
+   // on a failure, carry on with the messages after the one that failed
+   for (sent = 0; sent < count; sent += n)
+   {
+      n = count - sent;
+      ret = dnxPutBatch(idisp->channel, &msgs[sent], &n, 0);
+      for (i = sent; i < sent + n; i++)
+         dnxJobMsgSent(idisp, &pSvcReqs[i], &dmsgs[i], DNX_OK);
+      if (ret != DNX_OK && sent + n < count)
+      {
+         dnxJobMsgSent(idisp, &pSvcReqs[i], &dmsgs[i], ret);
+         n++;
       }
-   } else {
-      ret = dnxSendJobMsg(idisp, pSvcReq, pNode);
-      dnxAuditJob(pSvcReq, "DISPATCH");
    }
-   /** @todo Implement the fork-error re-scheduling logic as 
-    * found in run_service_check() in checks.c. 
-    */
-   
-   return ret;
 }
 
 //----------------------------------------------------------------------------
@@ -174,18 +234,16 @@ static void * dnxDispatcher(void * data)
    dnxLog("Dispatcher awaiting jobs...");
 
    while (1) {
-      DnxNewJob svcReq;
-      int ret;
+      DnxNewJob svcReqs[DNX_MAX_BATCH];
+      int count = DNX_MAX_BATCH;
 
       pthread_testcancel();
 
-      // wait for a new entry to be added to the job queue
-      if ((ret = dnxJobListDispatch(idisp->joblist, &svcReq)) == DNX_OK) {
-         if ((ret = dnxDispatchJob(idisp, &svcReq)) != DNX_OK) {
-            dnxAuditJob(&svcReq, "DISPATCH-FAIL");
-         }
-      }
-
+      // wait for a new entry to be added to the job queue, and take any
+      // others waiting with it
+      if (dnxJobListDispatchBatch(idisp->joblist, svcReqs, &count) == DNX_OK
+            && count > 0)
+         dnxDispatchJobs(idisp, svcReqs, count);
    }
    return 0;
 }
@@ -200,11 +258,13 @@ DnxChannel * dnxDispatcherGetChannel(DnxDispatcher * disp)
 //----------------------------------------------------------------------------
 
 int dnxDispatcherCreate(char * chname, char * dispurl, DnxJobList * joblist, 
-      DnxDispatcher ** pdisp)
+      unsigned threads, DnxDispatcher ** pdisp)
 {
    iDnxDispatcher * idisp;
    int ret;
 
+   assert(threads > 0 && threads <= DNX_DISPATCHER_MAX_THREADS);
+
    if ((idisp = (iDnxDispatcher *)xmalloc(sizeof *idisp)) == 0)
       return DNX_ERR_MEMORY;
 
@@ -235,16 +295,18 @@ int dnxDispatcherCreate(char * chname, char * dispurl, DnxJobList * joblist,
       goto e2;
    }
 
-   // create the dispatcher thread
-   if ((ret = pthread_create(&idisp->tid, 0, dnxDispatcher, idisp)) != 0)
-   {
-      dnxDebug(1, "dnxDispatcherCreate: thread creation failed: %s.",
-            dnxErrorString(ret));
-      dnxLog("dnxDispatcherCreate: thread creation failed: %s.",
-            dnxErrorString(ret));
-      ret = DNX_ERR_THREAD;
-      goto e3;
-   }
+   // create the dispatcher threads
+   for (; idisp->threads < threads; idisp->threads++)
+      if ((ret = pthread_create(&idisp->tids[idisp->threads], 0, 
+            dnxDispatcher, idisp)) != 0)
+      {
+         dnxDebug(1, "dnxDispatcherCreate: thread creation failed: %s.",
+               dnxErrorString(ret));
+         dnxLog("dnxDispatcherCreate: thread creation failed: %s.",
+               dnxErrorString(ret));
+         ret = DNX_ERR_THREAD;
+         goto e3;
+      }
 
    *pdisp = (DnxDispatcher*)idisp;
 
@@ -252,7 +314,12 @@ int dnxDispatcherCreate(char * chname, char * dispurl, DnxJobList * joblist,
 
 // error paths
 
-e3:dnxDisconnect(idisp->channel);
+e3:while (idisp->threads--)
+   {
+      pthread_cancel(idisp->tids[idisp->threads]);
+      pthread_join(idisp->tids[idisp->threads], 0);
+   }
+   dnxDisconnect(idisp->channel);
 e2:dnxChanMapDelete(idisp->chname);
 e1:xfree(idisp->url);
    xfree(idisp->chname);
@@ -266,9 +333,12 @@ e1:xfree(idisp->url);
 void dnxDispatcherDestroy(DnxDispatcher * disp)
 {
    iDnxDispatcher * idisp = (iDnxDispatcher *)disp;
+   unsigned i;
 
-   pthread_cancel(idisp->tid);
-   pthread_join(idisp->tid, 0);
+   for (i = 0; i < idisp->threads; i++)
+      pthread_cancel(idisp->tids[i]);
+   for (i = 0; i < idisp->threads; i++)
+      pthread_join(idisp->tids[i], 0);
 
    dnxDisconnect(idisp->channel);
    dnxChanMapDelete(idisp->chname);
@@ -38,6 +38,9 @@
 #include "dnxJobList.h"
 #include "dnxTransport.h"
 
+/** The most dispatcher threads a dispatcher may run. */
+#define DNX_DISPATCHER_MAX_THREADS  64
+
 /** Abstract data type for the DNX job dispatcher. */
 typedef struct { int unused; } DnxDispatcher;
 
@@ -50,17 +53,24 @@ typedef struct { int unused; } DnxDispatcher;
 DnxChannel * dnxDispatcherGetChannel(DnxDispatcher * disp);
 
 /** Create a new dispatcher object.
+ * 
+ * The dispatcher runs @p threads threads, each taking the next job from 
+ * the job list and encoding, sending and auditing it, so that jobs are 
+ * sent in parallel. All of them send on the dispatcher channel's socket, 
+ * which is also the one on which the registrar receives worker requests.
  * 
  * @param[in] chname - the name of the dispatch channel.
  * @param[in] dispurl - the dispatcher channel URL.
  * @param[in] joblist - a pointer to the global job list object.
+ * @param[in] threads - the number of dispatcher threads to run; from 1 to
+ *    DNX_DISPATCHER_MAX_THREADS.
  * @param[out] pdisp - the address of storage for the return of the new
  *    dispatcher object.
  * 
  * @return Zero on success, or a non-zero error value.
  */
 int dnxDispatcherCreate(char * chname, char * dispurl, DnxJobList * joblist, 
-      DnxDispatcher ** pdisp);
+      unsigned threads, DnxDispatcher ** pdisp);
 
 /** Destroy an existing dispatcher object.
  * 
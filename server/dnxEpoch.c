@@ -0,0 +1,408 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Implements epoch-based reclamation for DNX.
+ *
+ * The domain keeps a global epoch number, and each reading thread a record,
+ * reached through a thread-specific data key, of the epoch in which it 
+ * entered its read section, or zero while outside one. Retiring an object 
+ * advances the epoch and tags the object with the new one. An object may 
+ * be released once no reader is in a section entered before its tag: any
+ * reader still able to see the object announced an earlier epoch before
+ * looking for it. Entering and leaving a section touch only the reader's
+ * own record, so readers never contend with each other or with writers.
+ *
+ * @file dnxEpoch.c
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IMPL
+ */
+
+#include "dnxEpoch.h"
+
+#include "dnxError.h"
+#include "dnxDebug.h"
+#include "dnxLogging.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+struct iDnxEpoch;
+
+/** A reading thread's record. */
+typedef struct iDnxEpochReader
+{
+   volatile unsigned long epoch;    /*!< The epoch of the open section, or 0. */
+   unsigned nest;                   /*!< The depth of nested sections. */
+   struct iDnxEpoch * domain;       /*!< The domain the reader belongs to. */
+   struct iDnxEpochReader * next;   /*!< The domain's next reader. */
+   struct iDnxEpochReader * prev;   /*!< The domain's previous reader. */
+} iDnxEpochReader;
+
+/** A retired object awaiting release. */
+typedef struct iDnxEpochRetiree
+{
+   void * obj;                      /*!< The retired object. */
+   void (*release)(void *);         /*!< The routine that releases obj. */
+   unsigned long epoch;             /*!< The epoch in which obj was retired. */
+   struct iDnxEpochRetiree * next;  /*!< The next retired object. */
+} iDnxEpochRetiree;
+
+/** Epoch domain implementation structure. */
+typedef struct iDnxEpoch
+{
+   volatile unsigned long epoch;    /*!< The current epoch; never 0. */
+   volatile unsigned long strays;   /*!< Readers in a section without a record. */
+   iDnxEpochReader * readers;       /*!< The records of all live readers. */
+   iDnxEpochRetiree * retired;      /*!< Objects awaiting release. */
+   pthread_key_t key;               /*!< The key of the reader records. */
+   pthread_mutex_t mutex;           /*!< Protects the reader and retired lists. */
+} iDnxEpoch;
+
+/*--------------------------------------------------------------------------
+                              IMPLEMENTATION
+  --------------------------------------------------------------------------*/
+
+/** Remove a thread's reader record from its domain when the thread exits.
+ *
+ * @param[in] data - the exiting thread's reader record.
+ */
+static void dnxEpochReaderRelease(void * data)
+{
+   iDnxEpochReader * reader = (iDnxEpochReader *)data;
+   iDnxEpoch * iepoch = reader->domain;
+
+   DNX_PT_MUTEX_LOCK(&iepoch->mutex);
+   if (reader->prev)
+      reader->prev->next = reader->next;
+   else
+      iepoch->readers = reader->next;
+   if (reader->next)
+      reader->next->prev = reader->prev;
+   DNX_PT_MUTEX_UNLOCK(&iepoch->mutex);
+
+   xfree(reader);
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the calling thread's reader record, creating it if necessary.
+ *
+ * @param[in] iepoch - the domain whose reader record should be returned.
+ *
+ * @return The calling thread's record, or 0 if no memory is available.
+ */
+static iDnxEpochReader * dnxEpochReader(iDnxEpoch * iepoch)
+{
+   iDnxEpochReader * reader;
+
+   if ((reader = (iDnxEpochReader *)pthread_getspecific(iepoch->key)) != 0)
+      return reader;
+
+   if ((reader = (iDnxEpochReader *)xcalloc(1, sizeof *reader)) == 0)
+      return 0;
+   reader->domain = iepoch;
+
+   if (pthread_setspecific(iepoch->key, reader) != 0) {
+      xfree(reader);
+      return 0;
+   }
+
+   DNX_PT_MUTEX_LOCK(&iepoch->mutex);
+   if ((reader->next = iepoch->readers) != 0)
+      reader->next->prev = reader;
+   iepoch->readers = reader;
+   DNX_PT_MUTEX_UNLOCK(&iepoch->mutex);
+
+   return reader;
+}
+
+//----------------------------------------------------------------------------
+
+/** Detach the retired objects that no reader can still be using.
+ *
+ * The caller must hold the domain's mutex.
+ *
+ * @param[in] iepoch - the domain whose retired objects are to be examined.
+ *
+ * @return A list of the objects that may be released.
+ */
+static iDnxEpochRetiree * dnxEpochReclaim(iDnxEpoch * iepoch)
+{
+   iDnxEpochRetiree * safe = 0, ** pp, * r;
+   iDnxEpochReader * reader;
+   unsigned long oldest = (unsigned long)-1, epoch;
+
+   // readers without a record can't be told apart, so hold everything
+   if (iepoch->strays)
+      return 0;
+
+   for (reader = iepoch->readers; reader; reader = reader->next)
+      if ((epoch = reader->epoch) != 0 && epoch < oldest)
+         oldest = epoch;
+
+   for (pp = &iepoch->retired; (r = *pp) != 0; )
+      if (r->epoch <= oldest) {
+         *pp = r->next;
+         r->next = safe;
+         safe = r;
+      } else
+         pp = &r->next;
+
+   return safe;
+}
+
+/*--------------------------------------------------------------------------
+                                 INTERFACE
+  --------------------------------------------------------------------------*/
+
+void dnxEpochEnter(DnxEpoch * epoch)
+{
+   iDnxEpoch * iepoch = (iDnxEpoch *)epoch;
+   iDnxEpochReader * reader;
+
+   assert(epoch);
+
+   if ((reader = dnxEpochReader(iepoch)) == 0) {
+      __sync_fetch_and_add(&iepoch->strays, 1);
+      return;
+   }
+
+   if (reader->nest++ == 0) {
+      reader->epoch = iepoch->epoch;
+      __sync_synchronize();   // announce the epoch before reading anything
+   }
+}
+
+//----------------------------------------------------------------------------
+
+void dnxEpochExit(DnxEpoch * epoch)
+{
+   iDnxEpoch * iepoch = (iDnxEpoch *)epoch;
+   iDnxEpochReader * reader;
+
+   assert(epoch);
+
+   if ((reader = (iDnxEpochReader *)pthread_getspecific(iepoch->key)) == 0) {
+      __sync_fetch_and_sub(&iepoch->strays, 1);
+      return;
+   }
+
+   assert(reader->nest > 0);
+
+   if (--reader->nest == 0) {
+      __sync_synchronize();   // finish reading before leaving
+      reader->epoch = 0;
+   }
+}
+
+//----------------------------------------------------------------------------
+
+int dnxEpochRetire(DnxEpoch * epoch, void * obj, void (*release)(void *))
+{
+   iDnxEpoch * iepoch = (iDnxEpoch *)epoch;
+   iDnxEpochRetiree * r, * safe;
+
+   assert(epoch && release);
+
+   if ((r = (iDnxEpochRetiree *)xmalloc(sizeof *r)) == 0)
+      return DNX_ERR_MEMORY;
+   r->obj = obj;
+   r->release = release;
+
+   DNX_PT_MUTEX_LOCK(&iepoch->mutex);
+   // a full barrier: the object was unpublished before the epoch advanced, 
+   // and the readers are examined after it did
+   r->epoch = __sync_add_and_fetch(&iepoch->epoch, 1);
+   r->next = iepoch->retired;
+   iepoch->retired = r;
+   safe = dnxEpochReclaim(iepoch);
+   DNX_PT_MUTEX_UNLOCK(&iepoch->mutex);
+
+   while ((r = safe) != 0) {
+      safe = r->next;
+      r->release(r->obj);
+      xfree(r);
+   }
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxEpochCreate(DnxEpoch ** ppEpoch)
+{
+   iDnxEpoch * iepoch;
+
+   assert(ppEpoch);
+
+   if ((iepoch = (iDnxEpoch *)xcalloc(1, sizeof *iepoch)) == 0)
+      return DNX_ERR_MEMORY;
+
+   iepoch->epoch = 1;
+
+   if (pthread_key_create(&iepoch->key, dnxEpochReaderRelease) != 0) {
+      xfree(iepoch);
+      return DNX_ERR_MEMORY;
+   }
+   DNX_PT_MUTEX_INIT(&iepoch->mutex);
+
+   *ppEpoch = (DnxEpoch *)iepoch;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+void dnxEpochDestroy(DnxEpoch * epoch)
+{
+   iDnxEpoch * iepoch = (iDnxEpoch *)epoch;
+   iDnxEpochReader * reader;
+   iDnxEpochRetiree * r;
+
+   assert(epoch);
+
+   // reader records are not released by deleting the key
+   pthread_key_delete(iepoch->key);
+   while ((reader = iepoch->readers) != 0) {
+      assert(!reader->nest);
+      iepoch->readers = reader->next;
+      xfree(reader);
+   }
+
+   while ((r = iepoch->retired) != 0) {
+      iepoch->retired = r->next;
+      r->release(r->obj);
+      xfree(r);
+   }
+
+   DNX_PT_MUTEX_DESTROY(&iepoch->mutex);
+   xfree(iepoch);
+}
+
+/*--------------------------------------------------------------------------
+                                 UNIT TEST
+
+   From within dnx/server, compile with GNU tools using this command line:
+
+      gcc -DDEBUG -DDNX_EPOCH_TEST -g -O0 -I../common dnxEpoch.c \
+         ../common/dnxError.c -lpthread -lgcc_s -lrt -o dnxEpochTest
+
+  --------------------------------------------------------------------------*/
+
+#ifdef DNX_EPOCH_TEST
+
+#include "utesthelp.h"
+
+#include <string.h>
+
+#define EPOCH_READERS   4
+#define EPOCH_SWAPS     20000
+#define EPOCH_LIVE      0x600DF00D
+
+static int verbose;
+static DnxEpoch * epoch;
+static unsigned * volatile shared;  // the published object
+static volatile int done;
+static unsigned long releases;
+static unsigned long bad;
+
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+static void release(void * obj)
+{
+   *(unsigned *)obj = 0;      // make use after release visible
+   xfree(obj);
+   releases++;
+}
+
+/* Read the published object over and over, as the Nagios, dispatcher and
+ * registrar threads read the affinity tables.
+ */
+static void * readerThread(void * data)
+{
+   while (!done) {
+      unsigned * obj;
+      dnxEpochEnter(epoch);
+      dnxEpochEnter(epoch);   // sections nest
+      obj = shared;
+      dnxEpochExit(epoch);
+      if (*obj != EPOCH_LIVE)
+         __sync_fetch_and_add(&bad, 1);
+      dnxEpochExit(epoch);
+   }
+   return 0;
+}
+
+int main(int argc, char ** argv)
+{
+   pthread_t tids[EPOCH_READERS];
+   unsigned * obj, * old;
+   int i;
+
+   verbose = argc > 1? 1: 0;
+
+   CHECK_ZERO(dnxEpochCreate(&epoch));
+
+   // an object retired with no readers about is released at once
+   CHECK_TRUE((obj = (unsigned *)xmalloc(sizeof *obj)) != 0);
+   CHECK_ZERO(dnxEpochRetire(epoch, obj, release));
+   CHECK_TRUE(releases == 1);
+
+   // but not while a reader that might have seen it is in its section
+   CHECK_TRUE((obj = (unsigned *)xmalloc(sizeof *obj)) != 0);
+   dnxEpochEnter(epoch);
+   CHECK_ZERO(dnxEpochRetire(epoch, obj, release));
+   CHECK_TRUE(releases == 1);
+   dnxEpochExit(epoch);
+   CHECK_TRUE((obj = (unsigned *)xmalloc(sizeof *obj)) != 0);
+   CHECK_ZERO(dnxEpochRetire(epoch, obj, release));
+   CHECK_TRUE(releases == 3);
+
+   // readers never see a released object while it is swapped under them
+   CHECK_TRUE((shared = (unsigned *)xmalloc(sizeof *shared)) != 0);
+   *shared = EPOCH_LIVE;
+   for (i = 0; i < EPOCH_READERS; i++)
+      CHECK_ZERO(pthread_create(&tids[i], 0, readerThread, 0));
+   for (i = 0; i < EPOCH_SWAPS; i++) {
+      CHECK_TRUE((obj = (unsigned *)xmalloc(sizeof *obj)) != 0);
+      *obj = EPOCH_LIVE;
+      old = shared;
+      shared = obj;
+      CHECK_ZERO(dnxEpochRetire(epoch, old, release));
+   }
+   done = 1;
+   for (i = 0; i < EPOCH_READERS; i++)
+      CHECK_ZERO(pthread_join(tids[i], 0));
+   CHECK_ZERO(bad);
+
+   // the readers have gone, so destroying the domain releases the rest
+   dnxEpochDestroy(epoch);
+   CHECK_TRUE(releases == 3 + EPOCH_SWAPS);
+   xfree(shared);
+
+   return 0;
+}
+
+#endif   /* DNX_EPOCH_TEST */
+
+/*--------------------------------------------------------------------------*/
+
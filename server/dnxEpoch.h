@@ -0,0 +1,90 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Definitions and prototypes for DNX epoch-based reclamation.
+ *
+ * An epoch domain lets threads read shared data without taking a lock
+ * while another thread replaces it. A reader brackets its use of the data
+ * with dnxEpochEnter and dnxEpochExit; a writer publishes a new copy of the
+ * data and hands the old one to dnxEpochRetire, which releases it once 
+ * every reader that might have seen it has left its read section. Read 
+ * sections may nest, and should be short, as retired objects accumulate
+ * while a reader stays in one.
+ *
+ * @file dnxEpoch.h
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IFC
+ */
+
+#ifndef _DNXEPOCH_H_
+#define _DNXEPOCH_H_
+
+/** An abstract data type for a DNX epoch domain. */
+typedef struct { int unused; } DnxEpoch;
+
+/** Begin a read section.
+ *
+ * Objects published before this call, and not retired before it, remain
+ * valid until the matching dnxEpochExit.
+ *
+ * @param[in] epoch - the domain of the objects to be read.
+ */
+void dnxEpochEnter(DnxEpoch * epoch);
+
+/** End a read section begun by dnxEpochEnter.
+ *
+ * @param[in] epoch - the domain of the objects that were read.
+ */
+void dnxEpochExit(DnxEpoch * epoch);
+
+/** Release an object once no reader can still be using it.
+ *
+ * The caller must already have made the object unreachable to new readers.
+ * Any earlier retired objects that have become safe to release are 
+ * released by this call.
+ *
+ * @param[in] epoch - the domain of the object.
+ * @param[in] obj - the object to be released.
+ * @param[in] release - the routine that releases @p obj.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY, in which case the object
+ *    has not been retired.
+ */
+int dnxEpochRetire(DnxEpoch * epoch, void * obj, void (*release)(void *));
+
+/** Create a new epoch domain.
+ *
+ * @param[out] ppEpoch - the address of storage for returning the new domain.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxEpochCreate(DnxEpoch ** ppEpoch);
+
+/** Destroy an epoch domain.
+ *
+ * All retired objects are released. No thread may be in a read section,
+ * or use the domain once this routine is called.
+ *
+ * @param[in] epoch - the domain to be destroyed.
+ */
+void dnxEpochDestroy(DnxEpoch * epoch);
+
+#endif   /* _DNXEPOCH_H_ */
+
@@ -34,94 +34,1270 @@
 #include "dnxNebMain.h"
 
 #include <sys/time.h>
+#include <semaphore.h>
+#include <errno.h>
 
 #define DNX_JOBLIST_TIMEOUT   5     /*!< Wake up to see if we're shutting down. */
+#define DNX_JOBLIST_RETRY     5     /*!< Seconds to wait for a client Ack. */
 #define DNX_TIMER_SLEEP       2500  /*!< Timer sleep interval, in milliseconds */
 
+#define DNX_JOBLIST_NIL ((unsigned long)-1) /*!< Slot index meaning "none". */
+
+/** The low bits of a job XID objSlot hold the slot index; the remaining high
+ * bits hold a generation count that changes every time the slot is reused,
+ * so that late results for a recycled slot don't match the new job.
+ */
+#define DNX_JOBLIST_SLOT_BITS 24
+#define DNX_JOBLIST_SLOT_MASK ((1UL << DNX_JOBLIST_SLOT_BITS) - 1)
+
+/** The generation wraps within 32 bits, as clients may decode the XID into 
+ * a 32-bit unsigned long. Results are matched on the whole XID, so a late
+ * result is still told from the slot's current job by its objSerial once
+ * the generation has wrapped.
+ */
+#define DNX_JOBLIST_GEN_MASK  ((1UL << (32 - DNX_JOBLIST_SLOT_BITS)) - 1)
+
+/** Job slots are allocated in segments of this many slots, so the job list 
+ * can grow and shrink without moving jobs that are in flight.
+ */
+#define DNX_JOBLIST_SEG_BITS  8
+#define DNX_JOBLIST_SEG_SLOTS (1UL << DNX_JOBLIST_SEG_BITS)
+#define DNX_JOBLIST_SEG_MASK  (DNX_JOBLIST_SEG_SLOTS - 1)
+
+/** Slot command buffers are allocated in multiples of this many bytes, so
+ * that a recycled slot can usually hold the next command without growing.
+ */
+#define DNX_JOBLIST_CMD_ROUND 128
+
+/** Observed plugin runtimes are kept in a direct-mapped table of this many
+ * entries (a power of two), indexed by a hash of the plugin name.
+ */
+#define DNX_JOBLIST_RUNTIMES  1024
+
+/** Observed runtimes are kept in units of 1/DNX_RUNTIME_SCALE seconds. */
+#define DNX_RUNTIME_SCALE     16
+
+/** A newly registered worker is offered the first compatible job among at
+ * most this many of the oldest Unbound jobs in each lane; jobs further back
+ * are left to the timer.
+ */
+#define DNX_JOBLIST_BIND_SCAN 64
+
 DnxJobList * joblist; // Fwd declaration
 
+/** Job list action queue identifiers. */
+typedef enum iDnxJobQueueId_
+{
+   DNX_JQ_NONE = 0,        /*!< Slot is not linked into any action queue. */
+   DNX_JQ_DISPATCH,        /*!< Pending jobs ready to be sent to a client; 
+                                one queue per priority lane. */
+   DNX_JQ_RETRY = DNX_JQ_DISPATCH + DNX_PRIORITY_MAX, /*!< Sent jobs awaiting an Ack, in retry order. */
+   DNX_JQ_ACK,             /*!< Received jobs that need an Ack sent back. */
+   DNX_JQ_UNBOUND,         /*!< Jobs waiting for a client to be assigned; 
+                                one queue per priority lane. */
+   DNX_JQ_CLEANUP = DNX_JQ_UNBOUND + DNX_PRIORITY_MAX, /*!< Finished jobs waiting to be released. */
+   DNX_JQ_FREE,            /*!< Empty slots available for new jobs. */
+   DNX_JQ_MAX
+} iDnxJobQueueId;
+
+#define DNX_WHEEL_BITS     6  /*!< Log2 of the buckets in each wheel level. */
+#define DNX_WHEEL_SIZE     (1 << DNX_WHEEL_BITS)
+#define DNX_WHEEL_MASK     (DNX_WHEEL_SIZE - 1)
+#define DNX_WHEEL_LEVELS   3  /*!< 1 sec, 64 sec and 68 min buckets. */
+#define DNX_WHEEL_SPAN     ((time_t)1 << (DNX_WHEEL_BITS * DNX_WHEEL_LEVELS))
+
+/** Slot link sets; each slot may be in one queue of each set. */
+typedef enum iDnxJobLinkSet_
+{
+   DNX_JL_ACTION = 0,      /*!< Links for the action queues. */
+   DNX_JL_WHEEL,           /*!< Links for the expiration wheel buckets. */
+   DNX_JL_MAX
+} iDnxJobLinkSet;
+
+/** Per-slot queue linkage. */
+typedef struct iDnxJobLink_
+{
+   unsigned long prev;     /*!< Previous slot in the queue. */
+   unsigned long next;     /*!< Next slot in the queue. */
+   int queue;              /*!< The queue this slot is linked into, or 0. */
+} iDnxJobLink;
+
+/** A FIFO of job list slots, threaded through a slot link array. */
+typedef struct iDnxJobQueue_
+{
+   unsigned long head;     /*!< First slot in the queue. */
+   unsigned long tail;     /*!< Last slot in the queue. */
+   unsigned long count;    /*!< Number of slots in the queue. */
+} iDnxJobQueue;
+
+/** The job fields read by the scheduler, kept in one small record per slot
+ * so that queue and wheel passes don't pull in the rest of the job. 
+ */
+typedef struct iDnxJobHot_
+{
+   time_t start_time;      /*!< Service check start time. */
+   time_t expires;         /*!< Expiration time. */
+   time_t retry;           /*!< When to resend if the client hasn't Acked. */
+   time_t offerExpires;    /*!< When the assigned client's offer expires. */
+   time_t due;             /*!< Latest dispatch time for an on-time result. */
+   DnxJobState state;      /*!< Job state. */
+   bool ack;               /*!< The client has been sent an Ack. */
+   unsigned char priority; /*!< The job's priority lane. */
+} iDnxJobHot;
+
+/** The job fields only needed to send, report or release a job. */
+typedef struct iDnxJobCold_
+{
+   DnxXID xid;             /*!< Service request transaction id. */
+   char * cmd;             /*!< Processed check command, in the slot's buffer. */
+   size_t cmdSize;         /*!< Size of the slot's command buffer. */
+   char * host_name;       /*!< Name of the host, in the slot's buffer. */
+   char * service_description; /*!< Name of the check, in the slot's buffer. */
+   DnxNodeRequest * pNode; /*!< Worker Request that will handle this Job. */
+   struct timeval sent;    /*!< When the job was last dispatched. */
+   int timeout;            /*!< Service check timeout in seconds. */
+   int object_check_type;  /*!< Nagios object type (service = 0, host = 1). */
+} iDnxJobCold;
+
+/** A segment of job list slots. */
+typedef struct iDnxJobSegment_
+{
+   iDnxJobHot hot[DNX_JOBLIST_SEG_SLOTS]; /*!< Scheduling fields of each job. */
+   iDnxJobCold cold[DNX_JOBLIST_SEG_SLOTS]; /*!< Payload of each job. */
+   iDnxJobLink links[DNX_JL_MAX][DNX_JOBLIST_SEG_SLOTS]; /*!< Slot linkage. */
+   unsigned long used;     /*!< Number of slots holding a job. */
+} iDnxJobSegment;
+
+/** A job passed in by dnxJobListAdd that hasn't been given a slot yet. */
+typedef struct iDnxJobIntake_
+{
+   struct iDnxJobIntake_ * next; /*!< The next job in the intake chain. */
+   DnxNewJob job;          /*!< A copy of the added job. */
+   char cmd[];             /*!< Copies of the job's command line and names. */
+} iDnxJobIntake;
+
+/** The observed runtime of a plugin. */
+typedef struct iDnxJobRuntime_
+{
+   unsigned long hash;     /*!< Hash of the plugin name; 0 if unused. */
+   unsigned avg;           /*!< Moving average, in 1/DNX_RUNTIME_SCALE secs. */
+} iDnxJobRuntime;
+
 /** The JobList implementation data structure. */
 typedef struct iDnxJobList_ 
 {
-   DnxNewJob * list;       /*!< Array of Job Structures. */
-   unsigned long size;     /*!< Number of elements. */
-   unsigned long head;     /*!< List head. */
-   unsigned long tail;     /*!< List tail. */
+   iDnxJobSegment ** segs; /*!< Slot segments, indexed by slot. */
+   iDnxJobQueue queues[DNX_JQ_MAX]; /*!< Slots needing dispatcher action. */
+   iDnxJobQueue wheel[1 + DNX_WHEEL_LEVELS * DNX_WHEEL_SIZE]; /*!< Expiration wheel buckets; 0 is unused. */
+   time_t wheelTime;       /*!< The next second to be processed by the wheel. */
+   time_t wakeup;          /*!< When the timer is next due to run. */
+   unsigned long size;     /*!< Number of usable slots. */
+   unsigned long minSize;  /*!< The list never shrinks below this size. */
+   unsigned long maxSize;  /*!< The list never grows above this size. */
+   unsigned long highWater; /*!< The most slots ever in use at once. */
+   unsigned long generation; /*!< The highest slot generation handed out. */
+   volatile unsigned long jobCount; /*!< Jobs added and not yet released; atomic. */
+   volatile unsigned long unboundAdded; /*!< Unbound jobs added and not yet queued; atomic. */
+   iDnxJobIntake * volatile intake; /*!< Jobs added since the last drain, newest first; atomic. */
+   iDnxJobIntake * backlog; /*!< Drained jobs still waiting for a slot. */
+   iDnxJobIntake * backlogTail; /*!< The last job in the backlog. */
+   unsigned laneWeight[DNX_PRIORITY_MAX]; /*!< Dispatch weight of each lane. */
+   long laneCredit[DNX_PRIORITY_MAX]; /*!< Weighted round robin state. */
+   unsigned laneReserve[DNX_PRIORITY_MAX]; /*!< Idle workers each lane must leave. */
+   unsigned long * heap[DNX_PRIORITY_MAX]; /*!< Lane deadline heaps, or 0 for FIFO lanes. */
+   unsigned long heapSize; /*!< Capacity of each lane heap. */
+   iDnxJobRuntime runtimes[DNX_JOBLIST_RUNTIMES]; /*!< Observed plugin runtimes. */
    pthread_mutex_t mut;    /*!< The job list mutex. */
-   pthread_cond_t cond;    /*!< The job list condition variable. */
+   sem_t wake;             /*!< Posted when the dispatcher has work. */
    DnxTimer * timer;       /*!< The job list expiration timer. */
 } iDnxJobList;
 
+/*--------------------------------------------------------------------------
+                              IMPLEMENTATION
+  --------------------------------------------------------------------------*/
+
+/** Return the scheduling fields of the job stored in a job list slot.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] slot - the slot index; must be less than the list size.
+ *
+ * @return A pointer to the scheduling fields of the job in @p slot.
+ */
+static iDnxJobHot * dnxJobHotAt(iDnxJobList * ilist, unsigned long slot)
+{
+   return &ilist->segs[slot >> DNX_JOBLIST_SEG_BITS]->hot[slot & DNX_JOBLIST_SEG_MASK];
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the payload of the job stored in a job list slot.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] slot - the slot index; must be less than the list size.
+ *
+ * @return A pointer to the payload of the job in @p slot.
+ */
+static iDnxJobCold * dnxJobColdAt(iDnxJobList * ilist, unsigned long slot)
+{
+   return &ilist->segs[slot >> DNX_JOBLIST_SEG_BITS]->cold[slot & DNX_JOBLIST_SEG_MASK];
+}
+
+//----------------------------------------------------------------------------
+
+/** Copy the job stored in a job list slot out to a job structure.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] slot - the slot index; must be less than the list size.
+ * @param[out] pJob - the address of storage for the copy of the job.
+ */
+static void dnxJobLoad(iDnxJobList * ilist, unsigned long slot, DnxNewJob * pJob)
+{
+   iDnxJobHot * pHot = dnxJobHotAt(ilist, slot);
+   iDnxJobCold * pCold = dnxJobColdAt(ilist, slot);
+
+   pJob->xid = pCold->xid;
+   pJob->state = pHot->state;
+   pJob->cmd = pCold->cmd;
+   pJob->start_time = pHot->start_time;
+   pJob->timeout = pCold->timeout;
+   pJob->expires = pHot->expires;
+   pJob->host_name = pCold->host_name;
+   pJob->service_description = pCold->service_description;
+   pJob->object_check_type = pCold->object_check_type;
+   pJob->pNode = pCold->pNode;
+   pJob->sent = pCold->sent;
+   pJob->ack = pHot->ack;
+   pJob->priority = pHot->priority;
+}
+
+//----------------------------------------------------------------------------
+
+/** Store a job in a job list slot.
+ * 
+ * The job's command line, host name and service description are copied 
+ * into the slot's command buffer, which is kept when the slot is released 
+ * so the next job can reuse it. Jobs never refer to Nagios' objects, which
+ * Nagios frees when it reloads its configuration. Nothing is stored if the 
+ * buffer can't be grown.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] slot - the slot index; must be less than the list size.
+ * @param[in] pJob - the job to be stored in @p slot.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY.
+ */
+static int dnxJobStore(iDnxJobList * ilist, unsigned long slot, DnxNewJob * pJob)
+{
+   iDnxJobHot * pHot = dnxJobHotAt(ilist, slot);
+   iDnxJobCold * pCold = dnxJobColdAt(ilist, slot);
+   char * src = pJob->cmd ? pJob->cmd : "";
+   size_t len = strlen(src) + 1;
+   size_t hostLen = pJob->host_name ? strlen(pJob->host_name) + 1 : 0;
+   size_t svcLen = pJob->service_description 
+         ? strlen(pJob->service_description) + 1 : 0;
+   char * cmd;
+
+   if (len + hostLen + svcLen > pCold->cmdSize) {
+      size_t size = (len + hostLen + svcLen + DNX_JOBLIST_CMD_ROUND - 1) 
+            & ~(size_t)(DNX_JOBLIST_CMD_ROUND - 1);
+      if ((cmd = (char *)xmalloc(size)) == 0)
+         return DNX_ERR_MEMORY;
+      xfree(pCold->cmd);
+      pCold->cmd = cmd;
+      pCold->cmdSize = size;
+   }
+   memcpy(pCold->cmd, src, len);
+   pCold->host_name = hostLen 
+         ? memcpy(pCold->cmd + len, pJob->host_name, hostLen) : 0;
+   pCold->service_description = svcLen ? memcpy(pCold->cmd + len + hostLen, 
+         pJob->service_description, svcLen) : 0;
+
+   pCold->xid = pJob->xid;
+   pHot->start_time = pJob->start_time;
+   pHot->expires = pJob->expires;
+   pHot->retry = 0;
+   pHot->offerExpires = pJob->pNode ? pJob->pNode->expires : 0;
+   pHot->state = pJob->state;
+   pHot->ack = pJob->ack;
+   pHot->priority = (unsigned char)pJob->priority;
+   pCold->pNode = pJob->pNode;
+   timerclear(&pCold->sent);
+   pCold->timeout = pJob->timeout;
+   pCold->object_check_type = pJob->object_check_type;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return a job list slot's link for one of the slot link sets.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] set - the link set to be returned.
+ * @param[in] slot - the slot index; must be less than the list size.
+ *
+ * @return A pointer to the requested link for @p slot.
+ */
+static iDnxJobLink * dnxJobLinkAt(iDnxJobList * ilist, iDnxJobLinkSet set, 
+      unsigned long slot)
+{
+   return &ilist->segs[slot >> DNX_JOBLIST_SEG_BITS]->links[set][slot & DNX_JOBLIST_SEG_MASK];
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove a slot from whichever queue of a link set it is linked into.
+ * 
+ * Does nothing if the slot is not queued. The caller must hold the list 
+ * mutex.
+ *
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] set - the link set; selects the action queues or the wheel.
+ * @param[in] slot - the slot index to be unlinked.
+ */
+static void dnxJobLinkRemove(iDnxJobList * ilist, iDnxJobLinkSet set, 
+      unsigned long slot)
+{
+   iDnxJobQueue * queues = set == DNX_JL_WHEEL ? ilist->wheel : ilist->queues;
+   iDnxJobLink * link = dnxJobLinkAt(ilist, set, slot);
+   iDnxJobQueue * queue;
+
+   if (link->queue == 0)
+      return;
+
+   queue = &queues[link->queue];
+
+   if (link->prev == DNX_JOBLIST_NIL)
+      queue->head = link->next;
+   else
+      dnxJobLinkAt(ilist, set, link->prev)->next = link->next;
+
+   if (link->next == DNX_JOBLIST_NIL)
+      queue->tail = link->prev;
+   else
+      dnxJobLinkAt(ilist, set, link->next)->prev = link->prev;
+
+   queue->count--;
+
+   link->prev = link->next = DNX_JOBLIST_NIL;
+   link->queue = 0;
+}
+
+//----------------------------------------------------------------------------
+
+/** Append a slot to the tail of a queue in a link set.
+ * 
+ * If the slot is already linked into another queue of the set, it is moved.
+ * The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] set - the link set; selects the action queues or the wheel.
+ * @param[in] qid - the queue to which @p slot should be appended.
+ * @param[in] slot - the slot index to be appended.
+ */
+static void dnxJobLinkAppend(iDnxJobList * ilist, iDnxJobLinkSet set, 
+      int qid, unsigned long slot)
+{
+   iDnxJobQueue * queue = set == DNX_JL_WHEEL ? &ilist->wheel[qid] : &ilist->queues[qid];
+   iDnxJobLink * link = dnxJobLinkAt(ilist, set, slot);
+
+   dnxJobLinkRemove(ilist, set, slot);
+
+   link->queue = qid;
+   link->next = DNX_JOBLIST_NIL;
+   link->prev = queue->tail;
+
+   if (queue->tail == DNX_JOBLIST_NIL)
+      queue->head = slot;
+   else
+      dnxJobLinkAt(ilist, set, queue->tail)->next = slot;
+
+   queue->tail = slot;
+   queue->count++;
+}
+
+//----------------------------------------------------------------------------
+
+/** Determine whether an action queue is a deadline-ordered dispatch lane.
+ * 
+ * @param[in] ilist - the job list containing the queue.
+ * @param[in] qid - the queue to be examined.
+ *
+ * @return True if @p qid is kept as a deadline heap rather than a FIFO.
+ */
+static int dnxJobQueueIsHeap(iDnxJobList * ilist, int qid)
+{
+   return qid >= DNX_JQ_DISPATCH && qid < DNX_JQ_DISPATCH + DNX_PRIORITY_MAX 
+         && ilist->heap[qid - DNX_JQ_DISPATCH] != 0;
+}
+
+//----------------------------------------------------------------------------
+
+/** Determine whether one queued job should be dispatched before another.
+ * 
+ * Jobs are ordered by due time; jobs due in the same second are taken in 
+ * the order Nagios handed them to us.
+ *
+ * @param[in] ilist - the job list containing @p a and @p b.
+ * @param[in] a - the first slot index to be compared.
+ * @param[in] b - the second slot index to be compared.
+ *
+ * @return True if @p a should be dispatched before @p b.
+ */
+static int dnxJobHeapBefore(iDnxJobList * ilist, unsigned long a, unsigned long b)
+{
+   time_t da = dnxJobHotAt(ilist, a)->due, db = dnxJobHotAt(ilist, b)->due;
+
+   if (da != db)
+      return da < db;
+   return dnxJobColdAt(ilist, a)->xid.objSerial < dnxJobColdAt(ilist, b)->xid.objSerial;
+}
+
+//----------------------------------------------------------------------------
+
+/** Move a slot up or down a lane heap until the heap is ordered again.
+ * 
+ * A heap slot's action link holds its queue id and, in place of the prev
+ * link, its index in the heap. The queue head is kept pointing at the top 
+ * of the heap, so that dnxJobQueuePop works on heaps and FIFOs alike.
+ *
+ * @param[in] ilist - the job list containing the heap.
+ * @param[in] qid - the dispatch lane whose heap is to be ordered.
+ * @param[in] idx - the heap index of the slot that may be out of place.
+ */
+static void dnxJobHeapSift(iDnxJobList * ilist, int qid, unsigned long idx)
+{
+   unsigned long * heap = ilist->heap[qid - DNX_JQ_DISPATCH];
+   unsigned long count = ilist->queues[qid].count;
+   unsigned long slot = heap[idx], child;
+
+   // up, towards the root, while it's due before its parent
+   while (idx > 0 && dnxJobHeapBefore(ilist, slot, heap[(idx - 1) / 2])) {
+      heap[idx] = heap[(idx - 1) / 2];
+      dnxJobLinkAt(ilist, DNX_JL_ACTION, heap[idx])->prev = idx;
+      idx = (idx - 1) / 2;
+   }
+
+   // down, towards the leaves, while a child is due before it
+   while ((child = 2 * idx + 1) < count) {
+      if (child + 1 < count && dnxJobHeapBefore(ilist, heap[child + 1], heap[child]))
+         child++;
+      if (!dnxJobHeapBefore(ilist, heap[child], slot))
+         break;
+      heap[idx] = heap[child];
+      dnxJobLinkAt(ilist, DNX_JL_ACTION, heap[idx])->prev = idx;
+      idx = child;
+   }
+
+   heap[idx] = slot;
+   dnxJobLinkAt(ilist, DNX_JL_ACTION, slot)->prev = idx;
+   ilist->queues[qid].head = heap[0];
+}
+
+//----------------------------------------------------------------------------
+
+/** Add a slot to a lane heap.
+ * 
+ * The slot must not be in any action queue. The heap always has room, as
+ * it's as large as the job list.
+ *
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] qid - the dispatch lane to which @p slot should be added.
+ * @param[in] slot - the slot index to be added.
+ */
+static void dnxJobHeapPush(iDnxJobList * ilist, int qid, unsigned long slot)
+{
+   unsigned long idx = ilist->queues[qid].count++;
+
+   assert(idx < ilist->heapSize);
+
+   ilist->heap[qid - DNX_JQ_DISPATCH][idx] = slot;
+   dnxJobLinkAt(ilist, DNX_JL_ACTION, slot)->queue = qid;
+   dnxJobHeapSift(ilist, qid, idx);
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove a slot from a lane heap.
+ * 
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] qid - the dispatch lane from which @p slot should be removed.
+ * @param[in] slot - the slot index to be removed.
+ */
+static void dnxJobHeapRemove(iDnxJobList * ilist, int qid, unsigned long slot)
+{
+   unsigned long * heap = ilist->heap[qid - DNX_JQ_DISPATCH];
+   iDnxJobLink * link = dnxJobLinkAt(ilist, DNX_JL_ACTION, slot);
+   unsigned long idx = link->prev;
+   unsigned long last = --ilist->queues[qid].count;
+
+   link->prev = link->next = DNX_JOBLIST_NIL;
+   link->queue = 0;
+
+   // fill the hole with the last job in the heap
+   if (idx != last) {
+      heap[idx] = heap[last];
+      dnxJobHeapSift(ilist, qid, idx);
+   } else if (last == 0)
+      ilist->queues[qid].head = DNX_JOBLIST_NIL;
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove a slot from whichever action queue it is linked into.
+ * 
+ * The caller must hold the list mutex.
+ * 
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] slot - the slot index to be unlinked.
+ */
+static void dnxJobQueueUnlink(iDnxJobList * ilist, unsigned long slot)
+{
+   int qid = dnxJobLinkAt(ilist, DNX_JL_ACTION, slot)->queue;
+
+   if (dnxJobQueueIsHeap(ilist, qid))
+      dnxJobHeapRemove(ilist, qid, slot);
+   else
+      dnxJobLinkRemove(ilist, DNX_JL_ACTION, slot);
+}
+
+//----------------------------------------------------------------------------
+
+/** Append a slot to the tail of an action queue.
+ * 
+ * Slots added to a deadline-ordered lane are placed by their due time.
+ * 
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] qid - the queue to which @p slot should be appended.
+ * @param[in] slot - the slot index to be appended.
+ */
+static void dnxJobQueueAppend(iDnxJobList * ilist, iDnxJobQueueId qid, 
+      unsigned long slot)
+{
+   dnxJobQueueUnlink(ilist, slot);
+
+   if (dnxJobQueueIsHeap(ilist, qid))
+      dnxJobHeapPush(ilist, qid, slot);
+   else
+      dnxJobLinkAppend(ilist, DNX_JL_ACTION, qid, slot);
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove and return the slot at the head of an action queue.
+ * 
+ * The head of a deadline-ordered lane is the job with the earliest due time.
+ * 
+ * The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be queried.
+ * @param[in] qid - the queue from which to remove the head slot.
+ *
+ * @return The slot index, or DNX_JOBLIST_NIL if the queue is empty.
+ */
+static unsigned long dnxJobQueuePop(iDnxJobList * ilist, iDnxJobQueueId qid)
+{
+   unsigned long slot = ilist->queues[qid].head;
+
+   if (slot != DNX_JOBLIST_NIL)
+      dnxJobQueueUnlink(ilist, slot);
+
+   return slot;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the job list slot referred to by a job XID.
+ * 
+ * @param[in] ilist - the job list to be indexed.
+ * @param[in] pxid - the job XID, as returned by a client.
+ *
+ * @return The slot index, or DNX_JOBLIST_NIL if @p pxid is out of range.
+ */
+static unsigned long dnxJobListSlot(iDnxJobList * ilist, DnxXID * pxid)
+{
+   unsigned long slot = pxid->objSlot & DNX_JOBLIST_SLOT_MASK;
+   return slot < ilist->size ? slot : DNX_JOBLIST_NIL;
+}
+
+//----------------------------------------------------------------------------
+
+/** Resize the deadline heaps of a job list's dispatch lanes.
+ * 
+ * All heaps share one capacity, which is never less than the list size.
+ * The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list whose heaps should be resized.
+ * @param[in] size - the new capacity of each heap.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY; heaps that couldn't be 
+ *    resized are left as they were.
+ */
+static int dnxJobHeapResize(iDnxJobList * ilist, unsigned long size)
+{
+   unsigned long * heap;
+   int lane;
+
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++) {
+      if (!ilist->heap[lane])
+         continue;
+      if ((heap = (unsigned long *)xrealloc(ilist->heap[lane], 
+            size * sizeof *heap)) == 0)
+         return DNX_ERR_MEMORY;
+      ilist->heap[lane] = heap;
+   }
+   ilist->heapSize = size;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Add free slots to a job list, up to the end of the next segment.
+ * 
+ * The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be grown.
+ *
+ * @return Zero on success, DNX_ERR_CAPACITY if the list is already at its
+ *    maximum size, or DNX_ERR_MEMORY.
+ */
+static int dnxJobListGrow(iDnxJobList * ilist)
+{
+   unsigned long seg = ilist->size >> DNX_JOBLIST_SEG_BITS;
+   unsigned long newSize, slot, i;
+   iDnxJobSegment * pSeg;
+
+   if (ilist->size >= ilist->maxSize)
+      return DNX_ERR_CAPACITY;
+
+   if ((newSize = (seg + 1) << DNX_JOBLIST_SEG_BITS) > ilist->maxSize)
+      newSize = ilist->maxSize;
+
+   // deadline heaps must be able to hold every slot
+   if (ilist->heapSize && newSize > ilist->heapSize 
+         && dnxJobHeapResize(ilist, newSize) != DNX_OK)
+      return DNX_ERR_MEMORY;
+
+   if (!ilist->segs[seg])
+   {
+      if ((pSeg = (iDnxJobSegment *)xcalloc(1, sizeof *pSeg)) == 0)
+         return DNX_ERR_MEMORY;
+      for (i = 0; i < DNX_JOBLIST_SEG_SLOTS; i++)
+      {
+         pSeg->links[DNX_JL_ACTION][i].prev = pSeg->links[DNX_JL_ACTION][i].next = DNX_JOBLIST_NIL;
+         pSeg->links[DNX_JL_WHEEL][i] = pSeg->links[DNX_JL_ACTION][i];
+
+         // these slots may have been used before the list last shrank; 
+         // starting at the latest generation makes a repeat less likely, 
+         // but once generations wrap, a late result for an earlier job is
+         // only rejected by its objSerial (see dnxEqualXIDs)
+         pSeg->cold[i].xid.objSlot = (ilist->generation & DNX_JOBLIST_GEN_MASK) 
+               << DNX_JOBLIST_SLOT_BITS;
+      }
+      ilist->segs[seg] = pSeg;
+   }
+
+   for (slot = ilist->size; slot < newSize; slot++)
+      dnxJobQueueAppend(ilist, DNX_JQ_FREE, slot);
+
+   ilist->size = newSize;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Release a slot segment and its slots' command buffers.
+ * 
+ * @param[in] pSeg - the segment to be released.
+ */
+static void dnxJobSegmentFree(iDnxJobSegment * pSeg)
+{
+   unsigned long i;
+
+   for (i = 0; i < DNX_JOBLIST_SEG_SLOTS; i++)
+      xfree(pSeg->cold[i].cmd);
+   xfree(pSeg);
+}
+
+//----------------------------------------------------------------------------
+
+/** Release all of a job list's slot segments and the segment table.
+ * 
+ * @param[in] ilist - the job list whose segments should be released.
+ */
+static void dnxJobListFreeSegments(iDnxJobList * ilist)
+{
+   unsigned long i;
+
+   for (i = 0; i <= (ilist->maxSize - 1) >> DNX_JOBLIST_SEG_BITS; i++)
+      if (ilist->segs[i])
+         dnxJobSegmentFree(ilist->segs[i]);
+   xfree(ilist->segs);
+}
+
+//----------------------------------------------------------------------------
+
+/** Release the last segment of a job list if it's no longer needed.
+ * 
+ * The segment is released only if none of its slots are in use, the list
+ * would stay at or above its initial size, and at least one segment's worth
+ * of free slots would remain. The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be shrunk.
+ */
+static void dnxJobListShrink(iDnxJobList * ilist)
+{
+   unsigned long seg, start, slot;
+
+   if (ilist->size <= ilist->minSize)
+      return;
+
+   seg = (ilist->size - 1) >> DNX_JOBLIST_SEG_BITS;
+   start = seg << DNX_JOBLIST_SEG_BITS;
+
+   if (start < ilist->minSize || ilist->segs[seg]->used 
+         || ilist->size - ilist->queues[DNX_JQ_FREE].count + DNX_JOBLIST_SEG_SLOTS > start)
+      return;
+
+   for (slot = start; slot < ilist->size; slot++)
+      dnxJobQueueUnlink(ilist, slot);
+
+   dnxJobSegmentFree(ilist->segs[seg]);
+   ilist->segs[seg] = 0;
+   ilist->size = start;
+
+   dnxDebug(2, "dnxJobListShrink: Job list reduced to %lu slots.", ilist->size);
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the time at which a job should be expired by the timer.
+ * 
+ * Unbound jobs expire if no client is found for them within the dispatch
+ * timeout; all other jobs expire at their own expiration time.
+ *
+ * @param[in] pJob - the scheduling fields of the job to be examined.
+ *
+ * @return The expiration deadline of @p pJob.
+ */
+static time_t dnxJobDeadline(iDnxJobHot * pJob)
+{
+   if (pJob->state == DNX_JOB_UNBOUND)
+      return pJob->start_time + DNX_DISPATCH_TIMEOUT;
+   return pJob->expires;
+}
+
+//----------------------------------------------------------------------------
+
+/** Schedule a job slot on the expiration wheel.
+ * 
+ * The slot is placed in the bucket of the lowest wheel level that can hold
+ * its deadline; deadlines beyond the span of the wheel are parked in the 
+ * last bucket and rescheduled as the wheel turns. If the deadline is sooner
+ * than the timer's next wake up, the timer is moved forward. The caller 
+ * must hold the list mutex.
+ *
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] slot - the slot index to be (re)scheduled.
+ */
+static void dnxJobWheelInsert(iDnxJobList * ilist, unsigned long slot)
+{
+   time_t deadline = dnxJobDeadline(dnxJobHotAt(ilist, slot));
+   time_t delta;
+   int level;
+
+   if (deadline < ilist->wheelTime)
+      deadline = ilist->wheelTime;     // already due
+   if ((delta = deadline - ilist->wheelTime) >= DNX_WHEEL_SPAN)
+      deadline = ilist->wheelTime + (delta = DNX_WHEEL_SPAN - 1);
+
+   for (level = 0; delta >= (time_t)1 << (DNX_WHEEL_BITS * (level + 1)); level++)
+      ;
+
+   dnxJobLinkAppend(ilist, DNX_JL_WHEEL, 1 + level * DNX_WHEEL_SIZE 
+         + ((deadline >> (DNX_WHEEL_BITS * level)) & DNX_WHEEL_MASK), slot);
+
+   if (deadline < ilist->wakeup)
+   {
+      ilist->wakeup = deadline;
+      if (ilist->timer)
+         dnxTimerWakeAt(ilist->timer, deadline);
+   }
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove a job slot from the expiration wheel.
+ * 
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] slot - the slot index to be removed.
+ */
+static void dnxJobWheelRemove(iDnxJobList * ilist, unsigned long slot)
+{
+   dnxJobLinkRemove(ilist, DNX_JL_WHEEL, slot);
+}
+
+//----------------------------------------------------------------------------
+
+/** Reschedule every slot in an upper wheel level bucket.
+ * 
+ * @param[in] ilist - the job list whose wheel should be cascaded.
+ * @param[in] level - the wheel level to be cascaded.
+ */
+static void dnxJobWheelCascade(iDnxJobList * ilist, int level)
+{
+   iDnxJobQueue * bucket = &ilist->wheel[1 + level * DNX_WHEEL_SIZE 
+         + ((ilist->wheelTime >> (DNX_WHEEL_BITS * level)) & DNX_WHEEL_MASK)];
+   unsigned long count = bucket->count;
+   unsigned long slot;
+
+   while (count-- && (slot = bucket->head) != DNX_JOBLIST_NIL)
+   {
+      dnxJobWheelRemove(ilist, slot);
+      dnxJobWheelInsert(ilist, slot);
+   }
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the time of the next wheel bucket that needs attention.
+ * 
+ * @param[in] ilist - the job list whose wheel should be examined.
+ *
+ * @return The next non-empty one second bucket, or the next cascade point
+ *    if there are none.
+ */
+static time_t dnxJobWheelNext(iDnxJobList * ilist)
+{
+   int i;
+
+   for (i = 0; i < DNX_WHEEL_SIZE; i++)
+      if (ilist->wheel[1 + ((ilist->wheelTime + i) & DNX_WHEEL_MASK)].count)
+         return ilist->wheelTime + i;
+
+   return (ilist->wheelTime | DNX_WHEEL_MASK) + 1;
+}
+
+//----------------------------------------------------------------------------
+
+/** Expire a job slot that has passed its deadline.
+ * 
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] slot - the slot index to be expired.
+ * @param[in] now - the current time.
+ */
+static void dnxJobExpireSlot(iDnxJobList * ilist, unsigned long slot, time_t now)
+{
+   iDnxJobHot * pJob = dnxJobHotAt(ilist, slot);
+   iDnxJobCold * pCold = dnxJobColdAt(ilist, slot);
+
+   if (pJob->state == DNX_JOB_UNBOUND)
+      dnxDebug(2, "dnxJobListExpire: Expiring Unbound %s Job [%lu:%lu] Start Time: (%lu) Now: (%lu)",
+         (pCold->object_check_type ? "Host" : "Service"), pCold->xid.objSerial, pCold->xid.objSlot, 
+         pJob->start_time, now);
+   else
+      // This is an expired job, it was sent out, but never came back
+      dnxDebug(1, "dnxJobListExpire: Expiring Job [%lu:%lu] type(%i) Exp: (%lu) Now: (%lu)",
+         pCold->xid.objSerial, pCold->xid.objSlot, pJob->state, pJob->expires, now);
+
+   // Put the old job in a purgable state; it is released on the next pass,
+   // once the timer has reported it to Nagios
+   pJob->state = DNX_JOB_EXPIRED;
+   dnxJobWheelRemove(ilist, slot);
+   dnxJobQueueAppend(ilist, DNX_JQ_CLEANUP, slot);
+}
+
+//----------------------------------------------------------------------------
+
+/** Choose the priority lane from which the next new job is dispatched.
+ * 
+ * Uses smooth weighted round robin: every lane with jobs waiting earns its
+ * weight in credit, the lane with the most credit is chosen and pays the 
+ * total weight of the waiting lanes. Ties go to the more urgent lane. The
+ * caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be examined.
+ *
+ * @return The lane to dispatch from, or -1 if no new jobs are waiting.
+ */
+static int dnxJobLaneNext(iDnxJobList * ilist)
+{
+   long total = 0;
+   int lane, best = -1;
+
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++) {
+      if (!ilist->queues[DNX_JQ_DISPATCH + lane].count) {
+         ilist->laneCredit[lane] = 0;
+         continue;
+      }
+      ilist->laneCredit[lane] += ilist->laneWeight[lane];
+      total += ilist->laneWeight[lane];
+      if (best < 0 || ilist->laneCredit[lane] > ilist->laneCredit[best])
+         best = lane;
+   }
+   if (best >= 0)
+      ilist->laneCredit[best] -= total;
+
+   return best;
+}
+
+//----------------------------------------------------------------------------
+
+/** Wake a dispatcher thread if one is waiting for work.
+ * 
+ * The wake semaphore is only posted if it isn't already, so a burst of new 
+ * jobs wakes one dispatcher thread; see dnxJobListHasWork for how others 
+ * follow it. This never blocks, so it may be called with or without the 
+ * list mutex held.
+ *
+ * @param[in] ilist - the job list whose dispatcher should be woken.
+ */
+static void dnxJobListWake(iDnxJobList * ilist)
+{
+   int posted;
+
+   if (sem_getvalue(&ilist->wake, &posted) != 0 || posted <= 0)
+      sem_post(&ilist->wake);
+}
+
+//----------------------------------------------------------------------------
+
+/** Determine whether a job list has work waiting for a dispatcher thread.
+ * 
+ * A dispatcher thread that takes a job while there is more work waiting 
+ * wakes another, so a burst that woke one thread spreads to as many as
+ * it keeps busy. The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be examined.
+ *
+ * @return Non-zero if there are jobs to be stored, sent or acked, or zero.
+ */
+static int dnxJobListHasWork(iDnxJobList * ilist)
+{
+   int lane;
+
+   if (ilist->intake || ilist->queues[DNX_JQ_ACK].count)
+      return 1;
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++)
+      if (ilist->queues[DNX_JQ_DISPATCH + lane].count)
+         return 1;
+   return 0;
+}
+
+//----------------------------------------------------------------------------
+
+/** Try to get a worker for an Unbound job.
+ * 
+ * On success, the job is Pending in its lane's dispatch queue and the 
+ * dispatcher is woken; otherwise it's left where it is. The caller must 
+ * hold the list mutex.
+ *
+ * @param[in] ilist - the job list containing @p slot.
+ * @param[in] slot - the slot index of the Unbound job.
+ * @param[in] now - the current time.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxJobBind(iDnxJobList * ilist, unsigned long slot, time_t now)
+{
+   iDnxJobHot * pJob = dnxJobHotAt(ilist, slot);
+   iDnxJobCold * pCold = dnxJobColdAt(ilist, slot);
+   int ret;
+
+   if ((ret = dnxGetNodeRequest(dnxGetRegistrar(), &pCold->pNode, 
+         ilist->laneReserve[pJob->priority])) != DNX_OK) {
+      dnxDebug(6, "dnxJobBind: Unable to dequeue DNX_JOB_UNBOUND job [%lu:%lu] Now: (%lu) count(%lu)", 
+         pCold->xid.objSerial, pCold->xid.objSlot, now, slot);
+      return ret;
+   }
+
+   // the job now has a client, so it's due by the client's offer
+   pJob->offerExpires = pCold->pNode->expires;
+   dnxDebug(2, "dnxJobBind: Dequeueing DNX_JOB_UNBOUND job [%lu:%lu] Now: (%lu) count(%lu)", 
+      pCold->xid.objSerial, pCold->xid.objSlot, now, slot);
+   pJob->state = DNX_JOB_PENDING;
+   dnxJobWheelInsert(ilist, slot);
+   dnxJobQueueAppend(ilist, DNX_JQ_DISPATCH + pJob->priority, slot);
+   dnxJobListWake(ilist);  // signal that a new job is available
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the runtime table entry for a command's plugin.
+ * 
+ * Runtimes are kept per plugin, the first word of the command line, so 
+ * that every check run by the same plugin adds to the same average.
+ *
+ * @param[in] ilist - the job list whose runtime table is to be indexed.
+ * @param[in] cmd - the command line; may be null.
+ * @param[out] pHash - the address of storage for the plugin name hash.
+ *
+ * @return The table entry that holds, or would hold, the plugin's runtime.
+ */
+static iDnxJobRuntime * dnxJobRuntimeAt(iDnxJobList * ilist, char * cmd, 
+      unsigned long * pHash)
+{
+   unsigned long hash = 2166136261UL;  // FNV-1a
+
+   for (; cmd && *cmd && *cmd != ' ' && *cmd != '\t'; cmd++)
+      hash = (hash ^ (unsigned char)*cmd) * 16777619UL;
+   *pHash = hash ? hash : 1;
+
+   return &ilist->runtimes[(hash ^ (hash >> 16)) & (DNX_JOBLIST_RUNTIMES - 1)];
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the expected runtime of a command, from the runtimes observed.
+ * 
+ * @param[in] ilist - the job list whose runtime table is to be used.
+ * @param[in] cmd - the command line; may be null.
+ *
+ * @return The expected runtime in seconds, rounded up; zero for plugins 
+ *    that haven't been seen yet.
+ */
+static time_t dnxJobRuntimeEstimate(iDnxJobList * ilist, char * cmd)
+{
+   unsigned long hash;
+   iDnxJobRuntime * pRun = dnxJobRuntimeAt(ilist, cmd, &hash);
+
+   if (pRun->hash != hash)
+      return 0;
+   return (pRun->avg + DNX_RUNTIME_SCALE - 1) / DNX_RUNTIME_SCALE;
+}
+
+//----------------------------------------------------------------------------
+
+/** Add a command's observed runtime to the runtime table.
+ * 
+ * Keeps an exponential moving average that gives a quarter of the weight
+ * to the newest sample. A plugin whose hash collides with another's takes
+ * over the table entry.
+ *
+ * @param[in] ilist - the job list whose runtime table is to be updated.
+ * @param[in] cmd - the command line; may be null.
+ * @param[in] delta - the observed runtime in seconds.
+ */
+static void dnxJobRuntimeRecord(iDnxJobList * ilist, char * cmd, unsigned delta)
+{
+   unsigned long hash;
+   iDnxJobRuntime * pRun = dnxJobRuntimeAt(ilist, cmd, &hash);
+   long sample = (long)delta * DNX_RUNTIME_SCALE;
+
+   if (pRun->hash != hash) {
+      pRun->hash = hash;
+      pRun->avg = (unsigned)sample;
+   } else
+      pRun->avg = (unsigned)((long)pRun->avg + (sample - (long)pRun->avg) / 4);
+}
+
+//----------------------------------------------------------------------------
+
+/** Store a job in a free job list slot.
+ * 
+ * The caller must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to which @p pJob should be added.
+ * @param[in] pJob - the job to be stored; its XID objSlot is updated.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxJobListInsert(iDnxJobList * ilist, DnxNewJob * pJob)
+{
+   unsigned long slot, generation;
+   int ret;
+
+   // grow the list if we're out of free slots
+   if (!ilist->queues[DNX_JQ_FREE].count && (ret = dnxJobListGrow(ilist)) == DNX_OK)
+      dnxLog("dnxJobListInsert: Job list grown to %lu slots.", ilist->size);
+
+   // take the oldest free slot, so a recycled slot stays idle for as long 
+   // as possible before it's used again
+   if ((slot = dnxJobQueuePop(ilist, DNX_JQ_FREE)) == DNX_JOBLIST_NIL)
+      return DNX_ERR_MEMORY;
+
+   // add the slot index to the Job's XID - this allows us to index 
+   //    the job list using the returned result's XID.objSlot field; the
+   //    slot's previous XID is still in place, so bump its generation
+   generation = ((dnxJobColdAt(ilist, slot)->xid.objSlot >> DNX_JOBLIST_SLOT_BITS) + 1)
+         & DNX_JOBLIST_GEN_MASK;
+   if (generation > ilist->generation)
+      ilist->generation = generation;
+   pJob->xid.objSlot = (generation << DNX_JOBLIST_SLOT_BITS) | slot;
+
+   // add this job to the job list
+   if (dnxJobStore(ilist, slot, pJob) != DNX_OK) {
+      dnxJobQueueAppend(ilist, DNX_JQ_FREE, slot);
+      return DNX_ERR_MEMORY;
+   }
+   pJob->cmd = dnxJobColdAt(ilist, slot)->cmd;
+
+   // the job must start by this time for its result to be back before it
+   // expires, if it takes as long as its plugin usually does
+   dnxJobHotAt(ilist, slot)->due = pJob->expires 
+         - dnxJobRuntimeEstimate(ilist, pJob->cmd);
+
+   dnxAuditJob(pJob, "ASSIGN");
+
+   ilist->segs[slot >> DNX_JOBLIST_SEG_BITS]->used++;
+   if (ilist->size - ilist->queues[DNX_JQ_FREE].count > ilist->highWater)
+      ilist->highWater = ilist->size - ilist->queues[DNX_JQ_FREE].count;
+
+   dnxDebug(1, "dnxJobListInsert: Job [%lu:%lu]: Slot=%lu, Free=%lu.", 
+         pJob->xid.objSerial, pJob->xid.objSlot, slot, 
+         ilist->queues[DNX_JQ_FREE].count);
+
+   dnxJobWheelInsert(ilist, slot);
+   if (pJob->state == DNX_JOB_PENDING)
+      dnxJobQueueAppend(ilist, DNX_JQ_DISPATCH + pJob->priority, slot);
+   else {
+      // queued before it's uncounted, so dnxJobListBind always sees it
+      dnxJobQueueAppend(ilist, DNX_JQ_UNBOUND + pJob->priority, slot);
+      __sync_fetch_and_sub(&ilist->unboundAdded, 1);
+   }
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Give slots to the jobs passed in by dnxJobListAdd.
+ * 
+ * Jobs are taken from the intake chain in the order they were added. A job
+ * that can't be stored (the slot segment couldn't be allocated) stays in 
+ * the backlog, with the jobs after it, until the next drain. The caller 
+ * must hold the list mutex.
+ *
+ * @param[in] ilist - the job list to be drained.
+ */
+static void dnxJobListDrain(iDnxJobList * ilist)
+{
+   iDnxJobIntake * pChain, * pFirst, * pNext, * pRev = 0;
+   int ret;
+
+   // detach the whole intake chain; with a single consumer at a time (we 
+   // hold the mutex) taking everything can't suffer from ABA problems
+   do 
+      pChain = ilist->intake;
+   while (pChain && !__sync_bool_compare_and_swap(&ilist->intake, pChain, 0));
+
+   // the chain is newest first, so reverse it onto the end of the backlog
+   for (pFirst = pChain; pChain; pChain = pNext) {
+      pNext = pChain->next;
+      pChain->next = pRev;
+      pRev = pChain;
+   }
+   if (pRev) {
+      if (ilist->backlog)
+         ilist->backlogTail->next = pRev;
+      else
+         ilist->backlog = pRev;
+      ilist->backlogTail = pFirst;
+   }
+
+   while ((pChain = ilist->backlog) != 0) {
+      if ((ret = dnxJobListInsert(ilist, &pChain->job)) != DNX_OK) {
+         dnxLog("dnxJobListDrain: Unable to store Job [%lu]: %s.", 
+               pChain->job.xid.objSerial, dnxErrorString(ret));
+         break;
+      }
+      ilist->backlog = pChain->next;
+      xfree(pChain);
+   }
+}
+
 /*--------------------------------------------------------------------------
                                  INTERFACE
   --------------------------------------------------------------------------*/
 
 int dnxJobListAdd(DnxJobList * pJobList, DnxNewJob * pJob) {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
-   unsigned long tail;
-   int ret = DNX_OK;
+   iDnxJobIntake * pNew;
+   unsigned long count;
+   size_t len, hostLen, svcLen;
 
    assert(pJobList && pJob);
 
-   DNX_PT_MUTEX_LOCK(&ilist->mut);
-
-   tail = ilist->tail;
-
-   // verify space in the job list, this keeps a single empty buffer element to 
-   // protect us from not knowing a full ring from an empty one
-   if (ilist->list[tail].state && (tail = (tail + 1) % ilist->size) == ilist->head) {
-      dnxLog("dnxJobListAdd: Out of job slots (max=%lu): %s.", 
-            ilist->size, pJob->cmd);
-      dnxDebug(1, "dnxJobListAdd: Out of job slots (max=%lu): %s.", 
-            ilist->size, pJob->cmd);
-     ret = DNX_ERR_CAPACITY;
-   } else {
-      // add the slot index to the Job's XID - this allows us to index 
-      //    the job list using the returned result's XID.objSlot field
-      pJob->xid.objSlot = tail;
-      // We were unable to get an available dnxClient job request so we
-      // put the job into the queue anyway and have the timer thread try 
-      // and find a dnxClient for it later
-      if (pJob->pNode->xid.objSlot == -1) {
-         pJob->state = DNX_JOB_UNBOUND;
-      } else {
-         pJob->state = DNX_JOB_PENDING;
+   // reserve room for the job; slots are only released by the timer, so 
+   // the list can always find a slot for every job counted here
+   do {
+      if ((count = ilist->jobCount) >= ilist->maxSize) {
+         dnxLog("dnxJobListAdd: Out of job slots (max=%lu): %s.", 
+               ilist->maxSize, pJob->cmd);
+         dnxDebug(1, "dnxJobListAdd: Out of job slots (max=%lu): %s.", 
+               ilist->maxSize, pJob->cmd);
+         return DNX_ERR_CAPACITY;
       }
-      
-      dnxAuditJob(pJob, "ASSIGN");
-      
-      // add this job to the job list
-      memcpy(&ilist->list[tail], pJob, sizeof *pJob);
-      
-      ilist->tail = tail;
-   
-      dnxDebug(1, "dnxJobListAdd: Job [%lu:%lu]: Head=%lu, Tail=%lu.", 
-            pJob->xid.objSerial, pJob->xid.objSlot, ilist->head, ilist->tail);
-      
-      if(pJob->state == DNX_JOB_PENDING) {
-         pthread_cond_signal(&ilist->cond);  // signal that a new job is available
-      }         
+   } while (!__sync_bool_compare_and_swap(&ilist->jobCount, count, count + 1));
+
+   // the command line and names are copied along with the job, in the 
+   // same block, as Nagios may free its copies before the job is done
+   len = pJob->cmd ? strlen(pJob->cmd) + 1 : 0;
+   hostLen = pJob->host_name ? strlen(pJob->host_name) + 1 : 0;
+   svcLen = pJob->service_description ? strlen(pJob->service_description) + 1 : 0;
+   if ((pNew = (iDnxJobIntake *)xmalloc(sizeof *pNew + len + hostLen + svcLen)) == 0) {
+      __sync_fetch_and_sub(&ilist->jobCount, 1);
+      return DNX_ERR_MEMORY;
    }
 
-   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+   // We were unable to get an available dnxClient job request so we
+   // put the job into the queue anyway and have the timer thread try 
+   // and find a dnxClient for it later
+   if (pJob->pNode->xid.objSlot == -1) {
+      pJob->state = DNX_JOB_UNBOUND;
+   } else {
+      pJob->state = DNX_JOB_PENDING;
+   }
+   if (pJob->priority < 0 || pJob->priority >= DNX_PRIORITY_MAX)
+      pJob->priority = DNX_PRIORITY_SCHEDULED;
+   memcpy(&pNew->job, pJob, sizeof *pJob);
+   if (pJob->cmd)
+      pNew->job.cmd = memcpy(pNew->cmd, pJob->cmd, len);
+   if (pJob->host_name)
+      pNew->job.host_name = memcpy(pNew->cmd + len, pJob->host_name, hostLen);
+   if (pJob->service_description)
+      pNew->job.service_description = memcpy(pNew->cmd + len + hostLen, 
+            pJob->service_description, svcLen);
+
+   // push the job onto the intake chain for the dispatcher or timer to 
+   // store; this is the only part of the job list Nagios ever waits for
+   if (pJob->state == DNX_JOB_UNBOUND)
+      __sync_fetch_and_add(&ilist->unboundAdded, 1);
+   do
+      pNew->next = ilist->intake;
+   while (!__sync_bool_compare_and_swap(&ilist->intake, pNew->next, pNew));
+
+   if (pJob->state == DNX_JOB_PENDING)
+      dnxJobListWake(ilist);  // signal that a new job is available
 
-   return ret;
+   return DNX_OK;
 }
 
 int dnxJobListMarkAck(DnxJobList * pJobList, DnxResult * pRes) {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   DnxNewJob job;
    assert(pJobList && pRes);   // parameter validation
    time_t now = time(0);
    int ret = DNX_ERR_NOTFOUND;
    dnxDebug(4, "dnxJobListMarkAck: Job [%lu:%lu] serial (%lu) slot (%lu) latency (%lu) sec.", 
         pRes->xid.objSerial, pRes->xid.objSlot, pRes->xid.objSerial, pRes->xid.objSlot, (now - pRes->timestamp));
-   unsigned long current = pRes->xid.objSlot;
+   unsigned long current = dnxJobListSlot(ilist, &pRes->xid);
+
+   if (current == DNX_JOBLIST_NIL)
+      return DNX_ERR_NOTFOUND;
 
    DNX_PT_MUTEX_LOCK(&ilist->mut);
-   if (dnxEqualXIDs(&(pRes->xid), &ilist->list[current].xid)) {
-      if(ilist->list[current].state == DNX_JOB_PENDING || ilist->list[current].state == DNX_JOB_UNBOUND) {
-         ilist->list[current].state = DNX_JOB_INPROGRESS;
-         dnxAuditJob(&(ilist->list[current]), "ACK");
+   if (dnxEqualXIDs(&(pRes->xid), &dnxJobColdAt(ilist, current)->xid)) {
+      if(dnxJobHotAt(ilist, current)->state == DNX_JOB_PENDING || dnxJobHotAt(ilist, current)->state == DNX_JOB_UNBOUND) {
+         dnxJobHotAt(ilist, current)->state = DNX_JOB_INPROGRESS;
+         dnxJobQueueUnlink(ilist, current);
+         dnxJobWheelInsert(ilist, current);
+         dnxJobLoad(ilist, current, &job);
+         dnxAuditJob(&job, "ACK");
          ret = DNX_OK;
       }
    }
@@ -131,17 +1307,24 @@ int dnxJobListMarkAck(DnxJobList * pJobList, DnxResult * pRes) {
 
 int dnxJobListMarkAckSent(DnxJobList * pJobList, DnxXID * pXid) {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   DnxNewJob job;
    assert(pJobList && pXid);   // parameter validation
    int ret = DNX_ERR_NOTFOUND;
    dnxDebug(4, "dnxJobListMarkAckSent: Job [%lu:%lu]", 
         pXid->objSerial, pXid->objSlot);
-   unsigned long current = pXid->objSlot;
+   unsigned long current = dnxJobListSlot(ilist, pXid);
+
+   if (current == DNX_JOBLIST_NIL)
+      return DNX_ERR_NOTFOUND;
 
    DNX_PT_MUTEX_LOCK(&ilist->mut);
-   if (dnxEqualXIDs(pXid, &ilist->list[current].xid)) {
-      if(ilist->list[current].state == DNX_JOB_RECEIVED || ilist->list[current].state == DNX_JOB_COMPLETE) {
-         ilist->list[current].ack = 1;
-         dnxAuditJob(&(ilist->list[current]), "CONFIRMED");
+   if (dnxEqualXIDs(pXid, &dnxJobColdAt(ilist, current)->xid)) {
+      if(dnxJobHotAt(ilist, current)->state == DNX_JOB_RECEIVED || dnxJobHotAt(ilist, current)->state == DNX_JOB_COMPLETE) {
+         dnxJobHotAt(ilist, current)->ack = 1;
+         if(dnxJobHotAt(ilist, current)->state == DNX_JOB_COMPLETE)
+            dnxJobQueueAppend(ilist, DNX_JQ_CLEANUP, current);
+         dnxJobLoad(ilist, current, &job);
+         dnxAuditJob(&job, "CONFIRMED");
          ret = DNX_OK;
       }
    }
@@ -155,12 +1338,17 @@ int dnxJobListMarkComplete(DnxJobList * pJobList, DnxXID * pXid) {
    int ret = DNX_ERR_NOTFOUND;
    dnxDebug(4, "dnxJobListMarkComplete: Job [%lu:%lu]", 
         pXid->objSerial, pXid->objSlot);
-   unsigned long current = pXid->objSlot;
+   unsigned long current = dnxJobListSlot(ilist, pXid);
+
+   if (current == DNX_JOBLIST_NIL)
+      return DNX_ERR_NOTFOUND;
 
    DNX_PT_MUTEX_LOCK(&ilist->mut);
-   if (dnxEqualXIDs(pXid, &ilist->list[current].xid)) {
-      if(ilist->list[current].state == DNX_JOB_RECEIVED) {
-         ilist->list[current].state = DNX_JOB_COMPLETE;
+   if (dnxEqualXIDs(pXid, &dnxJobColdAt(ilist, current)->xid)) {
+      if(dnxJobHotAt(ilist, current)->state == DNX_JOB_RECEIVED) {
+         dnxJobHotAt(ilist, current)->state = DNX_JOB_COMPLETE;
+         if(dnxJobHotAt(ilist, current)->ack)
+            dnxJobQueueAppend(ilist, DNX_JQ_CLEANUP, current);
          ret = DNX_OK;
       }
    }
@@ -172,9 +1360,12 @@ int dnxJobListMarkComplete(DnxJobList * pJobList, DnxXID * pXid) {
 
 int dnxJobListExpire(DnxJobList * pJobList, DnxNewJob * pExpiredJobs, int * totalJobs) {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
-   unsigned long current;
-   DnxNewJob * pJob;
+   unsigned long current, next, count;
+   iDnxJobQueue * bucket;
+   iDnxJobCold * pCold;
+   DnxNewJob job;
    int jobCount = 0;
+   int level, lane;
    time_t now;
 
    assert(pJobList && pExpiredJobs && totalJobs && *totalJobs > 0);
@@ -184,93 +1375,67 @@ int dnxJobListExpire(DnxJobList * pJobList, DnxNewJob * pExpiredJobs, int * tota
    // get the current time (after we acquire the lock! In case we had to wait)
    now = time(0);
 
-   // walk the entire job list - InProgress and Pending jobs (in that order)
-   current = ilist->head;
-   int zero_factor = ilist->size - current; // add this value to normalize the index
-   dnxDebug(6, "dnxJobListExpire: searching for (%i) expired objects. Head(%lu) Tail(%i)", *totalJobs, ilist->head, ilist->tail);
-   int state = 0;
-   while(jobCount < *totalJobs) {
-      state = (pJob = &ilist->list[current])->state;
-      unsigned long dispatch_timeout = now - DNX_DISPATCH_TIMEOUT;
-
-      // only examine jobs that are either awaiting dispatch or results
-      switch (state) {
-         case DNX_JOB_UNBOUND:
-            if(pJob->start_time <= dispatch_timeout) {
-               dnxDebug(2, "dnxJobListExpire: Expiring Unbound %s Job [%lu:%lu] count(%i) type(%i) Start Time: (%lu) Now: (%lu) Expire: (%lu)",
-                  (pJob->object_check_type ? "Host" : "Service"),  pJob->xid.objSerial, pJob->xid.objSlot, current, state, pJob->start_time, now, dispatch_timeout);               
-               // Put the old job in a purgable state   
-               pJob->state = DNX_JOB_EXPIRED;
-               
-               // Add a copy to the expired job list
-               memcpy(&pExpiredJobs[jobCount++], pJob, sizeof(DnxNewJob));    
-            } else {
-               // If there is a client associated with it, xid.objSlot != -1
-               // then it means we may be getting a result coming back to us
-            
-               // This job has not expired, try and get a dnxClient for it
-               if (dnxGetNodeRequest(dnxGetRegistrar(), &(pJob->pNode)) == DNX_OK) { 
-                  // If OK we have successfully dispatched it so update it's expiration
-                  dnxDebug(2, "dnxJobListExpire: Dequeueing DNX_JOB_UNBOUND job [%lu:%lu] Expires in (%i) seconds. Dispatch TO:(%i) Now: (%lu) count(%i) type(%i)", 
-                     pJob->xid.objSerial, pJob->xid.objSlot, pJob->start_time - dispatch_timeout, dispatch_timeout, now, current, state);
-                  pJob->state = DNX_JOB_PENDING;
-                  pthread_cond_signal(&ilist->cond);  // signal that a new job is available
-               } else {
-                  dnxDebug(6, "dnxJobListExpire: Unable to dequeue DNX_JOB_UNBOUND job [%lu:%lu] Expires in (%i) seconds. Dispatch TO:(%i) Now: (%lu) count(%i) type(%i)", 
-                     pJob->xid.objSerial, pJob->xid.objSlot, pJob->start_time - dispatch_timeout, dispatch_timeout, now, current, state);
-               }
-            }
-            break;
-         case DNX_JOB_PENDING:
-         case DNX_JOB_INPROGRESS:
-            // check the job's expiration stamp
-            if (pJob->expires <= now) { //  
-               // This is an expired job, it was sent out, but never came back
-               dnxDebug(1, "dnxJobListExpire: Expiring Job [%lu:%lu] count(%i) type(%i) Exp: (%lu) Now: (%lu)",
-                  pJob->xid.objSerial, pJob->xid.objSlot, current, state, pJob->expires, now);               
-               // Put the old job in a purgable state   
-               pJob->state = DNX_JOB_EXPIRED;
-               // Add a copy to the expired job list
-               memcpy(&pExpiredJobs[jobCount++], pJob, sizeof(DnxNewJob));
-            } 
-            break;
-         case DNX_JOB_COMPLETE:
-            // If the Ack hasn't been sent out yet, give it time to complete
-            if(! pJob->ack) {
-               dnxDebug(3, "dnxJobListExpire: Waiting to send Ack. count(%i) type(%i)", current, state);
-               break;
-            }
-         case DNX_JOB_EXPIRED:
-            dnxJobCleanup(pJob);
-            dnxDebug(3, "dnxJobListExpire: Nullified Job. count(%i) type(%i)", current, state);
-         case DNX_JOB_NULL:
-            if(current == ilist->head && current != ilist->tail) {
-               ilist->head = ((current + 1) % ilist->size);
-               dnxDebug(2, "dnxJobListExpire: Moving head to (%i). count(%i) type(%i)", ilist->head, current, pJob->state);
-               // we have an old item at the head of the list, so we need to
-               // increment the head. It should never be larger than the tail.
-            } else {
-               dnxDebug(5, "dnxJobListExpire: Null Job. count(%i) type(%i)", current, pJob->state);
-            }
-            break;
-         case DNX_JOB_RECEIVED:
-            if(! pJob->ack) {
-               dnxDebug(3, "dnxJobListExpire: Waiting to send Ack. job [%lu:%lu] count(%i) type(%i)", current, state);
-            } else {
-               dnxDebug(2, "dnxJobListExpire: Ack sent. job [%lu:%lu] count(%i) type(%i)", current, state);
-            }
-            // The Collector thread will set this to DNX_JOB_COMPLETE once it has 
-            // replied to Nagios, but we don't advance the head until that happens
-            break;
-      }
+   dnxDebug(6, "dnxJobListExpire: searching for (%i) expired objects. Free(%lu)", 
+         *totalJobs, ilist->queues[DNX_JQ_FREE].count);
+
+   // release jobs that were expired on the last pass, or completed and Acked,
+   // and return their slots to the free list
+   while ((current = dnxJobQueuePop(ilist, DNX_JQ_CLEANUP)) != DNX_JOBLIST_NIL) {
+      dnxJobWheelRemove(ilist, current);
+      dnxJobLoad(ilist, current, &job);
+      dnxJobCleanup(&job);
+      // keep the XID; its generation is bumped when the slot is reused
+      pCold = dnxJobColdAt(ilist, current);
+      pCold->host_name = pCold->service_description = 0;
+      pCold->pNode = 0;
+      dnxJobHotAt(ilist, current)->state = DNX_JOB_NULL;
+      ilist->segs[current >> DNX_JOBLIST_SEG_BITS]->used--;
+      dnxJobQueueAppend(ilist, DNX_JQ_FREE, current);
+      __sync_fetch_and_sub(&ilist->jobCount, 1);
+      dnxDebug(3, "dnxJobListExpire: Nullified Job. count(%lu)", current);
+   }
 
-      // bail-out if this was the job list tail
-      if (current == ilist->tail) {
-         break;
+   // give back memory from a burst once it has passed
+   dnxJobListShrink(ilist);
+
+   // store new jobs, so that they're on the wheel before it's turned
+   dnxJobListDrain(ilist);
+
+   // turn the wheel up to the current second, expiring every job in each 
+   // one second bucket that has reached its deadline
+   while (ilist->wheelTime <= now && jobCount < *totalJobs) {
+      for (level = DNX_WHEEL_LEVELS - 1; level > 0; level--)
+         if ((ilist->wheelTime & (((time_t)1 << (DNX_WHEEL_BITS * level)) - 1)) == 0)
+            dnxJobWheelCascade(ilist, level);
+
+      bucket = &ilist->wheel[1 + (ilist->wheelTime & DNX_WHEEL_MASK)];
+      for (count = bucket->count; count && jobCount < *totalJobs; count--) {
+         current = bucket->head;
+         if (dnxJobDeadline(dnxJobHotAt(ilist, current)) > now) {
+            dnxJobWheelInsert(ilist, current);  // not due yet
+            continue;
+         }
+         dnxJobExpireSlot(ilist, current, now);
+         // Add a copy to the expired job list
+         dnxJobLoad(ilist, current, &pExpiredJobs[jobCount++]);
       }
-      // increment the job list index
-      current = ((current + 1) % ilist->size);
+      if (count == 0)
+         ilist->wheelTime++;
    }
+
+   // try and get a dnxClient for each job that still doesn't have one, 
+   // most urgent lane first; jobs that don't get one keep their place
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++)
+   for (current = ilist->queues[DNX_JQ_UNBOUND + lane].head; 
+         current != DNX_JOBLIST_NIL; current = next) {
+      next = dnxJobLinkAt(ilist, DNX_JL_ACTION, current)->next;
+      dnxJobBind(ilist, current, now);
+   }
+
+   // let the timer sleep until the next job is due
+   ilist->wakeup = dnxJobWheelNext(ilist);
+   if (ilist->timer)
+      dnxTimerWakeAt(ilist->timer, ilist->wakeup);
       
    // update the total jobs in the expired job list
    *totalJobs = jobCount;
@@ -278,193 +1443,282 @@ int dnxJobListExpire(DnxJobList * pJobList, DnxNewJob * pExpiredJobs, int * tota
 
    return DNX_OK;
 }
-   
 
 //----------------------------------------------------------------------------
 
-int dnxJobListDispatch(DnxJobList * pJobList, DnxNewJob * pJob)
+int dnxJobListBind(DnxJobList * pJobList, DnxAffinity flags)
 {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
-   unsigned long current;
-   int ret = DNX_OK; //DNX_ERR_TIMEOUT;
-   struct timeval now;
-   struct timespec timeout;
+   unsigned long current, scanned;
+   int lane, ret = DNX_ERR_NOTFOUND;
 
-   assert(pJobList && pJob);
+   assert(pJobList);
+
+   // most registrations find nothing waiting, so check before locking; an
+   // added job is counted until it's queued, so none can be missed
+   if (!ilist->unboundAdded) {
+      for (lane = 0; lane < DNX_PRIORITY_MAX; lane++)
+         if (ilist->queues[DNX_JQ_UNBOUND + lane].count)
+            break;
+      if (lane == DNX_PRIORITY_MAX)
+         return DNX_ERR_NOTFOUND;
+   }
 
    DNX_PT_MUTEX_LOCK(&ilist->mut);
 
+   dnxJobListDrain(ilist);
+
+   // the oldest job the worker can run, most urgent lane first; if it can't
+   // be bound, the worker is reserved for more urgent lanes (or was taken),
+   // and no later job could have it either
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++) {
+      current = ilist->queues[DNX_JQ_UNBOUND + lane].head;
+      for (scanned = 1; current != DNX_JOBLIST_NIL 
+            && !dnxAffinityIntersects(dnxJobColdAt(ilist, current)->pNode->flags, flags); 
+            scanned++)
+         current = scanned < DNX_JOBLIST_BIND_SCAN 
+               ? dnxJobLinkAt(ilist, DNX_JL_ACTION, current)->next 
+               : DNX_JOBLIST_NIL;
+      if (current != DNX_JOBLIST_NIL) {
+         ret = dnxJobBind(ilist, current, time(0));
+         break;
+      }
+   }
+
+   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+
+   return ret;
+}
 
-   // start at current head
-   current = ilist->head;
+//----------------------------------------------------------------------------
 
-   dnxDebug(6, "dnxJobListDispatch: BEFORE: Head=%lu, Tail=%lu, Queue=%lu.", 
-       ilist->head, ilist->tail, ilist->size);
+/** Take the next job needing dispatcher action from a job list.
+ * 
+ * Received jobs needing an Ack come first, then new jobs from the priority
+ * lanes. Retries that have come due on the way are requeued or resubmitted.
+ * The job list mutex must be held.
+ * 
+ * @param[in] ilist - the job list from which to take a job.
+ * @param[out] pJob - the address of storage in which to return a copy of the
+ *    job to be dispatched.
+ * @param[in] now - the current time.
+ * 
+ * @return Non-zero if a job was returned in @p pJob, or zero if there is 
+ *    nothing to dispatch.
+ */
+static int dnxJobListTake(iDnxJobList * ilist, DnxNewJob * pJob, time_t now)
+{
+   unsigned long current;
+   iDnxJobHot * pSlot;
+   iDnxJobCold * pCold;
+   int lane;
 
    while (1) {
- 
-      switch (ilist->list[current].state) {
-         case DNX_JOB_INPROGRESS:
-            dnxDebug(8, "dnxJobListDispatch: In Progress Item in slot:(%lu) head:(%lu) tail:(%lu).", 
-               current, ilist->head, ilist->tail);
-            break;
-         case DNX_JOB_NULL:
-            dnxDebug(8, "dnxJobListDispatch: Null Item in slot:(%lu) head:(%lu) tail:(%lu).", 
-               current, ilist->head, ilist->tail);
-            break;
-         case DNX_JOB_EXPIRED:
-            dnxDebug(8, "dnxJobListDispatch: Expired Item in slot:(%lu) head:(%lu) tail:(%lu).", 
-               current, ilist->head, ilist->tail);
-            break;
-         case DNX_JOB_UNBOUND:
-            dnxDebug(8, "dnxJobListDispatch: Unbound Item in slot:(%lu) head:(%lu) tail:(%lu).", 
-               current, ilist->head, ilist->tail);
-            break;
-         case DNX_JOB_PENDING:
-            gettimeofday(&now, 0);
-
-            // Check to see if we have recently dispatched this
-            if((ilist->list[current].pNode)->retry > now.tv_sec) {
-               dnxDebug(5, "dnxJobListDispatch: Pending job [%lu:%lu] waiting for Ack, resend in (%i) sec.",
-                  ilist->list[current].xid.objSerial, ilist->list[current].xid.objSlot, ((ilist->list[current].pNode)->retry - now.tv_sec));
-               break;
-            } else {
-                if((ilist->list[current].pNode)->retry) {
-                  // Make sure the dnxClient service offer is still fresh
-                  if((ilist->list[current].pNode)->expires < now.tv_sec) {
-                     dnxDebug(4, "dnxJobListDispatch: Pending job [%lu:%lu] waiting for Ack, client node expired. Resubmitting.",
-                     ilist->list[current].xid.objSerial, ilist->list[current].xid.objSlot);
-                     ilist->list[current].state = DNX_JOB_UNBOUND;
-                     
-                     // reset the node?
-                     // It's likely that the same client will be servicing us
-                     // or that the job might come back in the mean time, so we
-                     // should keep this node as long as possible
-                     // We just need to make sure that the Affinity is correct and that 
-                     // it's only used to find a new node, so if we get as far as 
-                     // resubmitting, we will have a valid node anyway
-                     
-                     // If the original job comes back, the acks will get all messed up
-                     // not sure how to deal with that other than to just be graceful
-                     // about receiving lots of results...
-                   
-                     
-//                      dnxDeleteNodeReq(ilist->list[current].pNode);
-//                      DnxNodeRequest * pNode = dnxCreateNodeReq();
-                     ilist->list[current].pNode->flags = *(dnxGetAffinity(ilist->list[current].host_name));
-//                      ilist->list[current].pNode->hn = xstrdup(ilist->list[current].host_name);
-//                      ilist->list[current].pNode->addr = NULL;
-
-                     // We should leave the address alone so we don't segfault if results come in late
-                     // but should we reset these? 
-//                      ilist->list[current].pNode->xid.objSlot = -1;
-//                      ilist->list[current].pNode->xid.objSerial = ilist->list[current].xid.objSerial;
-//                      ilist->list[current].pNode = pNode;
-                  }
-                  break;                  
-               } else {
-                  // This is a new job, so dispatch it
-                  dnxDebug(4, "dnxJobListDispatch: Dispatching new job [%lu:%lu] waiting for Ack",
-                     ilist->list[current].xid.objSerial, ilist->list[current].xid.objSlot);
-               }
-            }
-            
-            // set our retry interval
-            // This should be fairly forgiving in case we just missed the Ack but it actually
-            // got the job and is returning our results.
-            (ilist->list[current].pNode)->retry = now.tv_sec + 5; 
-            
+      // store any jobs added since we last looked
+      dnxJobListDrain(ilist);
+
+      // This is a job that we have received the response for and we need to 
+      // send an ack to the client to let it know we got it
+      if ((current = dnxJobQueuePop(ilist, DNX_JQ_ACK)) != DNX_JOBLIST_NIL) {
+         pSlot = dnxJobHotAt(ilist, current);
+         if (pSlot->ack) {
+            // Only send a single Ack
+            continue;
+         }
+         // make a copy for the Dispatcher to send an Ack to the client
+         dnxJobLoad(ilist, current, pJob);
          
-            // make a copy for the Dispatcher to send to client
-            memcpy(pJob, &ilist->list[current], sizeof *pJob);
-            
-            // release the mutex
-            DNX_PT_MUTEX_UNLOCK(&ilist->mut);
-            return ret;
-         case DNX_JOB_COMPLETE:
-         case DNX_JOB_RECEIVED:
-            // This is a job that we have received the response and we need to send an ack to
-            // the client to let it know we got it
-            if(ilist->list[current].ack) {
-               // Only send a single Ack
-               break;
-            }
-            // make a copy for the Dispatcher to send an Ack to the client
-            memcpy(pJob, &ilist->list[current], sizeof *pJob);
-            
-            dnxDebug(4, "dnxJobListDispatch: Received job [%lu:%lu] sending Ack.",
-               ilist->list[current].xid.objSerial, ilist->list[current].xid.objSlot);
-            
-            // release the mutex
-            DNX_PT_MUTEX_UNLOCK(&ilist->mut);
-            return ret;
+         dnxDebug(4, "dnxJobListDispatch: Received job [%lu:%lu] sending Ack.",
+            pJob->xid.objSerial, pJob->xid.objSlot);
+         return 1;
       }
 
-      if (current == ilist->tail) {
-         // if we are at the end of the queue
-         gettimeofday(&now, 0);
-         timeout.tv_sec = now.tv_sec + DNX_JOBLIST_TIMEOUT;
-         timeout.tv_nsec = now.tv_usec * 1000;
-         if ((ret = pthread_cond_timedwait(&ilist->cond, &ilist->mut, &timeout)) == ETIMEDOUT) {
-            // We waited for the time out period and no new jobs arrived. So give control back to caller.
-            dnxDebug(5, "dnxJobListDispatch: Reached end of dispatch queue. Thread timer returned.");      
-            DNX_PT_MUTEX_UNLOCK(&ilist->mut);
-            return ret;
-         } else {
-            // We were signaled that there is a new job, so lets move back to the head and get it!
-            current = ilist->head;
-            dnxDebug(5, "dnxJobListDispatch: Reached end of dispatch queue. A new job arrived.");      
-         }
+      // This is a new job, so dispatch it
+      if ((lane = dnxJobLaneNext(ilist)) >= 0) {
+         current = dnxJobQueuePop(ilist, DNX_JQ_DISPATCH + lane);
+         pSlot = dnxJobHotAt(ilist, current);
+
+         // the node's latency is measured from here to the job's result
+         gettimeofday(&dnxJobColdAt(ilist, current)->sent, 0);
+
+         // make a copy for the Dispatcher to send to client
+         dnxJobLoad(ilist, current, pJob);
+
+         dnxDebug(4, "dnxJobListDispatch: Dispatching new job [%lu:%lu] waiting for Ack",
+            pJob->xid.objSerial, pJob->xid.objSlot);
+
+         // set our retry interval
+         // This should be fairly forgiving in case we just missed the Ack but it actually
+         // got the job and is returning our results.
+         pSlot->retry = now + DNX_JOBLIST_RETRY; 
+         dnxJobQueueAppend(ilist, DNX_JQ_RETRY, current);
+         return 1;
+      }
+
+      // The retry queue is in dispatch order, so only the oldest job can be due
+      current = ilist->queues[DNX_JQ_RETRY].head;
+      if (current == DNX_JOBLIST_NIL || dnxJobHotAt(ilist, current)->retry > now)
+         return 0;
+
+      pSlot = dnxJobHotAt(ilist, current);
+      pCold = dnxJobColdAt(ilist, current);
+      dnxJobQueueUnlink(ilist, current);
+
+      // Make sure the dnxClient service offer is still fresh
+      if (pSlot->offerExpires < now) {
+         dnxDebug(4, "dnxJobListDispatch: Pending job [%lu:%lu] waiting for Ack, client node expired. Resubmitting.",
+            pCold->xid.objSerial, pCold->xid.objSlot);
+         pSlot->state = DNX_JOB_UNBOUND;
+
+         // reset the node?
+         // It's likely that the same client will be servicing us
+         // or that the job might come back in the mean time, so we
+         // should keep this node as long as possible
+         // We just need to make sure that the Affinity is correct and that 
+         // it's only used to find a new node, so if we get as far as 
+         // resubmitting, we will have a valid node anyway
+         
+         // If the original job comes back, the acks will get all messed up
+         // not sure how to deal with that other than to just be graceful
+         // about receiving lots of results...
+         pCold->pNode->flags = dnxGetAffinity(pCold->host_name);
+         dnxJobQueueAppend(ilist, DNX_JQ_UNBOUND + pSlot->priority, current);
+         dnxJobWheelInsert(ilist, current);
+
+         // We should leave the address alone so we don't segfault if results come in late
       } else {
-         // move to next item in queue
-         current = ((current + 1) % ilist->size);
+         dnxDebug(5, "dnxJobListDispatch: Pending job [%lu:%lu] waiting for Ack, resend in (%i) sec.",
+            pCold->xid.objSerial, pCold->xid.objSlot, DNX_JOBLIST_RETRY);
+         pSlot->retry = now + DNX_JOBLIST_RETRY; 
+         dnxJobQueueAppend(ilist, DNX_JQ_RETRY, current);
+      }
+   }
+}
+
+//----------------------------------------------------------------------------
+
+int dnxJobListDispatchBatch(DnxJobList * pJobList, DnxNewJob * pJobs, int * count)
+{
+   iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   unsigned long current;
+   int ret = DNX_OK; //DNX_ERR_TIMEOUT;
+   int retryWait, n = 0;
+   struct timeval now;
+   struct timespec timeout;
+
+   assert(pJobList && pJobs && count && *count > 0);
+
+   DNX_PT_MUTEX_LOCK(&ilist->mut);
+
+   dnxDebug(6, "dnxJobListDispatch: BEFORE: Dispatch=%lu/%lu/%lu, Retry=%lu, Ack=%lu.", 
+       ilist->queues[DNX_JQ_DISPATCH + DNX_PRIORITY_HOST].count, 
+       ilist->queues[DNX_JQ_DISPATCH + DNX_PRIORITY_ONDEMAND].count, 
+       ilist->queues[DNX_JQ_DISPATCH + DNX_PRIORITY_SCHEDULED].count, 
+       ilist->queues[DNX_JQ_RETRY].count, ilist->queues[DNX_JQ_ACK].count);
+
+   while (1) {
+      gettimeofday(&now, 0);
+
+      if (dnxJobListTake(ilist, &pJobs[0], now.tv_sec)) {
+         // take what else is waiting, without waiting for more
+         for (n = 1; n < *count && dnxJobListTake(ilist, &pJobs[n], now.tv_sec); n++)
+            ;
+         break;
       }
+
+      // Nothing to do - sleep until a new job arrives or the oldest retry is due
+      current = ilist->queues[DNX_JQ_RETRY].head;
+      timeout.tv_sec = now.tv_sec + DNX_JOBLIST_TIMEOUT;
+      timeout.tv_nsec = now.tv_usec * 1000;
+      retryWait = 0;
+      if (current != DNX_JOBLIST_NIL 
+            && dnxJobHotAt(ilist, current)->retry < timeout.tv_sec) {
+         timeout.tv_sec = dnxJobHotAt(ilist, current)->retry;
+         timeout.tv_nsec = 0;
+         retryWait = 1;
+      }
+      // new jobs are added without the mutex, so wait on the semaphore
+      // with the mutex released rather than on a condition variable
+      DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+      while ((ret = sem_timedwait(&ilist->wake, &timeout)) != 0 && errno == EINTR)
+         ;
+      if (ret != 0)
+         ret = errno;
+      DNX_PT_MUTEX_LOCK(&ilist->mut);
+      if (ret == ETIMEDOUT && !retryWait) {
+         // We waited for the time out period and no new jobs arrived. So give control back to caller.
+         dnxDebug(5, "dnxJobListDispatch: Reached end of dispatch queue. Thread timer returned.");      
+         break;
+      }
+      dnxDebug(5, "dnxJobListDispatch: Reached end of dispatch queue. A new job arrived.");      
+      ret = DNX_OK;
    }
+   *count = n;
+
+   // share the rest of a burst with the other dispatcher threads
+   if (ret == DNX_OK && dnxJobListHasWork(ilist))
+      dnxJobListWake(ilist);
+
+   // release the mutex
+   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+   return ret;
 }
 
 //----------------------------------------------------------------------------
 
-int dnxJobListCollect(DnxJobList * pJobList, DnxXID * pxid, DnxNewJob * pJob)
+int dnxJobListDispatch(DnxJobList * pJobList, DnxNewJob * pJob)
+{
+   int count = 1;
+   return dnxJobListDispatchBatch(pJobList, pJob, &count);
+}
+
+//----------------------------------------------------------------------------
+
+int dnxJobListCollect(DnxJobList * pJobList, DnxResult * pRes, DnxNewJob * pJob)
 {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   DnxXID * pxid = &pRes->xid;
    unsigned long current;
    int ret = DNX_OK;
-   assert(pJobList && pxid && pJob);   // parameter validation
+   assert(pJobList && pRes && pJob);   // parameter validation
 
-   current = pxid->objSlot;
+   current = dnxJobListSlot(ilist, pxid);
 
-   dnxDebug(4, "dnxJobListCollect: Job serial (%lu) slot (%lu) list head(%i)", 
-        pxid->objSerial, pxid->objSlot, ilist->head);
+   dnxDebug(4, "dnxJobListCollect: Job serial (%lu) slot (%lu)", 
+        pxid->objSerial, pxid->objSlot);
 
-   if (current >= ilist->size)         // runtime validation requires check
+   if (current == DNX_JOBLIST_NIL)     // runtime validation requires check
       return DNX_ERR_INVALID;          // corrupt client network message
 
    DNX_PT_MUTEX_LOCK(&ilist->mut);
    
    // verify that the XID of this result matches the XID of the service check 
-   if (ilist->list[current].state == DNX_JOB_NULL 
-         || !dnxEqualXIDs(pxid, &ilist->list[current].xid)) {
+   if (dnxJobHotAt(ilist, current)->state == DNX_JOB_NULL 
+         || !dnxEqualXIDs(pxid, &dnxJobColdAt(ilist, current)->xid)) {
       dnxDebug(4, "dnxJobListCollect: Job [%lu:%lu] not found.", pxid->objSerial, pxid->objSlot);      
       ret = DNX_ERR_NOTFOUND;          // Very old job or we restarted and lost state
-   } else if(ilist->list[current].state == DNX_JOB_EXPIRED) {
+   } else if(dnxJobHotAt(ilist, current)->state == DNX_JOB_EXPIRED) {
       dnxDebug(4, "dnxJobListCollect: Job [%lu:%lu] expired before retrieval.", pxid->objSerial, pxid->objSlot);      
       ret = DNX_ERR_EXPIRED;          // job expired; removed by the timer
    } else {
-      if(ilist->list[current].state == DNX_JOB_COMPLETE || ilist->list[current].state == DNX_JOB_RECEIVED) {
+      if(dnxJobHotAt(ilist, current)->state == DNX_JOB_COMPLETE || dnxJobHotAt(ilist, current)->state == DNX_JOB_RECEIVED) {
          dnxDebug(4, "dnxJobListCollect: Job [%lu:%lu] already retrieved.", pxid->objSerial, pxid->objSlot);      
-         ilist->list[current].ack = 0;
+         dnxJobHotAt(ilist, current)->ack = 0;
          ret = DNX_ERR_ALREADY;           // It needs another Ack
       } else {
          // DNX_JOB_INPROGRESS // DNX_JOB_UNBOUND!!
-         ilist->list[current].state = DNX_JOB_RECEIVED;      
+         dnxJobHotAt(ilist, current)->state = DNX_JOB_RECEIVED;      
+         dnxJobWheelRemove(ilist, current);
+         dnxJobRuntimeRecord(ilist, dnxJobColdAt(ilist, current)->cmd, pRes->delta);
          // make a copy to return to the Collector
-         memcpy(pJob, &ilist->list[current], sizeof *pJob);
+         dnxJobLoad(ilist, current, pJob);
          dnxDebug(4, "dnxJobListCollect: Job [%lu:%lu] completed. Copy of result for (%s) assigned to collector.",
              pxid->objSerial, pxid->objSlot, pJob->cmd);
       }
       
       // Signal to the dispatcher that we need to send an Ack
-      pthread_cond_signal(&ilist->cond);
+      dnxJobQueueAppend(ilist, DNX_JQ_ACK, current);
+      dnxJobListWake(ilist);
    }
 
    DNX_PT_MUTEX_UNLOCK(&ilist->mut);
@@ -474,37 +1728,72 @@ int dnxJobListCollect(DnxJobList * pJobList, DnxXID * pxid, DnxNewJob * pJob)
 
 //----------------------------------------------------------------------------
 
-int dnxJobListCreate(unsigned size, DnxJobList ** ppJobList)
+int dnxJobListCreate(unsigned size, unsigned maxSize, DnxJobList ** ppJobList)
 {
    iDnxJobList * ilist;
+   unsigned long i;
    int ret;
 
    assert(ppJobList && size);
 
+   // slot indexes must fit in the low bits of a job XID
+   if (size > DNX_JOBLIST_SLOT_MASK + 1)
+      return DNX_ERR_INVALID;
+   if (maxSize > DNX_JOBLIST_SLOT_MASK + 1)
+      maxSize = DNX_JOBLIST_SLOT_MASK + 1;
+   if (maxSize < size)
+      maxSize = size;
+
    if ((ilist = (iDnxJobList *)xmalloc(sizeof *ilist)) == 0)
       return DNX_ERR_MEMORY;
    memset(ilist, 0, sizeof *ilist);
 
-   if ((ilist->list = (DnxNewJob *)xmalloc(sizeof *ilist->list * size)) == 0)
+   if ((ilist->segs = (iDnxJobSegment **)xcalloc(((maxSize - 1) 
+         >> DNX_JOBLIST_SEG_BITS) + 1, sizeof *ilist->segs)) == 0)
    {
       xfree(ilist);
       return DNX_ERR_MEMORY;
    }
-   memset(ilist->list, 0, sizeof *ilist->list * size);
 
-   ilist->size = size;
-   // I'm pretty sure we should initialize these...
-   ilist->head = 0;
-   ilist->tail = 0;
+   for (i = 0; i < DNX_JQ_MAX; i++)
+   {
+      ilist->queues[i].head = ilist->queues[i].tail = DNX_JOBLIST_NIL;
+      ilist->queues[i].count = 0;
+   }
+   for (i = 0; i < sizeof ilist->wheel / sizeof *ilist->wheel; i++)
+   {
+      ilist->wheel[i].head = ilist->wheel[i].tail = DNX_JOBLIST_NIL;
+      ilist->wheel[i].count = 0;
+   }
 
-   DNX_PT_MUTEX_INIT(&ilist->mut);
-   pthread_cond_init(&ilist->cond, 0);
+   // the timer makes its first pass one interval after it's created
+   ilist->wheelTime = time(0);
+   ilist->wakeup = ilist->wheelTime + DNX_TIMER_SLEEP / 1000 + 1;
+
+   // lanes share dispatch equally, with no reserved workers, until set
+   for (i = 0; i < DNX_PRIORITY_MAX; i++)
+      ilist->laneWeight[i] = 1;
+
+   // allocate the initial slots; every slot starts out free
+   ilist->minSize = size;
+   ilist->maxSize = maxSize;
+   ret = DNX_OK;
+   while (ilist->size < ilist->minSize && (ret = dnxJobListGrow(ilist)) == DNX_OK)
+      ;
+
+   if (ret == DNX_OK) {
+      DNX_PT_MUTEX_INIT(&ilist->mut);
+      sem_init(&ilist->wake, 0, 0);
+
+      if ((ret = dnxTimerCreate((DnxJobList *)ilist, DNX_TIMER_SLEEP, 
+            &ilist->timer)) != 0) {
+         sem_destroy(&ilist->wake);
+         DNX_PT_MUTEX_DESTROY(&ilist->mut);
+      }
+   }
 
-   if ((ret = dnxTimerCreate((DnxJobList *)ilist, DNX_TIMER_SLEEP, 
-         &ilist->timer)) != 0) {
-      DNX_PT_COND_DESTROY(&ilist->cond);
-      DNX_PT_MUTEX_DESTROY(&ilist->mut);
-      xfree(ilist->list);
+   if (ret != DNX_OK) {
+      dnxJobListFreeSegments(ilist);
       xfree(ilist);
       return ret;
    }
@@ -519,142 +1808,722 @@ int dnxJobListCreate(unsigned size, DnxJobList ** ppJobList)
 void dnxJobListDestroy(DnxJobList * pJobList)
 {
    iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   iDnxJobIntake * pNext;
+   int lane;
 
    assert(pJobList);
 
    dnxTimerDestroy(ilist->timer);
 
-   DNX_PT_COND_DESTROY(&ilist->cond);
+   sem_destroy(&ilist->wake);
    DNX_PT_MUTEX_DESTROY(&ilist->mut);
 
-   xfree(ilist->list);
+   // release jobs that were added but never stored
+   for (; ilist->intake; ilist->intake = pNext) {
+      pNext = ilist->intake->next;
+      xfree(ilist->intake);
+   }
+   for (; ilist->backlog; ilist->backlog = pNext) {
+      pNext = ilist->backlog->next;
+      xfree(ilist->backlog);
+   }
+
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++)
+      xfree(ilist->heap[lane]);
+   dnxJobListFreeSegments(ilist);
    xfree(ilist);
 }
 
+//----------------------------------------------------------------------------
+
+void dnxJobListGetStats(DnxJobList * pJobList, DnxJobListStats * pStats)
+{
+   iDnxJobList * ilist = (iDnxJobList *)pJobList;
+
+   assert(pJobList && pStats);
+
+   DNX_PT_MUTEX_LOCK(&ilist->mut);
+   dnxJobListDrain(ilist);
+   pStats->size = ilist->size;
+   pStats->maxSize = ilist->maxSize;
+   pStats->inUse = ilist->size - ilist->queues[DNX_JQ_FREE].count;
+   pStats->highWater = ilist->highWater;
+   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+}
+
+//----------------------------------------------------------------------------
+
+void dnxJobListSetLanes(DnxJobList * pJobList, unsigned * weights, 
+      unsigned * reserves)
+{
+   iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   unsigned reserve = 0;
+   int lane;
+
+   assert(pJobList && weights && reserves);
+
+   DNX_PT_MUTEX_LOCK(&ilist->mut);
+   for (lane = 0; lane < DNX_PRIORITY_MAX; lane++)
+   {
+      ilist->laneWeight[lane] = weights[lane];
+      ilist->laneCredit[lane] = 0;
+      ilist->laneReserve[lane] = reserve;
+      reserve += reserves[lane];
+   }
+   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+}
+
+//----------------------------------------------------------------------------
+
+int dnxJobListSetDeadlineOrder(DnxJobList * pJobList, int enable)
+{
+   iDnxJobList * ilist = (iDnxJobList *)pJobList;
+   unsigned long * queued = 0;
+   unsigned long count, i;
+   int lane, ret = DNX_OK;
+
+   assert(pJobList);
+
+   DNX_PT_MUTEX_LOCK(&ilist->mut);
+
+   for (lane = 0; lane < DNX_PRIORITY_MAX && ret == DNX_OK; lane++) {
+      if (!enable == !ilist->heap[lane])
+         continue;
+
+      // take the lane's jobs out while its order is changed
+      if ((count = ilist->queues[DNX_JQ_DISPATCH + lane].count) != 0
+            && (queued = (unsigned long *)xmalloc(count * sizeof *queued)) == 0) {
+         ret = DNX_ERR_MEMORY;
+         break;
+      }
+      for (i = 0; i < count; i++)
+         queued[i] = dnxJobQueuePop(ilist, DNX_JQ_DISPATCH + lane);
+
+      if (!enable) {
+         xfree(ilist->heap[lane]);
+         ilist->heap[lane] = 0;
+      } else {
+         if (!ilist->heapSize)
+            ilist->heapSize = ilist->size;
+         if ((ilist->heap[lane] = (unsigned long *)xmalloc(
+               ilist->heapSize * sizeof *ilist->heap[lane])) == 0)
+            ret = DNX_ERR_MEMORY;
+      }
+
+      for (i = 0; i < count; i++)
+         dnxJobQueueAppend(ilist, DNX_JQ_DISPATCH + lane, queued[i]);
+      xfree(queued);
+      queued = 0;
+   }
+
+   DNX_PT_MUTEX_UNLOCK(&ilist->mut);
+
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+unsigned dnxJobListLaneReserve(DnxJobList * pJobList, int priority)
+{
+   iDnxJobList * ilist = (iDnxJobList *)pJobList;
+
+   assert(pJobList);
+
+   if (priority < 0 || priority >= DNX_PRIORITY_MAX)
+      priority = DNX_PRIORITY_SCHEDULED;
+
+   return ilist->laneReserve[priority];
+}
+
 /*--------------------------------------------------------------------------
                                  UNIT TEST
 
    From within dnx/server, compile with GNU tools using this command line:
     
       gcc -DDEBUG -DDNX_JOBLIST_TEST -g -O0 -I../common dnxJobList.c \
-         ../common/dnxError.c -lpthread -lgcc_s -lrt -o dnxJobListTest
+         dnxAffinity.c ../common/dnxError.c -lpthread -lgcc_s -lrt \
+         -o dnxJobListTest
+
+   The test finishes by printing the average dispatch time for a range of
+   job list sizes; these should be roughly equal. It then prints the cost
+   of a deadline scan over the list's scheduling records, next to the same
+   scan over whole jobs.
 
   --------------------------------------------------------------------------*/
 
 #ifdef DNX_JOBLIST_TEST
 
-// #include "utesthelp.h"
-// #include <time.h>
-// 
-// #define elemcount(x) (sizeof(x)/sizeof(*(x)))
-// 
-// static int verbose;
-// 
-// // functional stubs
-// IMPLEMENT_DNX_DEBUG(verbose);
-// IMPLEMENT_DNX_SYSLOG(verbose);
-// 
-// int dnxTimerCreate(DnxJobList * jl, int s, DnxTimer ** pt) { *pt = 0; return 0; }
-// void dnxTimerDestroy(DnxTimer * t) { }
-// 
-// int dnxEqualXIDs(DnxXID * pxa, DnxXID * pxb)
-//       { return pxa->objType == pxb->objType && pxa->objSerial == pxb->objSerial 
-//             && pxa->objSlot == pxb->objSlot; }
-// 
-// int dnxMakeXID(DnxXID * x, DnxObjType t, unsigned long s, unsigned long l)
-//       { x->objType = t; x->objSerial = s; x->objSlot = l; return DNX_OK; }
-// 
-// int main(int argc, char ** argv)
-// {
-//    DnxJobList * jobs;
-//    DnxNodeRequest n1[101];
-//    DnxNewJob j1[101];
-//    DnxNewJob jtmp;
-//    DnxXID xid;
-//    int serial, xlsz, expcount;
-//    iDnxJobList * ijobs;
-//    time_t now;
-// 
-//    verbose = argc > 1;
-// 
-//    // create a new job list and get a concrete reference to it for testing
-//    CHECK_ZERO(dnxJobListCreate(100, &jobs));
-//    ijobs = (iDnxJobList *)jobs;
-// 
-//    // force entire array to non-zero values for testing
-//    memset(j1, 0xcc, sizeof j1);
-//    memset(n1, 0xdd, sizeof n1);
-//    
-//    // test that we CAN add 100 jobs to the 100-job list
-//    now = time(0);
-//    for (serial = 0; serial < elemcount(j1); serial++)
-//    {
-//       // configure request node
-//       dnxMakeXID(&n1[serial].xid, DNX_OBJ_WORKER, serial, 0);
-//       n1[serial].reqType      = DNX_REQ_REGISTER;
-//       n1[serial].jobCap       = 1;     // jobs
-//       n1[serial].ttl          = 5;     // seconds
-//       n1[serial].expires      = 5;     // seconds
-//       strcpy(n1[serial].address, "localhost");
-// 
-//       // configure job
-//       dnxMakeXID(&j1[serial].xid, DNX_OBJ_JOB, serial, 0);
-//       j1[serial].cmd          = "some command line";
-//       j1[serial].start_time   = now;
-//       j1[serial].timeout      = serial < 50? 0: 5;  // 50 expire immediately
-//       j1[serial].expires      = j1[serial].start_time + j1[serial].timeout;
-//       j1[serial].payload      = 0;     // no payload for tests
-//       j1[serial].pNode        = &n1[serial];
-// 
-//       if (serial < 100)
-//          CHECK_ZERO(dnxJobListAdd(jobs, &j1[serial]));
-//       else  // test that we CAN'T add 101 jobs
-//          CHECK_NONZERO(dnxJobListAdd(jobs, &j1[serial]));
-//    }
-// 
-//    // test job expiration - ensure first 50 jobs have already expired
-//    expcount = 0;
-//    do
-//    {
-//       DnxNewJob xl[10];
-//       xlsz = (int)elemcount(xl);
-//       CHECK_ZERO(dnxJobListExpire(jobs, xl, &xlsz));
-//       expcount += xlsz;
-//    } while (xlsz != 0);
-//    CHECK_TRUE(expcount == 50);
-// 
-//    // dispatch 49 of the remaining 50 jobs
-//    for (serial = 50; serial < elemcount(j1) - 2; serial++)
-//       CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
-// 
-//    // ensure the dispatch head is valid and not in progress
-//    CHECK_TRUE(ijobs->dhead != 0);
-//    CHECK_TRUE(ijobs->list[ijobs->dhead].state != DNX_JOB_INPROGRESS);
-//    CHECK_TRUE(ijobs->list[ijobs->head].state == DNX_JOB_INPROGRESS);
-// 
-//    // ensure dispatch head points to last item in list
-//    CHECK_TRUE(ijobs->dhead == 99);
-// 
-//    // collect all pending jobs
-//    for (serial = 50; serial < elemcount(j1) - 2; serial++)
-//    {
-//       dnxMakeXID(&xid, DNX_OBJ_JOB, serial, serial);
-//       CHECK_ZERO(dnxJobListCollect(jobs, &xid, &jtmp));
-//    }
-// 
-//    // ensure there's one left
-//    CHECK_TRUE(ijobs->head == ijobs->tail);
-//    CHECK_TRUE(ijobs->head != 0);
-// 
-//    // ensure head, tail and dhead all point to the last element (99)
-//    CHECK_TRUE(ijobs->head == 99);
-//    CHECK_TRUE(ijobs->tail == 99);
-//    CHECK_TRUE(ijobs->dhead == 99);
-// 
-//    dnxJobListDestroy(jobs);
-// 
-//    return 0;
-// }
+#include "utesthelp.h"
+#include <time.h>
+
+#define elemcount(x) (sizeof(x)/sizeof(*(x)))
+
+static int verbose;
+
+// functional stubs
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+int dnxTimerCreate(DnxJobList * jl, int s, DnxTimer ** pt) { *pt = 0; return 0; }
+void dnxTimerDestroy(DnxTimer * t) { }
+void dnxTimerWakeAt(DnxTimer * t, time_t w) { }
+
+int dnxEqualXIDs(DnxXID * pxa, DnxXID * pxb)
+      { return pxa->objType == pxb->objType && pxa->objSerial == pxb->objSerial 
+            && pxa->objSlot == pxb->objSlot; }
+
+int dnxMakeXID(DnxXID * x, DnxObjType t, unsigned long s, unsigned long l)
+      { x->objType = t; x->objSerial = s; x->objSlot = l; return DNX_OK; }
+
+int dnxAuditJob(DnxNewJob * pJob, char * action) { return 0; }
+void dnxJobCleanup(DnxNewJob * pJob) { pJob->state = DNX_JOB_NULL; }
+DnxRegistrar * dnxGetRegistrar(void) { return 0; }
+
+static unsigned testWorkers;     // idle workers the registrar stub hands out
+
+int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode, unsigned reserve) 
+{
+   if (testWorkers <= reserve)
+      return DNX_ERR_NOTFOUND;
+   testWorkers--;
+   (*ppNode)->xid.objSlot = 0;
+   (*ppNode)->expires = time(0) + 60;
+   return DNX_OK;
+}
+
+static DnxAffinity testAffinity;
+DnxAffinity dnxGetAffinity(char * name) { return testAffinity; }
+
+static DnxAffinity testBit(unsigned bit)
+{
+   DnxAffinity set;
+   CHECK_ZERO(dnxAffinityBit(bit, &set));
+   return set;
+}
+
+static void initJob(DnxNewJob * pJob, DnxNodeRequest * pNode, unsigned long serial)
+{
+   memset(pNode, 0, sizeof *pNode);
+   dnxMakeXID(&pNode->xid, DNX_OBJ_WORKER, serial, 0);
+   pNode->expires = time(0) + 60;
+
+   memset(pJob, 0, sizeof *pJob);
+   dnxMakeXID(&pJob->xid, DNX_OBJ_JOB, serial, 0);
+   pJob->cmd = "some command line";
+   pJob->host_name = "localhost";
+   pJob->start_time = time(0);
+   pJob->timeout = 30;
+   pJob->expires = pJob->start_time + pJob->timeout;
+   pJob->pNode = pNode;
+}
+
+/** Measure the average cost of a dispatch in a mostly busy job list.
+ * 
+ * All but @p free slots are filled with jobs that are in progress on a 
+ * client, then @p free new jobs are added and dispatched.
+ *
+ * @param[in] size - the size of the job list to be created.
+ * @param[in] free - the number of slots to be dispatched.
+ *
+ * @return The average dispatch time in nanoseconds.
+ */
+static double dispatchCost(unsigned size, unsigned free)
+{
+   DnxJobList * jobs;
+   DnxNodeRequest node;
+   DnxNewJob job, jtmp;
+   DnxResult res;
+   struct timespec t0, t1;
+   unsigned serial;
+
+   CHECK_ZERO(dnxJobListCreate(size, size, &jobs));
+   initJob(&job, &node, 0);
+
+   memset(&res, 0, sizeof res);
+   for (serial = 0; serial < size - 1 - free; serial++)
+   {
+      job.xid.objSerial = serial;
+      CHECK_ZERO(dnxJobListAdd(jobs, &job));
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      res.xid = jtmp.xid;
+      CHECK_ZERO(dnxJobListMarkAck(jobs, &res));
+   }
+   for (; serial < size - 1; serial++)
+   {
+      job.xid.objSerial = serial;
+      CHECK_ZERO(dnxJobListAdd(jobs, &job));
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (serial = 0; serial < free; serial++)
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   dnxJobListDestroy(jobs);
+
+   return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / free;
+}
+
+/** Measure the cost of a deadline scan over every slot of a job list.
+ * 
+ * The same scan is run over an array of whole jobs, as the list stored them
+ * before the scheduling fields were split out, and over the list's own 
+ * scheduling records.
+ *
+ * @param[in] size - the number of job slots to be scanned.
+ * @param[out] pWhole - the address of storage for the average time per 
+ *    slot of the whole-job scan, in nanoseconds.
+ *
+ * @return The average time per slot of the scheduling record scan, in 
+ *    nanoseconds.
+ */
+static double scanCost(unsigned size, double * pWhole)
+{
+   DnxJobList * jobs;
+   iDnxJobList * ijobs;
+   DnxNodeRequest node;
+   DnxNewJob job, * whole;
+   struct timespec t0, t1, t2;
+   unsigned long slot, due = 0;
+   int pass;
+
+   CHECK_ZERO(dnxJobListCreate(size, size, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   CHECK_NONZERO(whole = (DnxNewJob *)xcalloc(size, sizeof *whole));
+   initJob(&job, &node, 0);
+   for (slot = 0; slot < size; slot++)
+   {
+      job.xid.objSerial = slot;
+      job.expires = job.start_time + (slot & 63);
+      whole[slot] = job;
+      CHECK_ZERO(dnxJobListAdd(jobs, &job));
+   }
+   dnxJobListDrain(ijobs);
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (pass = 0; pass < 10; pass++)
+      for (slot = 0; slot < size; slot++)
+         due += (whole[slot].state == DNX_JOB_UNBOUND ? whole[slot].start_time 
+               + DNX_DISPATCH_TIMEOUT : whole[slot].expires) <= job.start_time + pass;
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   for (pass = 0; pass < 10; pass++)
+      for (slot = 0; slot < size; slot++)
+         due -= dnxJobDeadline(dnxJobHotAt(ijobs, slot)) <= job.start_time + pass;
+   clock_gettime(CLOCK_MONOTONIC, &t2);
+   CHECK_TRUE(due == 0);
+
+   xfree(whole);
+   dnxJobListDestroy(jobs);
+
+   *pWhole = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / (10.0 * size);
+   return ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / (10.0 * size);
+}
+
+#define ADDER_JOBS 2000
+
+/** A thread adding jobs to a job list, for the concurrent add test. */
+typedef struct Adder
+{
+   pthread_t tid;
+   DnxJobList * jobs;
+   unsigned long first;
+   DnxNodeRequest nodes[ADDER_JOBS];
+} Adder;
+
+static void * addJobs(void * data)
+{
+   Adder * pAdder = (Adder *)data;
+   DnxNewJob job;
+   unsigned long i;
+
+   for (i = 0; i < ADDER_JOBS; i++)
+   {
+      initJob(&job, &pAdder->nodes[i], pAdder->first + i);
+      CHECK_ZERO(dnxJobListAdd(pAdder->jobs, &job));
+   }
+   return 0;
+}
+
+int main(int argc, char ** argv)
+{
+   DnxJobList * jobs;
+   static DnxNodeRequest n2[120], n3[300];
+   static Adder adders[2];
+   static char seen[2 * ADDER_JOBS];
+   DnxJobListStats stats;
+   DnxXID xid;
+   char * cmdBuf;
+   DnxNodeRequest n1[8];
+   DnxNewJob j1[8];
+   DnxNewJob jtmp, jbatch[4];
+   DnxResult res;
+   iDnxJobList * ijobs;
+   unsigned sizes[] = { 1000, 10000, 100000 };
+   int serial, xlsz, expcount, batchsz;
+   time_t now;
+
+   verbose = argc > 1;
+
+   // create a new job list and get a concrete reference to it for testing
+   CHECK_ZERO(dnxJobListCreate(elemcount(j1), elemcount(j1), &jobs));
+   ijobs = (iDnxJobList *)jobs;
+
+   // new jobs are queued for dispatch in arrival order
+   for (serial = 0; serial < 3; serial++)
+   {
+      initJob(&j1[serial], &n1[serial], serial);
+      CHECK_ZERO(dnxJobListAdd(jobs, &j1[serial]));
+   }
+   CHECK_TRUE(ijobs->queues[DNX_JQ_DISPATCH].count == 0);
+   dnxJobListDrain(ijobs);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_DISPATCH].count == 3);
+
+   // slots are assigned when the job is stored, so take the XIDs from the 
+   // dispatched copies
+   for (serial = 0; serial < 3; serial++)
+   {
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSerial == serial);
+      j1[serial].xid = jtmp.xid;
+   }
+   CHECK_TRUE(ijobs->queues[DNX_JQ_DISPATCH].count == 0);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_RETRY].count == 3);
+
+   // an acknowledged job no longer waits for a retry
+   memset(&res, 0, sizeof res);
+   res.xid = j1[1].xid;
+   CHECK_ZERO(dnxJobListMarkAck(jobs, &res));
+   CHECK_TRUE(dnxJobHotAt(ijobs, 1)->state == DNX_JOB_INPROGRESS);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_RETRY].count == 2);
+
+   // collected results are queued once for an Ack, even if sent twice
+   CHECK_ZERO(dnxJobListCollect(jobs, &res, &jtmp));
+   CHECK_TRUE(dnxJobListCollect(jobs, &res, &jtmp) == DNX_ERR_ALREADY);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_ACK].count == 1);
+
+   // Acks are sent before new jobs
+   initJob(&j1[3], &n1[3], 3);
+   CHECK_ZERO(dnxJobListAdd(jobs, &j1[3]));
+   CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+   CHECK_TRUE(jtmp.xid.objSerial == 1 && jtmp.state == DNX_JOB_RECEIVED);
+   CHECK_ZERO(dnxJobListMarkAckSent(jobs, &jtmp.xid));
+   CHECK_ZERO(dnxJobListMarkComplete(jobs, &jtmp.xid));
+   CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+   CHECK_TRUE(jtmp.xid.objSerial == 3);
+
+   // unbound jobs are left for the timer to bind
+   initJob(&j1[4], &n1[4], 4);
+   n1[4].xid.objSlot = -1;
+   CHECK_ZERO(dnxJobListAdd(jobs, &j1[4]));
+   dnxJobListDrain(ijobs);
+   CHECK_TRUE(dnxJobHotAt(ijobs, 4)->state == DNX_JOB_UNBOUND);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_DISPATCH].count == 0);
+
+   // test that we CAN fill the list, but CAN'T add any more
+   for (serial = 5; serial < elemcount(j1); serial++)
+   {
+      initJob(&j1[serial], &n1[serial], serial);
+      CHECK_ZERO(dnxJobListAdd(jobs, &j1[serial]));
+   }
+   CHECK_TRUE(dnxJobListAdd(jobs, &j1[0]) == DNX_ERR_CAPACITY);
+
+   dnxJobListDestroy(jobs);
+
+   // a batch takes the jobs already waiting, in order, up to its size
+   CHECK_ZERO(dnxJobListCreate(4, 4, &jobs));
+   for (serial = 0; serial < 3; serial++)
+   {
+      initJob(&j1[serial], &n1[serial], serial);
+      CHECK_ZERO(dnxJobListAdd(jobs, &j1[serial]));
+   }
+   batchsz = 2;
+   CHECK_ZERO(dnxJobListDispatchBatch(jobs, jbatch, &batchsz));
+   CHECK_TRUE(batchsz == 2);
+   CHECK_TRUE(jbatch[0].xid.objSerial == 0 && jbatch[1].xid.objSerial == 1);
+   batchsz = elemcount(jbatch);
+   CHECK_ZERO(dnxJobListDispatchBatch(jobs, jbatch, &batchsz));
+   CHECK_TRUE(batchsz == 1 && jbatch[0].xid.objSerial == 2);
+   dnxJobListDestroy(jobs);
+
+   // a finished job's slot is reused while older jobs are still running, 
+   // and late results for the slot's previous job are rejected
+   CHECK_ZERO(dnxJobListCreate(2, 2, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   for (serial = 0; serial < 2; serial++)
+   {
+      initJob(&j1[serial], &n1[serial], serial);
+      CHECK_ZERO(dnxJobListAdd(jobs, &j1[serial]));
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      j1[serial].xid = jtmp.xid;
+   }
+   CHECK_TRUE(dnxJobListAdd(jobs, &j1[2]) == DNX_ERR_CAPACITY);
+   res.xid = j1[1].xid;
+   CHECK_ZERO(dnxJobListMarkAck(jobs, &res));
+   CHECK_ZERO(dnxJobListCollect(jobs, &res, &jtmp));
+   CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+   CHECK_ZERO(dnxJobListMarkAckSent(jobs, &j1[1].xid));
+   CHECK_ZERO(dnxJobListMarkComplete(jobs, &j1[1].xid));
+   xlsz = 1;
+   CHECK_ZERO(dnxJobListExpire(jobs, &jtmp, &xlsz));
+   initJob(&j1[2], &n1[2], 2);
+   j1[2].cmd = "another command line";
+   cmdBuf = dnxJobColdAt(ijobs, 1)->cmd;
+   CHECK_ZERO(dnxJobListAdd(jobs, &j1[2]));
+   CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+   j1[2].xid = jtmp.xid;
+   CHECK_TRUE(jtmp.cmd == cmdBuf && strcmp(jtmp.cmd, j1[2].cmd) == 0);
+   CHECK_TRUE(jtmp.host_name != j1[2].host_name 
+         && strcmp(jtmp.host_name, j1[2].host_name) == 0
+         && jtmp.service_description == 0);
+   CHECK_TRUE((j1[2].xid.objSlot & DNX_JOBLIST_SLOT_MASK) == 1);
+   CHECK_TRUE(j1[2].xid.objSlot != j1[1].xid.objSlot);
+   CHECK_TRUE(dnxJobListCollect(jobs, &res, &jtmp) == DNX_ERR_NOTFOUND);
+   dnxJobListDestroy(jobs);
+
+   // the slot generation wraps, so the XID stays within 32 bits however 
+   // often a slot is reused
+   CHECK_ZERO(dnxJobListCreate(1, 1, &jobs));
+   for (serial = 0; serial < 300; serial++)
+   {
+      initJob(&j1[0], &n1[0], serial);
+      CHECK_ZERO(dnxJobListAdd(jobs, &j1[0]));
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSlot <= 0xFFFFFFFFUL);
+      CHECK_TRUE(jtmp.xid.objSlot == ((unsigned long)(serial + 1) 
+            & DNX_JOBLIST_GEN_MASK) << DNX_JOBLIST_SLOT_BITS);
+      res.xid = jtmp.xid;
+      CHECK_ZERO(dnxJobListMarkAck(jobs, &res));
+      CHECK_ZERO(dnxJobListCollect(jobs, &res, &jtmp));
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_ZERO(dnxJobListMarkAckSent(jobs, &res.xid));
+      CHECK_ZERO(dnxJobListMarkComplete(jobs, &res.xid));
+      xlsz = 1;
+      CHECK_ZERO(dnxJobListExpire(jobs, &jtmp, &xlsz));
+   }
+   dnxJobListDestroy(jobs);
+
+   // only jobs that have reached their deadline are expired, however many
+   CHECK_ZERO(dnxJobListCreate(200, 200, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   now = time(0);
+   for (serial = 0; serial < elemcount(n2); serial++)
+   {
+      initJob(&jtmp, &n2[serial], serial);
+      if (serial < 110)
+         jtmp.expires = now - 1;
+      else if (serial < 115)
+         jtmp.expires = now + 100;
+      else
+         jtmp.expires = now + DNX_WHEEL_SPAN + 100;
+      CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+   }
+
+   // unbound jobs expire when they can't be dispatched in time
+   initJob(&jtmp, &n1[0], serial);
+   n1[0].xid.objSlot = -1;
+   jtmp.start_time = now - DNX_DISPATCH_TIMEOUT - 1;
+   CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+
+   expcount = 0;
+   do
+   {
+      DnxNewJob xl[50];
+      xlsz = (int)elemcount(xl);
+      CHECK_ZERO(dnxJobListExpire(jobs, xl, &xlsz));
+      expcount += xlsz;
+   } while (xlsz == 50);
+   CHECK_TRUE(expcount == 111);
+
+   // expired jobs are released on the following pass
+   xlsz = 1;
+   CHECK_ZERO(dnxJobListExpire(jobs, &jtmp, &xlsz));
+   CHECK_TRUE(xlsz == 0);
+   CHECK_TRUE(ijobs->queues[DNX_JQ_FREE].count == 200 - 10);
+   CHECK_TRUE(dnxJobHotAt(ijobs, 110)->state == DNX_JOB_PENDING);
+   CHECK_TRUE(dnxJobHotAt(ijobs, 120)->state == DNX_JOB_NULL);
+   CHECK_TRUE(ijobs->wakeup == now + 100 || ijobs->wakeup == ((now | DNX_WHEEL_MASK) + 1));
+
+   dnxJobListDestroy(jobs);
+
+   // the list grows a segment at a time when it runs out of slots, and 
+   // gives the segment back once it's empty again
+   CHECK_ZERO(dnxJobListCreate(2, 600, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   dnxJobListGetStats(jobs, &stats);
+   CHECK_TRUE(stats.size == DNX_JOBLIST_SEG_SLOTS && stats.maxSize == 600);
+   for (serial = 0; serial < elemcount(n3); serial++)
+   {
+      initJob(&jtmp, &n3[serial], serial);
+      jtmp.expires = now - 1;
+      CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+   }
+   dnxJobListGetStats(jobs, &stats);
+   CHECK_TRUE(stats.size == 2 * DNX_JOBLIST_SEG_SLOTS);
+   CHECK_TRUE(stats.inUse == elemcount(n3) && stats.highWater == elemcount(n3));
+   xid = dnxJobColdAt(ijobs, elemcount(n3) - 1)->xid;
+   do
+   {
+      DnxNewJob xl[50];
+      xlsz = (int)elemcount(xl);
+      CHECK_ZERO(dnxJobListExpire(jobs, xl, &xlsz));
+   } while (xlsz != 0);
+   dnxJobListGetStats(jobs, &stats);
+   CHECK_TRUE(stats.size == DNX_JOBLIST_SEG_SLOTS);
+   CHECK_TRUE(stats.inUse == 0 && stats.highWater == elemcount(n3));
+   res.xid = xid;
+   CHECK_TRUE(dnxJobListCollect(jobs, &res, &jtmp) == DNX_ERR_INVALID);
+   dnxJobListDestroy(jobs);
+
+   // jobs added by several threads at once are each dispatched once
+   CHECK_ZERO(dnxJobListCreate(2 * ADDER_JOBS, 2 * ADDER_JOBS, &jobs));
+   memset(seen, 0, sizeof seen);
+   for (serial = 0; serial < elemcount(adders); serial++)
+   {
+      adders[serial].jobs = jobs;
+      adders[serial].first = serial * ADDER_JOBS;
+      CHECK_ZERO(pthread_create(&adders[serial].tid, 0, addJobs, &adders[serial]));
+   }
+   for (serial = 0; serial < 2 * ADDER_JOBS; serial++)
+   {
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSerial < 2 * ADDER_JOBS && !seen[jtmp.xid.objSerial]);
+      seen[jtmp.xid.objSerial] = 1;
+   }
+   for (serial = 0; serial < elemcount(adders); serial++)
+      CHECK_ZERO(pthread_join(adders[serial].tid, 0));
+   dnxJobListDestroy(jobs);
+
+   // busy lanes share dispatches by weight, and a lane of weight zero waits
+   // for the others to empty; reserves accumulate down the lanes
+   CHECK_ZERO(dnxJobListCreate(12, 12, &jobs));
+   {
+      unsigned weights[DNX_PRIORITY_MAX] = { 2, 1, 0 };
+      unsigned reserves[DNX_PRIORITY_MAX] = { 1, 2, 5 };
+      int lanes[DNX_PRIORITY_MAX] = { 0 };
+
+      dnxJobListSetLanes(jobs, weights, reserves);
+      CHECK_TRUE(dnxJobListLaneReserve(jobs, DNX_PRIORITY_HOST) == 0);
+      CHECK_TRUE(dnxJobListLaneReserve(jobs, DNX_PRIORITY_ONDEMAND) == 1);
+      CHECK_TRUE(dnxJobListLaneReserve(jobs, DNX_PRIORITY_SCHEDULED) == 3);
+      CHECK_TRUE(dnxJobListLaneReserve(jobs, 99) == 3);
+      for (serial = 0; serial < 12; serial++)
+      {
+         initJob(&jtmp, &n2[serial], serial);
+         jtmp.priority = DNX_PRIORITY_SCHEDULED - serial % DNX_PRIORITY_MAX;
+         CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+      }
+      for (serial = 0; serial < 6; serial++)
+      {
+         CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+         lanes[jtmp.priority]++;
+      }
+      CHECK_TRUE(lanes[DNX_PRIORITY_HOST] == 4 && lanes[DNX_PRIORITY_ONDEMAND] == 2);
+      for (serial = 6; serial < 12; serial++)
+      {
+         CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+         CHECK_TRUE(jtmp.priority == (serial < 8
+               ? DNX_PRIORITY_ONDEMAND : DNX_PRIORITY_SCHEDULED));
+      }
+   }
+   dnxJobListDestroy(jobs);
+
+   // a registering worker is given the oldest Unbound job it can run, most
+   // urgent lane first, without waiting for the timer
+   CHECK_ZERO(dnxJobListCreate(8, 8, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   {
+      static unsigned flags[] = { 70, 3, 3, 3 };
+      DnxAffinity both;
+      static int priority[] = { DNX_PRIORITY_HOST, DNX_PRIORITY_SCHEDULED,
+            DNX_PRIORITY_ONDEMAND, DNX_PRIORITY_ONDEMAND };
+
+      CHECK_TRUE(dnxJobListBind(jobs, testBit(3)) == DNX_ERR_NOTFOUND);
+      for (serial = 0; serial < elemcount(flags); serial++)
+      {
+         initJob(&jtmp, &n2[serial], serial);
+         n2[serial].xid.objSlot = -1;
+         n2[serial].flags = testBit(flags[serial]);
+         jtmp.priority = priority[serial];
+         CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+      }
+      CHECK_TRUE(ijobs->unboundAdded == elemcount(flags));
+      testWorkers = 1;
+      CHECK_TRUE(dnxJobListBind(jobs, testBit(5)) == DNX_ERR_NOTFOUND);
+      CHECK_TRUE(ijobs->unboundAdded == 0 && testWorkers == 1);
+      CHECK_ZERO(dnxJobListBind(jobs, testBit(3)));
+      CHECK_TRUE(testWorkers == 0);
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSerial == 2);
+      CHECK_TRUE(timerisset(&jtmp.sent));    // a node's latency starts here
+      CHECK_TRUE(dnxJobListBind(jobs, testBit(3)) == DNX_ERR_NOTFOUND);
+      testWorkers = 2;
+      CHECK_ZERO(dnxAffinityUnion(testBit(3), testBit(70), &both));
+      CHECK_ZERO(dnxJobListBind(jobs, both));
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSerial == 0);
+      xlsz = 1;
+      CHECK_ZERO(dnxJobListExpire(jobs, &jtmp, &xlsz));
+      CHECK_TRUE(xlsz == 0 && testWorkers == 0);
+      CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+      CHECK_TRUE(jtmp.xid.objSerial == 3);
+      CHECK_TRUE(ijobs->queues[DNX_JQ_UNBOUND + DNX_PRIORITY_SCHEDULED].count == 1);
+      testWorkers = 0;
+   }
+   dnxJobListDestroy(jobs);
+
+   // in deadline order, jobs go out by expiration time less the runtime of
+   // their plugin, ties in arrival order; expired jobs leave the lane
+   CHECK_ZERO(dnxJobListCreate(8, 8, &jobs));
+   ijobs = (iDnxJobList *)jobs;
+   dnxJobRuntimeRecord(ijobs, "/plugins/slow -H a", 30);
+   dnxJobRuntimeRecord(ijobs, "/plugins/slow -H b", 10);
+   CHECK_TRUE(dnxJobRuntimeEstimate(ijobs, "/plugins/slow") == 25);
+   CHECK_TRUE(dnxJobRuntimeEstimate(ijobs, "/plugins/fast") == 0);
+   {
+      static char * cmds[] = { "/plugins/fast", "/plugins/slow -H c",
+            "/plugins/fast", "/plugins/fast", "/plugins/fast" };
+      static int expires[] = { 60, 70, 20, 60, -1 };
+      static unsigned long order[] = { 2, 1, 0, 3 };
+
+      now = time(0);
+      for (serial = 0; serial < elemcount(cmds); serial++)
+      {
+         initJob(&jtmp, &n2[serial], serial);
+         jtmp.cmd = cmds[serial];
+         jtmp.expires = now + expires[serial];
+         CHECK_ZERO(dnxJobListAdd(jobs, &jtmp));
+      }
+      dnxJobListGetStats(jobs, &stats);   // stored in arrival order first
+      CHECK_ZERO(dnxJobListSetDeadlineOrder(jobs, 1));
+      xlsz = 1;
+      CHECK_ZERO(dnxJobListExpire(jobs, &jtmp, &xlsz));
+      CHECK_TRUE(xlsz == 1 && jtmp.xid.objSerial == 4);
+      for (serial = 0; serial < elemcount(order); serial++)
+      {
+         CHECK_ZERO(dnxJobListDispatch(jobs, &jtmp));
+         CHECK_TRUE(jtmp.xid.objSerial == order[serial]);
+      }
+      CHECK_TRUE(ijobs->queues[DNX_JQ_DISPATCH + DNX_PRIORITY_HOST].count == 0);
+      CHECK_ZERO(dnxJobListSetDeadlineOrder(jobs, 0));
+   }
+   dnxJobListDestroy(jobs);
+
+   // dispatch cost should not grow with the number of busy slots
+   for (serial = 0; serial < elemcount(sizes); serial++)
+      printf("dispatch: %6u slots: %8.1f ns/job\n", 
+            sizes[serial], dispatchCost(sizes[serial], 500));
+
+   // scanning scheduling records should beat scanning whole jobs
+   for (serial = 0; serial < elemcount(sizes); serial++)
+   {
+      double hot, whole;
+      hot = scanCost(sizes[serial], &whole);
+      printf("scan:     %6u slots: %8.2f ns/slot (whole jobs: %.2f ns/slot)\n", 
+            sizes[serial], hot, whole);
+   }
+
+   return 0;
+}
 
 #endif   /* DNX_JOBLIST_TEST */
 
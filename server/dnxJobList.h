@@ -29,11 +29,23 @@
 #define _DNXJOBLIST_H_
 
 #include <time.h>
+#include <sys/time.h>
 
 #include "../common/dnxTypes.h"
 #include "../common/dnxProtocol.h"
 #include "dnxRegistrar.h"
 
+/** Job priority lanes, most urgent first. The lane is also sent to the 
+ * client as the job's priority.
+ */
+typedef enum DnxJobPriority
+{
+   DNX_PRIORITY_HOST = 0,  /*!< Host checks, which gate dependencies and notifications. */
+   DNX_PRIORITY_ONDEMAND,  /*!< Forced service checks, usually requested by a user. */
+   DNX_PRIORITY_SCHEDULED, /*!< Regular scheduled service checks. */
+   DNX_PRIORITY_MAX
+} DnxJobPriority;
+
 typedef struct DnxNewJob
 { 
    DnxXID xid;             // Service request transaction id.
@@ -46,12 +58,23 @@ typedef struct DnxNewJob
    char * service_description; // Name of the check being run
    int object_check_type;  // Nagios object type (service = 0, host = 1)
    DnxNodeRequest * pNode; // Worker Request that will handle this Job
+   struct timeval sent;    // When the job was last dispatched; set by the job list
    bool ack;               // Boolean to tell us whether or not reciept was acknowledged by the client
+   int priority;           // Priority lane (DnxJobPriority)
 } DnxNewJob;
 
 /** An abstract data type for a DNX Job List object. */
 typedef struct { int unused; } DnxJobList;
 
+/** Job list occupancy statistics. */
+typedef struct DnxJobListStats
+{
+   unsigned long size;     /*!< Current number of job slots. */
+   unsigned long maxSize;  /*!< The most job slots the list may grow to. */
+   unsigned long inUse;    /*!< Job slots currently holding a job. */
+   unsigned long highWater; /*!< The most job slots ever in use at once. */
+} DnxJobListStats;
+
 /** Add a job to a job list.
  * 
  * This routine is invoked by the DNX NEB module's Service Check handler
@@ -59,6 +82,19 @@ typedef struct { int unused; } DnxJobList;
  * 
  * Jobs are marked as Waiting to be dispatched to worker nodes (via the
  * Dispatcher thread.)
+ * 
+ * This routine never waits for the job list mutex. The job is counted 
+ * against the list's maximum size and pushed onto a lock-free intake chain;
+ * the Dispatcher or Timer thread later stores it in a slot taken from the 
+ * list's free slots, so capacity depends only on the number of jobs in 
+ * flight. If there are no free slots, the list grows by a segment of slots,
+ * up to its maximum size. The slot index, tagged with a generation count 
+ * for the slot, is stored in the objSlot field of the stored job's XID; the
+ * caller's copy of the job is not updated.
+ *
+ * The command line, host name and service description are copied into a 
+ * buffer belonging to the job's slot that is reused by the slot's next job,
+ * so the caller's strings need only stay valid for the call.
  *
  * @param[in] pJobList - the job list to which @p pJob should be added.
  * @param[in] pJob - the job to be added to @p pJobList.
@@ -72,11 +108,16 @@ int dnxJobListAdd(DnxJobList * pJobList, DnxNewJob * pJob);
  * This routine is invoked by the Timer thread to dequeue all jobs whose
  * timeout has occurred.
  * 
- * Note that this routine walks the *entire* Job List and can remove jobs
- * that are either InProgress (awaiting a result) or Pending (awaiting dispatch.)
+ * Jobs are kept on a hierarchical timing wheel keyed on their expiration 
+ * time (or their dispatch deadline while they are Unbound), so this routine
+ * only visits jobs that are actually due. If more than @p totalJobs jobs are
+ * due, the remainder are returned by the next call. Before returning, the 
+ * Timer is asked to wake up again when the next job falls due.
  * 
- * Jobs that are deemed to have expired are passed to the Timer thread
- * via a call back mechanism (for efficiency.)
+ * Jobs expired by the previous call, and completed jobs whose Ack has been
+ * sent, are released at the start of each call. Jobs that are still Unbound
+ * at the end of each call are offered to the idle workers; see also 
+ * dnxJobListBind.
  *
  * @param[in] pJobList - the job list from which to expire old jobs.
  * @param[out] pExpiredJobs - the address of storage in which to return 
@@ -97,17 +138,44 @@ int dnxJobListAdd(DnxJobList * pJobList, DnxNewJob * pJob);
  */
 int dnxJobListExpire(DnxJobList * pJobList, DnxNewJob * pExpiredJobs, int * totalJobs);
 
+/** Give a waiting Unbound job to a newly registered worker.
+ * 
+ * This routine is invoked by the Registrar thread whenever a worker node
+ * registers or refreshes a request for work, so that jobs added while no
+ * worker could run them are dispatched as soon as one can, rather than on
+ * the Timer's next pass.
+ * 
+ * The oldest Unbound job whose affinity shares a flag with @p flags is bound
+ * to an idle worker, most urgent lane first; only the oldest few jobs of 
+ * each lane are examined. The worker is chosen by the Registrar as for any
+ * other job, subject to the lane's reserve.
+ *
+ * @param[in] pJobList - the job list whose Unbound jobs are to be examined.
+ * @param[in] flags - the affinity flags of the registered worker.
+ *
+ * @return Zero if a job was bound, or a non-zero error value.
+ */
+int dnxJobListBind(DnxJobList * pJobList, DnxAffinity flags);
+
 int dnxJobListMarkAck(DnxJobList * pJobList, DnxResult * pRes);
 int dnxJobListMarkAckSent(DnxJobList * pJobList, DnxXID * pXid);
 int dnxJobListMarkComplete(DnxJobList * pJobList, DnxXID * pXid);
 
 /** Select a dispatchable job from a job list.
  * 
- * This routine is invoked by the Dispatcher thread to select the next
- * job waiting to be dispatched to a worker node.
+ * This routine is invoked by the Dispatcher threads to select the next
+ * job waiting to be dispatched to a worker node. Any number of threads may
+ * wait in it at once; each job is returned to only one of them, and a 
+ * thread that finds more work waiting wakes another.
  * 
  * The job is *not* removed from the Job List, but is marked as InProgress;
  * that is, it is waiting for the results from the service check.
+ * 
+ * Jobs are taken from queues of slots that need dispatcher action, so the
+ * cost of a dispatch does not depend on the size of the Job List. Received
+ * jobs needing an Ack are returned before new jobs; new jobs are taken from
+ * the priority lanes by weighted round robin. Within a lane, jobs are sent
+ * in the order they were added, or by due time if deadline order is set.
  *
  * @param[in] pJobList - the job list from which to select a dispatchable job.
  * @param[out] pJob - the address of storage in which to return data about the
@@ -118,6 +186,23 @@ int dnxJobListMarkComplete(DnxJobList * pJobList, DnxXID * pXid);
  */
 int dnxJobListDispatch(DnxJobList * pJobList, DnxNewJob * pJob);
 
+/** Select a batch of dispatchable jobs from a job list.
+ * 
+ * Waits for a job as dnxJobListDispatch does, then takes as many more of the
+ * jobs already waiting as @p pJobs has room for, in the same order, so that
+ * a dispatcher thread can send them together. Jobs taken are handed to no
+ * other thread.
+ *
+ * @param[in] pJobList - the job list from which to select dispatchable jobs.
+ * @param[out] pJobs - storage in which to return copies of the jobs to be
+ *    dispatched.
+ * @param[in,out] count - on entry, the number of jobs @p pJobs has room for,
+ *    at least 1; on exit, the number returned, which is 0 on a timeout.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxJobListDispatchBatch(DnxJobList * pJobList, DnxNewJob * pJobs, int * count);
+
 /** Locate a pending job to which collected results should apply.
  * 
  * This routine is invoked by the Collector thread to dequeue a job from
@@ -126,14 +211,19 @@ int dnxJobListDispatch(DnxJobList * pJobList, DnxNewJob * pJob);
  * 
  * The job *is* removed from the the Job List.
  * 
+ * The runtime reported with the first result for a job is added to the
+ * average runtime of the job's plugin, which is used to order jobs by due
+ * time; see dnxJobListSetDeadlineOrder.
+ * 
  * @param[in] pJobList - the job list from which to obtain the pending job.
- * @param[in] pxid - the unique identifier for this pending job.
+ * @param[in] pRes - the result received for the pending job; its xid is 
+ *    the unique identifier of the job.
  * @param[out] pJob - the address of storage in which to return collected 
- *    result information about the job belonging to @p pxid.
+ *    result information about the job belonging to @p pRes.
  * 
  * @return Zero on success, or a non-zero error value.
  */
-int dnxJobListCollect(DnxJobList * pJobList, DnxXID * pxid, DnxNewJob * pJob);
+int dnxJobListCollect(DnxJobList * pJobList, DnxResult * pRes, DnxNewJob * pJob);
 
 /** Create a new job list.
  * 
@@ -146,13 +236,67 @@ int dnxJobListCollect(DnxJobList * pJobList, DnxXID * pxid, DnxNewJob * pJob);
  * and are pending the service check result from the worker node (state = 
  * Pending).
  * 
- * @param[in] size - the initial size of the job list to be created.
+ * Slots are allocated in fixed-size segments, so the list can grow while 
+ * jobs are in flight. Segments added during a burst are released again by 
+ * the Timer thread once they're empty, but the list never shrinks below 
+ * its initial size.
+ * 
+ * @param[in] size - the initial size of the job list to be created. This is
+ *    rounded up to a whole segment, but not beyond @p maxSize.
+ * @param[in] maxSize - the largest size the job list may grow to. Values
+ *    less than @p size create a list of fixed size.
  * @param[out] ppJobList - the address of storage for returning a new job
  *    list object pointer.
  *
  * @return Zero on success, or a non-zero error value.
  */
-int dnxJobListCreate(unsigned size, DnxJobList ** ppJobList);
+int dnxJobListCreate(unsigned size, unsigned maxSize, DnxJobList ** ppJobList);
+
+/** Set the weights and reserved worker capacity of a job list's lanes.
+ * 
+ * New jobs are dispatched from the lanes by weighted round robin, so a lane
+ * with twice the weight of another sends twice as many jobs while both 
+ * are busy. A lane with zero weight is only served when the others are 
+ * empty.
+ * 
+ * A lane's reserve is a number of idle workers held back for it and for
+ * the lanes before it; jobs in later lanes are only given a worker while 
+ * more than that many are registered. The last lane's reserve is ignored.
+ * 
+ * @param[in] pJobList - the job list to be configured.
+ * @param[in] weights - DNX_PRIORITY_MAX lane weights, most urgent first.
+ * @param[in] reserves - DNX_PRIORITY_MAX lane reserves, most urgent first.
+ */
+void dnxJobListSetLanes(DnxJobList * pJobList, unsigned * weights, 
+      unsigned * reserves);
+
+/** Choose between arrival and deadline order within each job lane.
+ * 
+ * In deadline order, the job dispatched next from a lane is the one that is
+ * due first: the one whose expiration time, less the average runtime 
+ * observed for its plugin, is earliest. When workers are scarce, this 
+ * sends the jobs that are closest to missing Nagios' timeout before those
+ * that can afford to wait. Jobs whose plugin hasn't been seen are due at 
+ * their expiration time.
+ * 
+ * Lanes are in arrival order when a job list is created.
+ * 
+ * @param[in] pJobList - the job list to be configured.
+ * @param[in] enable - non-zero for deadline order, zero for arrival order.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY, in which case some lanes 
+ *    may not have been switched.
+ */
+int dnxJobListSetDeadlineOrder(DnxJobList * pJobList, int enable);
+
+/** Return the number of idle workers that a lane's jobs must leave alone.
+ * 
+ * @param[in] pJobList - the job list to be examined.
+ * @param[in] priority - the lane (DnxJobPriority) of the job to be bound.
+ *
+ * @return The number of idle workers reserved for more urgent lanes.
+ */
+unsigned dnxJobListLaneReserve(DnxJobList * pJobList, int priority);
 
 /** Destroy a job list.
  * 
@@ -163,6 +307,13 @@ int dnxJobListCreate(unsigned size, DnxJobList ** ppJobList);
  */
 void dnxJobListDestroy(DnxJobList * pJobList);
 
+/** Return the current size and occupancy of a job list.
+ * 
+ * @param[in] pJobList - the job list to be examined.
+ * @param[out] pStats - the address of storage for returning the statistics.
+ */
+void dnxJobListGetStats(DnxJobList * pJobList, DnxJobListStats * pStats);
+
 
 
 #endif   /* _DNXJOBLIST_H_ */
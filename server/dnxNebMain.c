@@ -44,10 +44,13 @@
 #include "dnxRegistrar.h"
 #include "dnxJobList.h"
 #include "dnxNode.h"
+#include "dnxEpoch.h"
 #include "stdarg.h"
 #include "dnxXml.h"
 #include "dnxComStats.h"
 #include <netinet/in.h>
+#include <strings.h>
+#include <sys/time.h>
 
 #ifdef HAVE_CONFIG_H
 # include "config.h"
@@ -119,8 +122,47 @@ typedef struct DnxServerCfg
    char * debugFilePath;            //!< The debug log file path.
    char * auditFilePath;            //!< The audit log file path.
    unsigned debugLevel;             //!< The global debug level.
+   unsigned maxServiceSlots;        //!< The job list growth limit.
+   unsigned * laneWeights;          //!< Dispatch weights of the job lanes.
+   unsigned * laneReserves;         //!< Idle workers reserved for each lane.
+   unsigned deadlineDispatch;       //!< Boolean: dispatch lanes by due time.
+   char * workerSelection;          //!< The idle worker selection policy name.
+   unsigned dispatcherThreads;      //!< The number of dispatcher threads.
+   unsigned collectorThreads;       //!< The number of collector threads.
+   unsigned submitBatchSize;        //!< Results handed to Nagios at once.
+   unsigned submitBatchDelay;       //!< Milliseconds a result may wait for a batch.
+   unsigned injectClientToken;      //!< Boolean: add the DNX token to results.
 } DnxServerCfg;
 
+/** A host or dnxClient's entry in an affinity snapshot's host table. */
+typedef struct DnxHostAffinity
+{
+   unsigned long hash;     //!< The hash of the host name.
+   unsigned name;          //!< The offset of the host name; 0 in an empty slot.
+   DnxAffinity flag;       //!< The host's affinity.
+} DnxHostAffinity;
+
+/** An immutable snapshot of the affinity of hosts and hostgroups.
+ *
+ * A published snapshot is never changed. A writer copies it, changes the
+ * copy and publishes that in its place, and the old snapshot is freed once
+ * no reader can still be using it, so readers take no locks. Names are kept
+ * end to end in one store, and referred to by offset, so that a copy is a
+ * handful of memcpy calls.
+ */
+typedef struct DnxAffinitySnapshot
+{
+   DnxHostAffinity * hosts;   //!< Host affinity by name, open addressed.
+   unsigned hostSize;         //!< Host table slots; a power of two.
+   unsigned hostCount;        //!< Hosts in the host table.
+   unsigned * groups;         //!< The name offset of each bit's hostgroup, or 0.
+   unsigned groupCount;       //!< The number of entries in groups.
+   DnxAffinity allGroups;     //!< Every hostgroup's bit but the local one.
+   char * names;              //!< Host and hostgroup names; the first is "".
+   size_t namesLen;           //!< Bytes of names in use.
+   size_t namesSize;          //!< Bytes allocated to names.
+} DnxAffinitySnapshot;
+
 // module static data
 static DnxServerCfg cfg;            //!< The server configuration parameters.
 static DnxCfgParser * parser;       //!< The system configuration parser.
@@ -128,13 +170,22 @@ static DnxJobList * joblist;        //!< The master job list.
 static DnxRegistrar * registrar;    //!< The client node registrar.
 static DnxDispatcher * dispatcher;  //!< The job list dispatcher.
 static DnxCollector * collector;    //!< The job list results collector.
-static DnxAffinityList * hostGrpAffinity;  //!< The list of affinity groups.
-static DnxAffinityList * hostAffinity; //!< The affinity list of hosts.
+static DnxAffinitySnapshot * volatile affinity; //!< The published affinity snapshot.
+static DnxEpoch * affinityEpoch;    //!< Frees replaced affinity snapshots.
+static pthread_mutex_t affinityMutex = PTHREAD_MUTEX_INITIALIZER; //!< Serializes snapshot writers.
+static pthread_mutex_t quiesceMutex = PTHREAD_MUTEX_INITIALIZER; //!< Held while Nagios objects are read.
+static int quiesced;                //!< Nagios may be freeing its objects; under quiesceMutex.
 static time_t start_time;           //!< The module start time.
 static void * myHandle;             //!< Private NEB module handle.
 static regex_t regEx;               //!< Compiled regular expression structure.
 static unsigned long serial = 0;    //!< The number of service checks processed
 static pthread_mutex_t submitCheckMutex; //!< Make sure we serialize check submissions
+static pthread_mutex_t submitBatchMutex; //!< Protects the results awaiting submission.
+static check_result * submitHead;   //!< The results awaiting submission, oldest first.
+static check_result * submitTail;   //!< The newest result awaiting submission.
+static unsigned submitCount;        //!< The number of results awaiting submission.
+static struct timeval submitOldest; //!< When the oldest waiting result was queued.
+static DnxSubmitStats submitStats;  //!< Batch statistics; under submitCheckMutex.
 
 //SM 09/08 DnxNodeList
 DnxNode * gTopNode = NULL;
@@ -145,11 +196,33 @@ extern DCS * gTopDCS;
 extern circular_buffer service_result_buffer;   //!< Nagios result buffer
 extern int check_result_buffer_slots;           //!< Nagios result slot count
 
+/** Worker selection policy names, indexed by DnxSelectPolicy. */
+static char * selectPolicyNames[DNX_SELECT_MAX] = 
+      { "fifo", "leastJobs", "twoChoices", "latency" };
+
 
 /*--------------------------------------------------------------------------
                               IMPLEMENTATION
   --------------------------------------------------------------------------*/
 
+/** Look up a worker selection policy by name.
+ *
+ * @param[in] name - the policy name; case is ignored.
+ *
+ * @return The DnxSelectPolicy value of @p name, or -1 if there's none.
+ */
+static int selectPolicyFromName(char * name)
+{
+   int i;
+
+   for (i = 0; i < DNX_SELECT_MAX; i++)
+      if (strcasecmp(name, selectPolicyNames[i]) == 0)
+         return i;
+   return -1;
+}
+
+//----------------------------------------------------------------------------
+
 /** Cleanup the config file parser. */
 static void releaseConfig(void)
 {
@@ -195,6 +268,16 @@ static int validateCfg(DnxCfgDict * dict, void ** vptrs, void * passthru)
    cfg.debugFilePath      = (char *)vptrs[ 10];
    cfg.auditFilePath      = (char *)vptrs[11];
    cfg.debugLevel         = (unsigned)(intptr_t)vptrs[12];
+   cfg.maxServiceSlots    = (unsigned)(intptr_t)vptrs[13];
+   cfg.laneWeights        = (unsigned *)vptrs[14];
+   cfg.laneReserves       = (unsigned *)vptrs[15];
+   cfg.deadlineDispatch   = (unsigned)(intptr_t)vptrs[16];
+   cfg.workerSelection    = (char *)vptrs[17];
+   cfg.dispatcherThreads  = (unsigned)(intptr_t)vptrs[18];
+   cfg.collectorThreads   = (unsigned)(intptr_t)vptrs[19];
+   cfg.submitBatchSize    = (unsigned)(intptr_t)vptrs[20];
+   cfg.submitBatchDelay   = (unsigned)(intptr_t)vptrs[21];
+   cfg.injectClientToken  = (unsigned)(intptr_t)vptrs[22];
 
    // validate configuration items in context
    if (!cfg.dispatcherUrl)
@@ -207,6 +290,25 @@ static int validateCfg(DnxCfgDict * dict, void ** vptrs, void * passthru)
       dnxLog("config: Invalid minServiceSlots parameter.");
    else if (cfg.expirePollInterval < 1)
       dnxLog("config: Invalid expirePollInterval parameter.");
+   else if (!cfg.laneWeights || cfg.laneWeights[0] != DNX_PRIORITY_MAX)
+      dnxLog("config: Invalid laneWeights parameter; %d weights are required.",
+             DNX_PRIORITY_MAX);
+   else if (cfg.laneReserves && cfg.laneReserves[0] > DNX_PRIORITY_MAX)
+      dnxLog("config: Invalid laneReserves parameter; at most %d reserves are allowed.",
+             DNX_PRIORITY_MAX);
+   else if (!cfg.workerSelection || selectPolicyFromName(cfg.workerSelection) < 0)
+      dnxLog("config: Invalid workerSelection parameter; expected fifo, "
+             "leastJobs, twoChoices or latency.");
+   else if (cfg.dispatcherThreads < 1 
+         || cfg.dispatcherThreads > DNX_DISPATCHER_MAX_THREADS)
+      dnxLog("config: Invalid dispatcherThreads parameter; expected 1 to %d.",
+             DNX_DISPATCHER_MAX_THREADS);
+   else if (cfg.collectorThreads < 1 
+         || cfg.collectorThreads > DNX_COLLECTOR_MAX_THREADS)
+      dnxLog("config: Invalid collectorThreads parameter; expected 1 to %d.",
+             DNX_COLLECTOR_MAX_THREADS);
+   else if (cfg.submitBatchSize < 1)
+      dnxLog("config: Invalid submitBatchSize parameter.");
    else if (cfg.localCheckPattern && (err = regcomp(rep,
          cfg.localCheckPattern, REG_EXTENDED | REG_NOSUB)) != 0)
    {
@@ -247,6 +349,16 @@ static int initConfig(char * cfgfile)
       { "debugFile",          DNX_CFG_FSPATH,   &cfg.debugFilePath      },
       { "auditFile",          DNX_CFG_FSPATH,   &cfg.auditFilePath      },
       { "debugLevel",         DNX_CFG_UNSIGNED, &cfg.debugLevel         },
+      { "maxServiceSlots",    DNX_CFG_UNSIGNED, &cfg.maxServiceSlots    },
+      { "laneWeights",        DNX_CFG_UNSIGNED_ARRAY, &cfg.laneWeights  },
+      { "laneReserves",       DNX_CFG_UNSIGNED_ARRAY, &cfg.laneReserves },
+      { "deadlineDispatch",   DNX_CFG_BOOL,     &cfg.deadlineDispatch   },
+      { "workerSelection",    DNX_CFG_STRING,   &cfg.workerSelection    },
+      { "dispatcherThreads",  DNX_CFG_UNSIGNED, &cfg.dispatcherThreads  },
+      { "collectorThreads",   DNX_CFG_UNSIGNED, &cfg.collectorThreads   },
+      { "submitBatchSize",    DNX_CFG_UNSIGNED, &cfg.submitBatchSize    },
+      { "submitBatchDelay",   DNX_CFG_UNSIGNED, &cfg.submitBatchDelay   },
+      { "injectClientToken",  DNX_CFG_BOOL,     &cfg.injectClientToken  },
       { 0 },
    };
    char cfgdefs[] =
@@ -254,6 +366,15 @@ static int initConfig(char * cfgfile)
       "channelCollector = udp://0:12481\n"
       "maxNodeRequests = 0x7FFFFFFF\n"
       "minServiceSlots = 100\n"
+      "maxServiceSlots = 0x7FFFFFFF\n"
+      "laneWeights = 4,2,1\n"
+      "deadlineDispatch = No\n"
+      "workerSelection = fifo\n"
+      "dispatcherThreads = 1\n"
+      "collectorThreads = 1\n"
+      "submitBatchSize = 32\n"
+      "submitBatchDelay = 100\n"
+      "injectClientToken = Yes\n"
       "expirePollInterval = 5\n"
       "logFile = " DNX_DEFAULT_LOG "\n"
       "debugFile = " DNX_DEFAULT_DBGLOG "\n";
@@ -531,10 +652,91 @@ static int nagiosGetServiceCount(void)
 
 
 
-int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time)
+/** Return the number of microseconds from one time to a later one.
+ * 
+ * @param[in] from - the earlier time.
+ * @param[in] to - the later time.
+ * 
+ * @return The microseconds from @p from to @p to, or 0 if @p to is earlier.
+ */
+static unsigned long dnxElapsedUsec(struct timeval * from, struct timeval * to)
 {
+   long usec = (to->tv_sec - from->tv_sec) * 1000000L 
+         + (to->tv_usec - from->tv_usec);
+   return usec < 0? 0: (unsigned long)usec;
+}
+
+//----------------------------------------------------------------------------
+
+unsigned dnxSubmitFlush(int force)
+{
+   check_result * batch, * next;
+   struct timeval now, locked, unlocked;
+   unsigned long waited;
+   unsigned count;
+
+   gettimeofday(&now, 0);
+
+   // take the waiting results if there are enough, or they've waited enough
+   DNX_PT_MUTEX_LOCK(&submitBatchMutex);
+   if ((count = submitCount) == 0)
+   {
+      DNX_PT_MUTEX_UNLOCK(&submitBatchMutex);
+      return 0;
+   }
+   waited = dnxElapsedUsec(&submitOldest, &now);
+   if (!force && count < cfg.submitBatchSize 
+         && waited < cfg.submitBatchDelay * 1000UL)
+   {
+      DNX_PT_MUTEX_UNLOCK(&submitBatchMutex);
+      // round up, so the results are due when the caller next looks
+      return (unsigned)((cfg.submitBatchDelay * 1000UL - waited + 999) / 1000);
+   }
+   batch = submitHead;
+   submitHead = submitTail = 0;
+   submitCount = 0;
+   DNX_PT_MUTEX_UNLOCK(&submitBatchMutex);
+
+   // hand them all to Nagios in one critical section
+   DNX_PT_MUTEX_LOCK(&submitCheckMutex);
+   gettimeofday(&locked, 0);
+   for (; batch; batch = next)
+   {
+      next = batch->next;
+      add_check_result_to_list(batch);
+   }
+   gettimeofday(&unlocked, 0);
+
+   submitStats.batches++;
+   submitStats.results += count;
+   if (count > submitStats.maxBatch)
+      submitStats.maxBatch = count;
+   submitStats.lockUsec += dnxElapsedUsec(&locked, &unlocked);
+   if (dnxElapsedUsec(&locked, &unlocked) > submitStats.maxLockUsec)
+      submitStats.maxLockUsec = dnxElapsedUsec(&locked, &unlocked);
+   DNX_PT_MUTEX_UNLOCK(&submitCheckMutex);
+
+   dnxDebug(3, "dnxSubmitFlush: Submitted %u results in %lu us.", 
+         count, dnxElapsedUsec(&locked, &unlocked));
+
+   return 0;
+}
+
+//----------------------------------------------------------------------------
+
+void dnxSubmitGetStats(DnxSubmitStats * pStats)
+{
+   assert(pStats);
+
    DNX_PT_MUTEX_LOCK(&submitCheckMutex);
+   *pStats = submitStats;
+   DNX_PT_MUTEX_UNLOCK(&submitCheckMutex);
+}
+
+//----------------------------------------------------------------------------
 
+int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time)
+{
    check_result *chk_result;
    chk_result = (check_result *)malloc(sizeof(check_result));
    /* Set the default values in the check result structure */
@@ -570,17 +772,12 @@ int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time)
       // this was never dispatched
       dnxDebug(2, "dnxSubmitCheck: job[%lu] dnxClient=(unavailable) hostname=(%s)",
           Job->pNode->xid.objSerial, chk_result->host_name);
-      chk_result->output = xstrdup(sResult->resData);
-      xfree(sResult->resData);
+      chk_result->output = sResult->resData;
+   } else if (!cfg.injectClientToken) {
+      dnxDebug(2, "dnxSubmitCheck: dnxClient=(%s:%s) hostname=(%s) description=(%s)",
+         Job->pNode->hn, Job->pNode->addr, chk_result->host_name, chk_result->service_description);
+      chk_result->output = sResult->resData;
    } else {
-//    normalize_plugin_output(plugin_output, "B2");
-   // Encapsulate the additional data into the extended results
-      unsigned long long int *temp_aff = dnxGetAffinity(Job->host_name);
-      char * hGroup = dnxGetHostgroupFromFlags(*temp_aff, Job->pNode->flags);
-      
-      dnxDebug(2, "dnxSubmitCheck: dnxClient=(%s:%s) hostgroup=(%s) hostname=(%s) description=(%s)",
-         Job->pNode->hn, Job->pNode->addr, hGroup, chk_result->host_name, chk_result->service_description);
-   
       /* We want to add an XML token that gives Bronx (and anyone else) the DNX client info
          but doesn't leak it into the main results string
 
@@ -597,42 +794,32 @@ int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time)
       We should just be able to split on the first newline and insert our token after it.
          
       */
-      char * tokenString;
-      size_t tokenLength = asprintf(&tokenString, "<DNX><CLIENT=\"%s\"/><CLIENT_IP=\"%s\"/><HOSTGROUP=\"%s\"/></DNX>", Job->pNode->hn, Job->pNode->addr, hGroup);
-      
-      char * resultHead;
-      char * resultString;
-      size_t resultLength;
+      char token[DNX_NODE_TOKEN_MAX];
+      size_t tokenLength = dnxNodeListGetToken(Job->pNode->addr, Job->pNode->hn, token);
+
+      // the hostgroup name belongs to the affinity snapshot, so hold it 
+      // until the output has been assembled
+      DnxAffinity hostFlags = dnxGetAffinity(Job->host_name);
+      dnxEpochEnter(affinityEpoch);
+      char * hGroup = dnxGetHostgroupFromFlags(hostFlags, Job->pNode->flags);
       
-      if (tokenLength > 0) {
-         size_t firstMatch = strcspn(sResult->resData, "\n");
-
-         if(firstMatch > 0) { 
-            // Just split on the first newline and insert in between 
-            resultHead = (char *)xmalloc(firstMatch + 1);
-            strncpy(resultHead, sResult->resData, firstMatch);
-            resultHead[firstMatch]='\0'; // strncpy doesn't NULL terminate!
-            resultLength = asprintf(&resultString, "%s\n%s%s", resultHead, tokenString, strchr(sResult->resData, '\n'));
-         } else { // No perf data, no extended data
-            resultLength = asprintf(&resultString, "%s\n%s", sResult->resData, tokenString);
-         }
-         xfree(tokenString);
-      } else {
-         // Some memory allocation issue creating the token string
-         dnxDebug(1, "dnxSubmitCheck: Error allocating string.");
-      }
+      dnxDebug(2, "dnxSubmitCheck: dnxClient=(%s:%s) hostgroup=(%s) hostname=(%s) description=(%s)",
+         Job->pNode->hn, Job->pNode->addr, hGroup? hGroup: "", 
+         chk_result->host_name, chk_result->service_description);
+
+      chk_result->output = tokenLength? dnxNodeListInsertToken(sResult->resData, 
+            token, tokenLength, hGroup, MAX_PLUGIN_OUTPUT_LENGTH): 0;
+      dnxEpochExit(affinityEpoch);
    
-      if(0 < resultLength <= MAX_PLUGIN_OUTPUT_LENGTH) {
-         chk_result->output = resultString;
-         dnxDebug(3, "dnxSubmitCheck: %s", resultString);
+      if (chk_result->output) {
+         dnxDebug(3, "dnxSubmitCheck: %s", chk_result->output);
+         xfree(sResult->resData);
       } else {
          dnxDebug(2, "dnxSubmitCheck: Results string with DNX Token is too long!");
-         xfree(resultString);
-         chk_result->output = xstrdup(sResult->resData);
+         chk_result->output = sResult->resData;
       }
-      xfree(sResult->resData);
    }
-   
+   sResult->resData = 0;
    
    chk_result->return_code = sResult->resCode;
    chk_result->exited_ok = TRUE;
@@ -649,9 +836,21 @@ int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time)
       
       
    
-   /* Call the nagios function to insert the result into the result linklist */
-   add_check_result_to_list(chk_result);
-   DNX_PT_MUTEX_UNLOCK(&submitCheckMutex);
+   /* Queue the result for the next batch inserted into the nagios result linklist */
+   chk_result->next = 0;
+   DNX_PT_MUTEX_LOCK(&submitBatchMutex);
+   if (submitTail)
+      submitTail->next = chk_result;
+   else
+   {
+      submitHead = chk_result;
+      gettimeofday(&submitOldest, 0);
+   }
+   submitTail = chk_result;
+   submitCount++;
+   DNX_PT_MUTEX_UNLOCK(&submitBatchMutex);
+
+   dnxSubmitFlush(0);
    return 0;
 }
 
@@ -707,11 +906,13 @@ static int dnxCalculateJobListSize(void)
  * @param[in] pNode - a dnxClient node request structure that is being
  *    posted with this job. The dispatcher thread will send the job to the
  *    associated node.
+ * @param[in] priority - the job list lane (DnxJobPriority) for the job.
  *
  * @return Zero on success, or a non-zero error value.
  */
 static int dnxPostNewServiceJob(DnxJobList * joblist, unsigned long serial, 
-    int check_type, nebstruct_service_check_data * ds, DnxNodeRequest * pNode)
+    int check_type, nebstruct_service_check_data * ds, DnxNodeRequest * pNode,
+    int priority)
 {
    DnxNewJob Job;
    int ret;
@@ -722,12 +923,14 @@ static int dnxPostNewServiceJob(DnxJobList * joblist, unsigned long serial,
    now = time(0);
 
 
-   // fill-in the job structure with the necessary information
+   // fill-in the job structure with the necessary information; the job 
+   // list copies the names into the slot's buffer with the command line
    dnxMakeXID(&Job.xid, DNX_OBJ_JOB, serial, 0);
-   Job.host_name  = xstrdup(ds->host_name);
-   Job.service_description = xstrdup(ds->service_description);
+   Job.host_name  = ds->host_name;
+   Job.service_description = ds->service_description;
    Job.object_check_type  = check_type;
-   Job.cmd        = xstrdup(ds->command_line);
+   Job.cmd        = ds->command_line;
+   Job.priority   = priority;
    Job.start_time = ds->start_time.tv_sec;
    Job.timeout    = ds->timeout;
    // We need to expire a bit before Nagios does to make sure it get's our reply
@@ -742,7 +945,6 @@ static int dnxPostNewServiceJob(DnxJobList * joblist, unsigned long serial,
    if ((ret = dnxJobListAdd(joblist, &Job)) != DNX_OK) {
       dnxLog("dnxPostNewServiceJob: Failed to post Service Job [%lu:000000]; %s, \"%s\" Reason: %s.", 
          serial, ds->service_description, ds->command_line, dnxErrorString(ret));
-      xfree(Job.host_name);
    } else {   
       dnxDebug(2, "dnxPostNewServiceJob: TO:(%i) Expires in (%i)sec. Posting Service (%s) Job [%lu:000000]: %s, %s.", 
          ds->timeout, ((ds->start_time.tv_sec + ds->timeout - 5) - now), ds->host_name, serial, ds->service_description, ds->command_line);
@@ -777,12 +979,14 @@ static int dnxPostNewHostJob(DnxJobList * joblist, unsigned long serial,
    time_t now;
    now = time(0);
 
-   // fill-in the job structure with the necessary information
+   // fill-in the job structure with the necessary information; the job 
+   // list copies the host name into the slot's buffer with the command line
    dnxMakeXID(&Job.xid, DNX_OBJ_JOB, serial, 0);
-   Job.host_name  = xstrdup(ds->host_name); 
+   Job.host_name  = ds->host_name; 
    Job.service_description = NULL;
    Job.object_check_type = check_type;
-   Job.cmd        = xstrdup(ds->command_line); //ds->command_line;
+   Job.cmd        = ds->command_line;
+   Job.priority   = DNX_PRIORITY_HOST;
    Job.start_time = ds->start_time.tv_sec;
    Job.timeout    = ds->timeout;
    // We need to expire a bit before Nagios does to make sure it get's our reply
@@ -797,7 +1001,6 @@ static int dnxPostNewHostJob(DnxJobList * joblist, unsigned long serial,
    // post to the Job Queue
    if ((ret = dnxJobListAdd(joblist, &Job)) != DNX_OK) {
       dnxLog("dnxPostNewHostJob: Failed to post Host Job [%lu:000000]; \"%s\": %d.", serial, ds->command_line, ret);
-      xfree(Job.host_name);
    } else {
       dnxDebug(2, "dnxPostNewHostJob: TO:(%i) Expires in (%i)sec. Posting Host (%s) Job [%lu:000000]: %s.", 
          ds->timeout, ((ds->start_time.tv_sec + ds->timeout - 5) - now), ds->host_name, serial, ds->command_line);
@@ -848,20 +1051,26 @@ static int ehSvcCheck(int event_type, void * data)
 
    extern check_result check_result_info;
 
-   unsigned long long int affinity = *(dnxGetAffinity(hostObj->name));
+   DnxAffinity affinity = dnxGetAffinity(hostObj->name);
    
-   dnxDebug(4, "ehSvcCheck: [%s] Affinity flags (%llu)", hostObj->name, affinity);
+   dnxDebug(4, "ehSvcCheck: [%s] Affinity flags (%s)", hostObj->name, dnxAffinityText(affinity));
 
-   if (cfg.bypassHostgroup && (affinity & 1)) // Affinity bypass group is always the LSB
+   if (cfg.bypassHostgroup && dnxAffinityHas(affinity, 0)) // Affinity bypass group is always the LSB
    {
       dnxDebug(1, "ehSvcCheck: (bypassHostgroup match) Service for %s will execute locally: %s.", 
          hostObj->name, svcdata->command_line);
       return OK;     // tell nagios execute locally
    }
 
+   // forced checks are usually asked for by a user who is waiting on them
+   service * svcObj = (service *)svcdata->OBJECT_FIELD_NAME;
+   int priority = svcObj && (svcObj->check_options & CHECK_OPTION_FORCE_EXECUTION)
+         ? DNX_PRIORITY_ONDEMAND : DNX_PRIORITY_SCHEDULED;
+
    DnxNodeRequest * pNode = dnxCreateNodeReq();
    pNode->flags = affinity;
-   pNode->hn = xstrdup(hostObj->name);
+   // copied, as Nagios frees its host objects on reload; see dnxDeleteNodeReq
+   snprintf(pNode->hn, MAX_HOSTNAME + 1, "%s", hostObj->name);
    pNode->addr = NULL;
    pNode->xid.objSerial = serial;
    pNode->xid.objSlot = -1;
@@ -872,10 +1081,11 @@ static int ehSvcCheck(int event_type, void * data)
 //    time_t now = time(0);
 //    time_t expires = now + svcdata->timeout + DNX_DISPATCH_TIMEOUT;
    
-   if ((ret = dnxGetNodeRequest(registrar, &pNode)) != DNX_OK) { 
+   if ((ret = dnxGetNodeRequest(registrar, &pNode, 
+         dnxJobListLaneReserve(joblist, priority))) != DNX_OK) { 
    // No available workers
       if (ret == DNX_ERR_NOTFOUND) { // If NOT_FOUND we should try and queue it
-         if ((ret = dnxPostNewServiceJob(joblist, serial, check_result_info.object_check_type, svcdata, pNode)) != DNX_OK) {
+         if ((ret = dnxPostNewServiceJob(joblist, serial, check_result_info.object_check_type, svcdata, pNode, priority)) != DNX_OK) {
             dnxLog("ehSvcCheck: Unable to post job [%lu:000000]: %s.", serial, dnxErrorString(ret));
             dnxDebug(2,"ehSvcCheck: Unable to post job, no matching dnxClients [%lu]: %s.", serial, dnxErrorString(ret));
          } else {
@@ -889,7 +1099,7 @@ static int ehSvcCheck(int event_type, void * data)
       }
    } else {
    // We got a valid client worker thread
-      if ((ret = dnxPostNewServiceJob(joblist, serial, check_result_info.object_check_type, svcdata, pNode)) != DNX_OK) {
+      if ((ret = dnxPostNewServiceJob(joblist, serial, check_result_info.object_check_type, svcdata, pNode, priority)) != DNX_OK) {
          dnxLog("ehSvcCheck: Unable to post job [%lu:000000]: %s.", serial, dnxErrorString(ret));
          dnxDebug(2, "ehSvcCheck: Unable to post job [%lu:000000]: %s.", serial, dnxErrorString(ret));
       } else {
@@ -997,11 +1207,11 @@ static int ehHstCheck(int event_type, void * data)
       return OK;     // tell nagios execute locally
    }
 
-   unsigned long long int affinity = *(dnxGetAffinity(hostObj->name));
+   DnxAffinity affinity = dnxGetAffinity(hostObj->name);
 
-   dnxDebug(3, "ehHstCheck: [%s] Affinity flags (%llu)", hostObj->name, affinity);
+   dnxDebug(3, "ehHstCheck: [%s] Affinity flags (%s)", hostObj->name, dnxAffinityText(affinity));
 
-   if (cfg.bypassHostgroup && (affinity & 1)) // Affinity bypass group is always the LSB
+   if (cfg.bypassHostgroup && dnxAffinityHas(affinity, 0)) // Affinity bypass group is always the LSB
    {
       dnxDebug(1, "ehHstCheck: (bypassHostgroup match) Service for %s will execute locally: %s.", 
          hostObj->name, hstdata->command_line);      
@@ -1011,7 +1221,8 @@ static int ehHstCheck(int event_type, void * data)
       
    DnxNodeRequest * pNode = dnxCreateNodeReq();
    pNode->flags = affinity;
-   pNode->hn = xstrdup(hostObj->name);
+   // copied, as Nagios frees its host objects on reload; see dnxDeleteNodeReq
+   snprintf(pNode->hn, MAX_HOSTNAME + 1, "%s", hostObj->name);
    pNode->addr = NULL;
    pNode->xid.objSerial = serial;
    pNode->xid.objSlot = -1;
@@ -1049,7 +1260,8 @@ static int ehHstCheck(int event_type, void * data)
 	/* set the execution flag */
 	hostObj->is_executing=TRUE;
 	
-   if ((ret = dnxGetNodeRequest(registrar, &pNode)) != DNX_OK) { // If OK we dispatch
+   if ((ret = dnxGetNodeRequest(registrar, &pNode, 
+         dnxJobListLaneReserve(joblist, DNX_PRIORITY_HOST))) != DNX_OK) { // If OK we dispatch
       // If NOT_FOUND we should try and queue it
       if (ret == DNX_ERR_NOTFOUND) {    
          if ((ret = dnxPostNewHostJob(joblist, serial, HOST_CHECK, hstdata, pNode)) != DNX_OK) {
@@ -1095,6 +1307,613 @@ static int ehHstCheck(int event_type, void * data)
 // forward declaration due to circular reference
 static int ehProcessData(int event_type, void * data);
 
+/** Return the hash of a host name.
+ *
+ * @param[in] name - the host name to be hashed.
+ *
+ * @return The hash value (FNV-1a).
+ */
+static unsigned long dnxHostHash(char * name)
+{
+   unsigned long hash = 2166136261UL;
+
+   while (*name)
+      hash = (hash ^ (unsigned char)*name++) * 16777619UL;
+   return hash;
+}
+
+//----------------------------------------------------------------------------
+
+/** Add a name to an affinity snapshot's name store.
+ *
+ * @param[in] snap - the unpublished snapshot to be changed.
+ * @param[in] name - the name to be added.
+ * @param[out] pOffset - the address of storage for returning the offset of
+ *    the name's copy in the store.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY.
+ */
+static int dnxSnapAddName(DnxAffinitySnapshot * snap, char * name, 
+      unsigned * pOffset)
+{
+   size_t len = strlen(name) + 1;
+   size_t size = snap->namesSize;
+   char * names;
+
+   while (snap->namesLen + len > size)
+      size = size? 2 * size: 4096;
+   if (size != snap->namesSize)
+   {
+      if ((names = (char *)xrealloc(snap->names, size)) == 0)
+         return DNX_ERR_MEMORY;
+      snap->names = names;
+      snap->namesSize = size;
+   }
+   memcpy(snap->names + snap->namesLen, name, len);
+   *pOffset = (unsigned)snap->namesLen;
+   snap->namesLen += len;
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Locate a host's slot in an affinity snapshot's host table.
+ *
+ * The table must have at least one empty slot.
+ *
+ * @param[in] snap - the snapshot to be searched.
+ * @param[in] name - the host name to be located.
+ * @param[in] hash - the hash of @p name.
+ *
+ * @return The host's slot, or the empty slot where it would be added.
+ */
+static DnxHostAffinity * dnxSnapSlot(DnxAffinitySnapshot * snap, char * name, 
+      unsigned long hash)
+{
+   unsigned mask = snap->hostSize - 1;
+   unsigned i = (unsigned)hash & mask;
+
+   while (snap->hosts[i].name && (snap->hosts[i].hash != hash 
+         || strcmp(snap->names + snap->hosts[i].name, name) != 0))
+      i = (i + 1) & mask;
+   return &snap->hosts[i];
+}
+
+//----------------------------------------------------------------------------
+
+/** Make room in an affinity snapshot's host table for a number of hosts.
+ *
+ * The table is kept at most half full, so probe sequences stay short.
+ *
+ * @param[in] snap - the unpublished snapshot to be changed.
+ * @param[in] count - the number of hosts the table must be able to hold.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxSnapReserve(DnxAffinitySnapshot * snap, unsigned count)
+{
+   DnxHostAffinity * oldHosts = snap->hosts;
+   unsigned oldSize = snap->hostSize;
+   unsigned newSize = oldSize? oldSize: 256;
+   unsigned i;
+
+   while (newSize < 2 * count)
+      newSize *= 2;
+   if (newSize == oldSize)
+      return DNX_OK;
+
+   if ((snap->hosts = (DnxHostAffinity *)xcalloc(newSize, sizeof *snap->hosts)) == 0)
+   {
+      snap->hosts = oldHosts;
+      return DNX_ERR_MEMORY;
+   }
+   snap->hostSize = newSize;
+   for (i = 0; i < oldSize; i++)
+      if (oldHosts[i].name)
+         *dnxSnapSlot(snap, snap->names + oldHosts[i].name, oldHosts[i].hash) 
+               = oldHosts[i];
+   xfree(oldHosts);
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return a host's entry in an affinity snapshot, adding it if need be.
+ *
+ * A host that is added has an empty affinity.
+ *
+ * @param[in] snap - the unpublished snapshot to be changed.
+ * @param[in] name - the name of the host; the string is copied.
+ *
+ * @return The host's entry, or 0 if no memory is available.
+ */
+static DnxHostAffinity * dnxSnapEntry(DnxAffinitySnapshot * snap, char * name)
+{
+   unsigned long hash = dnxHostHash(name);
+   DnxHostAffinity * pSlot;
+   unsigned offset;
+
+   if (dnxSnapReserve(snap, snap->hostCount + 1) != DNX_OK)
+      return 0;
+
+   if ((pSlot = dnxSnapSlot(snap, name, hash))->name == 0)
+   {
+      if (dnxSnapAddName(snap, name, &offset) != DNX_OK)
+         return 0;
+      pSlot->name = offset;
+      pSlot->hash = hash;
+      pSlot->flag = 0;
+      snap->hostCount++;
+   }
+   return pSlot;
+}
+
+//----------------------------------------------------------------------------
+
+/** Free an affinity snapshot.
+ *
+ * @param[in] data - the snapshot to be freed; may be 0.
+ */
+static void dnxSnapRelease(void * data)
+{
+   DnxAffinitySnapshot * snap = (DnxAffinitySnapshot *)data;
+
+   if (!snap)
+      return;
+   xfree(snap->hosts);
+   xfree(snap->groups);
+   xfree(snap->names);
+   xfree(snap);
+}
+
+//----------------------------------------------------------------------------
+
+/** Copy an affinity snapshot, so that the copy may be changed.
+ *
+ * @param[in] snap - the snapshot to be copied; 0 to create an empty one.
+ * @param[out] pCopy - the address of storage for returning the copy.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY.
+ */
+static int dnxSnapCopy(DnxAffinitySnapshot * snap, DnxAffinitySnapshot ** pCopy)
+{
+   DnxAffinitySnapshot * copy;
+   int ret = DNX_ERR_MEMORY;
+
+   if ((copy = (DnxAffinitySnapshot *)xcalloc(1, sizeof *copy)) == 0)
+      return DNX_ERR_MEMORY;
+
+   if (!snap)
+   {
+      // the first name is the empty string, so no entry has offset 0
+      if ((copy->names = (char *)xcalloc(1, 4096)) != 0)
+      {
+         copy->namesLen = 1;
+         copy->namesSize = 4096;
+         ret = DNX_OK;
+      }
+   }
+   else if ((copy->hosts = (DnxHostAffinity *)xmalloc(
+               snap->hostSize * sizeof *snap->hosts)) != 0
+         && (copy->groups = (unsigned *)xmalloc(
+               (snap->groupCount + 1) * sizeof *snap->groups)) != 0
+         && (copy->names = (char *)xmalloc(snap->namesSize)) != 0)
+   {
+      memcpy(copy->hosts, snap->hosts, snap->hostSize * sizeof *snap->hosts);
+      memcpy(copy->groups, snap->groups, snap->groupCount * sizeof *snap->groups);
+      memcpy(copy->names, snap->names, snap->namesLen);
+      copy->hostSize = snap->hostSize;
+      copy->hostCount = snap->hostCount;
+      copy->groupCount = snap->groupCount;
+      copy->allGroups = snap->allGroups;
+      copy->namesLen = snap->namesLen;
+      copy->namesSize = snap->namesSize;
+      ret = DNX_OK;
+   }
+
+   if (ret != DNX_OK)
+      dnxSnapRelease(copy);
+   else
+      *pCopy = copy;
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Publish a new affinity snapshot in place of the current one.
+ *
+ * The replaced snapshot is freed once no reader can still be using it. The
+ * caller must hold the affinity mutex.
+ *
+ * @param[in] snap - the snapshot to be published; it may not be changed
+ *    from here on.
+ */
+static void dnxSnapPublish(DnxAffinitySnapshot * snap)
+{
+   DnxAffinitySnapshot * old = affinity;
+
+   __sync_synchronize();   // the snapshot is complete before it is seen
+   affinity = snap;
+
+   if (old && dnxEpochRetire(affinityEpoch, old, dnxSnapRelease) != DNX_OK)
+      dnxLog("dnxSnapPublish: Out of memory retiring an affinity snapshot; "
+            "it will not be freed.");
+}
+
+//----------------------------------------------------------------------------
+
+/** Look up a host's affinity.
+ *
+ * @param[in] name - the name of the host to be found.
+ * @param[out] pFlag - the address of storage for returning the host's 
+ *    affinity.
+ *
+ * @return Zero on success, or DNX_ERR_NOTFOUND if the host is not known.
+ */
+static int dnxHostCacheFind(char * name, DnxAffinity * pFlag)
+{
+   unsigned long hash = dnxHostHash(name);
+   DnxAffinitySnapshot * snap;
+   DnxHostAffinity * pSlot;
+   int ret = DNX_ERR_NOTFOUND;
+
+   dnxEpochEnter(affinityEpoch);
+   if ((snap = affinity) != 0 && snap->hostCount 
+         && (pSlot = dnxSnapSlot(snap, name, hash))->name)
+   {
+      *pFlag = pSlot->flag;
+      ret = DNX_OK;
+   }
+   dnxEpochExit(affinityEpoch);
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Add affinity to a host.
+ *
+ * A host that is not yet known is added with @p flag; the affinity of one
+ * that is becomes the union of the two. The current snapshot is copied,
+ * changed and published, which costs time in proportion to the number of
+ * hosts, but only happens for hosts and dnxClients Nagios doesn't know of.
+ *
+ * @param[in] name - the name of the host; the string is copied.
+ * @param[in] flag - the affinity to be added to the host.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxHostCacheAdd(char * name, DnxAffinity flag)
+{
+   DnxAffinitySnapshot * snap;
+   DnxHostAffinity * pSlot;
+   int ret;
+
+   DNX_PT_MUTEX_LOCK(&affinityMutex);
+   if ((ret = dnxSnapCopy(affinity, &snap)) == DNX_OK)
+   {
+      if ((pSlot = dnxSnapEntry(snap, name)) == 0)
+         ret = DNX_ERR_MEMORY;
+      else
+      {
+         dnxDebug(3, "dnxHostCacheAdd: Item [%s] flag was (%s)", 
+               name, dnxAffinityText(pSlot->flag));
+         if ((ret = dnxAffinityUnion(pSlot->flag, flag, &pSlot->flag)) == DNX_OK)
+            dnxDebug(3, "dnxHostCacheAdd: Item [%s] flag is now (%s)", 
+                  name, dnxAffinityText(pSlot->flag));
+      }
+      if (ret == DNX_OK)
+         dnxSnapPublish(snap);
+      else
+         dnxSnapRelease(snap);
+   }
+   DNX_PT_MUTEX_UNLOCK(&affinityMutex);
+
+   if (ret != DNX_OK)
+      dnxLog("dnxHostCacheAdd: Out of memory adding [%s] to the host cache.", name);
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Compute the affinity of every Nagios host from its hostgroups.
+ *
+ * Every host is added to the snapshot, and then each hostgroup's member 
+ * list is walked once, setting the group's bit in the affinity of its 
+ * members. This takes time in proportion to the number of hosts plus the
+ * number of hostgroup memberships, where asking Nagios whether each host
+ * is a member of each hostgroup took time in proportion to their product.
+ * Hosts in no hostgroup have an empty affinity. The name of each bit's 
+ * hostgroup is recorded as well.
+ *
+ * @param[in] snap - the unpublished snapshot to be filled in.
+ * @param[in] groups - the hostgroup of each affinity bit; null where a bit
+ *    has no group.
+ * @param[in] bits - the number of entries in @p groups.
+ * @param[out] pMembers - the address of storage for returning the number 
+ *    of hostgroup memberships.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxSnapBuild(DnxAffinitySnapshot * snap, hostgroup ** groups, 
+      unsigned bits, unsigned long * pMembers)
+{
+   extern host *host_list;
+   unsigned words = (bits + DNX_AFFINITY_WORD_BITS - 1) / DNX_AFFINITY_WORD_BITS;
+   DnxAffinityWord * rows = 0;
+   DnxHostAffinity * pSlot;
+   DnxAffinity flag;
+   host * temp_host;
+   unsigned count = 0, bit, i;
+   int ret = DNX_OK;
+
+   *pMembers = 0;
+
+   // name each bit's hostgroup
+   xfree(snap->groups);
+   if ((snap->groups = (unsigned *)xcalloc(bits + 1, sizeof *snap->groups)) == 0)
+      return DNX_ERR_MEMORY;
+   snap->groupCount = bits;
+   for (bit = 0; ret == DNX_OK && bit < bits; bit++)
+      if (groups[bit])
+         ret = dnxSnapAddName(snap, groups[bit]->group_name, &snap->groups[bit]);
+
+   // reserving room for every host first keeps the slots where they are
+   for (temp_host = host_list; temp_host; temp_host = temp_host->next)
+      count++;
+   if (ret == DNX_OK)
+      ret = dnxSnapReserve(snap, snap->hostCount + count);
+   for (temp_host = host_list; ret == DNX_OK && temp_host; temp_host = temp_host->next)
+      if (dnxSnapEntry(snap, temp_host->name) == 0)
+         ret = DNX_ERR_MEMORY;
+   if (ret == DNX_OK && (rows = (DnxAffinityWord *)xcalloc(
+         (size_t)snap->hostSize * words, sizeof *rows)) == 0)
+      ret = DNX_ERR_MEMORY;
+
+   // accumulate each host's bits in the row of its slot
+   for (bit = 0; ret == DNX_OK && bit < bits; bit++)
+   {
+#if CURRENT_NEB_API_VERSION == 2
+      hostgroupmember * member;
+#else
+      hostsmember * member;
+#endif
+      if (!groups[bit])
+         continue;
+      for (member = groups[bit]->members; member; member = member->next)
+      {
+         pSlot = dnxSnapSlot(snap, member->host_name, dnxHostHash(member->host_name));
+         if (!pSlot->name)
+            continue;
+         rows[(pSlot - snap->hosts) * words + bit / DNX_AFFINITY_WORD_BITS] 
+               |= (DnxAffinityWord)1 << (bit % DNX_AFFINITY_WORD_BITS);
+         (*pMembers)++;
+      }
+   }
+
+   // and intern each host's affinity once, merging any it already had
+   for (i = 0; ret == DNX_OK && i < snap->hostSize; i++)
+   {
+      if (!snap->hosts[i].name)
+         continue;
+      if ((ret = dnxAffinityMake(&rows[i * words], words, &flag)) == DNX_OK)
+         ret = dnxAffinityUnion(snap->hosts[i].flag, flag, &snap->hosts[i].flag);
+      dnxDebug(2, "dnxSnapBuild: Host [%s] has (%s) flags.", 
+            snap->names + snap->hosts[i].name, dnxAffinityText(snap->hosts[i].flag));
+   }
+
+   // unaffiliated dnxClients may run checks for any hostgroup but the local one
+   if (ret == DNX_OK)
+      ret = dnxAffinityRange(1, bits - 1, &snap->allGroups);
+
+   xfree(rows);
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Find the affinity bit of a hostgroup in an affinity snapshot.
+ *
+ * @param[in] snap - the snapshot to be searched; may be null.
+ * @param[in] name - the name of the hostgroup to be located.
+ *
+ * @return The hostgroup's bit, or 0 if it has none; the bypass group's bit
+ *    is not searched.
+ */
+static unsigned dnxSnapGroupBit(DnxAffinitySnapshot * snap, char * name)
+{
+   unsigned bit;
+
+   for (bit = 1; snap && bit < snap->groupCount; bit++)
+      if (snap->groups[bit] && strcmp(snap->names + snap->groups[bit], name) == 0)
+         return bit;
+   return 0;
+}
+
+//----------------------------------------------------------------------------
+
+/** Determine whether two affinity snapshots give the same hostgroup bits.
+ *
+ * @param[in] a - the first snapshot to be compared.
+ * @param[in] b - the second snapshot to be compared.
+ *
+ * @return Non-zero if every bit names the same hostgroup in both, or zero.
+ */
+static int dnxSnapSameGroups(DnxAffinitySnapshot * a, DnxAffinitySnapshot * b)
+{
+   unsigned bit;
+
+   if (a->groupCount != b->groupCount)
+      return 0;
+   for (bit = 0; bit < a->groupCount; bit++)
+      if (!a->groups[bit] != !b->groups[bit] || (a->groups[bit] 
+            && strcmp(a->names + a->groups[bit], b->names + b->groups[bit]) != 0))
+         return 0;
+   return 1;
+}
+
+//----------------------------------------------------------------------------
+
+/** Compute the affinity of the Nagios hosts and hostgroups, and publish it.
+ *
+ * Each hostgroup is given an affinity bit of its own, the bypass group 
+ * bit 0, and hosts are given the bits of their hostgroups. Hosts in 
+ * hostgroups without a dnxClient are then forced into the local group. 
+ *
+ * When Nagios has reloaded its configuration, the affinity is computed 
+ * afresh and compared with the one published. Hostgroups still defined 
+ * keep their bits, so the affinity held by jobs in flight and registered 
+ * workers keeps its meaning, and only hosts whose hostgroups changed are 
+ * given another. A new hostgroup takes a bit that was already unused 
+ * before the reload, never that of a hostgroup just removed, which jobs
+ * and workers may still hold. dnxClients Nagios doesn't know of are 
+ * dropped, and looked up again when next seen. Nothing is published if 
+ * nothing has changed.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxBuildAffinity(void)
+{
+   extern hostgroup *hostgroup_list;
+   hostgroup * temp_hostgroup;
+   hostgroup ** groups;
+   DnxAffinitySnapshot * snap = 0, * old;
+   DnxHostAffinity * pOld;
+   DnxAffinity flag, local, clientless = 0;
+   unsigned long members = 0;
+   struct timespec t0, t1;
+   unsigned groupCount = 0, bits = 1, oldBits = 0, next, spare = 1, bit, i;
+   unsigned added = 0, changed = 0, kept = 0, named = 0, oldCount = 0;
+   int ret, publish = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (temp_hostgroup=hostgroup_list; temp_hostgroup!=NULL; temp_hostgroup=temp_hostgroup->next) 
+      groupCount++;
+
+   /* Note:
+      We need to change this flag system so that
+         A) The flag bit's represent dnxClients instead of hostgroups
+         B) The check looks at the hostgroup being used, not the host
+            so that a host can be a member of several groups, but the check
+            will always go to a node designed to handle that check.
+   */
+   DNX_PT_MUTEX_LOCK(&affinityMutex);
+
+   // the hostgroup of each affinity bit; bit 0 is the bypass group's
+   if ((old = affinity) != 0)
+   {
+      oldCount = old->hostCount;
+      oldBits = old->groupCount;
+   }
+   next = oldBits > 1? oldBits: 1;
+   if ((groups = (hostgroup **)xcalloc(next + groupCount, sizeof *groups)) == 0)
+      ret = DNX_ERR_MEMORY;
+   else if ((ret = dnxAffinityBit(0, &local)) == DNX_OK
+         && (ret = dnxSnapCopy(0, &snap)) == DNX_OK)
+   {
+      // each hostgroup gets a bit of its own, however many there are, 
+      // and keeps the one it had before a reload
+      for (temp_hostgroup=hostgroup_list; temp_hostgroup!=NULL; temp_hostgroup=temp_hostgroup->next) 
+      {
+        dnxDebug(1, "dnxBuildAffinity: Entering hostgroup init loop: %s", temp_hostgroup->group_name);
+        if(cfg.bypassHostgroup && strcmp(cfg.bypassHostgroup, temp_hostgroup->group_name)==0) {
+           // This is the bypass group and should be assigned the NULL flag
+           groups[0] = temp_hostgroup;
+           dnxDebug(1, "dnxBuildAffinity: (bypassHostgroup match) Service for %s hostgroup will execute locally.", 
+           temp_hostgroup->group_name);
+           continue;
+        }
+        if ((bit = dnxSnapGroupBit(old, temp_hostgroup->group_name)) == 0) {
+           while (spare < oldBits && old->groups[spare])
+              spare++;
+           bit = spare < oldBits? spare++: next++;
+        }
+        dnxDebug(1, "dnxBuildAffinity: Hostgroup [%s] uses bit %u.", temp_hostgroup->group_name, bit);
+        groups[bit] = temp_hostgroup;
+        named++;
+        if (bit >= bits)
+           bits = bit + 1;
+      }
+
+      // Create the host table from the hostgroup member lists
+      ret = dnxSnapBuild(snap, groups, bits, &members);
+
+      // Make a bitmask where the 'holes' represent non-dnxClient hostgroups
+      // by bitwise OR ing all the dnxClients
+      for (i = 0; ret == DNX_OK && i < snap->hostSize; i++)
+      {
+         flag = snap->hosts[i].flag;
+         if(snap->hosts[i].name && dnxIsDnxClient(flag)) {
+            ret = dnxAffinityUnion(clientless, flag, &clientless);
+            dnxDebug(2, "dnxBuildAffinity: [%s] is a dnxClient  covered groups now (%s)", 
+               snap->names + snap->hosts[i].name, dnxAffinityText(clientless));
+         }
+      }
+
+      // Check a hosts bitmask flag against the clientless hostgroups flag
+      // and if it's not covered by a dnxClient, force it into the locals group
+      // FIXME?
+      for (i = 0; ret == DNX_OK && i < snap->hostSize; i++)
+      {
+         flag = snap->hosts[i].flag;
+         if(snap->hosts[i].name && !dnxAffinityIsSubset(flag, clientless)) {
+            dnxDebug(2, "dnxBuildAffinity: [%s] is in a hostgroup with no dnxClient",
+               snap->names + snap->hosts[i].name);
+            ret = dnxAffinityUnion(flag, local, &snap->hosts[i].flag);
+         }
+      }
+
+      // compare each host with its published affinity
+      for (i = 0; ret == DNX_OK && i < snap->hostSize; i++)
+      {
+         if (!snap->hosts[i].name)
+            continue;
+         if (!old || !old->hostCount || !(pOld = dnxSnapSlot(old, 
+               snap->names + snap->hosts[i].name, snap->hosts[i].hash))->name)
+            added++;
+         else if (pOld->flag != snap->hosts[i].flag)
+         {
+            dnxDebug(2, "dnxBuildAffinity: [%s] changes from (%s) flags.",
+               snap->names + snap->hosts[i].name, dnxAffinityText(pOld->flag));
+            changed++;
+         }
+         else
+            kept++;
+      }
+      publish = !old || added || changed || kept != oldCount 
+            || !dnxSnapSameGroups(old, snap);
+   }
+
+   if (ret == DNX_OK && publish)
+      dnxSnapPublish(snap);
+   else
+      dnxSnapRelease(snap);
+
+   DNX_PT_MUTEX_UNLOCK(&affinityMutex);
+
+   xfree(groups);
+
+   if (ret != DNX_OK)
+   {
+      dnxLog("Failed to compute host affinity: %s.", dnxErrorString(ret));
+      return ret;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   if (!old)
+      dnxLog("Computed the affinity of %u hosts in %u hostgroups (%lu memberships) in %ld ms.",
+            added, named, members, 
+            (long)((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000));
+   else
+      dnxLog("Recomputed the affinity of %u hosts in %u hostgroups in %ld ms: "
+            "%u added, %u changed, %u dropped%s.", added + changed + kept, 
+            named, (long)((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000),
+            added, changed, oldCount - changed - kept, 
+            publish? "": "; nothing to publish");
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
 /** Deinitialize the dnx server.
  *
  * @return Always returns zero.
@@ -1118,9 +1937,14 @@ static int dnxServerDeInit(void)
 
    if (joblist)
       dnxJobListDestroy(joblist);
-      
-   // Should make sure that the affinity list is freed
 
+   // the collector and timer threads are gone; hand Nagios what they left
+   dnxSubmitFlush(1);
+
+   joblist = 0;
+   registrar = 0;
+   dispatcher = 0;
+   collector = 0;
 
    // it doesn't matter if we haven't initialized the
    // channel map - it can figure that out for itself
@@ -1132,6 +1956,18 @@ static int dnxServerDeInit(void)
    dnxNodeListDestroy();
    //SM 09/08 END DnxNodeList
 
+   // jobs and threads holding node requests are gone by now
+   dnxNodeReqPoolRelease();
+
+   // as are the readers of the affinity snapshot, and the worker nodes and
+   // jobs holding affinity sets; all are rebuilt on the next init
+   dnxSnapRelease(affinity);
+   affinity = 0;
+   if (affinityEpoch)
+      dnxEpochDestroy(affinityEpoch);
+   affinityEpoch = 0;
+   dnxAffinityRelease();
+
    return OK;
 }
 
@@ -1150,132 +1986,95 @@ static int dnxServerInit(void)
    registrar = 0;
    dispatcher = 0;
    collector = 0;
-   hostGrpAffinity = (DnxAffinityList *)malloc(sizeof(DnxAffinityList));
-   hostAffinity = (DnxAffinityList *)malloc(sizeof(DnxAffinityList));
-   hostAffinity->flag = 0ULL;
-   hostAffinity->name = NULL;
-   hostAffinity->next = hostAffinity;
-   hostGrpAffinity->flag = 0ULL;
-   hostGrpAffinity->name = NULL;
-   hostGrpAffinity->next = hostGrpAffinity;
-   DnxAffinityList * temp_aff;
-   hostgroup * hostgroupObj;
    DNX_PT_MUTEX_INIT(&submitCheckMutex);
+   DNX_PT_MUTEX_INIT(&submitBatchMutex);
+   memset(&submitStats, 0, sizeof submitStats);
+
+   if ((ret = dnxEpochCreate(&affinityEpoch)) != 0)
+   {
+      dnxLog("Failed to initialize affinity epoch domain: %s.", dnxErrorString(ret));
+      return ret;
+   }
 
    if ((ret = dnxChanMapInit(0)) != 0)
    {
       dnxLog("Failed to initialize channel map: %s.", dnxErrorString(ret));
       return ret;
    }
+
+   if ((ret = dnxNodeReqPoolInit()) != 0)
+   {
+      dnxLog("Failed to initialize node request pool: %s.", dnxErrorString(ret));
+      return ret;
+   }
    
    // These need to be initialized before threads start trying to record stats....
    gTopNode = dnxNodeListCreateNode("127.0.0.1", "localhost");
 //    dnxNodeListSetNodeAffinity("127.0.0.1", "localhost");
 
-   // Create the list of affinity groups (Nagios Hostgroups)
-   // Get the list of host groups
-   extern hostgroup *hostgroup_list;
-   hostgroup * temp_hostgroup;
-   // Create affinity linked list
-   unsigned long long int flag = 2ULL;
-   for (temp_hostgroup=hostgroup_list; temp_hostgroup!=NULL; temp_hostgroup=temp_hostgroup->next) 
-   {
-     dnxDebug(1, "dnxServerInit: Entering hostgroup init loop: %s", temp_hostgroup->group_name);
-     if(strcmp(cfg.bypassHostgroup, temp_hostgroup->group_name)==0) {
-        // This is the bypass group and should be assigned the NULL flag
-        dnxAddAffinity(hostGrpAffinity, temp_hostgroup->group_name, 1);
-        dnxDebug(1, "dnxServerInit: (bypassHostgroup match) Service for %s hostgroup will execute locally.", 
-        temp_hostgroup->group_name);
-     } else {
-        dnxDebug(1, "dnxServerInit: Hostgroup [%s] uses (%llu) flag.", temp_hostgroup->group_name, flag);
-        dnxAddAffinity(hostGrpAffinity, temp_hostgroup->group_name, flag); 
-        flag <<= 1ULL;
-     }
-   }
+   // Create the affinity of Nagios Hostgroups and hosts
+   if ((ret = dnxBuildAffinity()) != DNX_OK)
+      return ret;
 
-   /* Note:
-      We need to change this flag system so that
-         A) The flag bit's represent dnxClients instead of hostgroups
-         B) The check looks at the hostgroup being used, not the host
-            so that a host can be a member of several groups, but the check
-            will always go to a node designed to handle that check.
-   */
-   // Create initial host list
-   extern host *host_list;
-   host * temp_host;
-   for (temp_host=host_list; temp_host!=NULL; temp_host=temp_host->next ) 
-   {
-      dnxDebug(2, "Adding host [%s] to hostAffinity cache.", temp_host->name);
-      flag = 0ULL;
-      temp_aff = hostGrpAffinity;
-      while (temp_aff != NULL) {
-         // Recurse through the affinity list
-         dnxDebug(6, "dnxServerInit: Recursing affinity list - [%s] = (%llu)", 
-         temp_aff->name, temp_aff->flag);
-         // Is host in this group?
-         hostgroupObj = find_hostgroup(temp_aff->name);
-         if(is_host_member_of_hostgroup(hostgroupObj, temp_host))
-         {
-            flag |= temp_aff->flag;
-            dnxDebug(2, "dnxServerInit: matches [%s] flag is now (%llu)", temp_aff->name, flag);
-         } else {
-            dnxDebug(6, "dnxServerInit: no match with [%s]", temp_aff->name);
-         }
-         temp_aff = temp_aff->next;
-      }
-      dnxAddAffinity(hostAffinity, temp_host->name, flag);
-   }
-   
-   unsigned long long clientless = 0ULL;
-   // Make a bitmask where the 'holes' represent non-dnxClient hostgroups
-   // by bitwise OR ing all the dnxClients
-   for (temp_host=host_list; temp_host!=NULL; temp_host=temp_host->next ) 
-   {
-      flag = *(dnxGetAffinity(temp_host->name));
-      if(dnxIsDnxClient(flag)) {
-         clientless |= flag;
-         dnxDebug(2, "dnxServerInit: [%s] is a dnxClient  covered groups now (%llu)", temp_host->name, clientless);
-      }
-   }
-  
-   // Check a hosts bitmask flag against the clientless hostgroups flag
-   // and if it's not covered by a dnxClient, force it into the locals group
-   // FIXME?
-   for (temp_host=host_list; temp_host!=NULL; temp_host=temp_host->next ) 
-   {
-      flag = *(dnxGetAffinity(temp_host->name));
-      if((flag | clientless) != clientless) {
-         dnxDebug(2, "dnxServerInit: [%s] is in a hostgroup with no dnxClient",
-            temp_host->name);
-         dnxAddAffinity(hostAffinity, temp_host->name, 1ULL);
-      }
-   }
- 
    joblistsz = dnxCalculateJobListSize();
 
-   dnxLog("Allocating %d service request slots in the DNX job list.", joblistsz);
+   dnxLog("Allocating %d service request slots in the DNX job list "
+          "(growing to at most %u).", joblistsz, cfg.maxServiceSlots);
 
-   if ((ret = dnxJobListCreate(joblistsz, &joblist)) != 0)
+   if ((ret = dnxJobListCreate(joblistsz, cfg.maxServiceSlots, &joblist)) != 0)
    {
       dnxLog("Failed to initialize DNX job list with %d slots.", joblistsz);
       return ret;
    }
 
+   // configure the priority lanes; config arrays are prefixed with a count
+   {
+      unsigned reserves[DNX_PRIORITY_MAX];
+      int i;
+
+      for (i = 0; i < DNX_PRIORITY_MAX; i++)
+         reserves[i] = cfg.laneReserves && i < (int)cfg.laneReserves[0]
+               ? cfg.laneReserves[i + 1] : 0;
+      dnxJobListSetLanes(joblist, &cfg.laneWeights[1], reserves);
+      dnxLog("Job lane weights (host/on-demand/scheduled): %u/%u/%u; "
+             "reserved workers: %u/%u.", cfg.laneWeights[1], cfg.laneWeights[2],
+             cfg.laneWeights[3], reserves[0], reserves[1]);
+   }
+
+   if (cfg.deadlineDispatch)
+   {
+      if ((ret = dnxJobListSetDeadlineOrder(joblist, 1)) != DNX_OK)
+      {
+         dnxLog("Failed to set deadline dispatch order: %s.", dnxErrorString(ret));
+         return ret;
+      }
+      dnxLog("Dispatching each job lane in deadline order.");
+   }
+
    // create and configure collector
    if ((ret = dnxCollectorCreate("Collect", cfg.collectorUrl,
-         joblist, &collector)) != 0)
+         joblist, cfg.collectorThreads, &collector)) != 0)
       return ret;
+   dnxLog("Collecting results on %u thread%s.", cfg.collectorThreads,
+         cfg.collectorThreads == 1? "": "s");
 
    // create and configure dispatcher
    if ((ret = dnxDispatcherCreate("Dispatch", cfg.dispatcherUrl,
-         joblist, &dispatcher)) != 0)
+         joblist, cfg.dispatcherThreads, &dispatcher)) != 0)
       return ret;
+   dnxLog("Dispatching jobs on %u thread%s.", cfg.dispatcherThreads,
+         cfg.dispatcherThreads == 1? "": "s");
 
    // create worker node registrar
    if ((ret = dnxRegistrarCreate(joblistsz * 2,
          dnxDispatcherGetChannel(dispatcher), &registrar)) != 0)
       return ret;
 
+   dnxRegistrarSetPolicy(registrar, 
+         (DnxSelectPolicy)selectPolicyFromName(cfg.workerSelection));
+   dnxLog("Selecting idle workers by the %s policy.", 
+         selectPolicyNames[selectPolicyFromName(cfg.workerSelection)]);
+
    pthread_t tid;
    if ((ret = pthread_create(&tid, NULL, (void *(*)(void *))dnxStatsRequestListener, NULL)) != 0)
    //if ((ret = pthread_create(&tid, 0, dnxStatsRequestListener, NULL)) != 0)
@@ -1297,6 +2096,84 @@ static int dnxServerInit(void)
 
 //----------------------------------------------------------------------------
 
+/** Stop handing Nagios checks to the dnxServer.
+ *
+ * Called when the Nagios event loop ends, which it does when Nagios shuts 
+ * down, and before it reloads its configuration. The threads keep running,
+ * so results still come back for the jobs in flight and workers stay 
+ * registered; they stop when the module is unloaded. Until the server is
+ * reloaded, new worker nodes aren't looked up in Nagios's objects, which
+ * Nagios may be freeing.
+ */
+static void dnxServerQuiesce(void)
+{
+   DNX_PT_MUTEX_LOCK(&quiesceMutex);
+   quiesced = 1;
+   DNX_PT_MUTEX_UNLOCK(&quiesceMutex);
+
+   neb_deregister_callback(NEBCALLBACK_SERVICE_CHECK_DATA, ehSvcCheck);
+   neb_deregister_callback(NEBCALLBACK_HOST_CHECK_DATA, ehHstCheck);
+   dnxLog("Deregistered for SERVICE_CHECK_DATA and HOST_CHECK_DATA events.");
+}
+
+//----------------------------------------------------------------------------
+
+/** Bring a running dnxServer up to date with a reloaded Nagios configuration.
+ *
+ * The affinity of the hosts and hostgroups is recomputed, and each worker
+ * node takes the affinity now given to its host, which its workers' 
+ * requests take as they register again. The job list, registrar, 
+ * dispatcher and collector keep running, so no job in flight is lost and 
+ * no worker has to register again. The DNX configuration file is not 
+ * read again.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxServerReload(void)
+{
+   DnxNode * pNode, * pNext;
+   DnxAffinity flag;
+   unsigned nodes = 0, changed = 0;
+   int ret;
+
+   // the affinity computed before the reload is better than none
+   if ((ret = dnxBuildAffinity()) != DNX_OK)
+      dnxLog("Keeping the host affinity computed before the reload.");
+
+   // Nagios's objects are whole again; this also corrects the nodes that 
+   // registered while they weren't
+   DNX_PT_MUTEX_LOCK(&quiesceMutex);
+   quiesced = 0;
+   DNX_PT_MUTEX_UNLOCK(&quiesceMutex);
+
+   for (pNode = gTopNode; ret == DNX_OK && pNode; pNode = pNext, nodes++)
+   {
+      flag = dnxGetAffinity(pNode->hostname);
+      DNX_PT_MUTEX_LOCK(&pNode->mutex);
+      if (flag != pNode->flags)
+      {
+         dnxDebug(2, "dnxServerReload: Node [%s,%s] has (%s) flags.",
+               pNode->address, pNode->hostname, dnxAffinityText(flag));
+         pNode->flags = flag;
+         changed++;
+      }
+      pNext = pNode->next;
+      DNX_PT_MUTEX_UNLOCK(&pNode->mutex);
+   }
+
+   neb_register_callback(NEBCALLBACK_SERVICE_CHECK_DATA, myHandle, 0, ehSvcCheck);
+   dnxLog("Registered for SERVICE_CHECK_DATA event.");
+   neb_register_callback(NEBCALLBACK_HOST_CHECK_DATA, myHandle, 0, ehHstCheck);
+   dnxLog("Registered for HOST_CHECK_DATA event.");
+
+   dnxLog("Server reload completed; %u of %u worker nodes changed affinity.",
+         changed, nodes);
+
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
 /** Launches an external command and waits for it to return a status code.
  *
  * @param[in] script - the command line to be launched.
@@ -1364,8 +2241,11 @@ static int ehProcessData(int event_type, void * data)
          launchScript(cfg.syncScript);
       }
 
+      // a server still running from before a reload keeps its threads;
       // if server init fails, do server shutdown
-      if (dnxServerInit() != 0)
+      if (joblist)
+         dnxServerReload();
+      else if (dnxServerInit() != 0)
          dnxServerDeInit();
    }
 
@@ -1373,9 +2253,9 @@ static int ehProcessData(int event_type, void * data)
    if (procdata->type == NEBTYPE_PROCESS_EVENTLOOPEND)
    {
       dnxDebug(2, "Startup handler received PROCESS_EVENTLOOPEND event.");
-      // See if we have any outstanding checks and get them back, we may need
-      // to save state or write out the checks to a temp file in the queue
-      dnxServerDeInit();
+      // Nagios may be about to reload, so only stop taking checks; the
+      // server is shut down when the module is unloaded
+      dnxServerQuiesce();
    }
    return OK;
 }
@@ -1390,11 +2270,9 @@ void dnxJobCleanup(DnxNewJob * pJob)
    {
       dnxDebug(1, "dnxJobCleanup: Job [%lu:%lu] object freed for (%s) [%s].", 
             pJob->xid.objSerial, pJob->xid.objSlot, pJob->host_name, pJob->pNode->addr);
-      xfree(pJob->cmd);
+      // the command line and names belong to the job list
       pJob->cmd = NULL;
-      xfree(pJob->host_name);
       pJob->host_name = NULL;
-      xfree(pJob->service_description);
       pJob->service_description = NULL;
       pJob->state = DNX_JOB_NULL;
       dnxDeleteNodeReq(pJob->pNode);
@@ -1613,6 +2491,9 @@ void buildStatsReplyForNode(DnxNode* pDnxNode, char* requested_stat, DnxMgmtRepl
         { "jobs_dispatched",        &pDnxNode->jobs_dispatched         },
         { "jobs_handled",           &pDnxNode->jobs_handled            },
         { "job_requests_expired",   &pDnxNode->jobs_req_exp            },
+        { "jobs_expired",           &pDnxNode->jobs_expired            },
+        { "jobs_outstanding",       &pDnxNode->jobs_outstanding        },
+        { "job_latency_ms",         &pDnxNode->latency                 },
         { "jobs_rejected_no_nodes", &pDnxNode->jobs_rejected_no_nodes  },
         { "jobs_rejected_no_memory",&pDnxNode->jobs_rejected_oom       },
         { "packets_out",            &packets_out                       },
@@ -1634,7 +2515,7 @@ void buildStatsReplyForNode(DnxNode* pDnxNode, char* requested_stat, DnxMgmtRepl
             {
                 appendString(&pReply->reply, "Reset Node %s\n",pDnxNode->address);
                 dnxComStatClear(pDnxNode->address);
-                dnxNodeListRemoveNode(pDnxNode);
+                dnxNodeListClearNode(pDnxNode);
             }else{
                 appendString(&pReply->reply,"Error: Cannot Clear Top Node, did you mean reset instead?\n");
             }
@@ -1653,7 +2534,7 @@ void buildStatsReplyForNode(DnxNode* pDnxNode, char* requested_stat, DnxMgmtRepl
         //They want help
         if(strncmp("HELP",token,strlen(token))==0)
         {
-            appendString(&pReply->reply,"HELP: Format is [node ip address* (optional)], HELP, CLEAR, RESETSTATS, ALLSTATS, AFFINITY");
+            appendString(&pReply->reply,"HELP: Format is [node ip address* (optional)], HELP, CLEAR, RESETSTATS, ALLSTATS, AFFINITY, JOBLIST, COLLECTOR");
             return;
         }
 
@@ -1712,8 +2593,6 @@ bool buildStatsReply(char * request, DnxMgmtReply * pReply)
     assert(request);
 
     DnxNode * pDnxNode = gTopNode->next; // skip the first node.
-    DnxAffinityList * temp_aff;
-    temp_aff = hostAffinity;   // Temp hostlist
 
     char * response = NULL;
     char * token = NULL;
@@ -1739,13 +2618,39 @@ bool buildStatsReply(char * request, DnxMgmtReply * pReply)
     DNX_PT_MUTEX_LOCK(&mutex);
         if(strcmp("AFFINITY",action) == 0){
             do {
-                appendString(&pReply->reply,"dnxClient (%s) IP: [%s]  Hostgroup flag [%llu]\n", 
-                  pDnxNode->hostname, pDnxNode->address, pDnxNode->flags);
+                appendString(&pReply->reply,"dnxClient (%s) IP: [%s]  Hostgroup flag [%s]\n", 
+                  pDnxNode->hostname, pDnxNode->address, dnxAffinityText(pDnxNode->flags));
             } while (pDnxNode = pDnxNode->next);
             
-            do {
-                appendString(&pReply->reply,"host (%s) Hostgroup flag [%llu]\n", temp_aff->name, temp_aff->flag);
-            } while (temp_aff = temp_aff->next);
+            DnxAffinitySnapshot * snap;
+            dnxEpochEnter(affinityEpoch);
+            for (snap = affinity, i = 0; snap && i < snap->hostSize; i++)
+                if (snap->hosts[i].name)
+                    appendString(&pReply->reply,"host (%s) Hostgroup flag [%s]\n", 
+                        snap->names + snap->hosts[i].name, dnxAffinityText(snap->hosts[i].flag));
+            dnxEpochExit(affinityEpoch);
+        }
+        else if(strcmp("JOBLIST",action) == 0)
+        {
+            DnxJobListStats jls;
+            dnxJobListGetStats(joblist, &jls);
+            appendString(&pReply->reply,"Job list slots: %lu (max %lu) in use: %lu high water: %lu\n",
+               jls.size, jls.maxSize, jls.inUse, jls.highWater);
+        }
+        else if(strcmp("COLLECTOR",action) == 0)
+        {
+            DnxCollectorStats cs;
+            if (dnxCollectorGetStats(collector, &cs) == DNX_OK)
+               appendString(&pReply->reply,"Collector threads: %u received: %lu socket drops: %lu queued bytes: %lu\n",
+                  cs.threads, cs.received, cs.drops, cs.queued);
+            else
+               appendString(&pReply->reply,"Collector threads: %u received: %lu socket drops: unavailable\n",
+                  cs.threads, cs.received);
+
+            DnxSubmitStats ss;
+            dnxSubmitGetStats(&ss);
+            appendString(&pReply->reply,"Result batches: %lu results: %lu (largest %u) Nagios lock time: %lu us (longest %lu us)\n",
+               ss.batches, ss.results, ss.maxBatch, ss.lockUsec, ss.maxLockUsec);
         }
         else
         {
@@ -1914,91 +2819,105 @@ static void * dnxStatsRequestListener(void * vpargs)
 
 //----------------------------------------------------------------------------
 
-unsigned long long int* dnxGetAffinity(char * name)
+DnxAffinity dnxGetAffinity(char * name)
 {
 
    dnxDebug(6, "dnxGetAffinity: entering with [%s]", name);
-   extern hostgroup *hostgroup_list;
-   hostgroup * hostgroupObj;
-   unsigned long long int* pFlag = (unsigned long long int*) xcalloc (1, sizeof(unsigned long long int));
+   DnxAffinitySnapshot * snap;
+   DnxAffinity flag = 0, allGroups = 0, groupFlag;
    short int match = 0;
-   DnxAffinityList * temp_aff;
-   temp_aff = hostAffinity;   // We are probably looking for a host or dnxClient
-
-   if(name == NULL) {
-        // We were passed either the local host or an unnamed (old) client
-      // This is a dnxClient that is unaffiliated with a hostgroup
-      // the default behavior should be that it can handle all requests
-      // for backwards compatibility. This is dangerous though as a rogue or
-      // misconfigured client could steal requests that it can't service.
-      *pFlag = (unsigned long long)-2; // Match all affinity but local(LSB)
-      dnxAddAffinity(hostAffinity, name, *pFlag);
-      dnxDebug(2, "dnxGetAffinity: Adding unnamed dnxClient to host cache with (%llu) flags."
-      " This host is not a member of any hostgroup and will service ALL requests!", *pFlag);
-      return pFlag;
+   unsigned bit;
+   int deferred;
+
+   // Check the host cache first; every Nagios host is in it from startup,
+   // so this is the usual way out
+   if (name && dnxHostCacheFind(name, &flag) == DNX_OK) {
+      dnxDebug(4, "dnxGetAffinity: Found [%s] in cache with (%s) flags.", 
+         name, dnxAffinityText(flag));
+      return flag;
    }
 
-   host * hostObj = find_host(name); 
+   // between the end of Nagios's event loop and its restart, its objects
+   // may be being freed, so only the hostgroup names in the snapshot are
+   // used; the affinity isn't cached, and is corrected by the reload
+   DNX_PT_MUTEX_LOCK(&quiesceMutex);
+   deferred = quiesced;
+   host * hostObj = name && !deferred? find_host(name): NULL; 
+   char * groupName;
+
+   dnxEpochEnter(affinityEpoch);
+   if ((snap = affinity) != 0) {
+      allGroups = snap->allGroups;
+      for (bit = 0; name && bit < snap->groupCount; bit++) {
+         if (!snap->groups[bit]) { continue; }
+         groupName = snap->names + snap->groups[bit];
+
+         if(!hostObj) {
+            // We might be looking for a specific affinity group flag otherwise it is
+            // a dynamically registered dnxClient that isn't in the Nagios hostlist
+            if (strcmp(groupName, name) == 0 && dnxAffinityBit(bit, &flag) == DNX_OK) {
+               dnxEpochExit(affinityEpoch);
+               DNX_PT_MUTEX_UNLOCK(&quiesceMutex);
+               dnxDebug(4, "dnxGetAffinity: Found hostgroup [%s] with (%s) flags.", 
+                  name, dnxAffinityText(flag));
+               return flag;
+            }
+            continue;
+         }
 
-   if(!hostObj) {
-      // We might be looking for a specific affinity group flag otherwise it is
-      // a dynamically registered dnxClient that isn't in the Nagios hostlist
-      hostgroupObj = find_hostgroup(name);
-      if(hostgroupObj) {
-         temp_aff = hostGrpAffinity;
+         // This is the first time we've seen this host; is it in this group?
+         if(is_host_member_of_hostgroup(find_hostgroup(groupName), hostObj)) {
+            if (dnxAffinityBit(bit, &groupFlag) != DNX_OK 
+                  || dnxAffinityUnion(flag, groupFlag, &flag) != DNX_OK)
+               dnxLog("dnxGetAffinity: Out of memory adding [%s] to the affinity of [%s].",
+                  groupName, name);
+            match++;
+            dnxDebug(4, "dnxGetAffinity: matches [%s] flag is now (%s)", 
+               groupName, dnxAffinityText(flag));
+         } else {
+            dnxDebug(6, "dnxGetAffinity: no match with [%s]", groupName);
+         }
       }
    }
+   dnxEpochExit(affinityEpoch);
+   DNX_PT_MUTEX_UNLOCK(&quiesceMutex);
 
-   // Check the host cache first
-   while (temp_aff != NULL) {
-      if(temp_aff->name == NULL) { break; }
-      dnxDebug(6, "dnxGetAffinity: Checking cache for [%s]", name);
-      if (strcmp(temp_aff->name, name) == 0) { // We have a cached copy so return
-         dnxDebug(4, "dnxGetAffinity: Found [%s] in cache with (%llu) flags.", name, temp_aff->flag);
-         xfree(pFlag);
-         return &temp_aff->flag;
-      }
-      temp_aff = temp_aff->next;
+   if(deferred && name) {
+      dnxDebug(2, "dnxGetAffinity: Nagios is reloading; [%s] dnxClient has (%s) flags"
+      " until it has.", name, dnxAffinityText(allGroups));
+      return allGroups;
    }
 
-   // This is the first time we've seen this host/dnxClient
-   temp_aff = hostGrpAffinity;
-   while (temp_aff != NULL) {
-      if(temp_aff->name == NULL) { break; }
-      // Recurse through the host group affinity list
-      dnxDebug(6, "dnxGetAffinity: Recursing Host Group list - [%s] = (%llu)", 
-      temp_aff->name, temp_aff->flag);
-
-      // Is host in this group?
-      hostgroupObj = find_hostgroup(temp_aff->name);
-      if(is_host_member_of_hostgroup(hostgroupObj, hostObj)) {
-         *pFlag |= (unsigned long long) temp_aff->flag;
-         match++;
-         dnxDebug(4, "dnxGetAffinity: matches [%s] flag is now (%llu)", temp_aff->name, *pFlag);
-      } else {
-         dnxDebug(6, "dnxGetAffinity: no match with [%s]", temp_aff->name);
-      }
-      temp_aff = temp_aff->next;
+   if(name == NULL) {
+        // We were passed either the local host or an unnamed (old) client
+      // This is a dnxClient that is unaffiliated with a hostgroup
+      // the default behavior should be that it can handle all requests
+      // for backwards compatibility. This is dangerous though as a rogue or
+      // misconfigured client could steal requests that it can't service.
+      dnxDebug(2, "dnxGetAffinity: Unnamed dnxClient has (%s) flags."
+      " This host is not a member of any hostgroup and will service ALL requests!", 
+         dnxAffinityText(allGroups));
+      return allGroups; // Match all affinity but local(LSB)
    }
 
    if(match)
    {
       // Push this into the host cache
-      dnxAddAffinity(hostAffinity, name, *pFlag);
-      dnxDebug(2, "dnxGetAffinity: Adding [%s] dnxClient to host cache with (%llu) flags.",
-         name, *pFlag);
-      return pFlag;
+      dnxHostCacheAdd(name, flag);
+      dnxDebug(2, "dnxGetAffinity: Adding [%s] dnxClient to host cache with (%s) flags.",
+         name, dnxAffinityText(flag));
+      return flag;
    } else {
       // This is a dnxClient that is unaffiliated with a hostgroup
       // the default behavior should be that it can handle all requests
       // for backwards compatibility. This is dangerous though as a rogue or
       // misconfigured client could steal requests that it can't service.
-      *pFlag = (unsigned long long)-2; // Match all affinity but local(LSB)
-      dnxAddAffinity(hostAffinity, name, *pFlag);
-      dnxDebug(2, "dnxGetAffinity: Adding [%s] dnxClient to host cache with (%llu) flags."
+      flag = allGroups; // Match all affinity but local(LSB)
+      dnxHostCacheAdd(name, flag);
+      dnxDebug(2, "dnxGetAffinity: Adding [%s] dnxClient to host cache with (%s) flags."
       " This host is not a member of any hostgroup and can service ALL requests!",
-         name, *pFlag);
-      return pFlag; 
+         name, dnxAffinityText(flag));
+      return flag; 
    }
 }
 
@@ -2006,19 +2925,14 @@ unsigned long long int* dnxGetAffinity(char * name)
 // This is a Hamming Weight function that will count the number of flags set 
 // in the affinity bitmask.
 
-int dnxHammingWeight(unsigned long long x) {
-    unsigned long long count;
-    unsigned long long y = x;
-    for (count=0; y; count++)
-        y &= y - 1ULL;
-    return count; // Returns the number of binary 1's in a bitmask
+int dnxHammingWeight(DnxAffinity x) {
+    return dnxAffinityCount(x); // Returns the number of binary 1's in a bitmask
 }
 
-int dnxIsDnxClient(unsigned long long x) {
+int dnxIsDnxClient(DnxAffinity x) {
    // If we are in more than 1 hostgroup and also in the local checks
    // we are a dnxClient
-    unsigned long long y = x;      
-    if ((dnxHammingWeight(y) > 1) && (y & 1ULL)) {
+    if ((dnxHammingWeight(x) > 1) && dnxAffinityHas(x, 0)) {
         return 1;
     } else {
         return 0;
@@ -2029,34 +2943,32 @@ DnxRegistrar * dnxGetRegistrar() {
    return registrar;
 }
 
-char * dnxGetHostgroupFromFlags (unsigned long long host, unsigned long long client) {
-   if(host == 1ULL && cfg.bypassHostgroup != NULL) {
+DnxJobList * dnxGetJobList() {
+   return joblist;
+}
+
+char * dnxGetHostgroupFromFlags (DnxAffinity host, DnxAffinity client) {
+   DnxAffinitySnapshot * snap;
+   char * name = NULL;
+   int bit;
+
+   if(dnxAffinityCount(host) == 1 && dnxAffinityHas(host, 0) 
+         && cfg.bypassHostgroup != NULL) {
       // If the host is only in the bypass group, there is no need to do a lookup
       dnxDebug(2, "dnxGetHostgroupFromFlags: Host is only in bypass group (%s)",
          cfg.bypassHostgroup);
       return cfg.bypassHostgroup;
    }
    
-   unsigned long long int flagUnion = host & client;
-   if (!flagUnion) {
-//       if(dnxHammingWeight(host) == 1) {
-//          flagUnion = host;
-//       }
-      return NULL;
-   }
-   
-   DnxAffinityList * temp_aff;
-   temp_aff = hostGrpAffinity;
-   while (temp_aff != NULL) {
-      // Recurse through the hostgroup affinity list
-      dnxDebug(6, "dnxGetHostgroupFromFlags: Recursing hostgroup affinity list - [%s] = (%llu)", 
-      temp_aff->name, temp_aff->flag);
-      // Is host in this group?
-      if(flagUnion & temp_aff->flag) {
-         dnxDebug(3, "dnxGetHostgroupFromFlags: Found host in (%s)",  temp_aff->name);
-         return temp_aff->name;
-      }
-      temp_aff = temp_aff->next;
+   // The lowest bit the host and client share is the hostgroup's; the 
+   // caller's read section keeps the name valid
+   bit = dnxAffinityFirstCommon(host, client);
+   dnxEpochEnter(affinityEpoch);
+   if (bit >= 0 && (snap = affinity) != 0 && (unsigned)bit < snap->groupCount
+         && snap->groups[bit]) {
+      name = snap->names + snap->groups[bit];
+      dnxDebug(3, "dnxGetHostgroupFromFlags: Found host in (%s)", name);
    }
-   
+   dnxEpochExit(affinityEpoch);
+   return name;
 }
@@ -29,6 +29,7 @@
 #define _DNXNEBMAIN_H_
 
 #include "dnxJobList.h"
+#include "dnxAffinity.h"
 
 #include <time.h>
 
@@ -56,6 +57,48 @@
 int dnxPostResult(void * data, time_t start_time, unsigned delta, 
       int early_timeout, int res_code, char * res_data);
 
+/** Statistics of the batches of results handed to Nagios. */
+typedef struct DnxSubmitStats
+{
+   unsigned long batches;     //!< The number of batches submitted.
+   unsigned long results;     //!< The number of results in them.
+   unsigned maxBatch;         //!< The largest batch submitted.
+   unsigned long lockUsec;    //!< Total microseconds spent in the Nagios lock.
+   unsigned long maxLockUsec; //!< The longest time spent in it by one batch.
+} DnxSubmitStats;
+
+/** Queue a job's result for submission to Nagios.
+ * 
+ * The Nagios check result is built outside of the lock that serializes
+ * additions to the Nagios result list, then queued. Queued results are 
+ * added to the list together, once submitBatchSize of them are waiting or
+ * the oldest has waited submitBatchDelay milliseconds; see dnxSubmitFlush.
+ * The result data in @p sResult is freed.
+ * 
+ * @param[in] Job - the job whose result is to be submitted.
+ * @param[in] sResult - the job's result.
+ * @param[in] check_time - the time the check finished.
+ * 
+ * @return Always returns zero.
+ */
+int dnxSubmitCheck(DnxNewJob * Job, DnxResult * sResult, time_t check_time);
+
+/** Add the queued results to the Nagios result list if they are due.
+ * 
+ * @param[in] force - boolean; true (1) adds any queued results, however 
+ *    few, and however briefly they have waited.
+ * 
+ * @return The number of milliseconds until the results still queued are due
+ *    to be added, or zero if none are queued.
+ */
+unsigned dnxSubmitFlush(int force);
+
+/** Return the statistics of the result batches submitted so far.
+ * 
+ * @param[out] pStats - the address of storage for the statistics.
+ */
+void dnxSubmitGetStats(DnxSubmitStats * pStats);
+
 /** Release all resources associated with a job object.
  * 
  * @param[in] pJob - the job to be freed.
@@ -71,12 +114,14 @@ void dnxJobCleanup(DnxNewJob * pJob);
  */
 int dnxAuditJob(DnxNewJob * pJob, char * action);
 
-unsigned long long int* dnxGetAffinity(char * name);
-int dnxHammingWeight(unsigned long long flag);
+DnxAffinity dnxGetAffinity(char * name);
+int dnxHammingWeight(DnxAffinity flag);
+int dnxIsDnxClient(DnxAffinity flag);
 
 DnxRegistrar * dnxGetRegistrar(void);
+DnxJobList * dnxGetJobList(void);
 
-char * dnxGetHostgroupFromFlags (unsigned long long host, unsigned long long client);
+char * dnxGetHostgroupFromFlags (DnxAffinity host, DnxAffinity client);
 
 #endif   /* _DNXNEBMAIN_H_ */
 
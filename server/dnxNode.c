@@ -1,19 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include "dnxDebug.h"
 #include "dnxNode.h"
+#include "dnxNebMain.h"
 
 DnxNode* gTopNode;
 
 
+///Format a node's result token start into storage of DNX_NODE_TOKEN_MAX bytes
+static size_t dnxNodeListFormatToken(char* address, char* hostname, char* buf)
+{
+    int len = snprintf(buf, DNX_NODE_TOKEN_MAX, DNX_NODE_TOKEN_FMT,
+        hostname? hostname: "", address? address: "");
+    return len > 0 && len < DNX_NODE_TOKEN_MAX? (size_t)len: 0;
+}
+
+///Build a new node's result token start
+static void dnxNodeListMakeToken(DnxNode* pDnxNode)
+{
+    char buf[DNX_NODE_TOKEN_MAX];
+
+    pDnxNode->tokenLen = dnxNodeListFormatToken(pDnxNode->address, pDnxNode->hostname, buf);
+    if(pDnxNode->tokenLen && (pDnxNode->token = (char*) xmalloc(pDnxNode->tokenLen + 1)) != NULL)
+        memcpy(pDnxNode->token, buf, pDnxNode->tokenLen + 1);
+    else
+        pDnxNode->tokenLen = 0;
+}
+
 ///Create a new node and add it to the end of the list
 DnxNode* dnxNodeListCreateNode(char *address, char *hostname)
 {
     DnxNode *pDnxNode = NULL;
-    unsigned long long int *temp_flag;
-    temp_flag = (unsigned long long int*)dnxGetAffinity(hostname);
+    DnxAffinity temp_flag;
+    temp_flag = dnxGetAffinity(hostname);
     // This is racy as hell, should have had a list level mutex
     
     if(gTopNode != NULL) {
@@ -28,9 +50,10 @@ DnxNode* dnxNodeListCreateNode(char *address, char *hostname)
             DNX_PT_MUTEX_INIT(&pDnxNode->mutex);
             pDnxNode->address = xstrdup(address);
             pDnxNode->hostname = xstrdup(hostname);
-            pDnxNode->flags = *temp_flag;
-            dnxDebug(4, "dnxNodeListCreateNode: [%s,%s] flags:(%llu)",
-                pDnxNode->address, pDnxNode->hostname, pDnxNode->flags);
+            pDnxNode->flags = temp_flag;
+            dnxNodeListMakeToken(pDnxNode);
+            dnxDebug(4, "dnxNodeListCreateNode: [%s,%s] flags:(%s)",
+                pDnxNode->address, pDnxNode->hostname, dnxAffinityText(pDnxNode->flags));
             
             // Push it behind the head
             pDnxNode->prev = pTopDnxNode;
@@ -46,9 +69,10 @@ DnxNode* dnxNodeListCreateNode(char *address, char *hostname)
         DNX_PT_MUTEX_INIT(&pDnxNode->mutex);
         pDnxNode->address = xstrdup(address);
         pDnxNode->hostname = xstrdup(hostname);
-        pDnxNode->flags = *temp_flag;
-        dnxDebug(4, "dnxNodeListCreateNode: [%s,%s] flags:(%llu)", 
-            pDnxNode->address, pDnxNode->hostname, pDnxNode->flags);
+        pDnxNode->flags = temp_flag;
+        dnxNodeListMakeToken(pDnxNode);
+        dnxDebug(4, "dnxNodeListCreateNode: [%s,%s] flags:(%s)", 
+            pDnxNode->address, pDnxNode->hostname, dnxAffinityText(pDnxNode->flags));
 
         pDnxNode->prev = NULL;
         pDnxNode->next = NULL;
@@ -128,7 +152,7 @@ DnxNode* dnxNodeListRemoveNode(DnxNode* pDnxNode)
     //Bye, Bye I'm leaving
     xfree(pDnxNode->address);
     xfree(pDnxNode->hostname);
-    xfree(&pDnxNode->flags);
+    xfree(pDnxNode->token);
     DNX_PT_MUTEX_UNLOCK(&pDnxNode->mutex);
     xfree(pDnxNode);
 
@@ -146,12 +170,42 @@ void dnxNodeListDestroy()
     gTopNode = NULL;
 }
 
-///Destroy all nodes and recreate the top node.
+///Zero a node's counters; the caller holds its mutex
+static void dnxNodeListClearStats(DnxNode* pDnxNode)
+{
+    // jobs_outstanding and latency are kept, as workers are chosen by them
+    pDnxNode->jobs_dispatched = 0;
+    pDnxNode->jobs_handled = 0;
+    pDnxNode->jobs_rejected_oom = 0;
+    pDnxNode->jobs_rejected_no_nodes = 0;
+    pDnxNode->jobs_req_recv = 0;
+    pDnxNode->jobs_req_exp = 0;
+    pDnxNode->jobs_expired = 0;
+}
+
+///Zero the stats of a node, leaving it in the list
+void dnxNodeListClearNode(DnxNode* pDnxNode)
+{
+    DNX_PT_MUTEX_LOCK(&pDnxNode->mutex);
+    dnxNodeListClearStats(pDnxNode);
+    DNX_PT_MUTEX_UNLOCK(&pDnxNode->mutex);
+}
+
+///Zero the stats of all nodes
 void dnxNodeListReset()
 {
+    DnxNode* pDnxNode = gTopNode;
+    DnxNode* pNext;
+
     dnxLog("dnxNodeListReset Called, reseting all node(s) stats!");
-    dnxNodeListDestroy();
-    gTopNode = dnxNodeListCreateNode("127.0.0.1", "localhost");
+    while(pDnxNode)
+    {
+        DNX_PT_MUTEX_LOCK(&pDnxNode->mutex);
+        dnxNodeListClearStats(pDnxNode);
+        pNext = pDnxNode->next;
+        DNX_PT_MUTEX_UNLOCK(&pDnxNode->mutex);
+        pDnxNode = pNext;
+    }
 }
 
 ///Return a pointer to the end node in the list
@@ -211,6 +265,54 @@ DnxNode* dnxNodeListFindNode(char* address)
     return pDnxNode;
 }
 
+///Copy the result token start of the node at address
+size_t dnxNodeListGetToken(char* address, char* hostname, char* buf)
+{
+    DnxNode* pDnxNode = address && hostname? dnxNodeListFindNode(address): NULL;
+    size_t len = 0;
+
+    if(pDnxNode)
+    {
+        DNX_PT_MUTEX_LOCK(&pDnxNode->mutex);
+        if((len = pDnxNode->tokenLen) != 0 && strcmp(pDnxNode->hostname, hostname) == 0)
+            memcpy(buf, pDnxNode->token, len + 1);
+        else
+            len = 0;
+        DNX_PT_MUTEX_UNLOCK(&pDnxNode->mutex);
+    }
+
+    return len? len: dnxNodeListFormatToken(address, hostname, buf);
+}
+
+///Assemble a check's output with a node's token after its first line
+char* dnxNodeListInsertToken(char* output, char* token, size_t tokenLen,
+    char* hostgroup, size_t maxLen)
+{
+    // the job's host may share no hostgroup with the node any more
+    char* group = hostgroup? hostgroup: "";
+    size_t outLen = strlen(output), groupLen = strlen(group);
+    size_t endLen = sizeof DNX_NODE_TOKEN_END - 1;
+    size_t headLen = strcspn(output, "\n");
+    size_t len = outLen + 1 + tokenLen + groupLen + endLen;
+    char *result, *cp;
+
+    if(len > maxLen || (cp = result = (char*) xmalloc(len + 1)) == NULL)
+        return NULL;
+
+    memcpy(cp, output, headLen);
+    cp += headLen;
+    *cp++ = '\n';
+    memcpy(cp, token, tokenLen);
+    cp += tokenLen;
+    memcpy(cp, group, groupLen);
+    cp += groupLen;
+    memcpy(cp, DNX_NODE_TOKEN_END, endLen);
+    cp += endLen;
+    memcpy(cp, output + headLen, outLen - headLen + 1);
+
+    return result;
+}
+
 ///Count the nodes in the list
 int dnxNodeListCountNodes()
 {
@@ -246,14 +348,29 @@ unsigned dnxNodeListIncrementNodeMember(char* address, int member)
         {
             case JOBS_DISPATCHED :
                 gTopNode->jobs_dispatched++;
+                gTopNode->jobs_outstanding++;
+                pDnxNode->jobs_outstanding++;
                 retval = pDnxNode->jobs_dispatched++;
             break;
 
             case JOBS_HANDLED :
                 gTopNode->jobs_handled++;
+                if(gTopNode->jobs_outstanding)
+                    gTopNode->jobs_outstanding--;
+                if(pDnxNode->jobs_outstanding)
+                    pDnxNode->jobs_outstanding--;
                 retval = pDnxNode->jobs_handled++;
             break;
 
+            case JOBS_EXPIRED :
+                gTopNode->jobs_expired++;
+                if(gTopNode->jobs_outstanding)
+                    gTopNode->jobs_outstanding--;
+                if(pDnxNode->jobs_outstanding)
+                    pDnxNode->jobs_outstanding--;
+                retval = pDnxNode->jobs_expired++;
+            break;
+
             case JOBS_REQ_RECV : gTopNode->jobs_req_recv++;
                 retval = pDnxNode->jobs_req_recv++;
             break;
@@ -278,6 +395,44 @@ unsigned dnxNodeListIncrementNodeMember(char* address, int member)
     return(retval);
 }
 
+/** Function to count a job result and average its latency
+*   @param address - The IP address of the node that ran the job
+*   @param latency - The time the node took to return the result, in milliseconds
+*/
+unsigned dnxNodeListRecordResult(char* address, unsigned latency)
+{
+    //If the IP address is NULL or corrupted it can cause nastiness later on, lets catch it here.
+    assert(address && isalnum(*address));
+
+    DnxNode* pDnxNode = dnxNodeListFindNode(address);
+    int sample = latency;
+    int retval = 0;
+
+    if(pDnxNode)
+    {
+        DNX_PT_MUTEX_LOCK(&pDnxNode->mutex);
+        gTopNode->jobs_handled++;
+        if(gTopNode->jobs_outstanding)
+            gTopNode->jobs_outstanding--;
+        if(pDnxNode->jobs_outstanding)
+            pDnxNode->jobs_outstanding--;
+        retval = pDnxNode->jobs_handled++;
+
+        // moving average over the last eight or so jobs
+        if(pDnxNode->latency == 0)
+            pDnxNode->latency = sample? sample: 1;
+        else
+            pDnxNode->latency += (sample - (int)pDnxNode->latency) / 8;
+        if(pDnxNode->latency == 0)
+            pDnxNode->latency = 1;
+        DNX_PT_MUTEX_UNLOCK(&pDnxNode->mutex);
+    } else {
+        dnxDebug(1,"dnxNodeListRecordResult: Tried to record a result for non-existent node ADDRESS: %s",address);
+    }
+
+    return(retval);
+}
+
 /** Function to set member values
 *   @param address  - The IP address of the node you want
 *   @param  hostname  - the value you want to set member to
@@ -312,3 +467,80 @@ unsigned dnxNodeListIncrementNodeMember(char* address, int member)
 //     }
 //     return(pDnxNode->flags);
 // }
+
+/*--------------------------------------------------------------------------
+                                 UNIT TEST
+
+   From within dnx/server, compile with GNU tools using this command line:
+
+      gcc -DDEBUG -DDNX_NODE_TEST -g -O0 -I../common dnxNode.c \
+         dnxAffinity.c ../common/dnxError.c -lpthread -lgcc_s -lrt \
+         -o dnxNodeTest
+
+  --------------------------------------------------------------------------*/
+
+#ifdef DNX_NODE_TEST
+
+#include "utesthelp.h"
+
+static int verbose;
+
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+DnxAffinity dnxGetAffinity(char * name) { return 0; }
+
+int main(int argc, char ** argv)
+{
+   char token[DNX_NODE_TOKEN_MAX], * out;
+   DnxNode * pNode;
+   size_t len;
+
+   verbose = argc > 1? 1: 0;
+
+   // clearing a node's stats leaves it where the registrar found it
+   CHECK_NONZERO(gTopNode = dnxNodeListCreateNode("127.0.0.1", "localhost"));
+   CHECK_NONZERO(pNode = dnxNodeListCreateNode("10.1.1.3", "node2"));
+   dnxNodeListIncrementNodeMember("10.1.1.3", JOBS_DISPATCHED);
+   dnxNodeListIncrementNodeMember("10.1.1.3", JOBS_REQ_RECV);
+   dnxNodeListClearNode(pNode);
+   CHECK_TRUE(dnxNodeListFindNode("10.1.1.3") == pNode);
+   CHECK_TRUE(pNode->jobs_dispatched == 0 && pNode->jobs_req_recv == 0);
+   CHECK_TRUE(pNode->jobs_outstanding == 1);
+   dnxNodeListIncrementNodeMember("10.1.1.3", JOBS_HANDLED);
+   dnxNodeListReset();
+   CHECK_TRUE(gTopNode->next == pNode && gTopNode->jobs_dispatched == 0);
+   CHECK_TRUE(pNode->jobs_handled == 0 && pNode->jobs_outstanding == 0);
+   dnxNodeListDestroy();
+
+   CHECK_TRUE((len = dnxNodeListGetToken("10.1.1.2", "node1", token)) != 0);
+
+   // the token follows the first line, and the rest of the output follows it
+   CHECK_NONZERO(out = dnxNodeListInsertToken("OK - up\nmore", token, len, 
+         "web", 1000));
+   CHECK_TRUE(strcmp(out, "OK - up\n<DNX><CLIENT=\"node1\"/>"
+         "<CLIENT_IP=\"10.1.1.2\"/><HOSTGROUP=\"web\"/></DNX>\nmore") == 0);
+   xfree(out);
+
+   // a host sharing no hostgroup with the node has none to name
+   CHECK_NONZERO(out = dnxNodeListInsertToken("OK - up", token, len, 0, 1000));
+   CHECK_TRUE(strcmp(out, "OK - up\n<DNX><CLIENT=\"node1\"/>"
+         "<CLIENT_IP=\"10.1.1.2\"/><HOSTGROUP=\"\"/></DNX>") == 0);
+   xfree(out);
+
+   // an empty first line is still the first line
+   CHECK_NONZERO(out = dnxNodeListInsertToken("\nmore", token, len, "web", 1000));
+   CHECK_TRUE(strcmp(out, "\n<DNX><CLIENT=\"node1\"/>"
+         "<CLIENT_IP=\"10.1.1.2\"/><HOSTGROUP=\"web\"/></DNX>\nmore") == 0);
+   xfree(out);
+
+   // output too long for Nagios is left alone
+   CHECK_TRUE(dnxNodeListInsertToken("OK - up", token, len, "web", 20) == 0);
+
+   return 0;
+}
+
+#endif   /* DNX_NODE_TEST */
+
+/*--------------------------------------------------------------------------*/
+
@@ -6,6 +6,7 @@
 *   The purpose of this file is to define a worker node instrumentation class.
 ***************************************************************************************/
 #include "dnxTypes.h"
+#include "dnxAffinity.h"
 
 #ifndef DNXNODE
 #define DNXNODE
@@ -18,6 +19,7 @@ enum
     JOBS_REJECTED_NO_NODES,
     JOBS_REQ_RECV,
     JOBS_REQ_EXP,
+    JOBS_EXPIRED,
     HOSTNAME,
     AFFINITY_FLAGS
 
@@ -33,13 +35,18 @@ typedef struct DnxNode
     struct DnxNode* prev; //!< Previous Node
     char* address;  //!< IP address or URL of worker
     char* hostname; //!< Hostname defined in dnxClient.cfg
-    unsigned long long int flags; //!< Affinity flags assigned during init
+    char* token;    //!< The node's result token, up to the hostgroup value
+    size_t tokenLen; //!< The length of token, 0 if it couldn't be built
+    DnxAffinity flags;      //!< Affinity flags assigned during init and reloads
     unsigned jobs_dispatched; //!< How many jobs have been sent to worker
     unsigned jobs_handled;   //!< How many jobs have been handled
     unsigned jobs_rejected_oom;  //!< How many jobs have been rejected due to memory
     unsigned jobs_rejected_no_nodes;  //!< How many jobs have been rejected due to no available nodes
     unsigned jobs_req_recv;  //!< How many job requests have been recieved from worker
     unsigned jobs_req_exp;  //!< How many job requests have expired
+    unsigned jobs_expired;  //!< How many dispatched jobs timed out without a result
+    unsigned jobs_outstanding; //!< How many dispatched jobs are awaiting a result
+    unsigned latency;       //!< Average time from dispatch to result in milliseconds, 0 if unknown
     pthread_mutex_t mutex;  //!< Thread locking control structure
 } DnxNode;
 
@@ -65,17 +72,24 @@ void dnxNodeListDestroy();
 *   Remove and delete a node.
 *   Since all nodes are linked together in a list, this function will also heal the list
 *   by pointing prev at next and vice versa
+*   Saved node pointers are used without checks, so this is only called at shutdown,
+*   once the server's threads have stopped
 *   @param pDnxNode - A pointer to the node you want to remove
 *   @return - A pointer to the next node in the list
 */
 DnxNode* dnxNodeListRemoveNode(DnxNode* pDnxNode);
 
-/** Removal function for DnxNodes
-*   Remove and delete all nodes.
-*   Then recreate gTopNode
+/** Reset function for DnxNodes
+*   Zero the stats of all nodes, leaving them in the list
 */
 void dnxNodeListReset();
 
+/** Zero the stats of a node, leaving it in the list
+*   The jobs it has outstanding and its latency are kept, as workers are chosen by them
+*   @param pDnxNode - A pointer to the node you want to clear
+*/
+void dnxNodeListClearNode(DnxNode* pDnxNode);
+
 /** Return a pointer to the end node
 */
 DnxNode* dnxNodeListEnd();
@@ -110,10 +124,57 @@ unsigned dnxNodeListGetMemberValue(DnxNode* pDnxNode, int member);
 */
 unsigned dnxNodeListCount(char* address, int member);
 
+/** Function to increment member values
+*   Counting a dispatched job also counts it as outstanding, until it is
+*   handled or expires.
+*   @param address - The IP address of the node you want
+*   @param member - The member you want to increment
+*/
 unsigned dnxNodeListIncrementNodeMember(char* address,int member);
 
+/** Count a job result from a node and add its latency to the node's average
+*   @param address - The IP address of the node that ran the job
+*   @param latency - The time from the job's dispatch to its result, in milliseconds
+*   @return - The node's previous count of handled jobs
+*/
+unsigned dnxNodeListRecordResult(char* address, unsigned latency);
+
 unsigned dnxNodeListSetNode(char* address, int member, void* value);
 
+/** The most bytes dnxNodeListGetToken may copy, including the null. */
+#define DNX_NODE_TOKEN_MAX 512
+
+/** Copy the start of the token DNX adds to a node's check results
+*   The token names the client and its address; the caller appends the
+*   hostgroup value and DNX_NODE_TOKEN_END. Nodes build theirs when they are
+*   created, so it is only formatted here for a host name the node wasn't
+*   created with.
+*   @param address - The IP address of the node that ran the check
+*   @param hostname - The host name the node registered with
+*   @param buf - Storage for at least DNX_NODE_TOKEN_MAX bytes
+*   @return - The length of the token start copied, or 0 if it didn't fit
+*/
+size_t dnxNodeListGetToken(char* address, char* hostname, char* buf);
+
+/** The format of a token's start, and the end that follows the hostgroup
+*/
+#define DNX_NODE_TOKEN_FMT "<DNX><CLIENT=\"%s\"/><CLIENT_IP=\"%s\"/><HOSTGROUP=\""
+#define DNX_NODE_TOKEN_END "\"/></DNX>"
+
+/** Return a copy of a check's output with a node's token after its first line
+*   The output is assembled in one pass into a buffer of the size required.
+*   Output of a single line gets the token on a new line after it.
+*   @param output - The check's output
+*   @param token - The start of the token, from dnxNodeListGetToken
+*   @param tokenLen - The length of token
+*   @param hostgroup - The hostgroup to be named in the token; NULL names none
+*   @param maxLen - The longest output the caller accepts
+*   @return - The allocated output, or NULL if it would be longer than maxLen,
+*   or no memory is available
+*/
+char* dnxNodeListInsertToken(char* output, char* token, size_t tokenLen,
+    char* hostgroup, size_t maxLen);
+
 static void * dnxStatsRequestListener(void *vptr_args);
 
 #endif
@@ -0,0 +1,510 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Implements fixed-size object pools for DNX.
+ *
+ * Free objects are kept on intrusive singly linked lists: one per thread,
+ * reached through a thread-specific data key, and one shared by all threads
+ * under the pool's mutex. Slabs are chained together through a small
+ * header so that they can be released when the pool is destroyed.
+ *
+ * @file dnxPool.c
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IMPL
+ */
+
+#include "dnxPool.h"
+
+#include "dnxError.h"
+#include "dnxDebug.h"
+#include "dnxLogging.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+/** The alignment of pool objects, in bytes. */
+#define DNX_POOL_ALIGN     (2 * sizeof(void *))
+
+/** The default number of objects in a slab. */
+#define DNX_POOL_BATCH     64
+
+/** A free pool object; the link overlays the object's contents. */
+typedef struct iDnxPoolObj
+{
+   struct iDnxPoolObj * next;       /*!< The next free object, 0 if none. */
+} iDnxPoolObj;
+
+/** A slab header; the slab's objects follow it. */
+typedef struct iDnxPoolSlab
+{
+   struct iDnxPoolSlab * next;      /*!< The next slab, 0 if none. */
+} iDnxPoolSlab;
+
+struct iDnxPool;
+
+/** A thread's cache of free objects. */
+typedef struct iDnxPoolCache
+{
+   iDnxPoolObj * head;              /*!< The thread's free objects. */
+   unsigned count;                  /*!< The number of objects at head. */
+   struct iDnxPool * pool;          /*!< The pool the cache belongs to. */
+   struct iDnxPoolCache * next;     /*!< The pool's next cache. */
+   struct iDnxPoolCache * prev;     /*!< The pool's previous cache. */
+} iDnxPoolCache;
+
+/** Object pool implementation structure. */
+typedef struct iDnxPool
+{
+   char * name;                     /*!< The pool's name, for logging. */
+   size_t objSize;                  /*!< Object size, rounded to alignment. */
+   size_t slabHdr;                  /*!< Slab header size, rounded likewise. */
+   unsigned batch;                  /*!< Objects per slab and per refill. */
+   iDnxPoolObj * free;              /*!< The shared free list. */
+   unsigned long freeCount;         /*!< The number of objects on free. */
+   iDnxPoolSlab * slabs;            /*!< All of the pool's slabs. */
+   iDnxPoolCache * caches;          /*!< The caches of all live threads. */
+   unsigned long objects;           /*!< Objects carved from slabs. */
+   unsigned long slabCount;         /*!< The number of slabs. */
+   unsigned long refills;           /*!< Batches taken from free. */
+   unsigned long flushes;           /*!< Batches returned to free. */
+   unsigned long inUse;             /*!< Allocated objects (DEBUG only). */
+   unsigned long highWater;         /*!< Most objects ever in use (DEBUG only). */
+   pthread_key_t key;               /*!< The key of the thread caches. */
+   pthread_mutex_t mutex;           /*!< Protects all but the caches' lists. */
+} iDnxPool;
+
+/*--------------------------------------------------------------------------
+                              IMPLEMENTATION
+  --------------------------------------------------------------------------*/
+
+/** Move a batch of objects from a thread cache to its pool's free list.
+ *
+ * @param[in] ipool - the pool to which @p cache belongs.
+ * @param[in] cache - the thread cache to be reduced.
+ * @param[in] count - the number of objects to be moved.
+ */
+static void dnxPoolFlush(iDnxPool * ipool, iDnxPoolCache * cache,
+      unsigned count)
+{
+   iDnxPoolObj * first, * last;
+   unsigned i;
+
+   if (!count)
+      return;
+
+   // detach the first count objects from the cache
+   first = last = cache->head;
+   for (i = 1; i < count; i++)
+      last = last->next;
+   cache->head = last->next;
+   cache->count -= count;
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   last->next = ipool->free;
+   ipool->free = first;
+   ipool->freeCount += count;
+   ipool->flushes++;
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+}
+
+//----------------------------------------------------------------------------
+
+/** Fill an empty thread cache with a batch of objects.
+ *
+ * Objects are taken from the pool's free list if it has any, or else from
+ * a new slab.
+ *
+ * @param[in] ipool - the pool to which @p cache belongs.
+ * @param[in] cache - the empty thread cache to be filled.
+ *
+ * @return Zero on success, or DNX_ERR_MEMORY.
+ */
+static int dnxPoolRefill(iDnxPool * ipool, iDnxPoolCache * cache)
+{
+   iDnxPoolObj * first, * last;
+   iDnxPoolSlab * slab;
+   unsigned count;
+   char * cp;
+
+   assert(!cache->head);
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   if (ipool->free) {
+      first = last = ipool->free;
+      for (count = 1; count < ipool->batch && last->next; count++)
+         last = last->next;
+      ipool->free = last->next;
+      ipool->freeCount -= count;
+      ipool->refills++;
+      DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+
+      last->next = 0;
+      cache->head = first;
+      cache->count = count;
+      return DNX_OK;
+   }
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+
+   // the free list is empty - carve a new slab into the cache
+   if ((slab = (iDnxPoolSlab *)xmalloc(ipool->slabHdr
+         + ipool->batch * ipool->objSize)) == 0)
+      return DNX_ERR_MEMORY;
+
+   cp = (char *)slab + ipool->slabHdr;
+   for (count = 0; count < ipool->batch; count++, cp += ipool->objSize) {
+      ((iDnxPoolObj *)cp)->next = cache->head;
+      cache->head = (iDnxPoolObj *)cp;
+   }
+   cache->count = ipool->batch;
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   slab->next = ipool->slabs;
+   ipool->slabs = slab;
+   ipool->slabCount++;
+   ipool->objects += ipool->batch;
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+
+   dnxDebug(4, "dnxPoolRefill: Pool %s grew to %lu objects.",
+         ipool->name, ipool->objects);
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return a thread's cached objects to its pool when the thread exits.
+ *
+ * @param[in] data - the exiting thread's cache.
+ */
+static void dnxPoolCacheRelease(void * data)
+{
+   iDnxPoolCache * cache = (iDnxPoolCache *)data;
+   iDnxPool * ipool = cache->pool;
+
+   dnxPoolFlush(ipool, cache, cache->count);
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   if (cache->prev)
+      cache->prev->next = cache->next;
+   else
+      ipool->caches = cache->next;
+   if (cache->next)
+      cache->next->prev = cache->prev;
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+
+   xfree(cache);
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the calling thread's cache for a pool, creating it if necessary.
+ *
+ * @param[in] ipool - the pool whose thread cache should be returned.
+ *
+ * @return The calling thread's cache, or 0 if no memory is available.
+ */
+static iDnxPoolCache * dnxPoolCache(iDnxPool * ipool)
+{
+   iDnxPoolCache * cache;
+
+   if ((cache = (iDnxPoolCache *)pthread_getspecific(ipool->key)) != 0)
+      return cache;
+
+   if ((cache = (iDnxPoolCache *)xcalloc(1, sizeof *cache)) == 0)
+      return 0;
+   cache->pool = ipool;
+
+   if (pthread_setspecific(ipool->key, cache) != 0) {
+      xfree(cache);
+      return 0;
+   }
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   if ((cache->next = ipool->caches) != 0)
+      cache->next->prev = cache;
+   ipool->caches = cache;
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+
+   return cache;
+}
+
+/*--------------------------------------------------------------------------
+                                 INTERFACE
+  --------------------------------------------------------------------------*/
+
+void * dnxPoolAlloc(DnxPool * pool)
+{
+   iDnxPool * ipool = (iDnxPool *)pool;
+   iDnxPoolCache * cache;
+   iDnxPoolObj * obj;
+
+   assert(pool);
+
+   if ((cache = dnxPoolCache(ipool)) == 0
+         || (!cache->head && dnxPoolRefill(ipool, cache) != DNX_OK)) {
+      dnxDebug(1, "dnxPoolAlloc: Pool %s is out of memory.", ipool->name);
+      return 0;
+   }
+
+   obj = cache->head;
+   cache->head = obj->next;
+   cache->count--;
+
+#ifdef DEBUG
+   {
+      unsigned long inUse = __sync_add_and_fetch(&ipool->inUse, 1);
+      unsigned long high;
+      while (inUse > (high = ipool->highWater)
+            && !__sync_bool_compare_and_swap(&ipool->highWater, high, inUse))
+         ;
+   }
+#endif
+
+   return obj;
+}
+
+//----------------------------------------------------------------------------
+
+void dnxPoolFree(DnxPool * pool, void * obj)
+{
+   iDnxPool * ipool = (iDnxPool *)pool;
+   iDnxPoolCache * cache;
+
+   assert(pool);
+
+   if (!obj)
+      return;
+
+#ifdef DEBUG
+   __sync_fetch_and_sub(&ipool->inUse, 1);
+   memset(obj, 0xA5, ipool->objSize);  // make stale references obvious
+#endif
+
+   if ((cache = dnxPoolCache(ipool)) == 0) {
+      // no cache - hand the object straight back to the free list
+      DNX_PT_MUTEX_LOCK(&ipool->mutex);
+      ((iDnxPoolObj *)obj)->next = ipool->free;
+      ipool->free = (iDnxPoolObj *)obj;
+      ipool->freeCount++;
+      DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+      return;
+   }
+
+   ((iDnxPoolObj *)obj)->next = cache->head;
+   cache->head = (iDnxPoolObj *)obj;
+
+   // threads that mostly free objects give them back a batch at a time
+   if (++cache->count > 2 * ipool->batch)
+      dnxPoolFlush(ipool, cache, ipool->batch);
+}
+
+//----------------------------------------------------------------------------
+
+void dnxPoolGetStats(DnxPool * pool, DnxPoolStats * pStats)
+{
+   iDnxPool * ipool = (iDnxPool *)pool;
+
+   assert(pool && pStats);
+
+   DNX_PT_MUTEX_LOCK(&ipool->mutex);
+   pStats->objects = ipool->objects;
+   pStats->inUse = ipool->inUse;
+   pStats->highWater = ipool->highWater;
+   pStats->slabs = ipool->slabCount;
+   pStats->refills = ipool->refills;
+   pStats->flushes = ipool->flushes;
+   DNX_PT_MUTEX_UNLOCK(&ipool->mutex);
+}
+
+//----------------------------------------------------------------------------
+
+int dnxPoolCreate(char * name, size_t objSize, unsigned batch,
+      DnxPool ** ppPool)
+{
+   iDnxPool * ipool;
+
+   assert(name && objSize && ppPool);
+
+   if ((ipool = (iDnxPool *)xcalloc(1, sizeof *ipool)) == 0)
+      return DNX_ERR_MEMORY;
+
+   if (objSize < sizeof(iDnxPoolObj))
+      objSize = sizeof(iDnxPoolObj);
+
+   ipool->name = name;
+   ipool->objSize = (objSize + DNX_POOL_ALIGN - 1) & ~(DNX_POOL_ALIGN - 1);
+   ipool->slabHdr = (sizeof(iDnxPoolSlab) + DNX_POOL_ALIGN - 1)
+         & ~(DNX_POOL_ALIGN - 1);
+   ipool->batch = batch? batch: DNX_POOL_BATCH;
+
+   if (pthread_key_create(&ipool->key, dnxPoolCacheRelease) != 0) {
+      xfree(ipool);
+      return DNX_ERR_MEMORY;
+   }
+   DNX_PT_MUTEX_INIT(&ipool->mutex);
+
+   *ppPool = (DnxPool *)ipool;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+void dnxPoolDestroy(DnxPool * pool)
+{
+   iDnxPool * ipool = (iDnxPool *)pool;
+   iDnxPoolCache * cache;
+   iDnxPoolSlab * slab;
+
+   assert(pool);
+
+   // thread caches are not released by deleting the key
+   pthread_key_delete(ipool->key);
+   while ((cache = ipool->caches) != 0) {
+      ipool->caches = cache->next;
+      xfree(cache);
+   }
+
+#ifdef DEBUG
+   if (ipool->inUse) {
+      dnxDebug(1, "dnxPoolDestroy: Pool %s still has %lu of %lu objects in use.",
+            ipool->name, ipool->inUse, ipool->objects);
+      dnxLog("dnxPoolDestroy: Pool %s still has %lu of %lu objects in use.",
+            ipool->name, ipool->inUse, ipool->objects);
+   }
+#endif
+
+   dnxDebug(2, "dnxPoolDestroy: Pool %s used %lu slabs, %lu refills, "
+         "%lu flushes.", ipool->name, ipool->slabCount, ipool->refills,
+         ipool->flushes);
+
+   while ((slab = ipool->slabs) != 0) {
+      ipool->slabs = slab->next;
+      xfree(slab);
+   }
+
+   DNX_PT_MUTEX_DESTROY(&ipool->mutex);
+   xfree(ipool);
+}
+
+/*--------------------------------------------------------------------------
+                                 UNIT TEST
+
+   From within dnx/server, compile with GNU tools using this command line:
+
+      gcc -DDEBUG -DDNX_POOL_TEST -g -O0 -I../common dnxPool.c \
+         ../common/dnxError.c -lpthread -lgcc_s -lrt -o dnxPoolTest
+
+  --------------------------------------------------------------------------*/
+
+#ifdef DNX_POOL_TEST
+
+#include "utesthelp.h"
+
+#define POOL_THREADS    4
+#define POOL_OBJECTS    1000
+
+static int verbose;
+static DnxPool * pool;
+
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+/* Allocate objects in one thread and free them in another, as the
+ * registrar and dispatcher do.
+ */
+static void * poolThread(void * data)
+{
+   void ** objs = (void **)data;
+   int i;
+
+   for (i = 0; i < POOL_OBJECTS; i++)
+      objs[i] = dnxPoolAlloc(pool);
+   return 0;
+}
+
+int main(int argc, char ** argv)
+{
+   static void * objs[POOL_THREADS][POOL_OBJECTS];
+   pthread_t tids[POOL_THREADS];
+   DnxPoolStats stats;
+   void * a, * b;
+   int i, j;
+
+   verbose = argc > 1? 1: 0;
+
+   CHECK_ZERO(dnxPoolCreate("test", 40, 16, &pool));
+
+   // objects are distinct, aligned and recycled
+   CHECK_TRUE((a = dnxPoolAlloc(pool)) != 0);
+   CHECK_TRUE((b = dnxPoolAlloc(pool)) != 0);
+   CHECK_TRUE(a != b);
+   CHECK_ZERO((unsigned long)a % (2 * sizeof(void *)));
+   CHECK_TRUE((char *)a - (char *)b >= 40 || (char *)b - (char *)a >= 40);
+   dnxPoolFree(pool, a);
+   CHECK_TRUE(dnxPoolAlloc(pool) == a);
+   dnxPoolFree(pool, a);
+   dnxPoolFree(pool, b);
+
+   for (i = 0; i < POOL_THREADS; i++)
+      CHECK_ZERO(pthread_create(&tids[i], 0, poolThread, objs[i]));
+   for (i = 0; i < POOL_THREADS; i++)
+      CHECK_ZERO(pthread_join(tids[i], 0));
+
+   dnxPoolGetStats(pool, &stats);
+   CHECK_TRUE(stats.objects >= POOL_THREADS * POOL_OBJECTS);
+#ifdef DEBUG
+   CHECK_TRUE(stats.inUse == POOL_THREADS * POOL_OBJECTS);
+#endif
+
+   for (i = 0; i < POOL_THREADS; i++)
+      for (j = 0; j < POOL_OBJECTS; j++) {
+         CHECK_TRUE(objs[i][j] != 0);
+         dnxPoolFree(pool, objs[i][j]);
+      }
+
+   // the freeing thread's surplus went back to the shared list...
+   dnxPoolGetStats(pool, &stats);
+   CHECK_ZERO(stats.inUse);
+   CHECK_TRUE(stats.flushes > 0);
+
+   // ...so reallocating them needs no more slabs
+   i = stats.slabs;
+   for (j = 0; j < POOL_OBJECTS; j++)
+      objs[0][j] = dnxPoolAlloc(pool);
+   dnxPoolGetStats(pool, &stats);
+   CHECK_TRUE(stats.slabs == i);
+#ifdef DEBUG
+   CHECK_TRUE(stats.highWater == POOL_THREADS * POOL_OBJECTS);
+#endif
+   for (j = 0; j < POOL_OBJECTS; j++)
+      dnxPoolFree(pool, objs[0][j]);
+
+   dnxPoolDestroy(pool);
+
+   return 0;
+}
+
+#endif   /* DNX_POOL_TEST */
+
+/*--------------------------------------------------------------------------*/
+
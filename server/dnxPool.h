@@ -0,0 +1,107 @@
+/*--------------------------------------------------------------------------
+ 
+   Copyright (c) 2006-2007, Intellectual Reserve, Inc. All rights reserved.
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 2 as 
+   published by the Free Software Foundation.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ 
+  --------------------------------------------------------------------------*/
+
+/** Definitions and prototypes for DNX fixed-size object pools.
+ *
+ * A pool hands out objects of a single size from slabs that are allocated
+ * in batches and only released when the pool is destroyed. Each thread
+ * keeps a cache of free objects, so most allocations and releases touch
+ * neither the heap nor a lock; a thread whose cache is empty takes a batch
+ * of objects from the pool's shared free list, and a thread that has freed
+ * more than it needs returns a batch to it. Objects may be freed by any
+ * thread, not just the one that allocated them.
+ *
+ * @file dnxPool.h
+ * @author Robert W. Ingraham (dnx-devel@lists.sourceforge.net)
+ * @attention Please submit patches to http://dnx.sourceforge.net
+ * @ingroup DNX_SERVER_IFC
+ */
+
+#ifndef _DNXPOOL_H_
+#define _DNXPOOL_H_
+
+#include <stddef.h>
+
+/** An abstract data type for a DNX object pool. */
+typedef struct { int unused; } DnxPool;
+
+/** Object pool statistics. */
+typedef struct DnxPoolStats
+{
+   unsigned long objects;  /*!< Objects carved from slabs so far. */
+   unsigned long inUse;    /*!< Objects currently allocated. */
+   unsigned long highWater; /*!< The most objects ever allocated at once. */
+   unsigned long slabs;    /*!< Slabs allocated from the heap. */
+   unsigned long refills;  /*!< Batches taken from the shared free list. */
+   unsigned long flushes;  /*!< Batches returned to the shared free list. */
+} DnxPoolStats;
+
+/** Allocate an object from a pool.
+ *
+ * The object's contents are undefined.
+ *
+ * @param[in] pool - the pool from which to allocate an object.
+ *
+ * @return A pointer to the new object, or 0 if no memory is available.
+ */
+void * dnxPoolAlloc(DnxPool * pool);
+
+/** Return an object to the pool it was allocated from.
+ *
+ * @param[in] pool - the pool from which @p obj was allocated.
+ * @param[in] obj - the object to be freed; may be 0.
+ */
+void dnxPoolFree(DnxPool * pool, void * obj);
+
+/** Return the statistics of an object pool.
+ *
+ * The in-use counts are only maintained in debug builds, and are zero
+ * otherwise.
+ *
+ * @param[in] pool - the pool to be examined.
+ * @param[out] pStats - the address of storage for returning the statistics.
+ */
+void dnxPoolGetStats(DnxPool * pool, DnxPoolStats * pStats);
+
+/** Create a new object pool.
+ *
+ * @param[in] name - the name of the pool, used in log messages; the string
+ *    is not copied.
+ * @param[in] objSize - the size in bytes of the pool's objects.
+ * @param[in] batch - the number of objects in each slab, and the number
+ *    moved between a thread's cache and the shared free list at a time.
+ * @param[out] ppPool - the address of storage for returning the new pool.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxPoolCreate(char * name, size_t objSize, unsigned batch,
+      DnxPool ** ppPool);
+
+/** Destroy an object pool.
+ *
+ * All of the pool's slabs are released, including any objects that are
+ * still allocated; in debug builds, these are reported as leaks. No thread
+ * may use the pool once this routine is called.
+ *
+ * @param[in] pool - the pool to be destroyed.
+ */
+void dnxPoolDestroy(DnxPool * pool);
+
+#endif   /* _DNXPOOL_H_ */
+
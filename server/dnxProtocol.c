@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 
 #include "dnxProtocol.h"
 #include "dnxXml.h"
@@ -9,6 +10,29 @@
 
 //----------------------------------------------------------------------------
 
+/** Encode a job for dispatch to a client node (server).
+ *
+ * @param[out] xbuf - the buffer in which to encode the message.
+ * @param[in] pJob - the job request to be encoded.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxEncodeJob(DnxXmlBuf * xbuf, DnxJob * pJob)
+{
+   assert(xbuf && pJob && pJob->cmd && *pJob->cmd);
+
+   dnxXmlOpen (xbuf, "Job");
+   dnxXmlAdd  (xbuf, "XID",      DNX_XML_XID,  &pJob->xid);
+   dnxXmlAdd  (xbuf, "State",    DNX_XML_INT,  &pJob->state);
+   dnxXmlAdd  (xbuf, "Priority", DNX_XML_INT,  &pJob->priority);
+   dnxXmlAdd  (xbuf, "Timeout",  DNX_XML_INT,  &pJob->timeout);
+   dnxXmlAdd  (xbuf, "Timestamp",DNX_XML_UINT, &pJob->timestamp);
+   dnxXmlAdd  (xbuf, "Command",  DNX_XML_STR,   pJob->cmd);
+   return dnxXmlClose(xbuf);
+}
+
+//----------------------------------------------------------------------------
+
 /** Dispatch a job to a client node (server).
  *
  * @param[in] channel - the channel on which to send @p pJob.
@@ -26,14 +50,7 @@ int dnxSendJob(DnxChannel * channel, DnxJob * pJob, char * address)
    assert(channel && pJob && pJob->cmd && *pJob->cmd);
 
    // create the XML message
-   dnxXmlOpen (&xbuf, "Job");
-   dnxXmlAdd  (&xbuf, "XID",      DNX_XML_XID,  &pJob->xid);
-   dnxXmlAdd  (&xbuf, "State",    DNX_XML_INT,  &pJob->state);
-   dnxXmlAdd  (&xbuf, "Priority", DNX_XML_INT,  &pJob->priority);
-   dnxXmlAdd  (&xbuf, "Timeout",  DNX_XML_INT,  &pJob->timeout);
-   dnxXmlAdd  (&xbuf, "Timestamp",DNX_XML_UINT, &pJob->timestamp);
-   dnxXmlAdd  (&xbuf, "Command",  DNX_XML_STR,   pJob->cmd);
-   dnxXmlClose(&xbuf);
+   dnxEncodeJob(&xbuf, pJob);
 
    dnxDebug(3, "dnxSendJob: XML msg(%d bytes)=%s.", xbuf.size, xbuf.buf);
 
@@ -42,86 +59,88 @@ int dnxSendJob(DnxChannel * channel, DnxJob * pJob, char * address)
 }
 
 //----------------------------------------------------------------------------
-/** Wait for a node request (server).
+
+/** Clear a node request to receive into, keeping its string buffers.
  *
- * @param[in] channel - the channel from which to receive the node request.
- * @param[out] pReg - the address of storage into which the request should
- *    be read from @p channel.
- * @param[out] address - the address of storage in which to return the address
- *    of the sender. This parameter is optional and may be passed as NULL. If
- *    non-NULL, it should be large enough to store sockaddr_* data.
- * @param[in] timeout - the maximum number of seconds the caller is willing to
- *    wait before accepting a timeout error.
+ * @param[in] pReg - the request to be cleared.
+ */
+static void dnxNodeRequestReset(DnxNodeRequest * pReg)
+{
+   char * addr = pReg->addr;
+   char * hn = pReg->hn;
+
+   assert(addr && hn);
+
+   memset(pReg, 0, sizeof *pReg);
+   pReg->addr = addr;
+   pReg->hn = hn;
+   *addr = *hn = 0;
+}
+
+//----------------------------------------------------------------------------
+
+/** Decode a node request received from a worker node.
+ *
+ * @param[in] xbuf - the message received; it is null-terminated here.
+ * @param[out] pReg - the request into which @p xbuf should be decoded, as 
+ *    cleared by dnxNodeRequestReset.
+ * @param[in] address - the sender's sockaddr_in, or NULL if unknown.
  *
  * @return Zero on success, or a non-zero error value.
  */
-int dnxWaitForNodeRequest(DnxChannel * channel, DnxNodeRequest * pReg, char * address, int timeout)
+static int dnxNodeRequestDecode(DnxXmlBuf * xbuf, DnxNodeRequest * pReg, 
+      char * address)
 {
-   DnxXmlBuf xbuf;
    int ret;
    int test;
 
-   assert(channel && pReg);
-
-   if(pReg->ttl != 0) {
-      // We are reusing an object and need to free up the old pointers
-      xfree(pReg->addr);
-      xfree(pReg->hn);
-   }
-   
-   memset(pReg, 0, sizeof *pReg);
-
-   // await a message from the specified channel
-   xbuf.size = sizeof xbuf.buf - 1;
-   if ((ret = dnxGet(channel, xbuf.buf, &xbuf.size, timeout, address)) != DNX_OK) {
-      return ret;
-   }
-   
    if (address != NULL) {
-        int maxlen = INET_ADDRSTRLEN + 1;
-        pReg->addr = (char *)xcalloc(maxlen,sizeof(char));
-        inet_ntop(AF_INET, &(((struct sockaddr_in *)address)->sin_addr), pReg->addr, maxlen); 
+        inet_ntop(AF_INET, &(((struct sockaddr_in *)address)->sin_addr), pReg->addr, DNX_MAX_ADDRESS); 
 //      pReg->addr = ntop((struct sockaddr *)address); //Do this now save time in logging later
    }
    
    // decode the XML message:
-   xbuf.buf[xbuf.size] = 0;
-   dnxDebug(6, "dnxWaitForNodeRequest: XML msg(%d bytes)=%s.", xbuf.size, xbuf.buf);
+   xbuf->buf[xbuf->size] = 0;
+   dnxDebug(6, "dnxWaitForNodeRequest: XML msg(%d bytes)=%s.", xbuf->size, xbuf->buf);
 
    // verify this is a "NodeRequest" message
-   if ((ret = dnxXmlCmpStr(&xbuf, "Request", "NodeRequest")) != DNX_OK)
+   if ((ret = dnxXmlCmpStr(xbuf, "Request", "NodeRequest")) != DNX_OK)
    {
-      test = dnxXmlCmpStr(&xbuf, "Request", "JobAck");
+      test = dnxXmlCmpStr(xbuf, "Request", "JobAck");
       dnxDebug(4, "dnxWaitForNodeRequest: Request (%i)", test);
       return ret;
    }
    // decode the worker node's XID 
-   if ((ret = dnxXmlGet(&xbuf, "XID", DNX_XML_XID, &pReg->xid)) != DNX_OK)
+   if ((ret = dnxXmlGet(xbuf, "XID", DNX_XML_XID, &pReg->xid)) != DNX_OK)
       return ret;
    
    // decode request type
-   if ((ret = dnxXmlGet(&xbuf, "ReqType", DNX_XML_INT, &pReg->reqType)) != DNX_OK)
+   if ((ret = dnxXmlGet(xbuf, "ReqType", DNX_XML_INT, &pReg->reqType)) != DNX_OK)
       return ret;
 
    // decode job capacity (support strange mixture of JobCap and Capacity)
-   if ((ret = dnxXmlGet(&xbuf, "JobCap", DNX_XML_INT, &pReg->jobCap)) != DNX_OK
-         && (ret = dnxXmlGet(&xbuf, "Capacity", DNX_XML_INT, &pReg->jobCap)) != DNX_OK)
+   if ((ret = dnxXmlGet(xbuf, "JobCap", DNX_XML_INT, &pReg->jobCap)) != DNX_OK
+         && (ret = dnxXmlGet(xbuf, "Capacity", DNX_XML_INT, &pReg->jobCap)) != DNX_OK)
       return ret;
     
    // decode the hostname
-   if ((ret = dnxXmlGet(&xbuf, "Hostname", DNX_XML_STR, &pReg->hn)) != DNX_OK)
+   if ((ret = dnxXmlGetStr(xbuf, "Hostname", pReg->hn, MAX_HOSTNAME + 1)) != DNX_OK)
       return ret;
         
    // decode job expiration (Time-To-Live in seconds)
-   return dnxXmlGet(&xbuf, "TTL", DNX_XML_INT, &pReg->ttl);
+   return dnxXmlGet(xbuf, "TTL", DNX_XML_INT, &pReg->ttl);
 }
+
 //----------------------------------------------------------------------------
 
-/** Collect job results from a client (server).
+/** Wait for a node request (server).
  *
- * @param[in] channel - the channel from which to receive the job result.
- * @param[out] pResult - the address of storage into which the job result
- *    should be read from @p channel.
+ * @param[in] channel - the channel from which to receive the node request.
+ * @param[out] pReg - the address of storage into which the request should
+ *    be read from @p channel. Its addr and hn fields must point at buffers
+ *    of DNX_MAX_ADDRESS and MAX_HOSTNAME + 1 bytes, as they do in a request
+ *    from dnxCreateNodeReq; the sender's address and host name are stored 
+ *    there, so that a request can be received without allocating memory.
  * @param[out] address - the address of storage in which to return the address
  *    of the sender. This parameter is optional and may be passed as NULL. If
  *    non-NULL, it should be large enough to store sockaddr_* data.
@@ -130,58 +149,234 @@ int dnxWaitForNodeRequest(DnxChannel * channel, DnxNodeRequest * pReg, char * ad
  *
  * @return Zero on success, or a non-zero error value.
  */
-int dnxWaitForResult(DnxChannel * channel, DnxResult * pResult, char * address, int timeout)
+int dnxWaitForNodeRequest(DnxChannel * channel, DnxNodeRequest * pReg, char * address, int timeout)
 {
    DnxXmlBuf xbuf;
    int ret;
 
-   assert(channel && pResult);
+   assert(channel && pReg && pReg->addr && pReg->hn);
 
-   memset(pResult, 0, sizeof *pResult);
+   // the request may be reused; keep its string buffers
+   dnxNodeRequestReset(pReg);
 
    // await a message from the specified channel
    xbuf.size = sizeof xbuf.buf - 1;
-   if ((ret = dnxGet(channel, xbuf.buf, &xbuf.size, timeout, address)) != DNX_OK)
+   if ((ret = dnxGet(channel, xbuf.buf, &xbuf.size, timeout, address)) != DNX_OK) {
       return ret;
+   }
+   
+   return dnxNodeRequestDecode(&xbuf, pReg, address);
+}
+
+//----------------------------------------------------------------------------
+
+/** Wait for a batch of node requests (server).
+ *
+ * Waits for the first request as dnxWaitForNodeRequest does, and takes any
+ * others already waiting with it. Requests that can't be decoded are 
+ * skipped.
+ *
+ * @param[in] channel - the channel from which to receive the node requests.
+ * @param[in,out] pRegs - the requests into which node requests should be
+ *    read, as for dnxWaitForNodeRequest; each sender's address is stored in
+ *    its request's address field. On exit, the requests decoded come first,
+ *    in the order received.
+ * @param[in,out] count - on entry, the number of requests in @p pRegs, from
+ *    1 to DNX_MAX_BATCH; on exit, the number decoded, which may be 0.
+ * @param[in] timeout - the maximum number of milliseconds the caller is
+ *    willing to wait before accepting a timeout error.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxWaitForNodeRequests(DnxChannel * channel, DnxNodeRequest ** pRegs, 
+      int * count, int timeout)
+{
+   DnxXmlBuf xbufs[DNX_MAX_BATCH];
+   DnxMsgBuf msgs[DNX_MAX_BATCH];
+   int i, n, ret;
+
+   assert(channel && pRegs && count && *count > 0 && *count <= DNX_MAX_BATCH);
+
+   for (i = 0; i < *count; i++)
+   {
+      dnxNodeRequestReset(pRegs[i]);
+      msgs[i].buf = xbufs[i].buf;
+      msgs[i].size = sizeof xbufs[i].buf - 1;
+      msgs[i].addr = pRegs[i]->address;
+   }
+
+   if ((ret = dnxGetBatch(channel, msgs, count, timeout)) != DNX_OK)
+      return ret;
+
+   // move the requests decoded to the front
+   for (i = n = 0; i < *count; i++)
+   {
+      xbufs[i].size = msgs[i].size;
+      if (!msgs[i].size || (ret = dnxNodeRequestDecode(&xbufs[i], pRegs[i], 
+            pRegs[i]->address)) != DNX_OK)
+      {
+         dnxDebug(2, "dnxWaitForNodeRequests: Discarded message: %s.", 
+               dnxErrorString(msgs[i].size? ret: DNX_ERR_SIZE));
+         continue;
+      }
+      if (n != i)
+      {
+         DnxNodeRequest * tmp = pRegs[n];
+         pRegs[n] = pRegs[i];
+         pRegs[i] = tmp;
+      }
+      n++;
+   }
+   *count = n;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Decode a job result or acknowledgement received from a client node.
+ *
+ * @param[in] xbuf - the message received; it is null-terminated here.
+ * @param[out] pResult - the result into which @p xbuf should be decoded.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+static int dnxResultDecode(DnxXmlBuf * xbuf, DnxResult * pResult)
+{
+   int ret;
 
    // decode the XML message
-   xbuf.buf[xbuf.size] = 0;
-   dnxDebug(3, "dnxWaitForResult: XML msg(%d bytes)=%s.", xbuf.size, xbuf.buf);
+   xbuf->buf[xbuf->size] = 0;
+   dnxDebug(3, "dnxWaitForResult: XML msg(%d bytes)=%s.", xbuf->size, xbuf->buf);
 
    // verify this is a "Result" message
-   if ((ret = dnxXmlCmpStr(&xbuf, "Request", "Result")) == DNX_OK)
+   if ((ret = dnxXmlCmpStr(xbuf, "Request", "Result")) == DNX_OK)
    {
 
        // decode the result's XID 
-       if ((ret = dnxXmlGet(&xbuf, "XID", DNX_XML_XID, &pResult->xid)) != DNX_OK)
+       if ((ret = dnxXmlGet(xbuf, "XID", DNX_XML_XID, &pResult->xid)) != DNX_OK)
           return ret;
 
        // decode the result's state
-       if ((ret = dnxXmlGet(&xbuf, "State", DNX_XML_INT, &pResult->state)) != DNX_OK)
+       if ((ret = dnxXmlGet(xbuf, "State", DNX_XML_INT, &pResult->state)) != DNX_OK)
           return ret;
 
        // decode the result's execution time delta
-       if ((ret = dnxXmlGet(&xbuf, "Delta", DNX_XML_UINT, &pResult->delta)) != DNX_OK)
+       if ((ret = dnxXmlGet(xbuf, "Delta", DNX_XML_UINT, &pResult->delta)) != DNX_OK)
           return ret;
 
        // decode the result's result code
-       if ((ret = dnxXmlGet(&xbuf, "ResultCode", DNX_XML_INT, &pResult->resCode)) != DNX_OK)
+       if ((ret = dnxXmlGet(xbuf, "ResultCode", DNX_XML_INT, &pResult->resCode)) != DNX_OK)
           return ret;
 
        // decode the result's result data
-       return dnxXmlGet(&xbuf, "ResultData", DNX_XML_STR, &pResult->resData);
+       return dnxXmlGet(xbuf, "ResultData", DNX_XML_STR, &pResult->resData);
    }
 
    //Record the job ack
-   else if((ret = dnxXmlCmpStr(&xbuf, "Request", "JobAck")) == DNX_OK) {
+   else if((ret = dnxXmlCmpStr(xbuf, "Request", "JobAck")) == DNX_OK) {
    
       // We will use resCode set to -1 to flag it as an ack
       pResult->resCode = -1;
       
-      if ((ret = dnxXmlGet(&xbuf, "XID", DNX_XML_XID, &pResult->xid)) != DNX_OK)
+      if ((ret = dnxXmlGet(xbuf, "XID", DNX_XML_XID, &pResult->xid)) != DNX_OK)
           return ret;
-      return dnxXmlGet(&xbuf, "Timestamp", DNX_XML_UINT, &pResult->timestamp);
+      return dnxXmlGet(xbuf, "Timestamp", DNX_XML_UINT, &pResult->timestamp);
    }
+   return ret;
+}
+
+//----------------------------------------------------------------------------
+
+/** Collect job results from a client (server).
+ *
+ * @param[in] channel - the channel from which to receive the job result.
+ * @param[out] pResult - the address of storage into which the job result
+ *    should be read from @p channel.
+ * @param[out] address - the address of storage in which to return the address
+ *    of the sender. This parameter is optional and may be passed as NULL. If
+ *    non-NULL, it should be large enough to store sockaddr_* data.
+ * @param[in] timeout - the maximum number of seconds the caller is willing to
+ *    wait before accepting a timeout error.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxWaitForResult(DnxChannel * channel, DnxResult * pResult, char * address, int timeout)
+{
+   DnxXmlBuf xbuf;
+   int ret;
+
+   assert(channel && pResult);
+
+   memset(pResult, 0, sizeof *pResult);
+
+   // await a message from the specified channel
+   xbuf.size = sizeof xbuf.buf - 1;
+   if ((ret = dnxGet(channel, xbuf.buf, &xbuf.size, timeout, address)) != DNX_OK)
+      return ret;
+
+   return dnxResultDecode(&xbuf, pResult);
+}
+
+//----------------------------------------------------------------------------
+
+/** Collect a batch of job results from clients (server).
+ *
+ * Waits for the first result as dnxWaitForResult does, and takes any others
+ * already waiting with it. Results that can't be decoded are skipped.
+ *
+ * @param[in] channel - the channel from which to receive the job results.
+ * @param[out] pResults - storage for the job results received; each 
+ *    sender's address is stored in its result's address field. The results
+ *    decoded come first, in the order received.
+ * @param[in,out] count - on entry, the number of results in @p pResults, 
+ *    from 1 to DNX_MAX_BATCH; on exit, the number decoded, which may be 0.
+ * @param[in] timeout - the maximum number of milliseconds the caller is
+ *    willing to wait before accepting a timeout error.
+ *
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxWaitForResults(DnxChannel * channel, DnxResult * pResults, int * count,
+      int timeout)
+{
+   DnxXmlBuf xbufs[DNX_MAX_BATCH];
+   DnxMsgBuf msgs[DNX_MAX_BATCH];
+   int i, n, ret;
+
+   assert(channel && pResults && count && *count > 0 && *count <= DNX_MAX_BATCH);
+
+   memset(pResults, 0, *count * sizeof *pResults);
+   for (i = 0; i < *count; i++)
+   {
+      msgs[i].buf = xbufs[i].buf;
+      msgs[i].size = sizeof xbufs[i].buf - 1;
+      msgs[i].addr = pResults[i].address;
+   }
+
+   if ((ret = dnxGetBatch(channel, msgs, count, timeout)) != DNX_OK)
+      return ret;
+
+   // decode each result into the first free place
+   for (i = n = 0; i < *count; i++)
+   {
+      if (n != i)
+      {
+         memset(&pResults[n], 0, sizeof pResults[n]);
+         memcpy(pResults[n].address, pResults[i].address, sizeof pResults[n].address);
+      }
+      xbufs[i].size = msgs[i].size;
+      if (!msgs[i].size || (ret = dnxResultDecode(&xbufs[i], &pResults[n])) != DNX_OK)
+      {
+         dnxDebug(2, "dnxWaitForResults: Discarded message: %s.", 
+               dnxErrorString(msgs[i].size? ret: DNX_ERR_SIZE));
+         xfree(pResults[n].resData);
+         continue;
+      }
+      n++;
+   }
+   *count = n;
+
+   return DNX_OK;
 }
 
 
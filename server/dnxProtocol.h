@@ -3,9 +3,11 @@
 #include "../common/dnxProtocol.h"
 
 int dnxWaitForResult(DnxChannel * channel, DnxResult * pResult, char * address, int timeout);
+int dnxWaitForResults(DnxChannel * channel, DnxResult * pResults, int * count, int timeout);
 int dnxSendJob(DnxChannel * channel, DnxJob * pJob, char * address);
+int dnxEncodeJob(DnxXmlBuf * xbuf, DnxJob * pJob);
 int dnxWaitForNodeRequest(DnxChannel * channel, DnxNodeRequest * pReg, char * address, int timeout);
-int dnxWaitForResult(DnxChannel * channel, DnxResult * pResult, char * address, int timeout);
+int dnxWaitForNodeRequests(DnxChannel * channel, DnxNodeRequest ** pRegs, int * count, int timeout);
 
 
 
@@ -30,12 +30,16 @@
 #include "dnxError.h"
 #include "dnxDebug.h"
 #include "dnxLogging.h"
+#include "dnxPool.h"
 
 #include <stdlib.h>
 #include <syslog.h>
 #include <assert.h>
 #include <pthread.h>
 
+/** The number of queue entries allocated at a time. */
+#define DNX_QUEUE_POOL_BATCH  64
+
 /** Queue entry wrapper structure - wraps user payload. */
 typedef struct iDnxQueueEntry_ 
 {
@@ -54,6 +58,7 @@ typedef struct iDnxQueue_
    unsigned maxsz;                  /*!< Maximum number of requests allowed in queue (zero = unlimited). */
    pthread_mutex_t mutex;           /*!< Queue's mutex. */
    pthread_cond_t cv;               /*!< Queue's condition variable. */
+   DnxPool * entries;               /*!< Pool of queue entry wrappers. */
 } iDnxQueue;
 
 /*--------------------------------------------------------------------------
@@ -111,7 +116,7 @@ int dnxQueueGetWait(DnxQueue * queue, void ** ppPayload)
    if (item) 
    {
       *ppPayload = item->pPayload;
-      xfree(item);
+      dnxPoolFree(iqueue->entries, item);
       return DNX_OK;
    }
 
@@ -202,7 +207,7 @@ int dnxQueuePut(DnxQueue * queue, void * pPayload)
    assert(queue);
    
    // create structure to store the new request
-   if ((item = (iDnxQueueEntry *)xmalloc(sizeof *item)) == 0)
+   if ((item = (iDnxQueueEntry *)dnxPoolAlloc(iqueue->entries)) == 0)
       return DNX_ERR_MEMORY;
 
    // We only put a pointer here, because this is a generic queue
@@ -245,7 +250,7 @@ int dnxQueuePut(DnxQueue * queue, void * pPayload)
       if (iqueue->freepayload)
          iqueue->freepayload(item->pPayload);
 
-      xfree(item);
+      dnxPoolFree(iqueue->entries, item);
    }
    
    // signal any waiters - there's a new item in the queue
@@ -290,7 +295,7 @@ int dnxQueueGet(DnxQueue * queue, void ** ppPayload)
    if (item) 
    {
       *ppPayload = item->pPayload;
-      xfree(item);
+      dnxPoolFree(iqueue->entries, item);
       return DNX_OK;
    }
 
@@ -343,7 +348,7 @@ DnxQueueResult dnxQueueRemove(DnxQueue * queue, void ** ppPayload,
    DNX_PT_MUTEX_UNLOCK(&iqueue->mutex);
 
    if (bFound == DNX_QRES_FOUND) {
-      xfree(item);       // free the queue entry wrapper object
+      dnxPoolFree(iqueue->entries, item); // free the queue entry wrapper object
    }
    return bFound;
 }
@@ -394,6 +399,13 @@ int dnxQueueCreate(unsigned maxsz, void (*pldtor)(void *), DnxQueue ** pqueue)
    iqueue->freepayload = pldtor;
    iqueue->maxsz = maxsz;
 
+   if (dnxPoolCreate("queue entries", sizeof(iDnxQueueEntry), 
+         DNX_QUEUE_POOL_BATCH, &iqueue->entries) != DNX_OK)
+   {
+      xfree(iqueue);
+      return DNX_ERR_MEMORY;
+   }
+
    // initialize thread sync
    DNX_PT_MUTEX_INIT(&iqueue->mutex);
    pthread_cond_init(&iqueue->cv, 0);
@@ -420,7 +432,7 @@ void dnxQueueDestroy(DnxQueue * queue)
    {
       iDnxQueueEntry * next = item->next;
       iqueue->freepayload(item->pPayload);
-      xfree(item);
+      dnxPoolFree(iqueue->entries, item);
       item = next;
    }
    
@@ -429,6 +441,7 @@ void dnxQueueDestroy(DnxQueue * queue)
    DNX_PT_MUTEX_DESTROY(&iqueue->mutex);
    pthread_cond_destroy(&iqueue->cv);
 
+   dnxPoolDestroy(iqueue->entries);
    xfree(iqueue);
 }
 
@@ -437,13 +450,13 @@ void dnxQueueDestroy(DnxQueue * queue)
 
    From within dnx/server, compile with GNU tools using this command line:
     
-      gcc -DDEBUG -DDNX_QUEUE_TEST -g -O0 -I../common dnxQueue.c \
+      gcc -DDEBUG -DDNX_QUEUE_TEST -g -O0 -I../common dnxQueue.c dnxPool.c \
          ../common/dnxError.c -lpthread -lgcc_s -lrt -o dnxQueueTest
 
    Alternatively, a heap check may be done with the following command line:
 
       gcc -DDEBUG -DDEBUG_HEAP -DDNX_QUEUE_TEST -g -O0 -I../common \
-         dnxQueue.c ../common/dnxError.c ../common/dnxHeap.c \
+         dnxQueue.c dnxPool.c ../common/dnxError.c ../common/dnxHeap.c \
          -lpthread -lgcc_s -lrt -o dnxCfgParserTest 
 
   --------------------------------------------------------------------------*/
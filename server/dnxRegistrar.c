@@ -38,13 +38,16 @@
 #include "dnxNebMain.h"
 #include "dnxError.h"
 #include "dnxDebug.h"
-#include "dnxQueue.h"
 #include "dnxSleep.h"
 #include "dnxTransport.h"
 #include "dnxProtocol.h"
 #include "dnxLogging.h"
 #include "dnxNode.h"
+#include "dnxPool.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <assert.h>
 #include <pthread.h>
 #include <arpa/inet.h>
@@ -52,73 +55,594 @@
 /** Registrar dispatch channel timeout in seconds. */
 #define DNX_REGISTRAR_REQUEST_TIMEOUT  5
 
+/** The initial number of worker XID hash buckets; a power of two. */
+#define DNX_REGISTRAR_HASH_MIN   256
+
+/** The number of objects the registrar's pools allocate at a time. */
+#define DNX_REGISTRAR_POOL_BATCH 64
+
+struct iDnxAffinityClass_;
+struct iDnxIdleNode_;
+
+/** A pooled node request, with room for the strings it refers to. */
+typedef struct iDnxNodeReq_
+{
+   DnxNodeRequest req;              /*!< The request; must be first. */
+   char addr[DNX_MAX_ADDRESS];      /*!< Storage for the source address. */
+   char hn[MAX_HOSTNAME + 1];       /*!< Storage for the source host name. */
+} iDnxNodeReq;
+
+/** A registered worker "request for work" waiting for a job. */
+typedef struct iDnxIdleWorker_
+{
+   struct iDnxIdleWorker_ * next;   /*!< The next worker in the same class. */
+   struct iDnxIdleWorker_ * prev;   /*!< The previous worker in the same class. */
+   struct iDnxIdleWorker_ * newer;  /*!< The next worker to have registered. */
+   struct iDnxIdleWorker_ * older;  /*!< The previous worker to have registered. */
+   struct iDnxIdleWorker_ * hashNext; /*!< The next worker in the same XID hash bucket. */
+   struct iDnxIdleWorker_ * nodeNext; /*!< The next worker of the same node and class. */
+   struct iDnxIdleWorker_ * nodePrev; /*!< The previous worker of the same node and class. */
+   struct iDnxAffinityClass_ * pClass; /*!< The class holding this worker. */
+   struct iDnxIdleNode_ * pNode;    /*!< The worker's node within its class. */
+   DnxNodeRequest * pReq;           /*!< The worker's request for work. */
+} iDnxIdleWorker;
+
+/** The idle workers of one worker node within an affinity class. 
+ * 
+ * The load-aware selection policies choose a node before a worker, so that
+ * a node with many worker threads is not given more jobs for having them.
+ */
+typedef struct iDnxIdleNode_
+{
+   char addr[DNX_MAX_ADDRESS];      /*!< The node's address. */
+   DnxNode * pStat;                 /*!< The node's stats, 0 if not yet found. */
+   iDnxIdleWorker * head;           /*!< The node's longest waiting worker. */
+   iDnxIdleWorker * tail;           /*!< The node's most recently added worker. */
+   unsigned index;                  /*!< The node's position in its class's nodes. */
+   struct iDnxIdleNode_ * next;     /*!< The next node seen in the same class. */
+} iDnxIdleNode;
+
+/** The idle workers that share one set of affinity flags. 
+ * 
+ * While a class has idle workers, it's linked into the class list of each
+ * of its flag bits, so that the workers able to run a job are found with a
+ * bit scan of the job's flags, however many workers are registered. The 
+ * per-bit links are allocated with the class, one pair for each bit of the
+ * words its flags span.
+ */
+typedef struct iDnxAffinityClass_
+{
+   DnxAffinity flags;               /*!< The affinity flags of these workers. */
+   iDnxIdleWorker * head;           /*!< The longest waiting worker. */
+   iDnxIdleWorker * tail;           /*!< The most recently added worker. */
+   struct iDnxAffinityClass_ * next; /*!< The next class of the registrar. */
+   iDnxIdleNode * allNodes;         /*!< Every node seen in this class. */
+   iDnxIdleNode ** nodes;           /*!< The nodes with idle workers in this class. */
+   unsigned nodeCount;              /*!< The number of nodes with idle workers. */
+   unsigned nodeMax;                /*!< The allocated size of nodes. */
+   unsigned rotor;                  /*!< Where the next node scan starts. */
+   struct iDnxAffinityClass_ ** bitNext; /*!< The next class with idle workers, per flag bit. */
+   struct iDnxAffinityClass_ ** bitPrev; /*!< The previous class with idle workers, per flag bit. */
+} iDnxAffinityClass;
+
 /** The internal registrar structure. */
 typedef struct iDnxRegistrar_
 {
    DnxChannel * dispchan;  /*!< The dispatch communications channel. */
-   DnxQueue * rqueue;      /*!< The registered worker node requests queue. */
+   iDnxAffinityClass * classes; /*!< Every affinity class seen so far. */
+   iDnxAffinityClass ** bitHead; /*!< Classes with idle workers, per flag bit. */
+   iDnxAffinityClass ** bitTail; /*!< The last such class, per flag bit. */
+   DnxAffinityWord * bits; /*!< The flag bits that have idle workers. */
+   unsigned bitWords;      /*!< The words of flag bits the lists above cover. */
+   iDnxIdleWorker * oldest; /*!< The longest registered idle worker. */
+   iDnxIdleWorker * newest; /*!< The most recently registered idle worker. */
+   unsigned count;         /*!< The number of idle workers. */
+   unsigned maxsz;         /*!< The most idle workers kept; zero = unlimited. */
+   iDnxIdleWorker ** hash; /*!< Idle workers by request XID. */
+   unsigned hashSize;      /*!< The number of XID hash buckets; a power of two. */
+   DnxPool * workers;      /*!< The pool of idle worker entries. */
+   DnxSelectPolicy policy; /*!< How a worker is chosen among those able to run a job. */
+   unsigned seed;          /*!< Random number state for the selection policy. */
+   pthread_mutex_t mutex;  /*!< The idle worker mutex. */
    pthread_t tid;          /*!< The registrar thread id. */
 } iDnxRegistrar;
 
+/** Node requests of all registrars and jobs, created by dnxNodeReqPoolInit. */
+static DnxPool * nodeReqPool;
+
 /*--------------------------------------------------------------------------
                               IMPLEMENTATION
   --------------------------------------------------------------------------*/
 
-/** Compare two node "request for work" requests for equality.
+/** Link an affinity class into the class list of each of its flag bits.
  * 
- * In the message exchange between the Registrar and client worker threads
- * the XID.TYPE field will ALWAYS be DNX_OBJ_WORKER, so there is no need to 
- * compare this field because it will always be the same value. However, the 
- * XID.SERIAL field is configured as the worker's thread identifier, and the
- * XID.SLOT field is configured as the worker's IP node address. Thus, the 
- * XID.SERIAL and XID.SLOT fields uniquely identify a given worker thread.
+ * Called when the class gains its first idle worker. The caller must hold
+ * the registrar mutex.
  * 
- * @param[in] pLeft - the left node to be compared.
- * @param[in] pRight - the right node to be compared.
+ * @param[in] ireg - the registrar holding @p pClass.
+ * @param[in] pClass - the class to be linked.
+ */
+static void dnxClassLink(iDnxRegistrar * ireg, iDnxAffinityClass * pClass)
+{
+   DnxAffinity flags = pClass->flags;
+   DnxAffinityWord word;
+   unsigned w, bit;
+
+   for (w = 0; flags && w < flags->words; w++) {
+      for (word = flags->bits[w]; word; word &= word - 1) {
+         bit = w * DNX_AFFINITY_WORD_BITS + __builtin_ctzll(word);
+         pClass->bitNext[bit] = 0;
+         pClass->bitPrev[bit] = ireg->bitTail[bit];
+         if (ireg->bitTail[bit])
+            ireg->bitTail[bit]->bitNext[bit] = pClass;
+         else
+            ireg->bitHead[bit] = pClass;
+         ireg->bitTail[bit] = pClass;
+      }
+      ireg->bits[w] |= flags->bits[w];
+   }
+}
+
+//----------------------------------------------------------------------------
+
+/** Remove an affinity class from the class list of one of its flag bits.
+ * 
+ * The caller must hold the registrar mutex.
  * 
- * @return DNX_QRES_FOUND on match; DNX_QRES_CONTINUE if no match.
+ * @param[in] ireg - the registrar holding @p pClass.
+ * @param[in] pClass - the class to be unlinked.
+ * @param[in] bit - the flag bit whose class list @p pClass is removed from.
  */
-static DnxQueueResult dnxCompareNodeReq(void * pLeft, void * pRight)
+static void dnxClassUnlinkBit(iDnxRegistrar * ireg, iDnxAffinityClass * pClass, 
+      unsigned bit)
 {
-   DnxXID * pxl = &((DnxNodeRequest *)pLeft)->xid;
-   DnxXID * pxr = &((DnxNodeRequest *)pRight)->xid;
+   if (pClass->bitPrev[bit])
+      pClass->bitPrev[bit]->bitNext[bit] = pClass->bitNext[bit];
+   else
+      ireg->bitHead[bit] = pClass->bitNext[bit];
 
-   assert(pLeft && pRight);
+   if (pClass->bitNext[bit])
+      pClass->bitNext[bit]->bitPrev[bit] = pClass->bitPrev[bit];
+   else
+      ireg->bitTail[bit] = pClass->bitPrev[bit];
 
-   dnxDebug(5, "dnxCompareNodeReq: dnxClient request IP [%lu]", pxl->objSlot);
+   pClass->bitNext[bit] = pClass->bitPrev[bit] = 0;
+}
+
+//----------------------------------------------------------------------------
 
-   return pxl->objSerial == pxr->objSerial && pxl->objSlot == pxr->objSlot
-         ? DNX_QRES_FOUND : DNX_QRES_CONTINUE;
+/** Remove an affinity class from the class lists of all of its flag bits.
+ * 
+ * Called when the class loses its last idle worker. The caller must hold 
+ * the registrar mutex.
+ * 
+ * @param[in] ireg - the registrar holding @p pClass.
+ * @param[in] pClass - the class to be unlinked.
+ */
+static void dnxClassUnlink(iDnxRegistrar * ireg, iDnxAffinityClass * pClass)
+{
+   DnxAffinity flags = pClass->flags;
+   DnxAffinityWord word;
+   unsigned w, bit;
+
+   for (w = 0; flags && w < flags->words; w++)
+      for (word = flags->bits[w]; word; word &= word - 1) {
+         bit = w * DNX_AFFINITY_WORD_BITS + __builtin_ctzll(word);
+         dnxClassUnlinkBit(ireg, pClass, bit);
+         if (!ireg->bitHead[bit])
+            ireg->bits[w] &= ~(word & -word);
+      }
 }
 
-/** Compare two node "request for work" requests for affinity.
+//----------------------------------------------------------------------------
+
+/** Make room in a registrar's per-bit class lists for a set of flags.
+ * 
+ * The lists only cover the words of flag bits seen so far, and are widened
+ * when a class with wider flags is created. The caller must hold the 
+ * registrar mutex.
  * 
- * @param[in] pLeft - the left node to be compared.
- * @param[in] pRight - the right node to be compared.
+ * @param[in] ireg - the registrar whose lists are to be widened.
+ * @param[in] flags - the affinity flags the lists must cover.
  * 
- * @return DNX_QRES_FOUND on match; DNX_QRES_CONTINUE if no match.
+ * @return Zero on success, or DNX_ERR_MEMORY.
  */
-static DnxQueueResult dnxCompareAffinityNodeReq(void * pLeft, void * pRight)
+static int dnxRegistrarGrowBits(iDnxRegistrar * ireg, DnxAffinity flags)
 {
-   time_t now = time(0);
-   
-   assert(pLeft && pRight);
+   unsigned words = flags? flags->words: 0;
+   unsigned oldBits = ireg->bitWords * DNX_AFFINITY_WORD_BITS;
+   unsigned newBits = words * DNX_AFFINITY_WORD_BITS;
+   iDnxAffinityClass ** lists;
+   DnxAffinityWord * bits;
+
+   if (words <= ireg->bitWords)
+      return DNX_OK;
+
+   if ((bits = (DnxAffinityWord *)xrealloc(ireg->bits, 
+         words * sizeof *bits)) == 0)
+      return DNX_ERR_MEMORY;
+   memset(bits + ireg->bitWords, 0, (words - ireg->bitWords) * sizeof *bits);
+   ireg->bits = bits;
+
+   // the heads and tails are kept in one block
+   if ((lists = (iDnxAffinityClass **)xcalloc(2 * newBits, 
+         sizeof *lists)) == 0)
+      return DNX_ERR_MEMORY;
+   if (oldBits) {
+      memcpy(lists, ireg->bitHead, oldBits * sizeof *lists);
+      memcpy(lists + newBits, ireg->bitTail, oldBits * sizeof *lists);
+   }
+   xfree(ireg->bitHead);
+   ireg->bitHead = lists;
+   ireg->bitTail = lists + newBits;
+   ireg->bitWords = words;
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the hash bucket of a worker request XID.
+ * 
+ * A worker's XID serial is its thread id, which is often an aligned 
+ * address, so the bits are mixed well before the bucket is chosen.
+ * 
+ * @param[in] ireg - the registrar whose hash table is to be indexed.
+ * @param[in] pxid - the XID of the worker's request.
+ * 
+ * @return The address of the bucket's first worker pointer.
+ */
+static iDnxIdleWorker ** dnxIdleBucket(iDnxRegistrar * ireg, DnxXID * pxid)
+{
+   unsigned long h = pxid->objSerial ^ (pxid->objSlot * 2654435761UL);
+
+   h ^= h >> 16;
+   h *= 2246822519UL;
+   h ^= h >> 13;
+   h ^= h >> 29;
+
+   return &ireg->hash[h & (ireg->hashSize - 1)];
+}
+
+//----------------------------------------------------------------------------
+
+/** Double the number of worker XID hash buckets.
+ * 
+ * If the new table can't be allocated, the old one is kept; lookups just 
+ * take a little longer. The caller must hold the registrar mutex.
+ * 
+ * @param[in] ireg - the registrar whose hash table should be grown.
+ */
+static void dnxIdleHashGrow(iDnxRegistrar * ireg)
+{
+   iDnxIdleWorker ** old = ireg->hash, * pWorker, ** ppBucket;
+   unsigned oldSize = ireg->hashSize, i;
 
-   // verify that this request's Time-To-Live (TTL) has not expired
-   if((((DnxNodeRequest *)pLeft)->expires - 1) > now) {
-      return DNX_QRES_CONTINUE;
+   if ((ireg->hash = (iDnxIdleWorker **)xcalloc(oldSize * 2, sizeof *old)) == 0) {
+      ireg->hash = old;
+      return;
    }
+   ireg->hashSize = oldSize * 2;
+
+   for (i = 0; i < oldSize; i++)
+      while ((pWorker = old[i]) != 0) {
+         old[i] = pWorker->hashNext;
+         ppBucket = dnxIdleBucket(ireg, &pWorker->pReq->xid);
+         pWorker->hashNext = *ppBucket;
+         *ppBucket = pWorker;
+      }
+
+   xfree(old);
+}
+
+//----------------------------------------------------------------------------
 
-   unsigned long long pxl = ((DnxNodeRequest *)pLeft)->flags;
-   unsigned long long pxr = ((DnxNodeRequest *)pRight)->flags;
+/** Remove a worker from the registrar's idle workers.
+ * 
+ * The worker's request is not freed. The caller must hold the registrar 
+ * mutex.
+ * 
+ * @param[in] ireg - the registrar holding @p pWorker.
+ * @param[in] pWorker - the idle worker to be removed; freed on return.
+ */
+static void dnxIdleRemove(iDnxRegistrar * ireg, iDnxIdleWorker * pWorker)
+{
+   iDnxAffinityClass * pClass = pWorker->pClass;
+   iDnxIdleNode * pNode = pWorker->pNode;
+   iDnxIdleWorker ** ppBucket;
+
+   if (pWorker->prev)
+      pWorker->prev->next = pWorker->next;
+   else
+      pClass->head = pWorker->next;
+   if (pWorker->next)
+      pWorker->next->prev = pWorker->prev;
+   else
+      pClass->tail = pWorker->prev;
+
+   if (!pClass->head)
+      dnxClassUnlink(ireg, pClass);
+
+   if (pWorker->nodePrev)
+      pWorker->nodePrev->nodeNext = pWorker->nodeNext;
+   else
+      pNode->head = pWorker->nodeNext;
+   if (pWorker->nodeNext)
+      pWorker->nodeNext->nodePrev = pWorker->nodePrev;
+   else
+      pNode->tail = pWorker->nodePrev;
+
+   // the node has no idle workers left, so it can't be chosen
+   if (!pNode->head) {
+      pClass->nodes[pNode->index] = pClass->nodes[--pClass->nodeCount];
+      pClass->nodes[pNode->index]->index = pNode->index;
+   }
+
+   for (ppBucket = dnxIdleBucket(ireg, &pWorker->pReq->xid); 
+         *ppBucket != pWorker; ppBucket = &(*ppBucket)->hashNext)
+      ;
+   *ppBucket = pWorker->hashNext;
+
+   if (pWorker->older)
+      pWorker->older->newer = pWorker->newer;
+   else
+      ireg->oldest = pWorker->newer;
+   if (pWorker->newer)
+      pWorker->newer->older = pWorker->older;
+   else
+      ireg->newest = pWorker->older;
+
+   ireg->count--;
+   dnxPoolFree(ireg->workers, pWorker);
+}
+
+//----------------------------------------------------------------------------
+
+/** Add a worker request to the registrar's idle workers.
+ * 
+ * The worker joins the class for its affinity flags, which is created the
+ * first time the flags are seen. If the registrar was created with a 
+ * maximum size, and is now over it, the longest registered request is 
+ * discarded. The caller must hold the registrar mutex.
+ * 
+ * @param[in] ireg - the registrar to which @p pReq should be added.
+ * @param[in] pReq - the worker request to be added; owned by the registrar
+ *    on success.
+ * 
+ * @return Zero on success, or DNX_ERR_MEMORY.
+ */
+static int dnxIdleAdd(iDnxRegistrar * ireg, DnxNodeRequest * pReq)
+{
+   iDnxAffinityClass * pClass;
+   iDnxIdleNode * pNode;
+   iDnxIdleWorker * pWorker, ** ppBucket;
+
+   // flag sets are interned, so equal flags are the same set
+   for (pClass = ireg->classes; pClass; pClass = pClass->next)
+      if (pClass->flags == pReq->flags)
+         break;
+
+   if (!pClass) {
+      unsigned bits = pReq->flags? pReq->flags->words * DNX_AFFINITY_WORD_BITS: 0;
+      if (dnxRegistrarGrowBits(ireg, pReq->flags) != DNX_OK
+            || (pClass = (iDnxAffinityClass *)xcalloc(1, sizeof *pClass 
+                  + 2 * bits * sizeof *pClass->bitNext)) == 0)
+         return DNX_ERR_MEMORY;
+      pClass->bitNext = (iDnxAffinityClass **)(pClass + 1);
+      pClass->bitPrev = pClass->bitNext + bits;
+      pClass->flags = pReq->flags;
+      pClass->next = ireg->classes;
+      ireg->classes = pClass;
+   }
+
+   for (pNode = pClass->allNodes; pNode; pNode = pNode->next)
+      if (strcmp(pNode->addr, pReq->addr) == 0)
+         break;
+
+   if (!pNode) {
+      if ((pNode = (iDnxIdleNode *)xcalloc(1, sizeof *pNode)) == 0)
+         return DNX_ERR_MEMORY;
+      strncpy(pNode->addr, pReq->addr, sizeof pNode->addr - 1);
+      pNode->next = pClass->allNodes;
+      pClass->allNodes = pNode;
+   }
+
+   // make sure there's room to list the node before anything is linked
+   if (!pNode->head && pClass->nodeCount == pClass->nodeMax) {
+      unsigned max = pClass->nodeMax? pClass->nodeMax * 2: 8;
+      iDnxIdleNode ** nodes;
+      if ((nodes = (iDnxIdleNode **)xrealloc(pClass->nodes, 
+            max * sizeof *nodes)) == 0)
+         return DNX_ERR_MEMORY;
+      pClass->nodes = nodes;
+      pClass->nodeMax = max;
+   }
+
+   if ((pWorker = (iDnxIdleWorker *)dnxPoolAlloc(ireg->workers)) == 0)
+      return DNX_ERR_MEMORY;
+
+   pWorker->pReq = pReq;
+   pWorker->pClass = pClass;
+   pWorker->pNode = pNode;
+
+   pWorker->nodeNext = 0;
+   if ((pWorker->nodePrev = pNode->tail) == 0) {
+      pNode->head = pWorker;
+      pNode->index = pClass->nodeCount;
+      pClass->nodes[pClass->nodeCount++] = pNode;
+   } else
+      pNode->tail->nodeNext = pWorker;
+   pNode->tail = pWorker;
+
+   pWorker->next = 0;
+   if ((pWorker->prev = pClass->tail) == 0) {
+      pClass->head = pWorker;
+      dnxClassLink(ireg, pClass);
+   } else
+      pClass->tail->next = pWorker;
+   pClass->tail = pWorker;
+
+   pWorker->newer = 0;
+   if ((pWorker->older = ireg->newest) == 0)
+      ireg->oldest = pWorker;
+   else
+      ireg->newest->newer = pWorker;
+   ireg->newest = pWorker;
+
+   ppBucket = dnxIdleBucket(ireg, &pReq->xid);
+   pWorker->hashNext = *ppBucket;
+   *ppBucket = pWorker;
+
+   // keep the hash chains short
+   if (++ireg->count > ireg->hashSize)
+      dnxIdleHashGrow(ireg);
+
+   // check for overflow if this registrar was created with a maximum size
+   if (ireg->maxsz > 0 && ireg->count > ireg->maxsz) {
+      pReq = ireg->oldest->pReq;
+      dnxIdleRemove(ireg, ireg->oldest);
+      dnxDeleteNodeReq(pReq);
+   }
+
+   return DNX_OK;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the stats of a node with idle workers.
+ * 
+ * Nodes are only removed from the node list at shutdown, so the stats 
+ * pointer is kept once the node has been found.
+ * 
+ * @param[in] pNode - the node whose stats are to be returned.
+ * 
+ * @return The node's stats, or 0 if the node isn't in the node list.
+ */
+static DnxNode * dnxIdleNodeStats(iDnxIdleNode * pNode)
+{
+   if (!pNode->pStat)
+      pNode->pStat = dnxNodeListFindNode(pNode->addr);
+   return pNode->pStat;
+}
+
+//----------------------------------------------------------------------------
+
+/** Return the cost of sending a job to a node, by the registrar's policy.
+ * 
+ * The cost is the number of jobs the node has outstanding; for the latency
+ * policy, it's the time the node is expected to take to finish them and
+ * one more, at its average latency.
+ * 
+ * @param[in] ireg - the registrar whose policy is used.
+ * @param[in] pNode - the node to be costed.
+ * @param[in] guess - the latency to assume for a node that has none yet.
+ * 
+ * @return The cost of the node; lower is better.
+ */
+static unsigned long long dnxIdleNodeCost(iDnxRegistrar * ireg, 
+      iDnxIdleNode * pNode, unsigned guess)
+{
+   DnxNode * pStat = dnxIdleNodeStats(pNode);
+   unsigned long long jobs = pStat? pStat->jobs_outstanding: 0;
+
+   if (ireg->policy != DNX_SELECT_LATENCY)
+      return jobs;
+
+   return (jobs + 1) * (pStat && pStat->latency? pStat->latency: guess);
+}
+
+//----------------------------------------------------------------------------
+
+/** Choose an idle worker from an affinity class.
+ * 
+ * The longest waiting worker in the class is chosen by the FIFO policy. The
+ * other policies choose a node, and return its longest waiting worker:
+ * the node with the fewest outstanding jobs or the shortest expected wait,
+ * or the less busy of two nodes picked at random. Ties are broken by 
+ * starting each scan at the next node. The caller must hold the registrar 
+ * mutex.
+ * 
+ * @param[in] ireg - the registrar holding @p pClass.
+ * @param[in] pClass - the class to choose from; it must have idle workers.
+ * 
+ * @return The chosen worker.
+ */
+static iDnxIdleWorker * dnxClassSelect(iDnxRegistrar * ireg, 
+      iDnxAffinityClass * pClass)
+{
+   iDnxIdleNode ** nodes = pClass->nodes, * pBest;
+   unsigned long long cost, bestCost;
+   unsigned n = pClass->nodeCount, i, j, guess = 0, known = 0;
+   DnxNode * pStat;
+
+   if (ireg->policy == DNX_SELECT_FIFO)
+      return pClass->head;
+   if (n == 1)
+      return nodes[0]->head;
+
+   if (ireg->policy == DNX_SELECT_TWO_CHOICES) {
+      i = rand_r(&ireg->seed) % n;
+      j = rand_r(&ireg->seed) % (n - 1);
+      if (j >= i)
+         j++;
+      pBest = dnxIdleNodeCost(ireg, nodes[i], 0) 
+            <= dnxIdleNodeCost(ireg, nodes[j], 0)? nodes[i]: nodes[j];
+      return pBest->head;
+   }
+
+   // nodes without a latency yet are assumed to be average
+   if (ireg->policy == DNX_SELECT_LATENCY) {
+      for (i = 0; i < n; i++)
+         if ((pStat = dnxIdleNodeStats(nodes[i])) != 0 && pStat->latency) {
+            guess += pStat->latency;
+            known++;
+         }
+      guess = known? guess / known: 1;
+   }
+
+   j = pClass->rotor++ % n;
+   pBest = nodes[j];
+   bestCost = dnxIdleNodeCost(ireg, pBest, guess);
+   for (i = 1; i < n && bestCost; i++) {
+      if (++j == n)
+         j = 0;
+      if ((cost = dnxIdleNodeCost(ireg, nodes[j], guess)) < bestCost) {
+         bestCost = cost;
+         pBest = nodes[j];
+      }
+   }
+   return pBest->head;
+}
+
+//----------------------------------------------------------------------------
+
+/** Locate an idle worker by its request XID.
+ * 
+ * In the message exchange between the Registrar and client worker threads
+ * the XID.TYPE field will ALWAYS be DNX_OBJ_WORKER, so there is no need to 
+ * compare this field because it will always be the same value. However, the 
+ * XID.SERIAL field is configured as the worker's thread identifier, and the
+ * XID.SLOT field is configured as the worker's IP node address. Thus, the 
+ * XID.SERIAL and XID.SLOT fields uniquely identify a given worker thread,
+ * and are hashed to index the idle workers.
+ * 
+ * The caller must hold the registrar mutex.
+ * 
+ * @param[in] ireg - the registrar to be searched.
+ * @param[in] pxid - the XID of the worker's request.
+ * 
+ * @return The idle worker, or 0 if the worker isn't registered.
+ */
+static iDnxIdleWorker * dnxIdleFind(iDnxRegistrar * ireg, DnxXID * pxid)
+{
+   iDnxIdleWorker * pWorker;
 
-   dnxDebug(6, "dnxCompareAffinityNodeReq: dnxClient flags [%llu], Host [%llu]",
-      pxr, pxl);
+   for (pWorker = *dnxIdleBucket(ireg, pxid); pWorker; pWorker = pWorker->hashNext)
+      if (pWorker->pReq->xid.objSerial == pxid->objSerial 
+            && pWorker->pReq->xid.objSlot == pxid->objSlot)
+         break;
 
-/* I did this because I incorrectly thought that I was trying to assign dnxClients to themselves :-/
-   return (((pxl & pxr) && strcmp( ((DnxNodeRequest *)pLeft)->hn, ((DnxNodeRequest *)pRight)->hn )) ? DNX_QRES_FOUND : DNX_QRES_CONTINUE);
-*/   
-   return ((pxl & pxr) ? DNX_QRES_FOUND : DNX_QRES_CONTINUE);   
+   return pWorker;
 }
 
 //----------------------------------------------------------------------------
@@ -129,6 +653,10 @@ static DnxQueueResult dnxCompareAffinityNodeReq(void * pLeft, void * pRight)
  * it will be reallocated by the caller. In all other cases, the same
  * message block can be reused by the caller for the next request.
  *
+ * Either way, the worker is then offered the oldest Unbound job it can run,
+ * so jobs that arrived while no worker could run them needn't wait for the
+ * timer.
+ *
  * @param[in] ireg - the registrar on which to register a new client request.
  * @param[in] ppDnxClientReq - the address of the dnx client request node pointer.
  *
@@ -137,6 +665,9 @@ static DnxQueueResult dnxCompareAffinityNodeReq(void * pLeft, void * pRight)
 static int dnxRegisterNode(iDnxRegistrar * ireg, DnxNodeRequest ** ppDnxClientReq) {
    pthread_t tid = pthread_self();
    DnxNodeRequest * pReq;
+   iDnxIdleWorker * pWorker;
+   DnxJobList * joblist;
+   DnxAffinity flags;
    time_t now = time(0);
    int ret = DNX_OK;
 
@@ -154,55 +685,56 @@ static int dnxRegisterNode(iDnxRegistrar * ireg, DnxNodeRequest ** ppDnxClientRe
    if(!pStatNode)
       pStatNode = dnxNodeListCreateNode(pReq->addr, pReq->hn);
 
-   pReq->flags = pStatNode->flags;
+   pReq->flags = flags = pStatNode->flags;
    dnxNodeListIncrementNodeMember(pReq->addr, JOBS_REQ_RECV);
+
+   DNX_PT_MUTEX_LOCK(&ireg->mutex);
+
    /* Locate existing dnxClient work request. The DNX client will send a request 
-      and we look it up to see if it's in the queue. If it is already registered
-      the dnxQueueFind will set the pointer to that object, that's a problem since
-      we are passing a real object and we might leak. 
-      If we find one, we update the expiration time, if it's already expired or 
-      we've never seen that client before we need to create a new node and add 
-      it to the queue 
+      and we look it up to see if it's already registered. If we find one, we 
+      update the expiration time and the caller reuses its message object; if 
+      it's already gone or we've never seen that client before, we keep the 
+      message object as the new request 
    */
-   if (dnxQueueFind(ireg->rqueue, (void **)&pReq, dnxCompareNodeReq) == DNX_QRES_FOUND) {
-      // We just assigned the pReq to the pointer in our queue. The old object is
-      // still found at *ppDnxClientReq, and since we updated the expiration
-      // on that object, we use it to update the pReq object we got from the queue
-      pReq->expires = (*ppDnxClientReq)->expires;
+   if ((pWorker = dnxIdleFind(ireg, &pReq->xid)) != 0) {
+      pWorker->pReq->expires = pReq->expires;
+      pReq = pWorker->pReq;
       dnxDebug(6,
-            "dnxRegisterNode[%lx]: Updated req for [%s,%s] flags:(%llu) [%lu,%lu] at %u; expires at %u.",
-            tid, pReq->addr, pReq->hn, pReq->flags, pReq->xid.objSerial, pReq->xid.objSlot,
+            "dnxRegisterNode[%lx]: Updated req for [%s,%s] flags:(%s) [%lu,%lu] at %u; expires at %u.",
+            tid, pReq->addr, pReq->hn, dnxAffinityText(pReq->flags), pReq->xid.objSerial, pReq->xid.objSlot,
             (unsigned)(now % 1000), (unsigned)(pReq->expires % 1000));
-      
-      // Unless we correctly reuse the ppDnxClientReq object or reap it, it will
-      // leak badly
-   } else {
-      // There was no prior object found, so we will try to store it in the req queue
-      // Set the correct flags in the queued object prior to queueing
-      pReq->flags = pStatNode->flags;
-      
-//       pReq->flags = dnxNodeListSetNodeAffinity(pReq->addr, pReq->hn);
-      
-      if ((ret = dnxQueuePut(ireg->rqueue, pReq)) == DNX_OK) {
-         // the pointer to the object pointer is set to null to indicate that we 
-         // need to allocate a new messaging object, pReq should still be pointing
-         // at the object in the queue
-
-
-         // we're keeping this message object, so we set the pointer to the pointer
-         // to null in order to indicate to the caller function that it needs to 
-         // create a new object
-         *ppDnxClientReq = 0;    
-         dnxDebug(6, 
-            "dnxRegisterNode[%lx]: Added new req for [%s,%s] flags:(%llu) [%lu,%lu] at %u; expires at %u.", 
-            tid, pReq->addr, pReq->hn, pReq->flags, pReq->xid.objSerial, pReq->xid.objSlot, 
-            (unsigned)(now % 1000), (unsigned)(pReq->expires % 1000));
-      } else {
-         dnxDebug(1, "dnxRegisterNode: Unable to enqueue node request: %s.", 
-               dnxErrorString(ret));
-         dnxLog("dnxRegisterNode: Unable to enqueue node request: %s.", 
-            dnxErrorString(ret));
+      // the node's affinity has changed since it registered, as it does 
+      // when Nagios reloads, so the worker moves to the class for its flags
+      if (pReq->flags != flags) {
+         dnxDebug(4, "dnxRegisterNode: Req for [%s,%s] moves to flags:(%s).",
+               pReq->addr, pReq->hn, dnxAffinityText(flags));
+         dnxIdleRemove(ireg, pWorker);
+         pReq->flags = flags;
+         if ((ret = dnxIdleAdd(ireg, pReq)) != DNX_OK)
+            dnxDeleteNodeReq(pReq);
       }
+   } else if ((ret = dnxIdleAdd(ireg, pReq)) == DNX_OK) {
+      // we're keeping this message object, so we set the pointer to the pointer
+      // to null in order to indicate to the caller function that it needs to 
+      // create a new object
+      *ppDnxClientReq = 0;    
+      dnxDebug(6, 
+         "dnxRegisterNode[%lx]: Added new req for [%s,%s] flags:(%s) [%lu,%lu] at %u; expires at %u.", 
+         tid, pReq->addr, pReq->hn, dnxAffinityText(pReq->flags), pReq->xid.objSerial, pReq->xid.objSlot, 
+         (unsigned)(now % 1000), (unsigned)(pReq->expires % 1000));
+   }
+
+   DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
+
+   if (ret != DNX_OK) {
+      dnxDebug(1, "dnxRegisterNode: Unable to enqueue node request: %s.", 
+            dnxErrorString(ret));
+      dnxLog("dnxRegisterNode: Unable to enqueue node request: %s.", 
+         dnxErrorString(ret));
+   } else if ((joblist = dnxGetJobList()) != 0) {
+      // put the worker to work on a job that's been waiting for one; the job
+      // list takes the registrar mutex, so we mustn't be holding it here
+      dnxJobListBind(joblist, flags);
    }
    return ret;
 }
@@ -212,43 +744,65 @@ void dnxDeleteNodeReq(void * pMsg) {
    DnxNodeRequest * pNode = (DnxNodeRequest *)pMsg;
    if(pNode != 0) {
       if(pNode->xid.objSlot == -1) {
+         // a job's search node, holding a copy of the job's host name
          dnxDebug(4, "dnxDeleteNodeReq: Deleting node message for job [%lu].", 
             pNode->xid.objSerial);
       } else {
          dnxDebug(4, "dnxDeleteNodeReq: Deleting node request [%lu,%lu].", 
             pNode->xid.objSerial, pNode->xid.objSlot);
       }
-      xfree(pNode->addr);
-      xfree(pNode->hn);
-      xfree(pNode);
+      // the strings are kept in the pooled object
+      dnxPoolFree(nodeReqPool, pNode);
    }
 }
 
 DnxNodeRequest * dnxNodeCleanup(DnxNodeRequest * pNode) {
+   iDnxNodeReq * iNode = (iDnxNodeReq *)pNode;
 //    assert(pMsg);
    if(pNode != 0) {
-      xfree(pNode->addr);
-      xfree(pNode->hn);
+      pNode->flags = 0;
+      pNode->hn = iNode->hn;
+      pNode->addr = iNode->addr;
+      *pNode->hn = *pNode->addr = 0;
+      pNode->xid.objSerial = -1;
+      pNode->xid.objSlot = -1;
    }
-   pNode->flags = 0ULL;
-   pNode->hn = NULL;
-   pNode->addr = NULL;
-   pNode->xid.objSerial = -1;
-   pNode->xid.objSlot = -1;
    return pNode;
 }
 
 DnxNodeRequest * dnxCreateNodeReq(void)
 {
-
-   DnxNodeRequest * pMsg = (DnxNodeRequest *)xmalloc(sizeof *pMsg);
-   if(pMsg == 0) {
+   iDnxNodeReq * iMsg = (iDnxNodeReq *)dnxPoolAlloc(nodeReqPool);
+   if(iMsg == 0) {
       dnxDebug(1, "dnxCreateNodeReq: Memory Allocation Failure.");      
       return NULL;
    } else {
-      memset(pMsg, 0, sizeof *pMsg);
+      memset(&iMsg->req, 0, sizeof iMsg->req);
+      iMsg->req.addr = iMsg->addr;
+      iMsg->req.hn = iMsg->hn;
+      *iMsg->addr = *iMsg->hn = 0;
+   }
+   return &iMsg->req;
+}
+
+//----------------------------------------------------------------------------
+
+int dnxNodeReqPoolInit(void)
+{
+   assert(!nodeReqPool);
+
+   return dnxPoolCreate("node requests", sizeof(iDnxNodeReq), 
+         DNX_REGISTRAR_POOL_BATCH, &nodeReqPool);
+}
+
+//----------------------------------------------------------------------------
+
+void dnxNodeReqPoolRelease(void)
+{
+   if (nodeReqPool) {
+      dnxPoolDestroy(nodeReqPool);
+      nodeReqPool = 0;
    }
-   return pMsg;
 }
 
 
@@ -266,13 +820,19 @@ DnxNodeRequest * dnxCreateNodeReq(void)
  */
 static int dnxDeregisterNode(iDnxRegistrar * ireg, DnxNodeRequest * pMsg)
 {
-   DnxNodeRequest * pReq = pMsg;
+   DnxNodeRequest * pReq = 0;
+   iDnxIdleWorker * pWorker;
 
    assert(ireg && pMsg);
 
-   if (dnxQueueRemove(ireg->rqueue, (void **)&pReq, dnxCompareNodeReq) == DNX_QRES_FOUND) {
-      dnxDeleteNodeReq(pReq);      // free the dequeued DnxNodeRequest message
+   DNX_PT_MUTEX_LOCK(&ireg->mutex);
+   if ((pWorker = dnxIdleFind(ireg, &pMsg->xid)) != 0) {
+      pReq = pWorker->pReq;
+      dnxIdleRemove(ireg, pWorker);
    }
+   DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
+
+   dnxDeleteNodeReq(pReq);      // free the dequeued DnxNodeRequest message
 
    // We probably shouldn't delete the request object by default since the thread
    // destructor seems to handle that
@@ -282,9 +842,29 @@ static int dnxDeregisterNode(iDnxRegistrar * ireg, DnxNodeRequest * pMsg)
 }
 
 
+//----------------------------------------------------------------------------
+
+/** Release the node requests held by a registrar thread.
+ * 
+ * @param[in] data - the thread's array of DNX_MAX_BATCH node requests, some
+ *    of which may be NULL.
+ */
+static void dnxDeleteNodeReqs(void * data)
+{
+   DnxNodeRequest ** pMsgs = (DnxNodeRequest **)data;
+   int i;
+
+   for (i = 0; i < DNX_MAX_BATCH; i++)
+      dnxDeleteNodeReq(pMsgs[i]);
+}
+
 //----------------------------------------------------------------------------
 
 /** The main thread entry point procedure for the registrar thread.
+ * 
+ * Requests waiting on the dispatch socket are received together, in as few
+ * system calls as the transport allows, into a set of message blocks that 
+ * is refilled as registered requests are kept.
  * 
  * @param[in] data - an opaque pointer to registrar thread data. This is 
  *    actually a pointer to the dnx server global data structure.
@@ -293,57 +873,76 @@ static int dnxDeregisterNode(iDnxRegistrar * ireg, DnxNodeRequest * pMsg)
  */
 static void * dnxRegistrar(void * data) {
    iDnxRegistrar * ireg = (iDnxRegistrar *)data;
-   DnxNodeRequest * pMsg = 0;
+   DnxNodeRequest * pMsgs[DNX_MAX_BATCH];
 
    assert(data);
 
+   memset(pMsgs, 0, sizeof pMsgs);
+
    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, 0);
 
    dnxLog("dnxRegistrar: Awaiting worker node requests...");
 
+   pthread_cleanup_push(dnxDeleteNodeReqs, pMsgs); // the thread cleanup handler
+
    while (1)
    {
-      int ret = DNX_ERR_UNSUPPORTED;
-      // (re)allocate message block if consumed in last pass
-      if (pMsg == 0 && (pMsg = dnxCreateNodeReq()) == 0)
+      int i, count, ret;
+
+      // (re)allocate message blocks consumed in last pass
+      for (count = 0; count < DNX_MAX_BATCH; count++)
+         if (pMsgs[count] == 0 && (pMsgs[count] = dnxCreateNodeReq()) == 0)
+            break;
+      if (count == 0)
       {
          dnxCancelableSleep(10);    // sleep for a while and try again...
          continue;
       } 
 
-      pthread_cleanup_push(dnxDeleteNodeReq, pMsg); // the thread cleanup handler
-      
       pthread_testcancel();
 
-      // wait on the dispatch socket for a request
-      if ((ret = dnxWaitForNodeRequest(ireg->dispchan, pMsg, pMsg->address, 
-            DNX_REGISTRAR_REQUEST_TIMEOUT)) == DNX_OK) {
-         switch (pMsg->reqType)
+      // wait on the dispatch socket for requests
+      if ((ret = dnxWaitForNodeRequests(ireg->dispchan, pMsgs, &count, 
+            DNX_REGISTRAR_REQUEST_TIMEOUT * 1000)) != DNX_OK)
+      {
+         if (ret != DNX_ERR_TIMEOUT)
+         {
+            dnxDebug(1, "dnxRegistrar: Receive node requests failed: %s.", 
+                  dnxErrorString(ret));
+            dnxLog("dnxRegistrar: Receive node requests failed: %s.", 
+                  dnxErrorString(ret));
+         }
+         continue;
+      }
+
+      for (i = 0; i < count; i++)
+      {
+         switch (pMsgs[i]->reqType)
          {
             case DNX_REQ_REGISTER:
-               ret = dnxRegisterNode(ireg, &pMsg);
+               ret = dnxRegisterNode(ireg, &pMsgs[i]);
                break;
 
             case DNX_REQ_DEREGISTER:
-               ret = dnxDeregisterNode(ireg, pMsg);
+               ret = dnxDeregisterNode(ireg, pMsgs[i]);
                break;
 
             default:
                ret = DNX_ERR_UNSUPPORTED;
          }
-      }
 
-      pthread_cleanup_pop(0); // Remove the cleanup handler
-
-      if (ret != DNX_OK && ret != DNX_ERR_TIMEOUT)
-      {
-         dnxDebug(1, "dnxRegistrar: Process node request failed: %s.", 
-               dnxErrorString(ret));
-         dnxLog("dnxRegistrar: Process node request failed: %s.", 
-               dnxErrorString(ret));
+         if (ret != DNX_OK)
+         {
+            dnxDebug(1, "dnxRegistrar: Process node request failed: %s.", 
+                  dnxErrorString(ret));
+            dnxLog("dnxRegistrar: Process node request failed: %s.", 
+                  dnxErrorString(ret));
+         }
       }
    }
+
+   pthread_cleanup_pop(0); // Remove the cleanup handler
    return NULL;
 }
 
@@ -355,16 +954,26 @@ static void * dnxRegistrar(void * data) {
    the data required to dispatch the job and delete the node it previously had
   --------------------------------------------------------------------------*/
 
-int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode) {
+int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode, 
+      unsigned reserve) {
    iDnxRegistrar * ireg = (iDnxRegistrar *)reg;
    int ret = DNX_ERR_NOTFOUND;
    int discard_count = 0;
-   int client_queue_len = dnxQueueSize(ireg->rqueue);
    DnxNodeRequest * pNode = *(DnxNodeRequest **)ppNode;
+   DnxNodeRequest * sNode = 0;
+   iDnxAffinityClass * pClass;
+   iDnxIdleWorker * pWorker;
+   DnxAffinity flags = pNode->flags;
+   DnxAffinityWord avail;
+   time_t now = time(0);
+   unsigned w = 0, words, bit;
    
    assert(reg && ppNode);
 
-   if(! client_queue_len) {
+   DNX_PT_MUTEX_LOCK(&ireg->mutex);
+
+   if(! ireg->count) {
+      DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
       dnxDebug(2, "dnxGetNodeRequest: There are no DNX client threads regestered.");
       // We probably just started up and no threads are registered yet.
       // It's also possable that all our Clients are down or a previous run 
@@ -373,17 +982,61 @@ int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode) {
       return ret;
    }
 
-   if((ret = dnxQueueRemove(ireg->rqueue, (void **)ppNode, dnxCompareAffinityNodeReq)) == DNX_QRES_FOUND) {
+   if(ireg->count <= reserve) {
+      dnxDebug(4, "dnxGetNodeRequest: Holding (%u) dnxClient threads in reserve for job [%lu].", 
+         ireg->count, pNode->xid.objSerial);
+      DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
+      return ret;
+   }
+
+   // take the longest waiting worker of the first class that shares a flag 
+   // bit with the job, discarding requests whose Time-To-Live has passed
+   words = flags? flags->words: 0;
+   if (words > ireg->bitWords)
+      words = ireg->bitWords;
+   while (w < words) {
+      if ((avail = flags->bits[w] & ireg->bits[w]) == 0) {
+         w++;
+         continue;
+      }
+      bit = w * DNX_AFFINITY_WORD_BITS + __builtin_ctzll(avail);
+      pClass = ireg->bitHead[bit];
+      pWorker = dnxClassSelect(ireg, pClass);
+      sNode = pWorker->pReq;
+      dnxIdleRemove(ireg, pWorker);
+      if (sNode->expires < now) {
+         dnxDeleteNodeReq(sNode);
+         sNode = 0;
+         discard_count++;
+         continue;
+      }
+      // share jobs among the classes with this bit by moving this one to 
+      // the back, if it still has idle workers
+      if (pClass->head && pClass != ireg->bitTail[bit]) {
+         dnxClassUnlinkBit(ireg, pClass, bit);
+         pClass->bitPrev[bit] = ireg->bitTail[bit];
+         ireg->bitTail[bit]->bitNext[bit] = pClass;
+         ireg->bitTail[bit] = pClass;
+      }
+      break;
+   }
+
+   DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
+
+   if (discard_count)
+      dnxDebug(4, "dnxGetNodeRequest: Discarded (%i) expired dnxClient requests.", 
+         discard_count);
+
+   if (sNode) {
       // make sure we return that we found a match...
       ret = DNX_OK;
-      DnxNodeRequest *sNode = *(DnxNodeRequest **)ppNode;
-      dnxDebug(1, "dnxGetNodeRequest: Found job [%lu] from Hostnode:[%s] flgs:(%llu) to dnxClient:[%s] flgs:(%llu) JobID [%lu:%lu].",
-         pNode->xid.objSerial, pNode->hn, pNode->flags, sNode->hn, sNode->flags, sNode->xid.objSerial, sNode->xid.objSlot);   
+      *ppNode = sNode;
+      dnxDebug(1, "dnxGetNodeRequest: Found job [%lu] from Hostnode:[%s] flgs:(%s) to dnxClient:[%s] flgs:(%s) JobID [%lu:%lu].",
+         pNode->xid.objSerial, pNode->hn, dnxAffinityText(pNode->flags), sNode->hn, dnxAffinityText(sNode->flags), sNode->xid.objSerial, sNode->xid.objSlot);   
       // ppNode now points at the dnxClient node , so we need to delete the 
       // job request at pNode to prevent leaks
       dnxDeleteNodeReq(pNode);
    } else {
-      ret = DNX_ERR_NOTFOUND;
       dnxDebug(8, "dnxGetNodeRequest: didn't find a match. Returning (%i)", ret);
    }
 
@@ -405,21 +1058,35 @@ int dnxRegistrarCreate(unsigned queuesz, DnxChannel * dispchan,
 
    memset(ireg, 0, sizeof *ireg);
    ireg->dispchan = dispchan;
+   ireg->maxsz = queuesz;
+   ireg->policy = DNX_SELECT_FIFO;
+   ireg->seed = (unsigned)time(0) ^ (unsigned)(uintptr_t)ireg;
 
-   // xfree needs to be replaced with a better destructor
-   if ((ret = dnxQueueCreate(queuesz, xfree, &ireg->rqueue)) != 0)
+   ireg->hashSize = DNX_REGISTRAR_HASH_MIN;
+   if ((ireg->hash = (iDnxIdleWorker **)xcalloc(ireg->hashSize, 
+         sizeof *ireg->hash)) == 0)
    {
-      dnxDebug(1, "dnxRegistrar: Queue creation failed: %s.", dnxErrorString(ret));
       xfree(ireg);
-      dnxLog("dnxRegistrar: Queue creation failed: %s.", dnxErrorString(ret));
+      return DNX_ERR_MEMORY;
+   }
+
+   if ((ret = dnxPoolCreate("idle workers", sizeof(iDnxIdleWorker), 
+         DNX_REGISTRAR_POOL_BATCH, &ireg->workers)) != DNX_OK)
+   {
+      xfree(ireg->hash);
       xfree(ireg);
       return ret;
    }
+
+   DNX_PT_MUTEX_INIT(&ireg->mutex);
+
    if ((ret = pthread_create(&ireg->tid, 0, dnxRegistrar, ireg)) != 0)
    {
       dnxDebug(1, "dnxRegistrar: Thread creation failed: %s.", strerror(ret));
-      xfree(ireg);
       dnxLog("dnxRegistrar: Thread creation failed: %s.", strerror(ret));
+      DNX_PT_MUTEX_DESTROY(&ireg->mutex);
+      dnxPoolDestroy(ireg->workers);
+      xfree(ireg->hash);
       xfree(ireg);
       return DNX_ERR_THREAD;
    }
@@ -434,52 +1101,50 @@ int dnxRegistrarCreate(unsigned queuesz, DnxChannel * dispchan,
 void dnxRegistrarDestroy(DnxRegistrar * reg)
 {
    iDnxRegistrar * ireg = (iDnxRegistrar *)reg;
+   iDnxAffinityClass * pClass;
+   iDnxIdleNode * pNode;
+   DnxNodeRequest * pReq;
 
    assert(reg && ireg->tid);
 
    pthread_cancel(ireg->tid);
    pthread_join(ireg->tid, 0);
 
-   dnxQueueDestroy(ireg->rqueue);
+   while (ireg->oldest) {
+      pReq = ireg->oldest->pReq;
+      dnxIdleRemove(ireg, ireg->oldest);
+      dnxDeleteNodeReq(pReq);
+   }
+   while ((pClass = ireg->classes) != 0) {
+      ireg->classes = pClass->next;
+      while ((pNode = pClass->allNodes) != 0) {
+         pClass->allNodes = pNode->next;
+         xfree(pNode);
+      }
+      xfree(pClass->nodes);
+      xfree(pClass);
+   }
+
+   DNX_PT_MUTEX_DESTROY(&ireg->mutex);
 
+   dnxPoolDestroy(ireg->workers);
+   xfree(ireg->bitHead);
+   xfree(ireg->bits);
+   xfree(ireg->hash);
    xfree(ireg);
 }
 
-DnxAffinityList* dnxAddAffinity(DnxAffinityList *p, char * name, unsigned long long flag)
+//----------------------------------------------------------------------------
+
+void dnxRegistrarSetPolicy(DnxRegistrar * reg, DnxSelectPolicy policy)
 {
-   DnxAffinityList * temp_list = p;
-   unsigned long long tmpFlag = flag;
-   
-   
-   if (p->next == p) 
-   {
-      p->name = xstrdup(name);
-      p->flag = tmpFlag;
-      p->next = NULL;
-      dnxDebug(3, "dnxAddAffinity: Added head item [%s] flag (%llu)", p->name, p->flag);    
-   } else {
-      // find our match or the end of the list
-      while (1) {
-         if(strcmp(name, temp_list->name) == 0){
-            tmpFlag = temp_list->flag;
-            temp_list->flag |= flag;
-            dnxDebug(3, "dnxAddAffinity: Item [%s] flag was (%llu) is now (%llu)",
-               temp_list->name, tmpFlag, temp_list->flag);    
-            return p;
-         }
-         if(temp_list->next == NULL)
-            break;
-         temp_list = temp_list->next;
-      }
-      DnxAffinityList * new_item = (DnxAffinityList *)malloc(sizeof(DnxAffinityList));
-      new_item->name = xstrdup(name);
-      new_item->flag = tmpFlag;
-      new_item->next = NULL;
-      temp_list->next = new_item;
-      dnxDebug(3, "dnxAddAffinity: Added new list item [%s] to [%s] with flag (%llu)", 
-         new_item->name, temp_list->name, new_item->flag);  
-   }
-   return p;
+   iDnxRegistrar * ireg = (iDnxRegistrar *)reg;
+
+   assert(reg && policy >= DNX_SELECT_FIFO && policy < DNX_SELECT_MAX);
+
+   DNX_PT_MUTEX_LOCK(&ireg->mutex);
+   ireg->policy = policy;
+   DNX_PT_MUTEX_UNLOCK(&ireg->mutex);
 }
 
 /*--------------------------------------------------------------------------
@@ -488,140 +1153,334 @@ DnxAffinityList* dnxAddAffinity(DnxAffinityList *p, char * name, unsigned long l
    From within dnx/server, compile with GNU tools using this command line:
     
       gcc -DDEBUG -DDNX_REGISTRAR_TEST -DHAVE_NANOSLEEP -g -O0 \
-         -lpthread -o dnxRegistrarTest -I../nagios/nagios-2.7/include \
-         -I../common dnxRegistrar.c ../common/dnxError.c \
-         ../common/dnxSleep.c
-
-   Alternatively, a heap check may be done with the following command line:
-
-      gcc -DDEBUG -DDEBUG_HEAP -DDNX_REGISTRAR_TEST -DHAVE_NANOSLEEP -g -O0 \
-         -lpthread -o dnxRegistrarTest -I../nagios/nagios-2.7/include \
-         -I../common dnxRegistrar.c ../common/dnxError.c \
-         ../common/dnxSleep.c ../common/dnxHeap.c
+         -I../common dnxRegistrar.c dnxPool.c dnxAffinity.c \
+         ../common/dnxError.c ../common/dnxSleep.c -lpthread -lrt \
+         -o dnxRegistrarTest
 
    Note: Leave out -DHAVE_NANOSLEEP if your system doesn't have nanosleep.
 
+   The test finishes by printing the average cost of matching a job to a
+   worker for a range of idle worker counts; these should be roughly equal.
+   It then prints the rate at which 4000 idle workers can be refreshed.
+
   --------------------------------------------------------------------------*/
 
 #ifdef DNX_REGISTRAR_TEST
-// 
-// #include "utesthelp.h"
-// 
-// static int verbose;
-// static int passes = 0;
-// static DnxNodeRequest * test_req1;
-// static DnxNodeRequest * test_req2;
-// 
-// // functional stubs
-// IMPLEMENT_DNX_DEBUG(verbose);
-// IMPLEMENT_DNX_SYSLOG(verbose);
-// 
-// int dnxWaitForNodeRequest(DnxChannel * channel, DnxNodeRequest * pReg, 
-//       char * address, int timeout)
-// {
-//    CHECK_TRUE(channel == (DnxChannel *)17);
-//    CHECK_TRUE(pReg != 0);
-//    CHECK_TRUE(address != 0);
-//    CHECK_TRUE(timeout == DNX_REGISTRAR_REQUEST_TIMEOUT);
-// 
-//    passes++;      // bump registrar loop pass count
-// 
-//    // complex test harness -
-//    //   pass 1: add a new registration
-//    //   pass 2: update an existing registration
-//    //   pass 3: remove an existing registration
-// 
-//    memset(pReg, 0, sizeof *pReg);
-//    pReg->ttl = 10;   // seconds - won't timeout during test
-//    if (passes < 3)
-//       pReg->reqType = DNX_REQ_REGISTER;
-//    else
-//       pReg->reqType = DNX_REQ_DEREGISTER;
-// 
-//    if (passes < 4)
-//       return 0;
-// 
-//    return DNX_ERR_TIMEOUT;
-// }
-// 
-// DnxQueueResult dnxQueueFind(DnxQueue * queue, void ** ppPayload, 
-//       DnxQueueResult (*Compare)(void * pLeft, void * pRight))
-// {
-//    CHECK_TRUE(queue = (DnxQueue *)37);
-//    if (passes == 1)
-//       return DNX_QRES_CONTINUE;  // pass 1: return not-found
-//    *ppPayload = test_req1;
-//    return DNX_QRES_FOUND;        // pass 2: return found
-// }
-// 
-// int dnxQueuePut(DnxQueue * queue, void * pPayload)
-// {
-//    CHECK_TRUE(queue = (DnxQueue *)37);
-//    CHECK_TRUE(pPayload != 0);
-//    test_req1 = (DnxNodeRequest *)pPayload;
-//    return 0;                     // pass 1: add new registration
-// }
-// 
-// DnxQueueResult dnxQueueRemove(DnxQueue * queue, void ** ppPayload, 
-//       DnxQueueResult (*Compare)(void * pLeft, void * pRight))
-// {
-//    CHECK_TRUE(queue = (DnxQueue *)37);
-//    CHECK_TRUE(ppPayload != 0);
-//    CHECK_TRUE(Compare == dnxCompareNodeReq);
-//    *ppPayload = test_req1;       // pass 3: remove existing registration
-//    return DNX_QRES_FOUND;
-// }
-// 
-// int dnxQueueGet(DnxQueue * queue, void ** ppPayload)
-// {
-//    CHECK_TRUE(queue = (DnxQueue *)37);
-//    CHECK_TRUE(ppPayload != 0);
-//    *ppPayload = test_req1;       // pass 4+: called from dnxGetNodeRequest
-//    return 0;
-// }
-// 
-// int dnxQueueCreate(unsigned maxsz, void (*pldtor)(void *), DnxQueue ** pqueue)
-// {
-//    CHECK_TRUE(pqueue != 0);
-//    *pqueue = (DnxQueue *)37;
-//    return 0;
-// }
-// 
-// void dnxQueueDestroy(DnxQueue * queue)
-// {
-//    CHECK_TRUE(queue == (DnxQueue *)37);
-// }
-// 
-// int main(int argc, char ** argv)
-// {
-//    DnxRegistrar * reg;
-//    iDnxRegistrar * ireg;
-//    DnxNodeRequest * node;
-// 
-//    verbose = argc > 1 ? 1 : 0;
-// 
-//    CHECK_ZERO(dnxRegistrarCreate(5, (DnxChannel *)17, &reg));
-// 
-//    ireg = (iDnxRegistrar *)reg;
-// 
-//    CHECK_TRUE(ireg->dispchan == (DnxChannel *)17);
-//    CHECK_TRUE(ireg->rqueue == (DnxQueue *)37);
-//    CHECK_TRUE(ireg->tid != 0);
-// 
-//    while (passes < 4)
-//       dnxCancelableSleep(10);
-// 
-//    CHECK_ZERO(dnxGetNodeRequest(reg, &node));
-//    CHECK_TRUE(node == test_req1);
-// 
-//    dnxRegistrarDestroy(reg);
-// 
-// #ifdef DEBUG_HEAP
-//    CHECK_ZERO(dnxCheckHeap());
-// #endif
-// 
-//    return 0;
-// }
+
+#include "utesthelp.h"
+#include <stdio.h>
+#include <time.h>
+
+#define elemcount(x) (sizeof(x)/sizeof(*(x)))
+
+static int verbose;
+static DnxNode testNodes[64];
+static char testAddrs[elemcount(testNodes)][DNX_MAX_ADDRESS];
+
+// functional stubs
+IMPLEMENT_DNX_DEBUG(verbose);
+IMPLEMENT_DNX_SYSLOG(verbose);
+
+int dnxWaitForNodeRequests(DnxChannel * channel, DnxNodeRequest ** pRegs, 
+      int * count, int timeout)
+{
+   CHECK_TRUE(channel == (DnxChannel *)17);
+   CHECK_TRUE(timeout == DNX_REGISTRAR_REQUEST_TIMEOUT * 1000);
+   dnxCancelableSleep(10);
+   return DNX_ERR_TIMEOUT;
+}
+
+DnxNode * dnxNodeListFindNode(char * address)
+{
+   unsigned i;
+   for (i = 0; i < elemcount(testNodes); i++)
+      if (strcmp(testAddrs[i], address) == 0)
+         return &testNodes[i];
+   return 0;
+}
+
+DnxNode * dnxNodeListCreateNode(char * address, char * hostname)
+      { return dnxNodeListFindNode(address); }
+unsigned dnxNodeListIncrementNodeMember(char * address, int member) { return 0; }
+DnxJobList * dnxGetJobList(void) { return 0; }
+int dnxJobListBind(DnxJobList * pJobList, DnxAffinity flags) { return 0; }
+
+/** Return the affinity of one or two flag bits; a negative bit is left out. */
+static DnxAffinity testFlags(int a, int b)
+{
+   DnxAffinity flags, other;
+   CHECK_ZERO(dnxAffinityBit(a, &flags));
+   if (b >= 0) {
+      CHECK_ZERO(dnxAffinityBit(b, &other));
+      CHECK_ZERO(dnxAffinityUnion(flags, other, &flags));
+   }
+   return flags;
+}
+
+/** Register a worker thread of a test node, as the registrar thread would. */
+static void testRegister(iDnxRegistrar * ireg, int node, unsigned long serial)
+{
+   DnxNodeRequest * pReq;
+
+   CHECK_NONZERO(pReq = dnxCreateNodeReq());
+   pReq->reqType = DNX_REQ_REGISTER;
+   pReq->xid.objType = DNX_OBJ_WORKER;
+   pReq->xid.objSerial = serial;
+   pReq->xid.objSlot = node;
+   pReq->ttl = 30;
+   strcpy(pReq->addr, testAddrs[node]);
+   strcpy(pReq->hn, "worker");
+   CHECK_ZERO(dnxRegisterNode(ireg, &pReq));
+   dnxDeleteNodeReq(pReq);    // a refresh leaves the message with us
+}
+
+/** Match a job needing some affinity to a worker, as the job list would. */
+static int testMatch(iDnxRegistrar * ireg, DnxAffinity flags, 
+      unsigned long * pSerial)
+{
+   DnxNodeRequest * pNode;
+   int ret;
+
+   CHECK_NONZERO(pNode = dnxCreateNodeReq());
+   pNode->flags = flags;
+   pNode->xid.objSerial = 99;
+   pNode->xid.objSlot = -1;
+   if ((ret = dnxGetNodeRequest((DnxRegistrar *)ireg, &pNode, 0)) == DNX_OK)
+      *pSerial = pNode->xid.objSerial;
+   dnxDeleteNodeReq(pNode);
+   return ret;
+}
+
+/** Return the idle worker with a given serial number, or 0. */
+static iDnxIdleWorker * testFind(iDnxRegistrar * ireg, int node, 
+      unsigned long serial)
+{
+   DnxXID xid;
+   xid.objType = DNX_OBJ_WORKER;
+   xid.objSerial = serial;
+   xid.objSlot = node;
+   return dnxIdleFind(ireg, &xid);
+}
+
+int main(int argc, char ** argv)
+{
+   DnxRegistrar * reg;
+   iDnxRegistrar * ireg;
+   unsigned long serial;
+   struct timespec t0, t1;
+   unsigned sizes[] = { 100, 500, 1000, 2000, 4000 };
+   unsigned long serials[4000];
+   int nodes[4000];
+   iDnxIdleWorker * pWorker;
+   DnxNodeRequest * pReq;
+   unsigned i, k, n, matches;
+   double elapsed;
+
+   verbose = argc > 1 ? 1 : 0;
+
+   for (i = 0; i < elemcount(testNodes); i++) {
+      sprintf(testAddrs[i], "10.0.0.%u", i + 1);
+      testNodes[i].address = testAddrs[i];
+   }
+
+   CHECK_ZERO(dnxNodeReqPoolInit());
+   CHECK_ZERO(dnxRegistrarCreate(100, (DnxChannel *)17, &reg));
+   ireg = (iDnxRegistrar *)reg;
+   CHECK_TRUE(ireg->dispchan == (DnxChannel *)17);
+   CHECK_TRUE(ireg->tid != 0);
+
+   // a job goes to the class sharing a flag bit with it, whatever the word
+   testNodes[0].flags = testFlags(0, 1);
+   testNodes[1].flags = testFlags(2, -1);
+   testNodes[2].flags = testFlags(1, 70);
+   testRegister(ireg, 0, 1);
+   testRegister(ireg, 1, 2);
+   testRegister(ireg, 2, 3);
+   CHECK_TRUE(ireg->count == 3 && ireg->bitWords == 2);
+   CHECK_ZERO(testMatch(ireg, testFlags(2, -1), &serial));
+   CHECK_TRUE(serial == 2);
+   CHECK_ZERO(testMatch(ireg, testFlags(5, 70), &serial));
+   CHECK_TRUE(serial == 3);
+   CHECK_TRUE(testMatch(ireg, testFlags(5, 64), &serial) == DNX_ERR_NOTFOUND);
+   CHECK_ZERO(testMatch(ireg, testFlags(1, -1), &serial));
+   CHECK_TRUE(serial == 1 && ireg->count == 0);
+   CHECK_TRUE(ireg->bits[0] == 0 && ireg->bits[1] == 0);
+
+   // a class that supplies a worker goes to the back of its bit's list
+   testNodes[3].flags = testFlags(0, 2);
+   testRegister(ireg, 0, 10);
+   testRegister(ireg, 0, 11);
+   testRegister(ireg, 3, 20);
+   testRegister(ireg, 3, 21);
+   CHECK_TRUE(ireg->bitHead[0]->flags == testNodes[0].flags);
+   CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+   CHECK_TRUE(serial == 10);
+   CHECK_TRUE(ireg->bitHead[0]->flags == testNodes[3].flags);
+   CHECK_TRUE(ireg->bitTail[0]->flags == testNodes[0].flags);
+   CHECK_TRUE(ireg->bitHead[2]->flags == testNodes[1].flags
+         || ireg->bitHead[2]->flags == testNodes[3].flags);
+   CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+   CHECK_TRUE(serial == 20);
+   CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+   CHECK_TRUE(serial == 11);
+   CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+   CHECK_TRUE(serial == 21 && ireg->count == 0);
+
+   // an expired request at the head of its class is discarded
+   testRegister(ireg, 1, 30);
+   testRegister(ireg, 1, 31);
+   testFind(ireg, 1, 30)->pReq->expires = time(0) - 1;
+   CHECK_ZERO(testMatch(ireg, testFlags(2, -1), &serial));
+   CHECK_TRUE(serial == 31 && ireg->count == 0);
+   CHECK_TRUE(testFind(ireg, 1, 30) == 0);
+
+   // over maxNodeRequests, the oldest request is dropped
+   ireg->maxsz = 3;
+   for (i = 40; i < 44; i++)
+      testRegister(ireg, i % 2, i);
+   CHECK_TRUE(ireg->count == 3 && testFind(ireg, 0, 40) == 0);
+   CHECK_TRUE(ireg->oldest->pReq->xid.objSerial == 41);
+   CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+   CHECK_TRUE(serial == 42);
+   ireg->maxsz = 0;
+
+   // a refresh finds the worker through the XID hash and keeps its place
+   pWorker = testFind(ireg, 1, 43);
+   pWorker->pReq->expires = 0;
+   testRegister(ireg, 1, 43);
+   CHECK_TRUE(ireg->count == 2 && testFind(ireg, 1, 43) == pWorker);
+   CHECK_TRUE(pWorker->pReq->expires > time(0));
+   CHECK_TRUE(ireg->oldest->pReq->xid.objSerial == 41);
+
+   // so does a deregistration, which frees the worker's request
+   CHECK_NONZERO(pReq = dnxCreateNodeReq());
+   pReq->xid = pWorker->pReq->xid;
+   CHECK_ZERO(dnxDeregisterNode(ireg, pReq));
+   CHECK_TRUE(ireg->count == 1 && testFind(ireg, 1, 43) == 0);
+   CHECK_ZERO(dnxDeregisterNode(ireg, pReq));
+   CHECK_TRUE(ireg->count == 1);
+   dnxDeleteNodeReq(pReq);
+
+   // a worker whose node's affinity changed moves to the class for it
+   testNodes[1].flags = testFlags(3, -1);
+   testRegister(ireg, 1, 41);
+   pWorker = testFind(ireg, 1, 41);
+   CHECK_TRUE(ireg->count == 1 && pWorker->pClass->flags == testNodes[1].flags);
+   CHECK_TRUE(testMatch(ireg, testFlags(2, -1), &serial) == DNX_ERR_NOTFOUND);
+   CHECK_ZERO(testMatch(ireg, testFlags(3, -1), &serial));
+   CHECK_TRUE(serial == 41 && ireg->count == 0);
+
+   // the hash table doubles as workers outnumber its buckets
+   CHECK_TRUE(ireg->hashSize == DNX_REGISTRAR_HASH_MIN);
+   for (i = 0; i <= DNX_REGISTRAR_HASH_MIN; i++)
+      testRegister(ireg, i % 2 * 3, 100 + i);
+   CHECK_TRUE(ireg->hashSize == 2 * DNX_REGISTRAR_HASH_MIN);
+   for (i = 0; i <= DNX_REGISTRAR_HASH_MIN; i++)
+      CHECK_TRUE(testFind(ireg, i % 2 * 3, 100 + i) != 0);
+   for (i = 0; i <= DNX_REGISTRAR_HASH_MIN; i++)
+      testRegister(ireg, i % 2 * 3, 100 + i);
+   CHECK_TRUE(ireg->count == DNX_REGISTRAR_HASH_MIN + 1);
+   while (ireg->count)
+      CHECK_ZERO(testMatch(ireg, testFlags(0, -1), &serial));
+
+   // the selection policies, over one class of three nodes that are busy
+   // in different ways; the node of worker 2x0 is 4 + x
+   for (i = 4; i < 7; i++)
+      testNodes[i].flags = testFlags(10, -1);
+   testNodes[4].jobs_outstanding = 5;
+   testNodes[4].latency = 10;
+   testNodes[5].jobs_outstanding = 1;
+   testNodes[5].latency = 1000;
+   testNodes[6].jobs_outstanding = 3;
+   testNodes[6].latency = 100;
+   testRegister(ireg, 4, 200);
+   testRegister(ireg, 5, 210);
+   testRegister(ireg, 6, 220);
+   testRegister(ireg, 4, 201);
+
+   // fifo takes the longest waiting worker, however busy its node
+   CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+   CHECK_TRUE(serial == 200);
+   testRegister(ireg, 4, 200);
+
+   // leastJobs takes a worker of the node with the fewest jobs
+   dnxRegistrarSetPolicy(reg, DNX_SELECT_LEAST_JOBS);
+   CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+   CHECK_TRUE(serial == 210);
+   testRegister(ireg, 5, 210);
+
+   // latency weighs the jobs by the node's latency: 6 x 10 ms is least
+   dnxRegistrarSetPolicy(reg, DNX_SELECT_LATENCY);
+   CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+   CHECK_TRUE(serial == 201);
+   testRegister(ireg, 4, 201);
+
+   // a node with no latency yet is taken to have the others' average
+   testNodes[4].latency = 0;
+   CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+   CHECK_TRUE(serial == 220);
+   testRegister(ireg, 6, 220);
+
+   // twoChoices never takes the busiest node, which loses to either other
+   dnxRegistrarSetPolicy(reg, DNX_SELECT_TWO_CHOICES);
+   for (i = 0, n = 0; i < 50; i++) {
+      CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+      CHECK_TRUE(serial == 210 || serial == 220);
+      n |= serial == 210? 1: 2;
+      testRegister(ireg, 4 + (serial - 200) / 10, serial);
+   }
+   CHECK_TRUE(n == 3);
+
+   dnxRegistrarSetPolicy(reg, DNX_SELECT_FIFO);
+   while (ireg->count)
+      CHECK_ZERO(testMatch(ireg, testFlags(10, -1), &serial));
+
+   // the cost of a match doesn't depend on the number of idle workers; 
+   // each node has a class of its own, sharing bit 64 with the others
+   for (i = 0; i < elemcount(testNodes); i++)
+      testNodes[i].flags = testFlags(i, 64);
+   for (k = 0; k < elemcount(sizes); k++) {
+      while (ireg->count < sizes[k]) {
+         n = ireg->count;
+         testRegister(ireg, n % elemcount(testNodes), 1000 + n);
+      }
+      elapsed = 0;
+      matches = 0;
+      for (n = 0; n < 100000; n += elemcount(testNodes)) {
+         clock_gettime(CLOCK_MONOTONIC, &t0);
+         for (i = 0; i < elemcount(testNodes); i++)
+            if (testMatch(ireg, testNodes[i].flags, &serial) == DNX_OK)
+               matches++;
+         clock_gettime(CLOCK_MONOTONIC, &t1);
+         elapsed += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+
+         // put the workers back for the next round
+         for (i = 0; i < elemcount(testNodes); i++)
+            testRegister(ireg, i, 1000 + sizes[k] + n + i);
+      }
+      CHECK_TRUE(ireg->count == sizes[k] && matches == n);
+      printf("match:  %5u idle workers: %8.1f ns/match\n", sizes[k], 
+            elapsed / matches);
+   }
+
+   // a refresh costs the same however many workers there are
+   for (i = 0, pWorker = ireg->oldest; pWorker; pWorker = pWorker->newer, i++) {
+      serials[i] = pWorker->pReq->xid.objSerial;
+      nodes[i] = pWorker->pReq->xid.objSlot;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (n = 0; n < 100000; n++)
+      testRegister(ireg, nodes[n % i], serials[n % i]);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   CHECK_TRUE(ireg->count == i);
+   printf("refresh: %4u idle workers: %8.0f refreshes/s\n", i, n / 
+         ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9));
+
+   dnxRegistrarDestroy(reg);
+   dnxNodeReqPoolRelease();
+
+   return 0;
+}
 
 #endif   /* DNX_REGISTRAR_TEST */
 
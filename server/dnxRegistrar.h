@@ -39,30 +39,64 @@
 #include "dnxQueue.h"
 #include "dnxTransport.h"
 #include "dnxProtocol.h"
+#include "dnxAffinity.h"
 
 /** An abstraction data type for the DNX registrar object. */
 typedef struct { int unused; } DnxRegistrar;
 
-typedef struct DnxAffinityList
+/** How an idle worker is chosen from those able to run a job. */
+typedef enum DnxSelectPolicy
 {
-   char * name;                     //!< Name of Nagios Host group/dnxClient
-   unsigned long long int flag;     //!< Flag for affinity check
-   struct DnxAffinityList * next;   //!< Next structure in linked list
-} DnxAffinityList;
-
+   DNX_SELECT_FIFO = 0,    /*!< The longest waiting worker. */
+   DNX_SELECT_LEAST_JOBS,  /*!< A worker of the node with the fewest jobs outstanding. */
+   DNX_SELECT_TWO_CHOICES, /*!< A worker of the less busy of two random nodes. */
+   DNX_SELECT_LATENCY,     /*!< A worker of the node expected to finish its jobs first. */
+   DNX_SELECT_MAX
+} DnxSelectPolicy;
 
 void dnxDeleteNodeReq(void * pMsg);
 DnxNodeRequest * dnxNodeCleanup(DnxNodeRequest * pNode);
 DnxNodeRequest * dnxCreateNodeReq(void);
 
+/** Create the pool from which node requests are allocated.
+ * 
+ * Requests made by dnxCreateNodeReq come from a pool shared by all threads,
+ * and have room for their source address and host name, so registering a
+ * worker or queueing a check allocates no memory once the pool has grown to
+ * the number of requests in flight. Must be called before any request is 
+ * created.
+ * 
+ * @return Zero on success, or a non-zero error value.
+ */
+int dnxNodeReqPoolInit(void);
+
+/** Destroy the node request pool.
+ * 
+ * Every request is freed, including any still held by jobs, so this must
+ * only be called once the threads using requests have stopped.
+ */
+void dnxNodeReqPoolRelease(void);
+
 /** Return an available node "request for work" object pointer.
+ * 
+ * Idle worker requests are grouped by their affinity flags, and each group
+ * with idle workers is listed under every flag bit it has, so a request 
+ * whose flags share a bit with the job's flags (in @p ppNode) is found with
+ * a bit scan, however many workers are registered. The request is taken 
+ * from that group by the registrar's selection policy; see 
+ * dnxRegistrarSetPolicy. Requests whose Time-To-Live has passed are 
+ * discarded rather than returned.
  * 
  * @param[in] reg - the registrar from which a node request should be returned.
- * @param[out] ppNode - the address of storage in which to return the located
- *    request node. 
+ * @param[in,out] ppNode - on entry, the address of the job's search node,
+ *    whose flags are the job's affinity; on success, the search node is 
+ *    freed and the located request node is returned in its place.
+ * @param[in] reserve - the number of registered requests to be left for 
+ *    more urgent jobs; no request is returned unless there are more.
  * @return Zero on success, or a non-zero error value.
  */
-int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode);
+int dnxGetNodeRequest(DnxRegistrar * reg, DnxNodeRequest ** ppNode, 
+      unsigned reserve);
 
 /** Create a new registrar object.
  * 
@@ -85,18 +119,21 @@ int dnxRegistrarCreate(unsigned queuesz, DnxChannel * dispchan,
  */
 void dnxRegistrarDestroy(DnxRegistrar * reg);
 
-/** Create an Affinity linked list item.
-*
-* Adds an affinity struct and returns the new item.
-*
-* @param[in] p - the affinity list to add item to.
-* @param[in] name - the name of the affinity group or host.
-* @param[in] flag - the binary bitmask representation for the affinity group.
-*
-* @return Affinity object on success, NULL on failure.
-*/
-DnxAffinityList * dnxAddAffinity(DnxAffinityList *p, char * name, unsigned long long flag);
-
+/** Set how a registrar chooses among the idle workers able to run a job.
+ * 
+ * With the FIFO policy, the longest waiting worker is chosen, so a node
+ * with many worker threads gets a share of the jobs to match, however busy
+ * it is. The other policies choose a worker node first, from the worker
+ * node statistics (see dnxNode.h): the one with the fewest jobs outstanding;
+ * the less busy of two picked at random, which spreads jobs almost as well
+ * at a fixed cost; or the one that should finish its outstanding jobs 
+ * soonest at its average job runtime. The chosen node's longest waiting 
+ * worker is then used. A registrar uses the FIFO policy when created.
+ * 
+ * @param[in] reg - the registrar to be configured.
+ * @param[in] policy - the selection policy to be used.
+ */
+void dnxRegistrarSetPolicy(DnxRegistrar * reg, DnxSelectPolicy policy);
 
 #endif   /* _DNXREGISTRAR_H_ */
 
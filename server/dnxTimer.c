@@ -40,6 +40,7 @@
 #include "dnxJobList.h"
 #include "dnxLogging.h"
 #include "dnxSleep.h"
+#include "dnxNode.h"
 
 #if HAVE_CONFIG_H
 # include "config.h"
@@ -58,10 +59,17 @@
 #include <string.h>
 #include <time.h>
 #include <error.h>
+#include <errno.h>
 #include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#if HAVE_SYS_TIMERFD_H
+# include <sys/timerfd.h>
+#endif
 
 #define DNX_DEF_TIMER_SLEEP   5000  /*!< Default timer sleep interval. */
-#define MAX_EXPIRED           50    /*!< Maximum expired jobs during interval. */
+#define MAX_EXPIRED           50    /*!< Expired jobs collected per call. */
 
 /** DNX job expiration timer implementation structure. */
 typedef struct iDnxTimer_
@@ -69,6 +77,9 @@ typedef struct iDnxTimer_
    DnxJobList * joblist;   /*!< Job list to be expired. */
    pthread_t tid;          /*!< Timer thread ID. */
    int sleepms;            /*!< Milliseconds to sleep between passes. */
+   int fd;                 /*!< Timer file descriptor, or -1 if none. */
+   struct timespec armed;  /*!< When the timer file descriptor will fire. */
+   pthread_mutex_t mut;    /*!< Protects the armed time. */
 } iDnxTimer;
 
 /*--------------------------------------------------------------------------
@@ -91,6 +102,66 @@ static void dnxTimerCleanup(void * data)
 
 //----------------------------------------------------------------------------
 
+/** Set the time at which the timer thread will next wake up.
+ * 
+ * The caller must hold the timer mutex.
+ * 
+ * @param[in] itimer - the timer to be armed.
+ * @param[in] when - the absolute time at which the timer should fire.
+ */
+static void dnxTimerArm(iDnxTimer * itimer, struct timespec * when)
+{
+#if HAVE_SYS_TIMERFD_H
+   struct itimerspec its;
+
+   memset(&its, 0, sizeof its);
+   its.it_value = *when;
+   if (timerfd_settime(itimer->fd, TFD_TIMER_ABSTIME, &its, 0) != 0)
+      dnxDebug(1, "dnxTimerArm: timerfd_settime failed: %s.", strerror(errno));
+#endif
+   itimer->armed = *when;
+}
+
+//----------------------------------------------------------------------------
+
+/** Wait until the timer is due to make its next pass.
+ * 
+ * This is a cancellation point. The timer is re-armed for a full interval 
+ * before returning; the job list will move it forward during the pass if it 
+ * has anything due sooner.
+ * 
+ * @param[in] itimer - the timer to wait on.
+ */
+static void dnxTimerWait(iDnxTimer * itimer)
+{
+   struct timespec when;
+
+#if HAVE_SYS_TIMERFD_H
+   uint64_t ticks;
+
+   while (read(itimer->fd, &ticks, sizeof ticks) < 0 && errno == EINTR)
+      ;
+#else
+   dnxCancelableSleep(itimer->sleepms);
+#endif
+
+   pthread_testcancel();
+
+   clock_gettime(CLOCK_REALTIME, &when);
+   when.tv_sec += itimer->sleepms / 1000;
+   if ((when.tv_nsec += (itimer->sleepms % 1000) * 1000000L) >= 1000000000L)
+   {
+      when.tv_sec++;
+      when.tv_nsec -= 1000000000L;
+   }
+
+   DNX_PT_MUTEX_LOCK(&itimer->mut);
+   dnxTimerArm(itimer, &when);
+   DNX_PT_MUTEX_UNLOCK(&itimer->mut);
+}
+
+//----------------------------------------------------------------------------
+
 /** The main timer thread procedure entry point.
  * 
  * @param[in] data - an opaque pointer to thread data for the timer thread.
@@ -105,7 +176,6 @@ static void * dnxTimer(void * data)
    DnxResult sResult;
    int i, totalExpired;
    int ret = 0;
-   int skew = 0;
    
    assert(data);
 
@@ -119,51 +189,50 @@ static void * dnxTimer(void * data)
    {
       pthread_testcancel();
 
-      // Create some skew in the timing so that we don't get a repeating 
-      // harmonic where the dnxClient and timer thread are both expiring at the
-      // same time.
-//       srand(time(0));
-//       skew = (rand() % itimer->sleepms) - (int)(itimer->sleepms / 2);
-//    
-//       dnxDebug(2, "dnxTimerCreate: Skew is (%d)", itimer->sleepms + skew);
-
-
-      dnxCancelableSleep(itimer->sleepms + skew);
+      // sleep until the job list's next deadline, or a full interval at most
+      dnxTimerWait(itimer);
 
-      // search for expired jobs in the pending queue
-      totalExpired = MAX_EXPIRED;
-      if ((ret = dnxJobListExpire(itimer->joblist, ExpiredList, &totalExpired)) == DNX_OK && totalExpired > 0)
+      // search for expired jobs in the pending queue, until we have them all
+      do
       {
-         dnxDebug(4, "Expired Checks");
-         for (i = 0; i < totalExpired; i++)
+         totalExpired = MAX_EXPIRED;
+         if ((ret = dnxJobListExpire(itimer->joblist, ExpiredList, &totalExpired)) == DNX_OK && totalExpired > 0)
          {
-            char msg[128];
-            DnxNewJob * job = &ExpiredList[i];
-
-            dnxDebug(1, "dnxTimer[%lx]: Expiring Job [%lu:%lu]: %s.",pthread_self(), job->xid.objSerial, job->xid.objSlot, job->cmd);
-
-            if(job->pNode->addr == NULL) {
-               sprintf(msg, "(DNX: %s Check [%lu:%lu] Timed Out - No dnxClients were available to service this request)",
-               (job->object_check_type ? "Host" : "Service"), job->xid.objSerial, job->xid.objSlot);
-               dnxAuditJob(job, "DECLINE");
-            } else {
-               sprintf(msg, "(DNX: %s Check [%lu:%lu] Timed Out - Node: %s - Failed to return job response in time allowed)",
-               (job->object_check_type ? "Host" : "Service"), job->xid.objSerial, job->xid.objSlot, job->pNode->addr);
-               dnxAuditJob(job, "EXPIRE");
+            dnxDebug(4, "Expired Checks");
+            for (i = 0; i < totalExpired; i++)
+            {
+               char msg[128];
+               DnxNewJob * job = &ExpiredList[i];
+
+               dnxDebug(1, "dnxTimer[%lx]: Expiring Job [%lu:%lu]: %s.",pthread_self(), job->xid.objSerial, job->xid.objSlot, job->cmd);
+
+               if(job->pNode->addr == NULL) {
+                  sprintf(msg, "(DNX: %s Check [%lu:%lu] Timed Out - No dnxClients were available to service this request)",
+                  (job->object_check_type ? "Host" : "Service"), job->xid.objSerial, job->xid.objSlot);
+                  dnxAuditJob(job, "DECLINE");
+               } else {
+                  sprintf(msg, "(DNX: %s Check [%lu:%lu] Timed Out - Node: %s - Failed to return job response in time allowed)",
+                  (job->object_check_type ? "Host" : "Service"), job->xid.objSerial, job->xid.objSlot, job->pNode->addr);
+                  dnxAuditJob(job, "EXPIRE");
+                  dnxNodeListIncrementNodeMember(job->pNode->addr, JOBS_EXPIRED);
+               }
+
+               dnxDebug(2, "dnxTimer: %s", msg);
+
+               time_t check_time = job->start_time;
+               sResult.resData = xstrdup(msg);
+               // We need to give the correct service or host result code (service = 0, host = 1)
+               sResult.resCode = job->object_check_type ? 2 : 3; // host = HOST_UNREACHABLE, service = STATE_UNKNOWN
+               ret = dnxSubmitCheck(job, &sResult, check_time); // This will delete the job and node objects
             }
-
-            dnxDebug(2, "dnxTimer: %s", msg);
-
-            time_t check_time = job->start_time;
-            sResult.resData = xstrdup(msg);
-            // We need to give the correct service or host result code (service = 0, host = 1)
-            sResult.resCode = job->object_check_type ? 2 : 3; // host = HOST_UNREACHABLE, service = STATE_UNKNOWN
-            ret = dnxSubmitCheck(job, &sResult, check_time); // This will delete the job and node objects
          }
-      }
 
-      if (totalExpired > 0 || ret != DNX_OK)
-         dnxDebug(2, "dnxTimer[%lx]: Expired job count: %d  Retcode=%d: %s.",pthread_self(), totalExpired, ret, dnxErrorString(ret));
+         if (totalExpired > 0 || ret != DNX_OK)
+            dnxDebug(2, "dnxTimer[%lx]: Expired job count: %d  Retcode=%d: %s.",pthread_self(), totalExpired, ret, dnxErrorString(ret));
+      } while (totalExpired == MAX_EXPIRED);
+
+      // hand Nagios the expired checks now; no result may arrive to do so
+      dnxSubmitFlush(1);
    }
 
    dnxLog("dnxTimer[%lx]: Terminating: %s.", pthread_self(), dnxErrorString(ret));
@@ -194,11 +263,36 @@ int dnxTimerCreate(DnxJobList * joblist, int sleeptime, DnxTimer ** ptimer)
    memset(itimer, 0, sizeof *itimer);
    itimer->joblist = joblist;
    itimer->sleepms = sleeptime;
+   itimer->fd = -1;
+
+#if HAVE_SYS_TIMERFD_H
+   if ((itimer->fd = timerfd_create(CLOCK_REALTIME, 0)) < 0)
+   {
+      dnxLog("Timer file descriptor creation failed: %s.", strerror(errno));
+      xfree(itimer);
+      return DNX_ERR_OPEN;
+   }
+#endif
+
+   DNX_PT_MUTEX_INIT(&itimer->mut);
+
+   // make the first pass one full interval from now
+   clock_gettime(CLOCK_REALTIME, &itimer->armed);
+   itimer->armed.tv_sec += sleeptime / 1000;
+   if ((itimer->armed.tv_nsec += (sleeptime % 1000) * 1000000L) >= 1000000000L)
+   {
+      itimer->armed.tv_sec++;
+      itimer->armed.tv_nsec -= 1000000000L;
+   }
+   dnxTimerArm(itimer, &itimer->armed);
    
    // create the timer thread
    if ((ret = pthread_create(&itimer->tid, 0, dnxTimer, itimer)) != 0)
    {
       dnxLog("Timer thread creation failed: %s.", dnxErrorString(ret));
+      DNX_PT_MUTEX_DESTROY(&itimer->mut);
+      if (itimer->fd >= 0)
+         close(itimer->fd);
       xfree(itimer);
       return DNX_ERR_THREAD;
    }
@@ -210,6 +304,25 @@ int dnxTimerCreate(DnxJobList * joblist, int sleeptime, DnxTimer ** ptimer)
 
 //----------------------------------------------------------------------------
 
+void dnxTimerWakeAt(DnxTimer * timer, time_t when)
+{
+   iDnxTimer * itimer = (iDnxTimer *)timer;
+   struct timespec ts;
+
+   assert(timer);
+
+   ts.tv_sec = when;
+   ts.tv_nsec = 0;
+
+   DNX_PT_MUTEX_LOCK(&itimer->mut);
+   if (ts.tv_sec < itimer->armed.tv_sec 
+         || (ts.tv_sec == itimer->armed.tv_sec && itimer->armed.tv_nsec > 0))
+      dnxTimerArm(itimer, &ts);
+   DNX_PT_MUTEX_UNLOCK(&itimer->mut);
+}
+
+//----------------------------------------------------------------------------
+
 void dnxTimerDestroy(DnxTimer * timer)
 {
    iDnxTimer * itimer = (iDnxTimer *)timer;
@@ -217,6 +330,10 @@ void dnxTimerDestroy(DnxTimer * timer)
    pthread_cancel(itimer->tid);
    pthread_join(itimer->tid, 0);
 
+   DNX_PT_MUTEX_DESTROY(&itimer->mut);
+   if (itimer->fd >= 0)
+      close(itimer->fd);
+
    xfree(itimer);
 }
 
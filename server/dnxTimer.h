@@ -40,6 +40,9 @@
 typedef struct { int unused; } DnxTimer;
 
 /** Create a new job list expiration timer object.
+ * 
+ * The timer thread calls dnxJobListExpire whenever the job list asks for it
+ * through dnxTimerWakeAt, and at least once every @p sleeptime milliseconds.
  * 
  * @param[in] joblist - the job list that should be expired by the timer.
  * @param[in] sleeptime - time between expiration checks, in milliseconds.
@@ -50,6 +53,16 @@ typedef struct { int unused; } DnxTimer;
  */
 int dnxTimerCreate(DnxJobList * joblist, int sleeptime, DnxTimer ** ptimer);
 
+/** Ask a job list expiration timer to make its next pass no later than @p when.
+ * 
+ * If the timer is already due to run earlier, this call has no effect. The
+ * timer never sleeps longer than the interval it was created with.
+ * 
+ * @param[in] timer - the timer object to be rescheduled.
+ * @param[in] when - the time by which the timer should next run.
+ */
+void dnxTimerWakeAt(DnxTimer * timer, time_t when);
+
 /** Destroy an existing job list expiration timer object.
  * 
  * @param[in] timer - the timer object to be destroyed.